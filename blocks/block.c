@@ -5,9 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "libp2p/crypto/sha256.h"
+#include "ipfs/multihash/multihash.h"
 #include "ipfs/blocks/block.h"
 #include "ipfs/cid/cid.h"
+#include "ipfs/util/memory.h"
 
 /***
  * The protobuf functions
@@ -118,7 +119,7 @@ exit:
 struct Block* ipfs_block_new() {
 
 	// allocate memory for structure
-	struct Block* block = (struct Block*)malloc(sizeof(struct Block));
+	struct Block* block = (struct Block*)ipfs_util_memory_alloc(MEMORY_TAG_BLOCKS, sizeof(struct Block));
 	if ( block == NULL)
 		return 0;
 	block->data = NULL;
@@ -131,7 +132,7 @@ struct Block* ipfs_block_new() {
 int ipfs_blocks_block_add_data(const unsigned char* data, size_t data_size, struct Block* block) {
 	// cid
 	unsigned char hash[32];
-	if (libp2p_crypto_hashing_sha256(data, data_size, &hash[0]) == 0) {
+	if (ipfs_multihash_sha256(data, data_size, &hash[0]) == 0) {
 		return 0;
 	}
 
@@ -163,7 +164,7 @@ int ipfs_block_free(struct Block* block) {
 			ipfs_cid_free(block->cid);
 		if (block->data != NULL)
 			free(block->data);
-		free(block);
+		ipfs_util_memory_free(MEMORY_TAG_BLOCKS, block);
 	}
 	return 1;
 }
@@ -1,13 +1,20 @@
 /***
  * a thin wrapper over a datastore for getting and putting block objects
  */
-#include "libp2p/crypto/encoding/base32.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "ipfs/cid/cid.h"
 #include "ipfs/blocks/block.h"
 #include "ipfs/blocks/blockstore.h"
 #include "ipfs/datastore/ds_helper.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 #include "libp2p/os/utils.h"
+#include "ipfs/unixfs/unixfs.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
+#include "protobuf.h"
 
 
 /***
@@ -64,32 +71,34 @@ int ipfs_blockstore_has(const struct BlockstoreContext* context, struct Cid* cid
 	return 0;
 }
 
-unsigned char* ipfs_blockstore_cid_to_base32(const struct Cid* cid) {
-	size_t key_length = libp2p_crypto_encoding_base32_encode_size(cid->hash_length);
-	unsigned char* buffer = (unsigned char*)malloc(key_length + 1);
-	if (buffer == NULL)
-		return NULL;
-	int retVal = ipfs_datastore_helper_ds_key_from_binary(cid->hash, cid->hash_length, &buffer[0], key_length, &key_length);
-	if (retVal == 0) {
-		free(buffer);
-		return NULL;
-	}
-	buffer[key_length] = 0;
-	return buffer;
+/***
+ * Write the datastore key of a block, which is the base32 of its multihash, without allocating
+ * @param hash the multihash
+ * @param hash_length the length of the multihash
+ * @param key where to put the key, of at least IPFS_BLOCKSTORE_KEY_SIZE(hash_length) bytes
+ * @param key_size the size of key
+ * @returns true(1) on success, false(0) if key is too small
+ */
+int ipfs_blockstore_hash_to_key(const unsigned char* hash, size_t hash_length, char* key, size_t key_size) {
+	size_t key_length = 0;
+	return ipfs_datastore_helper_ds_key_from_binary(hash, hash_length, (unsigned char*)key, key_size, &key_length)
+			&& key_length < key_size;
 }
 
 unsigned char* ipfs_blockstore_hash_to_base32(const unsigned char* hash, size_t hash_length) {
-	size_t key_length = libp2p_crypto_encoding_base32_encode_size(hash_length);
-	unsigned char* buffer = (unsigned char*)malloc(key_length + 1);
+	size_t key_size = IPFS_BLOCKSTORE_KEY_SIZE(hash_length);
+	char* buffer = (char*)malloc(key_size);
 	if (buffer == NULL)
 		return NULL;
-	int retVal = ipfs_datastore_helper_ds_key_from_binary(hash, hash_length, &buffer[0], key_length, &key_length);
-	if (retVal == 0) {
+	if (!ipfs_blockstore_hash_to_key(hash, hash_length, buffer, key_size)) {
 		free(buffer);
 		return NULL;
 	}
-	buffer[key_length] = 0;
-	return buffer;
+	return (unsigned char*)buffer;
+}
+
+unsigned char* ipfs_blockstore_cid_to_base32(const struct Cid* cid) {
+	return ipfs_blockstore_hash_to_base32(cid->hash, cid->hash_length);
 }
 
 char* ipfs_blockstore_path_get(const struct FSRepo* fs_repo, const char* filename) {
@@ -115,11 +124,16 @@ char* ipfs_blockstore_path_get(const struct FSRepo* fs_repo, const char* filenam
  * @returns true(1) on success
  */
 int ipfs_blockstore_get(const struct BlockstoreContext* context, struct Cid* cid, struct Block** block) {
+	IPFS_TRACE_SPAN("ipfs_blockstore_get");
 	int retVal = 0;
+	uint64_t start = ipfs_util_metrics_now();
 	// get datastore key, which is a base32 key of the multihash
-	unsigned char* key = ipfs_blockstore_hash_to_base32(cid->hash, cid->hash_length);
-
-	char* filename = ipfs_blockstore_path_get(context->fs_repo, (char*)key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(cid->hash_length)];
+	if (!ipfs_blockstore_hash_to_key(cid->hash, cid->hash_length, key, sizeof(key))) {
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
+		return 0;
+	}
+	char* filename = ipfs_blockstore_path_get(context->fs_repo, key);
 
 	size_t file_size = os_utils_file_size(filename);
 	unsigned char buffer[file_size];
@@ -137,8 +151,11 @@ int ipfs_blockstore_get(const struct BlockstoreContext* context, struct Cid* cid
 	(*block)->cid = ipfs_cid_copy(cid);
 
 	retVal = 1;
+	ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_BYTES, bytes_read);
+	ipfs_util_metrics_observe(METRICS_BLOCKSTORE_GET_SECONDS, start);
 	exit:
-	free(key);
+	if (!retVal)
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
 	free(filename);
 
 	return retVal;
@@ -150,15 +167,18 @@ int ipfs_blockstore_get(const struct BlockstoreContext* context, struct Cid* cid
  * @returns true(1) on success
  */
 int ipfs_blockstore_put(const struct BlockstoreContext* context, struct Block* block, size_t* bytes_written) {
+	IPFS_TRACE_SPAN("ipfs_blockstore_put");
 	// from blockstore.go line 118
 	int retVal = 0;
+	uint64_t start = ipfs_util_metrics_now();
+
+	// a garbage collection that is running must not delete it
+	ipfs_repo_fsrepo_gc_keep(context->fs_repo, block->cid->hash, block->cid->hash_length);
 
 	// Get Datastore key, which is a base32 key of the multihash,
-	unsigned char* key = ipfs_blockstore_cid_to_base32(block->cid);
-	if (key == NULL) {
-		free(key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(block->cid->hash_length)];
+	if (!ipfs_blockstore_hash_to_key(block->cid->hash, block->cid->hash_length, key, sizeof(key)))
 		return 0;
-	}
 
 	//TODO: put this in subdirectories
 
@@ -166,23 +186,18 @@ int ipfs_blockstore_put(const struct BlockstoreContext* context, struct Block* b
 	size_t protobuf_len = ipfs_blocks_block_protobuf_encode_size(block);
 	unsigned char protobuf[protobuf_len];
 	retVal = ipfs_blocks_block_protobuf_encode(block, protobuf, protobuf_len, &protobuf_len);
-	if (retVal == 0) {
-		free(key);
+	if (retVal == 0)
 		return 0;
-	}
 
 	// now write byte array to file
-	char* filename = ipfs_blockstore_path_get(context->fs_repo, (char*)key);
-	if (filename == NULL) {
-		free(key);
+	char* filename = ipfs_blockstore_path_get(context->fs_repo, key);
+	if (filename == NULL)
 		return 0;
-	}
 
 	FILE* file = fopen(filename, "wb");
 	*bytes_written = fwrite(protobuf, 1, protobuf_len, file);
 	fclose(file);
 	if (*bytes_written != protobuf_len) {
-		free(key);
 		free(filename);
 		return 0;
 	}
@@ -190,7 +205,8 @@ int ipfs_blockstore_put(const struct BlockstoreContext* context, struct Block* b
 	// send to Put with key (this is now done separately)
 	//fs_repo->config->datastore->datastore_put(key, key_length, block->data, block->data_length, fs_repo->config->datastore);
 
-	free(key);
+	ipfs_util_metrics_add(METRICS_BLOCKSTORE_PUT_BYTES, *bytes_written);
+	ipfs_util_metrics_observe(METRICS_BLOCKSTORE_PUT_SECONDS, start);
 	free(filename);
 	return 1;
 }
@@ -207,11 +223,9 @@ int ipfs_blockstore_put_unixfs(const struct UnixFS* unix_fs, const struct FSRepo
 	int retVal = 0;
 
 	// Get Datastore key, which is a base32 key of the multihash,
-	unsigned char* key = ipfs_blockstore_hash_to_base32(unix_fs->hash, unix_fs->hash_length);
-	if (key == NULL) {
-		free(key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(unix_fs->hash_length)];
+	if (!ipfs_blockstore_hash_to_key(unix_fs->hash, unix_fs->hash_length, key, sizeof(key)))
 		return 0;
-	}
 
 	//TODO: put this in subdirectories
 
@@ -219,28 +233,22 @@ int ipfs_blockstore_put_unixfs(const struct UnixFS* unix_fs, const struct FSRepo
 	size_t protobuf_len = ipfs_unixfs_protobuf_encode_size(unix_fs);
 	unsigned char protobuf[protobuf_len];
 	retVal = ipfs_unixfs_protobuf_encode(unix_fs, protobuf, protobuf_len, &protobuf_len);
-	if (retVal == 0) {
-		free(key);
+	if (retVal == 0)
 		return 0;
-	}
 
 	// now write byte array to file
-	char* filename = ipfs_blockstore_path_get(fs_repo, (char*)key);
-	if (filename == NULL) {
-		free(key);
+	char* filename = ipfs_blockstore_path_get(fs_repo, key);
+	if (filename == NULL)
 		return 0;
-	}
 
 	FILE* file = fopen(filename, "wb");
 	*bytes_written = fwrite(protobuf, 1, protobuf_len, file);
 	fclose(file);
 	if (*bytes_written != protobuf_len) {
-		free(key);
 		free(filename);
 		return 0;
 	}
 
-	free(key);
 	free(filename);
 	return 1;
 }
@@ -255,9 +263,10 @@ int ipfs_blockstore_put_unixfs(const struct UnixFS* unix_fs, const struct FSRepo
  */
 int ipfs_blockstore_get_unixfs(const unsigned char* hash, size_t hash_length, struct UnixFS** block, const struct FSRepo* fs_repo) {
 	// get datastore key, which is a base32 key of the multihash
-	unsigned char* key = ipfs_blockstore_hash_to_base32(hash, hash_length);
-
-	char* filename = ipfs_blockstore_path_get(fs_repo, (char*)key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(hash_length)];
+	if (!ipfs_blockstore_hash_to_key(hash, hash_length, key, sizeof(key)))
+		return 0;
+	char* filename = ipfs_blockstore_path_get(fs_repo, key);
 
 	size_t file_size = os_utils_file_size(filename);
 	unsigned char buffer[file_size];
@@ -268,7 +277,6 @@ int ipfs_blockstore_get_unixfs(const unsigned char* hash, size_t hash_length, st
 
 	int retVal = ipfs_unixfs_protobuf_decode(buffer, bytes_read, block);
 
-	free(key);
 	free(filename);
 
 	return retVal;
@@ -282,15 +290,15 @@ int ipfs_blockstore_get_unixfs(const unsigned char* hash, size_t hash_length, st
  * @returns true(1) on success
  */
 int ipfs_blockstore_put_node(const struct HashtableNode* node, const struct FSRepo* fs_repo, size_t* bytes_written) {
+	IPFS_TRACE_SPAN("ipfs_blockstore_put_node");
 	// from blockstore.go line 118
 	int retVal = 0;
+	uint64_t start = ipfs_util_metrics_now();
 
 	// Get Datastore key, which is a base32 key of the multihash,
-	unsigned char* key = ipfs_blockstore_hash_to_base32(node->hash, node->hash_size);
-	if (key == NULL) {
-		free(key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(node->hash_size)];
+	if (!ipfs_blockstore_hash_to_key(node->hash, node->hash_size, key, sizeof(key)))
 		return 0;
-	}
 
 	//TODO: put this in subdirectories
 
@@ -298,28 +306,24 @@ int ipfs_blockstore_put_node(const struct HashtableNode* node, const struct FSRe
 	size_t protobuf_len = ipfs_hashtable_node_protobuf_encode_size(node);
 	unsigned char protobuf[protobuf_len];
 	retVal = ipfs_hashtable_node_protobuf_encode(node, protobuf, protobuf_len, &protobuf_len);
-	if (retVal == 0) {
-		free(key);
+	if (retVal == 0)
 		return 0;
-	}
 
 	// now write byte array to file
-	char* filename = ipfs_blockstore_path_get(fs_repo, (char*)key);
-	if (filename == NULL) {
-		free(key);
+	char* filename = ipfs_blockstore_path_get(fs_repo, key);
+	if (filename == NULL)
 		return 0;
-	}
 
 	FILE* file = fopen(filename, "wb");
 	*bytes_written = fwrite(protobuf, 1, protobuf_len, file);
 	fclose(file);
 	if (*bytes_written != protobuf_len) {
-		free(key);
 		free(filename);
 		return 0;
 	}
 
-	free(key);
+	ipfs_util_metrics_add(METRICS_BLOCKSTORE_PUT_BYTES, *bytes_written);
+	ipfs_util_metrics_observe(METRICS_BLOCKSTORE_PUT_SECONDS, start);
 	free(filename);
 	return 1;
 }
@@ -333,33 +337,142 @@ int ipfs_blockstore_put_node(const struct HashtableNode* node, const struct FSRe
  * @returns true(1) on success
  */
 int ipfs_blockstore_get_node(const unsigned char* hash, size_t hash_length, struct HashtableNode** node, const struct FSRepo* fs_repo) {
+	IPFS_TRACE_SPAN("ipfs_blockstore_get_node");
+	uint64_t start = ipfs_util_metrics_now();
 	// get datastore key, which is a base32 key of the multihash
-	unsigned char* key = ipfs_blockstore_hash_to_base32(hash, hash_length);
-
-	char* filename = ipfs_blockstore_path_get(fs_repo, (char*)key);
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(hash_length)];
+	if (!ipfs_blockstore_hash_to_key(hash, hash_length, key, sizeof(key))) {
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
+		return 0;
+	}
+	char* filename = ipfs_blockstore_path_get(fs_repo, key);
 
 	size_t file_size = os_utils_file_size(filename);
 	unsigned char buffer[file_size];
 
 	FILE* file = fopen(filename, "rb");
+	free(filename);
+	if (file == NULL) {
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
+		return 0;
+	}
 	size_t bytes_read = fread(buffer, 1, file_size, file);
 	fclose(file);
 
 	// now we have the block, convert it to a node
-	struct Block* block;
+	struct Block* block = NULL;
 	if (!ipfs_blocks_block_protobuf_decode(buffer, bytes_read, &block)) {
-		free(key);
-		free(filename);
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
 		ipfs_block_free(block);
 		return 0;
 	}
 
-	int retVal = ipfs_hashtable_node_protobuf_decode(block->data, block->data_length, node);
+	// the node points into the block, and frees it
+	int retVal = ipfs_hashtable_node_protobuf_decode_view(block, node);
+	if (retVal) {
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_BYTES, bytes_read);
+		ipfs_util_metrics_observe(METRICS_BLOCKSTORE_GET_SECONDS, start);
+	} else {
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_GET_MISSES, 1);
+		ipfs_block_free(block);
+	}
+
+	return retVal;
+}
+
+/***
+ * Read the tag and the length of a length delimited protobuf field
+ * @param buffer the bytes
+ * @param buffer_length the number of bytes
+ * @param field_no the field that is expected
+ * @param pos where the field starts. Moved to where its contents start
+ * @param length the length of the contents
+ * @returns true(1) if the expected field was found
+ */
+int ipfs_blockstore_field_header(const unsigned char* buffer, size_t buffer_length, int field_no, size_t* pos, size_t* length) {
+	int found_no = 0;
+	enum WireType found_type;
+	size_t bytes_read = 0;
+	unsigned long long value = 0;
+
+	if (*pos >= buffer_length)
+		return 0;
+	if (!protobuf_decode_field_and_type(&buffer[*pos], buffer_length - *pos, &found_no, &found_type, &bytes_read))
+		return 0;
+	if (found_no != field_no || found_type != WIRETYPE_LENGTH_DELIMITED)
+		return 0;
+	*pos += bytes_read;
+	if (*pos >= buffer_length || !protobuf_decode_varint(&buffer[*pos], buffer_length - *pos, &value, &bytes_read))
+		return 0;
+	*pos += bytes_read;
+	*length = value;
+	return 1;
+}
 
-	free(key);
+/***
+ * Find where the data of a UnixFS leaf is within the file of its block, so it
+ * can be sent without being read and decoded (i.e. with sendfile)
+ * @param hash the hash of the node
+ * @param hash_length the length of the hash
+ * @param fs_repo where the block is stored
+ * @param fd the open file of the block, to be closed by the caller
+ * @param offset where the data starts in the file
+ * @param size the number of bytes of data
+ * @returns true(1) if the block is stored here and is a leaf with data, false(0) otherwise
+ */
+int ipfs_blockstore_locate_unixfs_data(const unsigned char* hash, size_t hash_length, const struct FSRepo* fs_repo, int* fd, off_t* offset, size_t* size) {
+	int retVal = 0;
+	// enough for the headers of the block, the node and the UnixFS
+	unsigned char buffer[64];
+	size_t pos = 0;
+	size_t length = 0;
+	int field_no = 0;
+	enum WireType field_type;
+	size_t bytes_read = 0;
+	unsigned long long data_type = 0;
+	struct stat file_stat;
+
+	*fd = -1;
+	char key[IPFS_BLOCKSTORE_KEY_SIZE(hash_length)];
+	if (!ipfs_blockstore_hash_to_key(hash, hash_length, key, sizeof(key)))
+		return 0;
+	char* filename = ipfs_blockstore_path_get(fs_repo, key);
+	if (filename == NULL)
+		return 0;
+	int file = open(filename, O_RDONLY);
 	free(filename);
-	ipfs_block_free(block);
+	if (file < 0)
+		return 0;
+
+	ssize_t buffer_length = read(file, buffer, sizeof(buffer));
+	if (buffer_length <= 0 || fstat(file, &file_stat) != 0)
+		goto exit;
+	// the node is the first field of the block
+	if (!ipfs_blockstore_field_header(buffer, buffer_length, 1, &pos, &length))
+		goto exit;
+	// links are written before the data, so only a leaf starts with its data
+	if (!ipfs_blockstore_field_header(buffer, buffer_length, 1, &pos, &length))
+		goto exit;
+	// the UnixFS starts with its type, then the bytes
+	if (!protobuf_decode_field_and_type(&buffer[pos], buffer_length - pos, &field_no, &field_type, &bytes_read) || field_no != 1)
+		goto exit;
+	pos += bytes_read;
+	if (!protobuf_decode_varint(&buffer[pos], buffer_length - pos, &data_type, &bytes_read))
+		goto exit;
+	pos += bytes_read;
+	if (data_type != UNIXFS_FILE && data_type != UNIXFS_RAW)
+		goto exit;
+	if (!ipfs_blockstore_field_header(buffer, buffer_length, 2, &pos, &length))
+		goto exit;
+	if (pos + length > (size_t)file_stat.st_size)
+		goto exit;
 
+	*offset = pos;
+	*size = length;
+	*fd = file;
+	retVal = 1;
+	exit:
+	if (retVal == 0)
+		close(file);
 	return retVal;
 }
-
@@ -9,10 +9,15 @@
 #include "ipfs/cid/cid.h"
 #include "libp2p/crypto/encoding/base58.h"
 #include "ipfs/multibase/multibase.h"
+#include "ipfs/multihash/multihash.h"
+#include "ipfs/util/memory.h"
 #include "mh/hashes.h"
 #include "mh/multihash.h"
 #include "varint.h"
 
+// the most base58 characters a multihash can take. Each holds less than 6 bits.
+#define CID_BASE58_MAX_LENGTH (IPFS_MULTIHASH_MAX_SIZE * 138 / 100 + 1)
+
 enum WireType ipfs_cid_message_fields[] = { WIRETYPE_VARINT, WIRETYPE_VARINT, WIRETYPE_LENGTH_DELIMITED };
 
 
@@ -99,7 +104,7 @@ int ipfs_cid_protobuf_decode(unsigned char* buffer, size_t buffer_length, struct
  * @returns the new Cid or NULL if there was a problem
  */
 struct Cid* ipfs_cid_new(int version, const unsigned char* hash, size_t hash_length, const char codec) {
-	struct Cid* cid = (struct Cid*) malloc(sizeof(struct Cid));
+	struct Cid* cid = (struct Cid*) ipfs_util_memory_alloc(MEMORY_TAG_CID, sizeof(struct Cid));
 	if (cid != NULL) {
 		cid->hash_length = hash_length;
 		if (hash_length == 0 || hash == NULL) {
@@ -107,7 +112,7 @@ struct Cid* ipfs_cid_new(int version, const unsigned char* hash, size_t hash_len
 		} else {
 			cid->hash = (unsigned char*) malloc(sizeof(unsigned char) * hash_length);
 			if (cid->hash == NULL) {
-				free(cid);
+				ipfs_util_memory_free(MEMORY_TAG_CID, cid);
 				return NULL;
 			}
 			memcpy(cid->hash, hash, hash_length);
@@ -130,7 +135,7 @@ int ipfs_cid_free(struct Cid* cid) {
 			free(cid->hash);
 			cid->hash = NULL;
 		}
-		free(cid);
+		ipfs_util_memory_free(MEMORY_TAG_CID, cid);
 	}
 	return 1;
 }
@@ -141,7 +146,7 @@ int ipfs_cid_free(struct Cid* cid) {
  * @returns a copy of the original
  */
 struct Cid* ipfs_cid_copy(const struct Cid* original) {
-	struct Cid* copy = (struct Cid*) malloc(sizeof(struct Cid));
+	struct Cid* copy = (struct Cid*) ipfs_util_memory_alloc(MEMORY_TAG_CID, sizeof(struct Cid));
 	if (copy != NULL) {
 		copy->codec = original->codec;
 		copy->version = original->version;
@@ -167,11 +172,9 @@ int ipfs_cid_decode_hash_from_ipfs_ipns_string(const char* incoming, struct Cid*
 		return 0;
 	if (strstr(incoming, "/ipfs/") != incoming && strstr(incoming, "/ipns/") != incoming)
 		return 0;
+	// the hash ends at the next slash, if there is one
 	const char* base58 = &incoming[6];
-	char* slash = strstr(incoming, "/");
-	if (slash != NULL)
-		slash[0] = '\0';
-	return ipfs_cid_decode_hash_from_base58((unsigned char*)base58, strlen(base58), cid);
+	return ipfs_cid_decode_hash_from_base58((unsigned char*)base58, strcspn(base58, "/"), cid);
 }
 
 /***
@@ -182,41 +185,34 @@ int ipfs_cid_decode_hash_from_ipfs_ipns_string(const char* incoming, struct Cid*
  * @return true(1) on success
  */
 int ipfs_cid_decode_hash_from_base58(const unsigned char* incoming, size_t incoming_length, struct Cid** cid) {
-	int retVal = 0;
-
 	if (incoming_length < 2)
 		return 0;
 
 	// is this a sha_256 multihash?
-	if (incoming_length == 46 && incoming[0] == 'Q' && incoming[1] == 'm') {
-		size_t hash_length = libp2p_crypto_encoding_base58_decode_size(incoming_length);
-		unsigned char hash[hash_length];
-		unsigned char* ptr = hash;
-		retVal = libp2p_crypto_encoding_base58_decode(incoming, incoming_length, &ptr, &hash_length);
-		if (retVal == 0)
+	if (incoming_length == MULTIBASE_BASE58_CIDV0_LENGTH && incoming[0] == 'Q' && incoming[1] == 'm') {
+		unsigned char hash[MULTIBASE_MULTIHASH_SIZE];
+		if (!multibase_base58_decode_cidv0(incoming, incoming_length, hash))
 			return 0;
 		// now we have the hash, build the object
-		*cid = ipfs_cid_new(0, &hash[2], hash_length - 2, CID_DAG_PROTOBUF);
+		*cid = ipfs_cid_new(0, &hash[2], sizeof(hash) - 2, CID_DAG_PROTOBUF);
 		return *cid != NULL;
 	}
 
-	// TODO: finish this
-	/*
-	// it wasn't a sha_256 multihash, try to decode it using multibase
-	size_t buffer_size = multibase_decode_size(incoming_length);
-	if (buffer_size == 0)
+	// it wasn't a sha_256 multihash, so maybe one of another function. What is
+	// longer than any multihash is not decoded.
+	unsigned char buffer[CID_BASE58_MAX_LENGTH];
+	size_t buffer_size = libp2p_crypto_encoding_base58_decode_size(incoming_length);
+	if (incoming_length > CID_BASE58_MAX_LENGTH || buffer_size > sizeof(buffer))
 		return 0;
-	unsigned char buffer[buffer_size];
-
-	memset(buffer, 0, buffer_size);
-
-	retVal = multibase_decode(incoming, incoming_length, buffer, buffer_size, &buffer_size);
-	if (retVal == 0)
+	unsigned char* ptr = &buffer[0];
+	if (libp2p_crypto_encoding_base58_decode(incoming, incoming_length, &ptr, &buffer_size) == 0
+			|| buffer_size > IPFS_MULTIHASH_MAX_SIZE)
 		return 0;
-
-	return cid_cast(buffer, buffer_size, cid);
-	*/
-	return 0;
+	if (ipfs_multihash_hash_code(buffer, buffer_size) == IPFS_MULTIHASH_SHA2_256)
+		return 0;
+	// the whole multihash is the hash
+	*cid = ipfs_cid_new(1, buffer, buffer_size, CID_DAG_PROTOBUF);
+	return *cid != NULL;
 }
 
 /**
@@ -229,9 +225,9 @@ int ipfs_cid_decode_hash_from_base58(const unsigned char* incoming, size_t incom
  */
 int ipfs_cid_hash_to_base58(const unsigned char* hash, size_t hash_length, unsigned char* buffer, size_t max_buffer_length) {
 
-	int multihash_len = hash_length + 2;
-	unsigned char multihash[multihash_len];
-	if (mh_new(multihash, MH_H_SHA2_256, hash, hash_length) < 0) {
+	size_t multihash_len = 0;
+	unsigned char multihash[hash_length + IPFS_MULTIHASH_MAX_SIZE];
+	if (!ipfs_multihash_wrap(hash, hash_length, multihash, sizeof(multihash), &multihash_len)) {
 		return 0;
 	}
 
@@ -1,8 +1,123 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "ipfs/cid/cid.h"
 #include "ipfs/util/errs.h"
 
+#define CID_SET_EMPTY 0
+#define CID_SET_REMOVED 1
+#define CID_SET_MIN_CAPACITY 16
+
+/**
+ * Hash a multihash. The digest is random, but the multihash may be an
+ * identity hash, so all of it is mixed in, 8 bytes at a time.
+ * @returns the hash, never CID_SET_EMPTY or CID_SET_REMOVED
+ */
+static uint32_t ipfs_cid_set_code (const unsigned char *hash, size_t hash_length)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ hash_length;
+    uint64_t word;
+
+    while (hash_length >= 8) {
+        memcpy(&word, hash, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+        hash += 8;
+        hash_length -= 8;
+    }
+    if (hash_length > 0) {
+        word = 0;
+        memcpy(&word, hash, hash_length);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+    }
+    h ^= h >> 29;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 32;
+    return (uint32_t)h < 2 ? (uint32_t)h + 2 : (uint32_t)h;
+}
+
+/**
+ * Find the slot of a multihash
+ * @returns the slot holding it, or, if it isn't there, the empty slot that ends the probe
+ */
+static struct CidSetSlot *ipfs_cid_set_find (struct CidSet *set, const unsigned char *hash, size_t hash_length, uint32_t code)
+{
+    size_t mask = set->capacity - 1;
+    size_t i = code & mask;
+
+    for (;;) {
+        struct CidSetSlot *slot = &set->slots[i];
+        if (slot->code == CID_SET_EMPTY) {
+            return slot;
+        }
+        if (slot->code == code && slot->hash_length == hash_length &&
+            memcmp(&set->arena[slot->offset], hash, hash_length) == 0) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * Move the cids into a table with room for more, dropping the removed
+ * slots, and the multihashes of removed cids from the arena
+ * @returns 0 on success, otherwise ErrAllocFailed
+ */
+static int ipfs_cid_set_rebuild (struct CidSet *set)
+{
+    size_t capacity = CID_SET_MIN_CAPACITY;
+    size_t arena_size = 0;
+    struct CidSetSlot *slots;
+    unsigned char *arena = NULL;
+    size_t arena_used = 0;
+    size_t i;
+
+    // keep the table at most half full after adding
+    while (capacity < (set->count + 1) * 2) {
+        capacity *= 2;
+    }
+    for (i = 0; i < set->capacity; i++) {
+        if (set->slots[i].code > CID_SET_REMOVED) {
+            arena_size += set->slots[i].hash_length;
+        }
+    }
+    // room for as many more multihashes as there are now
+    arena_size = arena_size * 2 + 64 * CID_SET_MIN_CAPACITY;
+
+    slots = calloc(capacity, sizeof (struct CidSetSlot));
+    if (!slots) {
+        return ErrAllocFailed;
+    }
+    arena = malloc(arena_size);
+    if (!arena) {
+        free(slots);
+        return ErrAllocFailed;
+    }
+    for (i = 0; i < set->capacity; i++) {
+        struct CidSetSlot *old = &set->slots[i];
+        if (old->code <= CID_SET_REMOVED) {
+            continue;
+        }
+        size_t j = old->code & (capacity - 1);
+        while (slots[j].code != CID_SET_EMPTY) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = *old;
+        slots[j].offset = arena_used;
+        memcpy(&arena[arena_used], &set->arena[old->offset], old->hash_length);
+        arena_used += old->hash_length;
+    }
+    free(set->slots);
+    free(set->arena);
+    set->slots = slots;
+    set->capacity = capacity;
+    set->used = set->count;
+    set->arena = arena;
+    set->arena_size = arena_size;
+    set->arena_used = arena_used;
+    return 0;
+}
+
 struct CidSet *ipfs_cid_set_new ()
 {
     return calloc(1, sizeof(struct CidSet));
@@ -10,158 +125,118 @@ struct CidSet *ipfs_cid_set_new ()
 
 void ipfs_cid_set_destroy (struct CidSet **set)
 {
-    struct CidSet *prev;
-
-    if (set) {
-        while (*set) {
-            prev = *set;
-            *set = (*set)->next;
-            if (prev->cid) {
-                free (prev->cid);
-            }
-            free (prev);
-        }
+    if (set && *set) {
+        free((*set)->slots);
+        free((*set)->arena);
+        free(*set);
+        *set = NULL;
     }
 }
 
 int ipfs_cid_set_add (struct CidSet *set, struct Cid *cid, int visit)
 {
-    if (!set || !cid) {
+    struct CidSetSlot *slot;
+    uint32_t code;
+
+    if (!set || !cid || cid->hash_length > UINT16_MAX) {
         return ErrInvalidParam;
     }
-    if (!set->cid) { // First item.
-        set->cid = malloc(sizeof (struct Cid));
-        if (!set->cid) {
+    // at most 3/4 of the slots in use, removed ones included
+    if ((set->used + 1) * 4 > set->capacity * 3) {
+        if (ipfs_cid_set_rebuild(set) != 0) {
             return ErrAllocFailed;
         }
-        memcpy(set->cid, cid, sizeof (struct Cid));
-        set->cid->hash = calloc(1, cid->hash_length);
-        if (!set->cid->hash) {
-            free (set->cid);
-            return ErrAllocFailed;
+    }
+    code = ipfs_cid_set_code(cid->hash, cid->hash_length);
+    slot = ipfs_cid_set_find(set, cid->hash, cid->hash_length, code);
+    if (slot->code != CID_SET_EMPTY) {
+        // Already added.
+        if (!visit) {
+            // update with new cid.
+            slot->version = cid->version;
+            slot->codec = cid->codec;
         }
-        memcpy(set->cid->hash, cid->hash, cid->hash_length);
         return 0;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
-            // Already added.
-            if (!visit) {
-                // update with new cid.
-                free(set->cid->hash);
-                memcpy(set->cid, cid, sizeof (struct Cid));
-                set->cid->hash = calloc(1, cid->hash_length);
-                if (!set->cid->hash) {
-                    return ErrAllocFailed;
-                }
-                memcpy(set->cid->hash, cid->hash, cid->hash_length);
-            }
-            return 0;
+    if (set->arena_used + cid->hash_length > set->arena_size) {
+        size_t arena_size = set->arena_size * 2 + cid->hash_length;
+        if (set->arena_used + cid->hash_length > UINT32_MAX) {
+            return ErrAllocFailed;
         }
-        if (!set->next) {
-            set->next = ipfs_cid_set_new();
-            if (!set->next) {
-                return ErrAllocFailed;
-            }
-            set = set->next;
-            set->cid = malloc(sizeof (struct Cid));
-            if (!set->cid) {
-                return ErrAllocFailed;
-            }
-            memcpy(set->cid, cid, sizeof (struct Cid));
-            set->cid->hash = calloc(1, cid->hash_length);
-            if (!set->cid->hash) {
-                return ErrAllocFailed;
-            }
-            memcpy(set->cid->hash, cid->hash, cid->hash_length);
-            return 0;
+        if (arena_size > UINT32_MAX) {
+            arena_size = UINT32_MAX;
+        }
+        unsigned char *arena = realloc(set->arena, arena_size);
+        if (!arena) {
+            return ErrAllocFailed;
         }
-        set = set->next;
+        set->arena = arena;
+        set->arena_size = arena_size;
     }
-    //this should never get hit
+    memcpy(&set->arena[set->arena_used], cid->hash, cid->hash_length);
+    slot->code = code;
+    slot->offset = set->arena_used;
+    slot->hash_length = cid->hash_length;
+    slot->version = cid->version;
+    slot->codec = cid->codec;
+    set->arena_used += cid->hash_length;
+    set->count++;
+    set->used++;
     return 0;
 }
 
 int ipfs_cid_set_has (struct CidSet *set, struct Cid *cid)
 {
-    if (!set || !cid || !set->cid) {
+    if (!set || !cid || set->count == 0) {
         return 0;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
-            return 1; // has
-        }
-        if (!set->next) {
-            return 0; // end without found.
-        }
-        set = set->next;
-    }
-    return 0;
+    uint32_t code = ipfs_cid_set_code(cid->hash, cid->hash_length);
+    return ipfs_cid_set_find(set, cid->hash, cid->hash_length, code)->code != CID_SET_EMPTY;
 }
 
 int ipfs_cid_set_remove (struct CidSet *set, struct Cid *cid)
 {
-    struct CidSet *prev = set;
+    struct CidSetSlot *slot;
 
-    if (!set || !cid || !set->cid) {
+    if (!set || !cid || set->count == 0) {
         return 0;
     }
-    for (;;) {
-        if ((set->cid->hash_length == cid->hash_length) &&
-            (memcmp(set->cid->hash, cid->hash, cid->hash_length)==0)) {
-            free (set->cid);
-            if (prev == set) { // first item
-                set = set->next;
-                if (!set) {
-                    prev->cid = NULL;
-                    return 1;
-                }
-                prev->cid = set->cid;
-            } else {
-                prev->next = set->next;
-            }
-            free (set);
-            return 1; // removed
-        }
-        if (!set->next) {
-            return 0; // end without found.
-        }
-        prev = set;
-        set = set->next;
+    slot = ipfs_cid_set_find(set, cid->hash, cid->hash_length, ipfs_cid_set_code(cid->hash, cid->hash_length));
+    if (slot->code == CID_SET_EMPTY) {
+        return 0; // not there
     }
-    return 0;
+    // the probes of other multihashes may go past this slot, so it can't be emptied
+    slot->code = CID_SET_REMOVED;
+    set->count--;
+    return 1; // removed
 }
 
 int ipfs_cid_set_len (struct CidSet *set)
 {
-    int len;
-
-    if (!set || !set->cid) {
+    if (!set) {
         return 0;
     }
-
-    for (len = 0 ; set ; len++, set = set->next);
-
-    return len;
+    return (int)set->count;
 }
 
 unsigned char **ipfs_cid_set_keys (struct CidSet *set)
 {
-    int i, len=ipfs_cid_set_len(set);
+    int i = 0, len = ipfs_cid_set_len(set);
     unsigned char **ret;
+    size_t j;
 
     ret = calloc(len+1, sizeof(char*));
-    if (ret) {
-        for (i = 0 ; i<len ; len++) {
-            if (set && set->cid && set->cid->hash) {
-                ret[i] = calloc(1, set->cid->hash_length + 1);
-                if (ret[i]) {
-                    memcpy(ret[i], set->cid->hash, set->cid->hash_length);
-                }
+    if (ret && len > 0) {
+        for (j = 0 ; j < set->capacity ; j++) {
+            struct CidSetSlot *slot = &set->slots[j];
+            if (slot->code <= CID_SET_REMOVED) {
+                continue;
             }
-            set = set->next;
+            ret[i] = calloc(1, slot->hash_length + 1);
+            if (ret[i]) {
+                memcpy(ret[i], &set->arena[slot->offset], slot->hash_length);
+            }
+            i++;
         }
     }
     return ret;
@@ -170,15 +245,25 @@ unsigned char **ipfs_cid_set_keys (struct CidSet *set)
 int ipfs_cid_set_foreach (struct CidSet *set, int (*func)(struct Cid *))
 {
     int err = 0;
+    struct Cid cid;
+    size_t i;
 
-    while (set) {
-        if (set->cid) {
-            err = func (set->cid);
-            if (err) {
-                return err;
-            }
+    if (!set) {
+        return 0;
+    }
+    for (i = 0 ; i < set->capacity ; i++) {
+        struct CidSetSlot *slot = &set->slots[i];
+        if (slot->code <= CID_SET_REMOVED) {
+            continue;
+        }
+        cid.version = slot->version;
+        cid.codec = slot->codec;
+        cid.hash = &set->arena[slot->offset];
+        cid.hash_length = slot->hash_length;
+        err = func (&cid);
+        if (err) {
+            return err;
         }
-        set = set->next;
     }
 
     return err;
@@ -10,6 +10,11 @@
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <sys/uio.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
 
 #include <fcntl.h>
 
@@ -17,14 +22,15 @@
 #include "libp2p/os/memstream.h"
 #include "libp2p/utils/logger.h"
 #include "libp2p/utils/urlencode.h"
+#include "ipfs/cid/cid.h"
 #include "ipfs/core/api.h"
+#include "ipfs/core/gateway.h"
+#include "ipfs/core/multipart.h"
 #include "ipfs/importer/exporter.h"
+#include "ipfs/importer/importer.h"
 #include "ipfs/core/http_request.h"
-
-//pthread_mutex_t conns_lock;
-//int conns_count;
-
-struct ApiContext api_list;
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
 
 /**
  * Write two strings on one write.
@@ -60,129 +66,55 @@ int find_chunk(char *buf, const size_t buf_size, size_t *pos, size_t *size)
 	return 0;
 }
 
-int read_chunked(int fd, struct s_request *req, char *already, size_t already_size)
+/**
+ * Find the end of a chunked body, and copy its data out if it is complete.
+ * @param data the bytes after the header.
+ * @param len the number of bytes in data.
+ * @param out where to copy the body (can be NULL to just find the end).
+ * @param out_size the size of the body.
+ * @param used the number of bytes of data used by the body.
+ * @returns 1 if the body is complete, 0 if more is needed, -1 if it is malformed.
+ */
+int api_dechunk(char *data, size_t len, char *out, size_t *out_size, size_t *used)
 {
-	char buf[MAX_READ], *p;
-	size_t pos, nsize, buf_size = 0, r;
+	size_t pos = 0, chunk_pos, chunk_size;
 
-	if (already_size > 0) {
-		if (already_size <= sizeof(buf)) {
-			memcpy(buf, already, already_size);
-			buf_size += already_size;
-			already_size = 0;
-		} else {
-			memcpy(buf, already, sizeof(buf));
-			already += sizeof(buf);
-			buf_size += sizeof(buf);
-			already_size -= sizeof(buf);
+	*out_size = 0;
+	for (;;) {
+		if (!memchr(data + pos, '\n', len - pos)) {
+			return 0; // the size of the chunk has not arrived yet.
 		}
-	}
-
-	while(buf_size) {
-		if (!find_chunk(buf, buf_size, &pos, &nsize)) {
+		if (!find_chunk(data + pos, len - pos, &chunk_pos, &chunk_size)) {
 			libp2p_logger_error("api", "fail find_chunk.\n");
-			libp2p_logger_error("api", "nsize = %d.\n", nsize);
-			return 0;
-		}
-		if (nsize == 0) {
-			break;
+			return -1;
 		}
-		p = realloc(req->buf, req->size + nsize);
-		if (!p) {
-			libp2p_logger_error("api", "fail realloc.\n");
+		pos += chunk_pos;
+		if (len - pos < chunk_size + 2) {
 			return 0;
 		}
-		req->buf = p;
-		req->size += nsize;
-
-CPCHUNK:
-		r = nsize;
-		buf_size -= pos;
-		if (r > buf_size) {
-			r = buf_size;
-		}
-		memcpy(req->buf + req->body + req->body_size, buf + pos, r);
-		req->body_size += r;
-		nsize -= r;
-		buf_size -= r;
-		if (buf_size > 0) {
-			memmove(buf, buf + pos + r, buf_size);
-		}
-		pos = 0;
-		if (already_size > 0) {
-			r = sizeof(buf) - buf_size;
-			if (already_size <= r) {
-				memcpy(buf, already, already_size);
-				buf_size += already_size;
-				already_size = 0;
-			} else {
-				memcpy(buf, already, r);
-				already += r;
-				buf_size += r;
-				already_size -= r;
-			}
+		if (chunk_size == 0) {
+			break; // last chunk, trailers are not supported.
 		}
-
-		if (socket_read_select4(fd, 5) > 0) {
-			r = sizeof(buf) - buf_size;
-			r = read(fd, buf+buf_size, r);
-			buf_size += r;
-			if (r == 0 && nsize == 0) {
-				break;
-			}
-
-			if (r <= 0) {
-				libp2p_logger_error("api", "read fail.\n");
-				return 0;
-			}
+		if (out) {
+			memcpy(out + *out_size, data + pos, chunk_size);
 		}
-
-		if (nsize > 0)
-			goto CPCHUNK; // still have data to transfer on current chunk.
-
-		if (memcmp (buf, "\r\n", 2)!=0) {
+		*out_size += chunk_size;
+		pos += chunk_size;
+		if (memcmp (data + pos, "\r\n", 2)!=0) {
 			libp2p_logger_error("api", "fail CRLF.\n");
-			return 0;
+			return -1;
 		}
+		pos += 2;
 	}
-	return 1;
-}
-
-int read_all(int fd, struct s_request *req, char *already, size_t alread_size)
-{
-	char buf[MAX_READ], *p;
-	size_t size = 0;
-
-	if (alread_size > 0) {
-		p = realloc(req->buf, req->size + alread_size);
-		if (!p) {
-			return 0;
-		}
-		req->buf = p;
-		req->size += alread_size;
-		memcpy(req->buf + req->body + req->body_size, already, alread_size);
-		req->body_size += alread_size;
-	}
-	for(;;) {
-		if (socket_read_select4(fd, 5) <= 0) {
-			break;
-		}
-		size = read(fd, buf, sizeof buf);
-		if (size <= 0) {
-			break;
-		}
-		p = realloc(req->buf, req->size + size);
-		if (!p) {
-			return 0;
-		}
-		req->buf = p;
-		req->size += size;
-		memcpy(req->buf + req->body + req->body_size, buf, size);
-		req->body_size += size;
+	if (memcmp (data + pos, "\r\n", 2)!=0) {
+		libp2p_logger_error("api", "fail CRLF.\n");
+		return -1;
 	}
+	*used = pos + 2;
 	return 1;
 }
 
+
 /**
  * Find a token in a string array.
  * @param string array and token string.
@@ -271,10 +203,164 @@ size_t boundary_size(char *str, char *boundary, size_t limit)
 	return 0;
 }
 
-struct ApiConnectionParam {
-	int index;
-	struct IpfsNode* this_node;
-};
+/**
+ * Take the header of one request from the bytes read from a connection.
+ * @param data the bytes read.
+ * @param len the number of bytes.
+ * @param req where to put the request, its buf must be freed by the caller.
+ * @param used the number of bytes of data that were part of the header.
+ * @returns 1 if a header was found, 0 if more bytes are needed, -1 if it is malformed.
+ */
+int api_request_parse_header(char *data, size_t len, struct s_request *req, size_t *used)
+{
+	char *p;
+	size_t head;
+
+	req->buf = NULL;
+	p = memmem(data, len, "\r\n\r\n", 4);
+	if (!p) {
+		return 0;
+	}
+	head = p - data;
+
+	req->size = head + 1;
+	req->buf = malloc(req->size);
+	if (!req->buf) {
+		libp2p_logger_error("api", "malloc fail.\n");
+		return -1;
+	}
+	memcpy(req->buf, data, head);
+	req->buf[head] = '\0';
+
+	req->method = 0;
+	p = strchr(req->buf + req->method, ' ');
+	if (!p) {
+		libp2p_logger_error("api", "fail looking for space on method '%s'.\n", req->buf + req->method);
+		goto fail;
+	}
+	*p++ = '\0'; // End of method.
+	req->path = p - req->buf;
+	if (strchr(p, '?')) {
+		p = strchr(p, '?');
+		*p++ = '\0';
+		req->query = p - req->buf;
+	} else {
+		req->query = 0;
+	}
+	p = strchr(p, ' ');
+	if (!p) {
+		libp2p_logger_error("api", "fail looking for space on path '%s'.\n", req->buf + req->path);
+		goto fail;
+	}
+	*p++ = '\0'; // End of path.
+	req->http_ver = p - req->buf;
+	p = strchr(req->buf + req->http_ver, '\r');
+	if (p) {
+		*p++ = '\0'; // End of http version.
+		while (*p == '\r' || *p == '\n') p++;
+	} else {
+		p = req->buf + head; // no headers.
+	}
+	req->header = p - req->buf;
+	req->body = req->size;
+	req->body_size = 0;
+	req->boundary = 0;
+	req->boundary_size = 0;
+	*used = head + 4;
+	return 1;
+
+fail:
+	free(req->buf);
+	req->buf = NULL;
+	return -1;
+}
+
+/**
+ * Take the body of a request, once all of it has arrived.
+ * @param data the bytes after the header.
+ * @param len the number of bytes.
+ * @param req the request, the body is added to its buf.
+ * @param used the number of bytes of data that were part of the body.
+ * @returns 1 if the body is complete, 0 if more bytes are needed, -1 if it is malformed.
+ */
+int api_request_parse_body(char *data, size_t len, struct s_request *req, size_t *used)
+{
+	char *p;
+	size_t body_size = 0, wire_size = 0;
+	int r, chunked = 0;
+
+	if (header_value_cmp(req, "Transfer-Encoding:", "chunked")) {
+		chunked = 1;
+		r = api_dechunk(data, len, NULL, &body_size, &wire_size);
+		if (r <= 0) {
+			return r;
+		}
+	} else if ((p = str_tok(req->buf + req->header, "Content-Length:")) != NULL) {
+		body_size = strtoul(p, NULL, 10);
+		wire_size = body_size;
+		if (len < wire_size) {
+			return 0;
+		}
+	}
+
+	// the body follows the header, with a NULL after it.
+	p = realloc(req->buf, req->size + body_size + 1);
+	if (!p) {
+		libp2p_logger_error("api", "fail realloc.\n");
+		return -1;
+	}
+	req->buf = p;
+	if (chunked) {
+		api_dechunk(data, len, req->buf + req->body, &body_size, &wire_size);
+	} else {
+		memcpy(req->buf + req->body, data, body_size);
+	}
+	req->body_size = body_size;
+	req->buf[req->body + body_size] = '\0';
+	*used = wire_size;
+	return 1;
+}
+
+/**
+ * Take one request from the bytes read from a connection. More requests can
+ * follow it in the same bytes (pipelining).
+ * @param data the bytes read.
+ * @param len the number of bytes.
+ * @param req where to put the request, its buf must be freed by the caller.
+ * @param used the number of bytes of data that were part of the request.
+ * @returns 1 if a request was found, 0 if more bytes are needed, -1 if it is malformed.
+ */
+int api_request_parse(char *data, size_t len, struct s_request *req, size_t *used)
+{
+	size_t head, body;
+	int r;
+
+	r = api_request_parse_header(data, len, req, &head);
+	if (r <= 0) {
+		return r;
+	}
+	r = api_request_parse_body(data + head, len - head, req, &body);
+	if (r <= 0) {
+		free(req->buf);
+		req->buf = NULL;
+		return r;
+	}
+	*used = head + body;
+	return 1;
+}
+
+/**
+ * Check if the connection can be used for more requests after this one.
+ * @param req the request.
+ * @returns 1 if the client wants to keep the connection open, 0 otherwise.
+ */
+int api_keep_alive(struct s_request *req)
+{
+	if (strcmp(req->buf + req->http_ver, "HTTP/1.1") != 0) {
+		return 0; // responses are chunked, which is HTTP/1.1 only.
+	}
+	return header_value_cmp(req, "Connection:", "close") == NULL;
+}
 
 /***
  * Take an s_request and turn it into an HttpRequest
@@ -338,6 +424,11 @@ int api_send_resp_chunks(int fd, void *buf, size_t size)
 	int l;
 	struct iovec iov[3];
 
+	if (size == 0) {
+		// nothing to send, but the client still needs the last chunk.
+		return write_cstr(fd, "0\r\n\r\n") != -1;
+	}
+
 	// will be reused in each write, so defined only once.
 	iov[2].iov_base = "\r\n";
 	iov[2].iov_len = 2;
@@ -368,315 +459,1020 @@ int api_send_resp_chunks(int fd, void *buf, size_t size)
 }
 
 /**
- * Pthread to take care of each client connection.
- * @param ptr an ApiConnectionParam
- * @returns nothing
+ * The socket of a chunk stream, and the buffer that is sent as a chunk when full.
  */
-void *api_connection_thread (void *ptr)
+struct ApiChunkStream {
+	int fd;
+	char buf[MAX_CHUNK];
+};
+
+/**
+ * Write chunks, no larger than MAX_CHUNK. The write function of a chunk stream.
+ * @param cookie the ApiChunkStream.
+ * @param buf the bytes to send.
+ * @param size the number of bytes.
+ * @returns size when success or -1 if it fails.
+ */
+ssize_t api_chunk_stream_write(void *cookie, const char *buf, size_t size)
 {
-	int timeout, s, r;
-	struct ApiConnectionParam* params = (struct ApiConnectionParam*)ptr;
-	char resp[MAX_READ+1], buf[MAX_READ+1], *p, *body;
-	char client[INET_ADDRSTRLEN];
-	struct s_request req;
-	int (*read_func)(int, struct s_request*, char*, size_t) = read_all;
+	struct ApiChunkStream *stream = (struct ApiChunkStream*)cookie;
+	char head[20];
+	struct iovec iov[3];
+	size_t s, left = size;
+	int l;
+
+	// an empty chunk would end the body, so nothing is sent for size 0.
+	while (left > 0) {
+		s = left > MAX_CHUNK ? MAX_CHUNK : left;
+		l = snprintf(head, sizeof head, "%x\r\n", (unsigned int)s);
+		iov[0].iov_base = head;
+		iov[0].iov_len = l;
+		iov[1].iov_base = (void*)buf;
+		iov[1].iov_len = s;
+		iov[2].iov_base = "\r\n";
+		iov[2].iov_len = 2;
+		libp2p_logger_debug("api", "writing chunk block of %lu bytes\n", (unsigned long)s);
+		if (writev(stream->fd, iov, 3) != (ssize_t)(l + s + 2)) {
+			return -1; // fail writing, or timed out.
+		}
+		buf += s;
+		left -= s;
+	}
+	return size;
+}
+
+int api_chunk_stream_close(void *cookie)
+{
+	free(cookie);
+	return 0;
+}
 
-	req.buf = NULL; // sanity.
+/**
+ * Open a stream that sends what is written to it as chunks. Small writes
+ * are gathered until there is MAX_CHUNK to send.
+ * @param fd the socket.
+ * @returns the stream, or NULL if it fails.
+ */
+FILE *api_chunk_stream_open(int fd)
+{
+	cookie_io_functions_t funcs = { NULL, api_chunk_stream_write, NULL, api_chunk_stream_close };
+	struct ApiChunkStream *stream;
+	FILE *out;
 
-	buf[MAX_READ] = '\0';
+	stream = malloc(sizeof(struct ApiChunkStream));
+	if (!stream) {
+		return NULL;
+	}
+	stream->fd = fd;
+	out = fopencookie(stream, "w", funcs);
+	if (!out) {
+		free(stream);
+		return NULL;
+	}
+	setvbuf(out, stream->buf, _IOFBF, MAX_CHUNK);
+	return out;
+}
 
-	s = params->this_node->api_context->conns[params->index]->socket;
-	timeout = params->this_node->api_context->timeout;
+/**
+ * Send a body that is written by the handler of the request as it is produced.
+ * @param local_node the context.
+ * @param fd the socket.
+ * @param response the response, with stream_body set.
+ * @returns 1 when success or 0 if it fails.
+ */
+int api_send_resp_stream(struct IpfsNode* local_node, int fd, struct HttpResponse *response)
+{
+	FILE *out = api_chunk_stream_open(fd);
+	int ok;
 
-	if (socket_read_select4(s, timeout) <= 0) {
-		libp2p_logger_error("api", "Client connection timeout.\n");
-		goto quit;
+	if (!out) {
+		return 0;
 	}
-	r = read(s, buf, sizeof buf);
-	if (r <= 0) {
-		// this is a common occurrence, so moved from error to debug
-		libp2p_logger_debug("api", "Read from client fail.\n");
-		goto quit;
+	ok = response->stream_body(local_node, response->stream_context, out);
+	if (fclose(out) != 0) { // sends what is left.
+		ok = 0;
+	}
+	if (!ok) {
+		// the status was sent already. Without the last chunk, the client
+		// knows that the body is not complete.
+		libp2p_logger_error("api", "Unable to send the whole response.\n");
+		return 0;
 	}
-	buf[r] = '\0';
+	return write_cstr(fd, "0\r\n\r\n") != -1;
+}
 
-	p = strstr(buf, "\r\n\r\n");
+/**
+ * Write the head of a successful response, the body follows in chunks.
+ * @param fd the socket of the client.
+ * @param req the request being answered.
+ * @param content_type the type of the body.
+ * @param keep_alive true if the connection stays open after the response.
+ * @returns 1 when success or 0 if it fails.
+ */
+int api_send_resp_head(int fd, struct s_request *req, const char *content_type, int keep_alive)
+{
+	char resp[MAX_READ+1];
+
+	snprintf(resp, MAX_READ+1, "%s 200 OK\r\n" \
+		"Content-Type: %s\r\n"
+		"Server: c-ipfs/0.0.0-dev\r\n"
+		"X-Chunked-Output: 1\r\n"
+		"X-Ipfs-Trace: %016llx\r\n"
+		"Connection: %s\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		,req->buf + req->http_ver, content_type, (unsigned long long)ipfs_util_trace_id(), keep_alive ? "keep-alive" : "close");
+	libp2p_logger_debug("api", "resp = {\n%s\n}\n", resp);
+	return write_str (fd, resp) != -1;
+}
 
-	if (p) {
-		body = p + 4;
+/**
+ * Get the boundary of a multipart/form-data request.
+ * @param req the request.
+ * @returns the boundary, to be freed by the caller, or NULL if there is none.
+ */
+char *api_boundary(struct s_request *req)
+{
+	char *p, *l, *boundary;
+	int len;
 
-		req.size = p - buf + 1;
-		req.buf = malloc(req.size);
-		if (!req.buf) {
-			// memory allocation fail.
-			libp2p_logger_error("api", "malloc fail.\n");
-			write_cstr (s, HTTP_500);
-			goto quit;
+	p = header_value_cmp(req, "Content-Type:", "multipart/form-data;");
+	if (!p) {
+		return NULL;
+	}
+	p = str_tok(p, "boundary=");
+	if (!p) {
+		return NULL;
+	}
+	if (*p == '"') {
+		p++;
+		l = strchr(p, '"');
+		if (!l) {
+			return NULL;
 		}
-		memcpy(req.buf, buf, req.size - 1);
-		req.buf[req.size-1] = '\0';
+	} else {
+		l = p;
+		while (*l != '\r' && *l != '\0') l++;
+	}
+	len = l - p;
+	boundary = malloc (len+1);
+	if (boundary) {
+		memcpy(boundary, p, len);
+		boundary[len] = '\0';
+	}
+	return boundary;
+}
 
-		req.method = 0;
-		p = strchr(req.buf + req.method, ' ');
-		if (!p) {
-			libp2p_logger_error("api", "fail looking for space on method '%s'.\n", req.buf + req.method);
-			write_cstr (s, HTTP_400);
-			goto quit;
-		}
-		*p++ = '\0'; // End of method.
-		req.path = p - req.buf;
-		if (strchr(p, '?')) {
-			p = strchr(p, '?');
-			*p++ = '\0';
-			req.query = p - req.buf;
-		} else {
-			req.query = 0;
+/**
+ * Find the histogram that times a request.
+ * @param req the request.
+ * @returns the histogram of its command.
+ */
+int api_metrics_histogram(struct s_request *req)
+{
+	static const struct {
+		char *command;
+		int histogram;
+	} commands[] = {
+		{ "add", METRICS_API_ADD_SECONDS },
+		{ "dht", METRICS_API_DHT_SECONDS },
+		{ "metrics", METRICS_API_METRICS_SECONDS },
+		{ "name", METRICS_API_NAME_SECONDS },
+		{ "object", METRICS_API_OBJECT_SECONDS },
+		{ "swarm", METRICS_API_SWARM_SECONDS }
+	};
+	char *p = req->buf + req->path;
+	size_t i, len;
+
+	if (ipfs_core_gateway_is_path(p)) {
+		return METRICS_API_GATEWAY_SECONDS;
+	}
+	if (strcmp(p, API_METRICS_PATH) == 0) {
+		return METRICS_API_METRICS_SECONDS;
+	}
+	if (!cstrstart(p, API_V0_START)) {
+		return METRICS_API_OTHER_SECONDS;
+	}
+	p += sizeof(API_V0_START) - 1;
+	len = strcspn(p, "/");
+	for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+		if (strlen(commands[i].command) == len && memcmp(p, commands[i].command, len) == 0) {
+			return commands[i].histogram;
 		}
-		p = strchr(p, ' ');
-		if (!p) {
-			libp2p_logger_error("api", "fail looking for space on path '%s'.\n", req.buf + req.path);
-			write_cstr (s, HTTP_400);
-			goto quit;
+	}
+	return METRICS_API_OTHER_SECONDS;
+}
+
+/**
+ * Write the state of the connections and of the worker pool, as metrics.
+ * @param context the api context.
+ * @param out where to write.
+ * @returns 1 when success or 0 if it fails.
+ */
+int api_metrics_write(struct ApiContext *context, FILE *out)
+{
+	int conns, ready, busy, workers;
+
+	pthread_mutex_lock(&context->conns_lock);
+	conns = context->conns_count;
+	ready = context->ready_count;
+	busy = context->busy_workers;
+	workers = context->num_workers;
+	pthread_mutex_unlock(&context->conns_lock);
+
+	return ipfs_util_metrics_write_header(out, "ipfs_api_connections", "gauge", "Open connections to the API.") &&
+	       fprintf(out, "ipfs_api_connections %d\n", conns) > 0 &&
+	       ipfs_util_metrics_write_header(out, "ipfs_api_queue_depth", "gauge", "Connections with a request waiting for a worker.") &&
+	       fprintf(out, "ipfs_api_queue_depth %d\n", ready) > 0 &&
+	       ipfs_util_metrics_write_header(out, "ipfs_api_workers_busy", "gauge", "Workers serving a request.") &&
+	       fprintf(out, "ipfs_api_workers_busy %d\n", busy) > 0 &&
+	       ipfs_util_metrics_write_header(out, "ipfs_api_workers", "gauge", "Workers in the pool.") &&
+	       fprintf(out, "ipfs_api_workers %d\n", workers) > 0;
+}
+
+/**
+ * Answer one request.
+ * @param local_node the context.
+ * @param s the socket of the client.
+ * @param req the request.
+ * @returns 1 if the connection can be kept open, 0 if it must be closed.
+ */
+int api_request_process(struct IpfsNode* local_node, int s, struct s_request *req)
+{
+	char *p, *boundary;
+	int keep_alive = api_keep_alive(req);
+
+	if (strncmp(req->buf + req->method, "GET", 3)==0) {
+		if (strcmp (req->buf + req->path, "/")==0      ||
+		    strcmp (req->buf + req->path, "/webui")==0 ||
+		    strcmp (req->buf + req->path, "/webui/")==0) {
+			char *redir;
+			size_t size = sizeof(HTTP_301) + (sizeof(WEBUI_ADDR)*2);
+
+			redir = malloc(size);
+			if (redir) {
+				snprintf(redir, size, HTTP_301, WEBUI_ADDR, WEBUI_ADDR);
+				redir[size-1] = '\0'; // just in case
+				write_dual (s, req->buf + req->http_ver, strchr (redir, ' '));
+				free (redir);
+			} else {
+				write_cstr (s, HTTP_500);
+			}
+			return 0;
+		} else if (ipfs_core_gateway_is_path(req->buf + req->path)) {
+			return ipfs_core_gateway_process(local_node, s, req, keep_alive);
+		} else if (!cstrstart(req->buf + req->path, API_V0_START) &&
+		           strcmp(req->buf + req->path, API_METRICS_PATH) != 0) {
+			write_cstr (s, HTTP_404);
+			return 0;
 		}
-		*p++ = '\0'; // End of path.
-		req.http_ver = p - req.buf;
-		p = strchr(req.buf + req.http_ver, '\r');
-		if (!p) {
-			libp2p_logger_error("api", "fail looking for CR on http_ver '%s'.\n", req.buf + req.http_ver);
-			write_cstr (s, HTTP_400);
-			goto quit;
+		// end of GET
+	} else if (strcmp(req->buf + req->method, "HEAD")==0 && ipfs_core_gateway_is_path(req->buf + req->path)) {
+		return ipfs_core_gateway_process(local_node, s, req, keep_alive);
+	} else if (strncmp(req->buf + req->method, "POST", 4)==0) {
+		// TODO: Handle gzip/json POST requests.
+
+		boundary = api_boundary(req);
+		if (boundary) {
+			p = boundary_find(req->buf + req->body, boundary, NULL, NULL);
+			if (p) {
+				req->boundary_size = boundary_size(p, boundary, req->body_size - (p - (req->buf + req->body)));
+				if (req->boundary_size > 0) {
+					req->boundary = p - req->buf;
+				}
+			}
+			free (boundary);
 		}
-		*p++ = '\0'; // End of http version.
-		while (*p == '\r' || *p == '\n') p++;
-		req.header = p - req.buf;
-		req.body = req.size;
-		req.body_size = 0;
 
-		if (header_value_cmp(&req, "Transfer-Encoding:", "chunked")) {
-			read_func = read_chunked;
+		if (req->boundary > 0) {
+			libp2p_logger_error("api", "boundary index = %d, size = %d\n", req->boundary, req->boundary_size);
 		}
 
-		if (!read_func(s, &req, body, r - (body - buf))) {
-			libp2p_logger_error("api", "fail read_func.\n");
-			write_cstr (s, HTTP_500);
-			goto quit;
-		}
+		libp2p_logger_debug("api", "method = '%s'\n"
+					   "path = '%s'\n"
+					   "http_ver = '%s'\n"
+					   "header {\n%s\n}\n"
+					   "body_size = %d\n",
+		req->buf+req->method, req->buf+req->path, req->buf+req->http_ver,
+		req->buf+req->header, req->body_size);
 
-		if (strncmp(req.buf + req.method, "GET", 3)==0) {
-			if (strcmp (req.buf + req.path, "/")==0      ||
-			    strcmp (req.buf + req.path, "/webui")==0 ||
-			    strcmp (req.buf + req.path, "/webui/")==0) {
-				char *redir;
-				size_t size = sizeof(HTTP_301) + (sizeof(WEBUI_ADDR)*2);
+		if (!cstrstart(req->buf + req->path, API_V0_START)) {
+			write_cstr (s, HTTP_404);
+			return 0;
+		}
+		// end of POST
+	} else {
+		// Unexpected???
+		libp2p_logger_error("api", "fail unexpected '%s'.\n", req->buf + req->method);
+		write_cstr (s, HTTP_501);
+		return 0;
+	}
 
-				redir = malloc(size);
-				if (redir) {
-					snprintf(redir, size, HTTP_301, WEBUI_ADDR, WEBUI_ADDR);
-					redir[size-1] = '\0'; // just in case
-					write_dual (s, req.buf + req.http_ver, strchr (redir, ' '));
-					free (redir);
-				} else {
-					write_cstr (s, HTTP_500);
-				}
-			} else if (!cstrstart(req.buf + req.path, API_V0_START)) {
-				// TODO: handle download file here.
-				// move out of the if to do further processing
+	if (strcmp(req->buf + req->path, API_METRICS_PATH) == 0) {
+		req->request = req->path + sizeof("/debug/") - 1; // metrics/prometheus
+	} else {
+		req->request = req->path + sizeof(API_V0_START) - 1;
+	}
+	// now do something with the request we have built
+	struct HttpRequest* http_request = api_build_http_request(req);
+	if (http_request == NULL) {
+		// uh oh... something went wrong converting to the HttpRequest struct
+		libp2p_logger_error("api", "Unable to build HttpRequest struct.\n");
+		write_cstr (s, HTTP_500);
+		return 0;
+	}
+	struct HttpResponse* http_response = NULL;
+	if (!ipfs_core_http_request_process(local_node, http_request, &http_response)) {
+		libp2p_logger_error("api", "ipfs_core_http_request_process returned false.\n");
+		// 404
+		write_str(s, HTTP_404);
+		keep_alive = 0;
+	} else {
+		api_send_resp_head(s, req, http_response->content_type, keep_alive);
+		if (http_response->stream_body) {
+			if (!api_send_resp_stream(local_node, s, http_response)) {
+				keep_alive = 0;
 			}
-			// end of GET
-		} else if (strncmp(req.buf + req.method, "POST", 4)==0) {
-			// TODO: Handle gzip/json POST requests.
+		} else if (!api_send_resp_chunks(s, http_response->bytes, http_response->bytes_size)) {
+			keep_alive = 0;
+		}
+	}
+	ipfs_core_http_request_free(http_request);
+	ipfs_core_http_response_free(http_response);
+	return keep_alive;
+}
 
-			p = header_value_cmp(&req, "Content-Type:", "multipart/form-data;");
-			if (p) {
-				p = str_tok(p, "boundary=");
-				if (p) {
-					char *boundary, *l;
-					int len;
-					if (*p == '"') {
-						p++;
-						l = strchr(p, '"');
-					} else {
-						l = p;
-						while (*l != '\r' && *l != '\0') l++;
-					}
-					len = l - p;
-					boundary = malloc (len+1);
-					if (boundary) {
-						memcpy(boundary, p, len);
-						boundary[len] = '\0';
-
-						p = boundary_find(req.buf + req.body, boundary, NULL, NULL);
-						if (p) {
-							req.boundary_size = boundary_size(p, boundary, req.size - (p - buf));
-							if (req.boundary_size > 0) {
-								req.boundary = p - req.buf;
-							}
-						}
+/**
+ * Read what has arrived on a connection, until at least size bytes are in its buffer.
+ * It does not wait, so that a slow client does not hold a worker. The connection
+ * goes back to the event loop until more arrives.
+ * @param conn the connection.
+ * @param size the number of bytes wanted, no more than MAX_READ.
+ * @returns 1 when they are there, 0 if they have not arrived yet, or -1 if the connection failed.
+ */
+int api_conn_need(struct s_conns *conn, size_t size)
+{
+	ssize_t r;
 
-						free (boundary);
-					}
-				}
-			}
+	while (conn->buf_len < size) {
+		r = recv(conn->socket, conn->buf + conn->buf_len, conn->buf_size - conn->buf_len, MSG_DONTWAIT);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		}
+		if (r <= 0) {
+			libp2p_logger_debug("api", "Read from client fail.\n");
+			return -1;
+		}
+		conn->buf_len += r;
+	}
+	return 1;
+}
+
+/**
+ * Remove bytes from the front of the buffer of a connection.
+ * @param conn the connection.
+ * @param size the number of bytes.
+ */
+void api_conn_consume(struct s_conns *conn, size_t size)
+{
+	conn->buf_len -= size;
+	memmove(conn->buf, conn->buf + size, conn->buf_len);
+}
 
-			if (req.boundary > 0) {
-				libp2p_logger_error("api", "boundary index = %d, size = %d\n", req.boundary, req.boundary_size);
+/**
+ * Read the next piece of a request body. Nothing more than what has arrived
+ * is read from the socket, so a slow consumer holds back the client.
+ * @param body the body being read.
+ * @param out where to put the bytes.
+ * @param size the most bytes wanted.
+ * @returns the number of bytes, 0 at the end of the body, API_AGAIN if more
+ * has not arrived yet, or -1 on error.
+ */
+ssize_t api_body_read(struct ApiBody *body, char *out, size_t size)
+{
+	struct s_conns *conn = body->conn;
+	size_t pos, n;
+	int r;
+
+	// nothing is consumed before all that is needed has arrived, so a read
+	// that gives API_AGAIN starts over at the same place.
+	while (body->remaining == 0) {
+		if (!body->chunked || body->done) {
+			return 0;
+		}
+		if (body->in_chunk) {
+			// the data of a chunk is followed by CRLF
+			r = api_conn_need(conn, 2);
+			if (r == 0) {
+				return API_AGAIN;
+			}
+			if (r < 0 || memcmp(conn->buf, "\r\n", 2) != 0) {
+				libp2p_logger_error("api", "fail CRLF.\n");
+				return -1;
+			}
+			api_conn_consume(conn, 2);
+			body->in_chunk = 0;
+		}
+		// the size of the next chunk
+		while (!memchr(conn->buf, '\n', conn->buf_len)) {
+			r = conn->buf_len > 32 ? -1 : api_conn_need(conn, conn->buf_len + 1);
+			if (r == 0) {
+				return API_AGAIN;
+			}
+			if (r < 0) {
+				libp2p_logger_error("api", "fail find_chunk.\n");
+				return -1;
+			}
+		}
+		if (!find_chunk(conn->buf, conn->buf_len, &pos, &n)) {
+			libp2p_logger_error("api", "fail find_chunk.\n");
+			return -1;
+		}
+		if (n == 0) {
+			// last chunk, trailers are not supported.
+			r = api_conn_need(conn, pos + 2);
+			if (r == 0) {
+				return API_AGAIN;
 			}
+			if (r < 0 || memcmp(conn->buf + pos, "\r\n", 2) != 0) {
+				libp2p_logger_error("api", "fail CRLF.\n");
+				return -1;
+			}
+			api_conn_consume(conn, pos + 2);
+			body->done = 1;
+			return 0;
+		}
+		api_conn_consume(conn, pos);
+		body->remaining = n;
+		body->in_chunk = 1;
+	}
 
-			libp2p_logger_debug("api", "method = '%s'\n"
-						   "path = '%s'\n"
-						   "http_ver = '%s'\n"
-						   "header {\n%s\n}\n"
-						   "body_size = %d\n",
-			req.buf+req.method, req.buf+req.path, req.buf+req.http_ver,
-			req.buf+req.header, req.body_size);
-			// end of POST
-		} else {
-			// Unexpected???
-			libp2p_logger_error("api", "fail unexpected '%s'.\n", req.buf + req.method);
-			write_cstr (s, HTTP_500);
-		}
-
-		if (cstrstart(req.buf + req.path, API_V0_START)) {
-			req.request = req.path + sizeof(API_V0_START) - 1;
-			// now do something with the request we have built
-			struct HttpRequest* http_request = api_build_http_request(&req);
-			if (http_request != NULL) {
-				struct HttpResponse* http_response = NULL;
-				if (!ipfs_core_http_request_process(params->this_node, http_request, &http_response)) {
-					libp2p_logger_error("api", "ipfs_core_http_request_process returned false.\n");
-					// 404
-					write_str(s, HTTP_404);
+	r = api_conn_need(conn, 1);
+	if (r <= 0) {
+		return r == 0 ? API_AGAIN : -1;
+	}
+	n = conn->buf_len;
+	if (n > size) {
+		n = size;
+	}
+	if (n > body->remaining) {
+		n = body->remaining;
+	}
+	memcpy(out, conn->buf, n);
+	api_conn_consume(conn, n);
+	body->remaining -= n;
+	return n;
+}
+
+/**
+ * Write text into a json string, escaping quotes, backslashes and control characters.
+ * @param out where to write.
+ * @param text the text.
+ */
+void api_json_escape(FILE *out, const char *text)
+{
+	for (; *text; text++) {
+		switch (*text) {
+			case '"': fputs("\\\"", out); break;
+			case '\\': fputs("\\\\", out); break;
+			case '\n': fputs("\\n", out); break;
+			case '\r': fputs("\\r", out); break;
+			case '\t': fputs("\\t", out); break;
+			default:
+				if ((unsigned char)*text < 0x20) {
+					fprintf(out, "\\u%04x", *text);
 				} else {
-					snprintf(resp, MAX_READ+1, "%s 200 OK\r\n" \
-						"Content-Type: %s\r\n"
-						"Server: c-ipfs/0.0.0-dev\r\n"
-						"X-Chunked-Output: 1\r\n"
-						"Connection: close\r\n"
-						"Transfer-Encoding: chunked\r\n"
-						"\r\n"
-						,req.buf + req.http_ver, http_response->content_type);
-					write_str (s, resp);
-					api_send_resp_chunks(s, http_response->bytes, http_response->bytes_size);
-					libp2p_logger_debug("api", "resp = {\n%s\n}\n", resp);
+					fputc(*text, out);
 				}
-				ipfs_core_http_request_free(http_request);
-				ipfs_core_http_response_free(http_response);
-			} else {
-				// uh oh... something went wrong converting to the HttpRequest struct
-				libp2p_logger_error("api", "Unable to build HttpRequest struct.\n");
-			}
 		}
+	}
+}
+
+/**
+ * The state of an upload to /api/v0/add
+ */
+struct ApiAddContext {
+	struct IpfsNode* local_node;
+	struct ImportStream* stream; // the file of the current part
+	char *filename;
+	FILE *results; // a line of json for each file added
+};
+
+int api_add_part(void *ptr, const char *filename)
+{
+	struct ApiAddContext *add = (struct ApiAddContext*)ptr;
+
+	add->stream = ipfs_import_stream_new(add->local_node);
+	add->filename = strdup(filename ? filename : "");
+	return add->stream != NULL && add->filename != NULL;
+}
+
+int api_add_data(void *ptr, const uint8_t *data, size_t size)
+{
+	struct ApiAddContext *add = (struct ApiAddContext*)ptr;
+
+	return ipfs_import_stream_write(add->stream, data, size);
+}
+
+int api_add_part_end(void *ptr)
+{
+	struct ApiAddContext *add = (struct ApiAddContext*)ptr;
+	struct HashtableNode *node = NULL;
+	unsigned char hash[100];
+	int retVal = 0;
+
+	if (ipfs_import_stream_finish(add->stream, &node) &&
+	    ipfs_cid_hash_to_base58(node->hash, node->hash_size, hash, sizeof(hash))) {
+		fputs("{\"Name\":\"", add->results);
+		api_json_escape(add->results, add->filename);
+		fprintf(add->results, "\",\"Hash\":\"%s\",\"Size\":\"%lu\"}\n",
+			hash, (unsigned long)add->stream->bytes_written);
+		retVal = 1;
+	}
+	if (node) {
+		ipfs_hashtable_node_free(node);
+	}
+	ipfs_import_stream_free(add->stream);
+	add->stream = NULL;
+	free(add->filename);
+	add->filename = NULL;
+	return retVal;
+}
+
+/**
+ * Get the boundary of a request that uploads files to /api/v0/add.
+ * @param req the request.
+ * @returns the boundary, to be freed by the caller, or NULL if it is another request.
+ */
+char *api_add_boundary(struct s_request *req)
+{
+	if (strcmp(req->buf + req->method, "POST") != 0 ||
+	    strcmp(req->buf + req->path, API_V0_START "add") != 0) {
+		return NULL;
+	}
+	return api_boundary(req);
+}
+
+/**
+ * An upload to /api/v0/add, kept with its connection while it waits for more of its body
+ */
+struct ApiUpload {
+	struct s_request req; // without its body
+	struct ApiBody body;
+	struct ApiAddContext add;
+	struct MultipartParser *parser;
+	char *results;
+	size_t results_size;
+	uint64_t start; // when the request arrived, for the metrics
+};
+
+/**
+ * Free an upload, and what was imported of a file it did not finish.
+ * @param upload the upload, can be NULL.
+ */
+void api_add_free(struct ApiUpload *upload)
+{
+	if (!upload) {
+		return;
+	}
+	if (upload->add.results)
+		fclose(upload->add.results);
+	free(upload->results);
+	ipfs_import_stream_free(upload->add.stream);
+	free(upload->add.filename);
+	ipfs_core_multipart_free(upload->parser);
+	free(upload->req.buf);
+	free(upload);
+}
+
+/**
+ * Start an upload to /api/v0/add. Its files are imported while the body is
+ * read, so that only a chunk of each file is in memory at a time.
+ * @param local_node the context.
+ * @param conn the connection, its buffer has the start of the body.
+ * @param req the request, without its body. Its buffer belongs to the upload from here on.
+ * @param boundary the multipart boundary.
+ * @param start when the request arrived.
+ * @returns the upload, or NULL if the connection must be closed.
+ */
+struct ApiUpload *api_add_begin(struct IpfsNode* local_node, struct s_conns *conn, struct s_request *req, char *boundary, uint64_t start)
+{
+	struct ApiUpload *upload;
+	char *p;
+
+	upload = calloc(1, sizeof(struct ApiUpload));
+	if (!upload) {
+		free(req->buf);
+		write_cstr (conn->socket, HTTP_500);
+		return NULL;
+	}
+	upload->req = *req;
+	upload->start = start;
+	upload->body.conn = conn;
+	upload->body.chunked = header_value_cmp(req, "Transfer-Encoding:", "chunked") != NULL;
+	if (!upload->body.chunked) {
+		p = str_tok(req->buf + req->header, "Content-Length:");
+		if (!p) {
+			write_cstr (conn->socket, HTTP_400);
+			api_add_free(upload);
+			return NULL;
+		}
+		upload->body.remaining = strtoul(p, NULL, 10);
+	}
+
+	upload->add.local_node = local_node;
+	upload->add.results = open_memstream(&upload->results, &upload->results_size);
+	upload->parser = ipfs_core_multipart_new(boundary, api_add_part, api_add_data, api_add_part_end, &upload->add);
+	if (!upload->add.results || !upload->parser) {
+		write_cstr (conn->socket, HTTP_500);
+		api_add_free(upload);
+		return NULL;
+	}
+
+	if (header_value_cmp(req, "Expect:", "100-continue")) {
+		write_dual (conn->socket, req->buf + req->http_ver, " 100 Continue\r\n\r\n");
+	}
+	return upload;
+}
+
+/**
+ * Import what has arrived of the body of the upload of a connection, and
+ * answer it once the body is all there. The upload is then freed.
+ * @param conn the connection.
+ * @returns 1 if the connection can be kept open, 0 if it must be closed,
+ * or API_AGAIN if more of the body has not arrived yet.
+ */
+int api_add_continue(struct s_conns *conn)
+{
+	struct ApiUpload *upload = conn->upload;
+	char buf[MAX_READ];
+	ssize_t r;
+	int retVal = 0;
+
+	while ((r = api_body_read(&upload->body, buf, sizeof(buf))) > 0) {
+		if (!ipfs_core_multipart_feed(upload->parser, (uint8_t*)buf, r)) {
+			r = -1;
+			break;
+		}
+	}
+	if (r == API_AGAIN) {
+		return API_AGAIN;
+	}
+	fclose(upload->add.results);
+	upload->add.results = NULL;
+	if (r < 0 || !ipfs_core_multipart_done(upload->parser)) {
+		libp2p_logger_error("api", "Unable to add files.\n");
+		write_cstr (conn->socket, HTTP_400);
 	} else {
-		libp2p_logger_error("api", "fail looking for body.\n");
-		write_cstr (s, HTTP_400);
+		retVal = api_keep_alive(&upload->req);
+		api_send_resp_head(conn->socket, &upload->req, "application/json", retVal);
+		if (!api_send_resp_chunks(conn->socket, upload->results, upload->results_size)) {
+			retVal = 0;
+		}
 	}
+	ipfs_util_metrics_observe(METRICS_API_ADD_SECONDS, upload->start);
+	api_add_free(upload);
+	conn->upload = NULL;
+	return retVal;
+}
 
-quit:
-	if (req.buf)
+/**
+ * Read what has arrived on a connection, and answer every complete request in it.
+ * @param local_node the context.
+ * @param conn the connection, owned by the calling worker.
+ * @returns 1 if the connection should wait for more requests, 0 if it must be closed.
+ */
+int api_connection_serve(struct IpfsNode* local_node, struct s_conns *conn)
+{
+	struct s_request req;
+	size_t used, body_used;
+	ssize_t r;
+	int closed = 0, histogram;
+	uint64_t start;
+	struct TraceSpan span;
+	char *p;
+
+	if (conn->buf_len == conn->buf_size) {
+		p = realloc(conn->buf, conn->buf_size ? conn->buf_size * 2 : MAX_READ);
+		if (!p) {
+			libp2p_logger_error("api", "fail realloc.\n");
+			write_cstr (conn->socket, HTTP_500);
+			return 0;
+		}
+		conn->buf = p;
+		conn->buf_size = conn->buf_size ? conn->buf_size * 2 : MAX_READ;
+	}
+	// one read at a time, so that busy connections do not starve the others.
+	r = recv(conn->socket, conn->buf + conn->buf_len, conn->buf_size - conn->buf_len, MSG_DONTWAIT);
+	if (r > 0) {
+		conn->buf_len += r;
+	} else if (r == 0) {
+		closed = 1;
+	} else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		// this is a common occurrence, so moved from error to debug
+		libp2p_logger_debug("api", "Read from client fail.\n");
+		return 0;
+	}
+
+	if (conn->upload) {
+		// more of the body of an upload has arrived
+		ipfs_util_trace_begin(&span, "api_add");
+		r = api_add_continue(conn);
+		ipfs_util_trace_end(&span);
+		if (r == API_AGAIN) {
+			return !closed;
+		}
+		if (!r) {
+			return 0;
+		}
+	}
+
+	while (conn->buf_len > 0) {
+		r = api_request_parse_header(conn->buf, conn->buf_len, &req, &used);
+		if (r < 0) {
+			write_cstr (conn->socket, HTTP_400);
+			return 0;
+		}
+		if (r == 0) {
+			if (conn->buf_len > MAX_READ) {
+				libp2p_logger_error("api", "fail looking for body.\n");
+				write_cstr (conn->socket, HTTP_400);
+				return 0;
+			}
+			break; // wait for the rest of the header.
+		}
+		start = ipfs_util_metrics_now();
+		p = api_add_boundary(&req);
+		if (p) {
+			// the files are imported as the body is read, and the
+			// connection waits in the event loop when it is slow to come.
+			api_conn_consume(conn, used);
+			conn->upload = api_add_begin(local_node, conn, &req, p, start);
+			free(p);
+			if (!conn->upload) {
+				return 0;
+			}
+			ipfs_util_trace_begin(&span, "api_add");
+			r = api_add_continue(conn);
+			ipfs_util_trace_end(&span);
+			if (r == API_AGAIN) {
+				break;
+			}
+			if (!r) {
+				return 0;
+			}
+			continue;
+		}
+		r = api_request_parse_body(conn->buf + used, conn->buf_len - used, &req, &body_used);
+		if (r <= 0) {
+			free(req.buf);
+			if (r < 0) {
+				write_cstr (conn->socket, HTTP_400);
+				return 0;
+			}
+			break; // wait for the rest of the body.
+		}
+		histogram = api_metrics_histogram(&req);
+		ipfs_util_trace_begin(&span, "api_request");
+		r = api_request_process(local_node, conn->socket, &req);
+		ipfs_util_trace_end(&span);
+		ipfs_util_metrics_observe(histogram, start);
 		free(req.buf);
-	if (inet_ntop(AF_INET, &( params->this_node->api_context->conns[params->index]->ipv4), client, INET_ADDRSTRLEN) == NULL)
+		api_conn_consume(conn, used + body_used);
+		if (!r) {
+			return 0;
+		}
+	}
+	if (conn->buf_len == 0 && conn->buf_size > MAX_READ) {
+		// give back what a large request needed.
+		free(conn->buf);
+		conn->buf = NULL;
+		conn->buf_size = 0;
+	}
+	return !closed;
+}
+
+/**
+ * Close a connection and give its slot back. Must be called with conns_lock held.
+ * @param context the api context.
+ * @param index the index of the connection.
+ */
+void api_connection_close(struct ApiContext *context, int index)
+{
+	struct s_conns *conn = &context->conns[index];
+	char client[INET_ADDRSTRLEN];
+
+	if (inet_ntop(AF_INET, &conn->ipv4, client, INET_ADDRSTRLEN) == NULL)
 		strcpy(client, "UNKNOW");
-	libp2p_logger_debug("api", "Closing client connection %s:%d (%d).\n", client, params->this_node->api_context->conns[params->index]->port, params->index+1);
-	pthread_mutex_lock(&params->this_node->api_context->conns_lock);
-	close(s);
-	free ( params->this_node->api_context->conns[params->index]);
-	params->this_node->api_context->conns[params->index] = NULL;
-	params->this_node->api_context->conns_count--;
-	pthread_mutex_unlock(&params->this_node->api_context->conns_lock);
-	free(params);
+	libp2p_logger_debug("api", "Closing client connection %s:%d (%d).\n", client, conn->port, index+1);
+	close(conn->socket); // this also takes it out of epoll.
+	api_add_free(conn->upload);
+	conn->upload = NULL;
+	free(conn->buf);
+	conn->buf = NULL;
+	conn->buf_len = 0;
+	conn->buf_size = 0;
+	conn->state = API_CONN_FREE;
+	context->free_slots[context->free_count++] = index;
+	context->conns_count--;
+}
+
+/**
+ * Pthread that takes connections with data from the event loop and serves them.
+ * @param ptr the IpfsNode.
+ * @returns nothing
+ */
+void *api_worker_thread (void *ptr)
+{
+	struct IpfsNode* local_node = (struct IpfsNode*)ptr;
+	struct ApiContext *context = local_node->api_context;
+	struct epoll_event ev;
+	int i, keep;
+
+	for (;;) {
+		pthread_mutex_lock(&context->conns_lock);
+		while (context->ready_count == 0 && !context->shutting_down) {
+			pthread_cond_wait(&context->ready_cond, &context->conns_lock);
+		}
+		if (context->shutting_down) {
+			pthread_mutex_unlock(&context->conns_lock);
+			break;
+		}
+		i = context->ready[context->ready_head];
+		context->ready_head = (context->ready_head + 1) % context->max_conns;
+		context->ready_count--;
+		context->busy_workers++;
+		pthread_mutex_unlock(&context->conns_lock);
+
+		keep = api_connection_serve(local_node, &context->conns[i]);
+
+		pthread_mutex_lock(&context->conns_lock);
+		context->busy_workers--;
+		if (keep && !context->shutting_down) {
+			context->conns[i].state = API_CONN_WAITING;
+			context->conns[i].last_active = time(NULL);
+			ev.events = EPOLLIN | EPOLLONESHOT;
+			ev.data.u64 = i;
+			if (epoll_ctl(context->epoll_fd, EPOLL_CTL_MOD, context->conns[i].socket, &ev) == -1) {
+				api_connection_close(context, i);
+			}
+		} else {
+			api_connection_close(context, i);
+		}
+		pthread_mutex_unlock(&context->conns_lock);
+	}
 	return NULL;
 }
 
 /**
- * Close all connections stopping respectives pthreads and free allocated memory.
+ * Accept a new client, and give it a slot in the connection table.
+ * @param local_node the context.
+ */
+void api_accept(struct IpfsNode* local_node)
+{
+	struct ApiContext *context = local_node->api_context;
+	struct s_conns *conn;
+	struct epoll_event ev;
+	struct timeval tv;
+	char client[INET_ADDRSTRLEN];
+	uint32_t ipv4;
+	uint16_t port;
+	int s, i, one = 1;
+
+	s = socket_accept4(context->socket, &ipv4, &port);
+	if (s <= 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&context->conns_lock);
+	if (context->free_count == 0) { // limit reached.
+		pthread_mutex_unlock(&context->conns_lock);
+		libp2p_logger_error("api", "Limit of connections reached (%d).\n", context->max_conns);
+		close (s);
+		return;
+	}
+	i = context->free_slots[--context->free_count];
+	context->conns_count++;
+	conn = &context->conns[i];
+	conn->socket = s;
+	conn->ipv4 = ipv4;
+	conn->port = port;
+	conn->state = API_CONN_WAITING;
+	conn->last_active = time(NULL);
+
+	// responses are written in a few pieces, don't let them wait for acks.
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	// a client that stops reading must not hold a worker forever.
+	tv.tv_sec = context->timeout;
+	tv.tv_usec = 0;
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = i;
+	if (epoll_ctl(context->epoll_fd, EPOLL_CTL_ADD, s, &ev) == -1) {
+		libp2p_logger_error("api", "Unable to watch connection.\n");
+		api_connection_close(context, i);
+		pthread_mutex_unlock(&context->conns_lock);
+		return;
+	}
+	if (inet_ntop(AF_INET, &ipv4, client, INET_ADDRSTRLEN) == NULL)
+		strcpy(client, "UNKNOW");
+	libp2p_logger_debug("api", "API for %s: Accept connection %s:%d (%d/%d), slot %d.\n", local_node->identity->peer->id, client, port, context->conns_count, context->max_conns, i+1);
+	pthread_mutex_unlock(&context->conns_lock);
+}
+
+/**
+ * Close connections that have waited too long for a request.
+ * @param context the api context.
+ * @param now the current time.
+ */
+void api_connections_expire(struct ApiContext *context, time_t now)
+{
+	int i;
+
+	pthread_mutex_lock(&context->conns_lock);
+	for (i = 0 ; i < context->max_conns ; i++) {
+		if (context->conns[i].state == API_CONN_WAITING && now - context->conns[i].last_active >= context->timeout) {
+			libp2p_logger_debug("api", "Client connection timeout.\n");
+			api_connection_close(context, i);
+		}
+	}
+	pthread_mutex_unlock(&context->conns_lock);
+}
+
+/**
+ * Close all connections and free allocated memory. The event loop and
+ * the workers must be stopped first.
  */
 void api_connections_cleanup (struct IpfsNode* local_node)
 {
 	int i;
 
 	pthread_mutex_lock(&local_node->api_context->conns_lock);
-	if (local_node->api_context->conns_count > 0 && local_node->api_context->conns) {
+	if (local_node->api_context->conns) {
 		for (i = 0 ; i < local_node->api_context->max_conns ; i++) {
-			if (local_node->api_context->conns[i]->pthread) {
-				pthread_cancel (local_node->api_context->conns[i]->pthread);
-				close (local_node->api_context->conns[i]->socket);
-				free (local_node->api_context->conns[i]);
-				local_node->api_context->conns[i] = NULL;
+			if (local_node->api_context->conns[i].state != API_CONN_FREE) {
+				api_connection_close(local_node->api_context, i);
 			}
 		}
 		local_node->api_context->conns_count = 0;
-	}
-	if (local_node->api_context->conns) {
 		free (local_node->api_context->conns);
 		local_node->api_context->conns = NULL;
 	}
+	free (local_node->api_context->free_slots);
+	local_node->api_context->free_slots = NULL;
+	free (local_node->api_context->ready);
+	local_node->api_context->ready = NULL;
+	free (local_node->api_context->workers);
+	local_node->api_context->workers = NULL;
 	pthread_mutex_unlock(&local_node->api_context->conns_lock);
 }
 
 /**
- * Pthread to keep in background dealing with client connections.
- * @param ptr is not used.
+ * Pthread of the event loop. It accepts clients, and hands connections that
+ * have data to the workers.
+ * @param ptr the IpfsNode.
  * @returns nothing
  */
 void *api_listen_thread (void *ptr)
 {
-	int s;
-	INT_TYPE i;
-	uint32_t ipv4;
-	uint16_t port;
-	char client[INET_ADDRSTRLEN];
 	struct IpfsNode* local_node = (struct IpfsNode*)ptr;
-
-	local_node->api_context->conns_count = 0;
+	struct ApiContext *context = local_node->api_context;
+	struct epoll_event events[API_MAX_EVENTS];
+	time_t now, last_expire = time(NULL);
+	int n, i, index;
 
 	for (;;) {
-		s = socket_accept4(local_node->api_context->socket, &ipv4, &port);
-		if (s <= 0) {
+		n = epoll_wait(context->epoll_fd, events, API_MAX_EVENTS, 1000);
+		if (n < 0 && errno != EINTR) {
+			libp2p_logger_error("api", "epoll_wait failed.\n");
 			break;
 		}
-		if (local_node->api_context->conns_count >= local_node->api_context->max_conns) { // limit reached.
-			libp2p_logger_error("api", "Limit of connections reached (%d).\n", local_node->api_context->max_conns);
-			close (s);
-			continue;
-		}
-
-		pthread_mutex_lock(&local_node->api_context->conns_lock);
-		for (i = 0 ; i < local_node->api_context->max_conns && local_node->api_context->conns[i] ; i++);
-		local_node->api_context->conns[i] = malloc (sizeof (struct s_conns));
-		if (!local_node->api_context->conns[i]) {
-			libp2p_logger_error("api", "Fail to allocate memory to accept connection.\n");
-			pthread_mutex_unlock(&local_node->api_context->conns_lock);
-			close (s);
-			continue;
+		if (context->shutting_down) {
+			break;
 		}
-		if (inet_ntop(AF_INET, &ipv4, client, INET_ADDRSTRLEN) == NULL)
-			strcpy(client, "UNKNOW");
-		local_node->api_context->conns[i]->socket = s;
-		local_node->api_context->conns[i]->ipv4   = ipv4;
-		local_node->api_context->conns[i]->port   = port;
-		// create a struct, which the thread is responsible to destroy
-		struct ApiConnectionParam* connection_param = (struct ApiConnectionParam*) malloc(sizeof(struct ApiConnectionParam));
-		if (connection_param == NULL) {
-			libp2p_logger_error("api", "api_listen_thread: Unable to allocate memory.\n");
-			pthread_mutex_unlock(&local_node->api_context->conns_lock);
-			close (s);
-			continue;
+		for (i = 0 ; i < n ; i++) {
+			if (events[i].data.u64 == API_EVENT_LISTEN) {
+				api_accept(local_node);
+			} else if (events[i].data.u64 != API_EVENT_WAKE) {
+				index = (int)events[i].data.u64;
+				pthread_mutex_lock(&context->conns_lock);
+				context->conns[index].state = API_CONN_BUSY;
+				context->ready[(context->ready_head + context->ready_count) % context->max_conns] = index;
+				context->ready_count++;
+				pthread_cond_signal(&context->ready_cond);
+				pthread_mutex_unlock(&context->conns_lock);
+			}
 		}
-		connection_param->index = i;
-		connection_param->this_node = local_node;
-		if (pthread_create(&(local_node->api_context->conns[i]->pthread), NULL, api_connection_thread, (void*)connection_param)) {
-			libp2p_logger_error("api", "Create pthread fail.\n");
-			free (local_node->api_context->conns[i]);
-			local_node->api_context->conns[i] = NULL;
-			local_node->api_context->conns_count--;
-			close(s);
-		} else {
-			local_node->api_context->conns_count++;
+		now = time(NULL);
+		if (now != last_expire) {
+			api_connections_expire(context, now);
+			last_expire = now;
 		}
-		libp2p_logger_debug("api", "API for %s: Accept connection %s:%d (%d/%d), pthread %d.\n", local_node->identity->peer->id, client, port, local_node->api_context->conns_count, local_node->api_context->max_conns, i+1);
-		pthread_mutex_unlock(&local_node->api_context->conns_lock);
 	}
-	api_connections_cleanup (local_node);
 	return NULL;
 }
 
@@ -690,11 +1486,45 @@ struct ApiContext* api_context_new() {
 		context->port = 0;
 		context->socket = 0;
 		context->timeout = 0;
+		context->api_thread = 0;
+		context->epoll_fd = -1;
+		context->wake_pipe[0] = -1;
+		context->wake_pipe[1] = -1;
+		context->shutting_down = 0;
+		context->free_slots = NULL;
+		context->free_count = 0;
+		context->ready = NULL;
+		context->ready_head = 0;
+		context->ready_count = 0;
+		context->num_workers = 0;
+		context->busy_workers = 0;
+		context->workers = NULL;
 		pthread_mutex_init(&context->conns_lock, NULL);
+		pthread_cond_init(&context->ready_cond, NULL);
 	}
 	return context;
 }
 
+void api_context_free(struct ApiContext* context) {
+	if (context != NULL) {
+		if (context->epoll_fd >= 0)
+			close(context->epoll_fd);
+		if (context->wake_pipe[0] >= 0)
+			close(context->wake_pipe[0]);
+		if (context->wake_pipe[1] >= 0)
+			close(context->wake_pipe[1]);
+		if (context->socket > 0)
+			close(context->socket);
+		free(context->conns);
+		free(context->free_slots);
+		free(context->ready);
+		free(context->workers);
+		pthread_mutex_destroy(&context->conns_lock);
+		pthread_cond_destroy(&context->ready_cond);
+		free(context);
+	}
+}
+
 /**
  * Start API interface daemon.
  * @param local_node the context
@@ -704,54 +1534,101 @@ struct ApiContext* api_context_new() {
  */
 int api_start (struct IpfsNode* local_node, int max_conns, int timeout)
 {
-	int s;
-	size_t alloc_size = sizeof(void*) * max_conns;
+	int s, i;
+	struct ApiContext *context;
+	struct epoll_event ev;
 
 	struct MultiAddress* my_address = multiaddress_new_from_string(local_node->repo->config->addresses->api);
 
 	char* ip = NULL;
 	multiaddress_get_ip_address(my_address, &ip);
 	int port = multiaddress_get_ip_port(my_address);
+	multiaddress_free(my_address);
 
-	local_node->api_context = api_context_new();
-	if (local_node->api_context == NULL) {
-		multiaddress_free(my_address);
+	context = api_context_new();
+	if (context == NULL) {
+		if (ip != NULL)
+			free(ip);
 		return 0;
 	}
+	local_node->api_context = context;
 
-	local_node->api_context->ipv4 = hostname_to_ip(ip); // api is listening only on loopback.
+	context->ipv4 = hostname_to_ip(ip); // api is listening only on loopback.
 	if (ip != NULL)
 		free(ip);
-	local_node->api_context->port = port;
+	context->port = port;
 
-	if ((s = socket_listen(socket_tcp4(), &(local_node->api_context->ipv4), &(local_node->api_context->port))) <= 0) {
+	if ((s = socket_listen(socket_tcp4(), &(context->ipv4), &(context->port))) <= 0) {
 		libp2p_logger_error("api", "Failed to init API. port: %d\n", port);
-		return 0;
+		goto fail;
+	}
+	// the event loop accepts only when epoll says a client is waiting.
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+
+	context->socket = s;
+	context->max_conns = max_conns;
+	context->timeout = timeout;
+	context->num_workers = max_conns < API_WORKERS ? max_conns : API_WORKERS;
+
+	context->conns = calloc (max_conns, sizeof (struct s_conns));
+	context->free_slots = malloc (sizeof (int) * max_conns);
+	context->ready = malloc (sizeof (int) * max_conns);
+	context->workers = calloc (context->num_workers, sizeof (pthread_t));
+	if (!context->conns || !context->free_slots || !context->ready || !context->workers) {
+		libp2p_logger_error("api", "Error allocating memory.\n");
+		goto fail;
+	}
+	// the lowest slots are handed out first.
+	for (i = 0 ; i < max_conns ; i++) {
+		context->free_slots[i] = max_conns - 1 - i;
 	}
+	context->free_count = max_conns;
 
-	local_node->api_context->socket = s;
-	local_node->api_context->max_conns = max_conns;
-	local_node->api_context->timeout = timeout;
+	context->epoll_fd = epoll_create1(0);
+	if (context->epoll_fd < 0 || pipe(context->wake_pipe) != 0) {
+		libp2p_logger_error("api", "Error creating epoll for API.\n");
+		goto fail;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u64 = API_EVENT_LISTEN;
+	if (epoll_ctl(context->epoll_fd, EPOLL_CTL_ADD, s, &ev) == -1) {
+		libp2p_logger_error("api", "Error adding API socket to epoll.\n");
+		goto fail;
+	}
+	ev.data.u64 = API_EVENT_WAKE;
+	if (epoll_ctl(context->epoll_fd, EPOLL_CTL_ADD, context->wake_pipe[0], &ev) == -1) {
+		libp2p_logger_error("api", "Error adding API socket to epoll.\n");
+		goto fail;
+	}
 
-	local_node->api_context->conns = malloc (alloc_size);
-	if (!local_node->api_context->conns) {
-		close (s);
-		libp2p_logger_error("api", "Error allocating memory.\n");
-		return 0;
+	for (i = 0 ; i < context->num_workers ; i++) {
+		if (pthread_create(&context->workers[i], NULL, api_worker_thread, (void*)local_node)) {
+			libp2p_logger_error("api", "Error creating worker thread for API.\n");
+			context->num_workers = i;
+			goto fail;
+		}
 	}
-	memset(local_node->api_context->conns, 0, alloc_size);
 
-	if (pthread_create(&local_node->api_context->api_thread, NULL, api_listen_thread, (void*)local_node)) {
-		close (s);
-		free (local_node->api_context->conns);
-		local_node->api_context->conns = NULL;
-		local_node->api_context->api_thread = 0;
+	if (pthread_create(&context->api_thread, NULL, api_listen_thread, (void*)local_node)) {
+		context->api_thread = 0;
 		libp2p_logger_error("api", "Error creating thread for API.\n");
-		return 0;
+		goto fail;
 	}
 
 	libp2p_logger_info("api", "API server listening on %d.\n", port);
 	return 1;
+
+fail:
+	pthread_mutex_lock(&context->conns_lock);
+	context->shutting_down = 1;
+	pthread_cond_broadcast(&context->ready_cond);
+	pthread_mutex_unlock(&context->conns_lock);
+	for (i = 0 ; i < context->num_workers ; i++) {
+		pthread_join(context->workers[i], NULL);
+	}
+	api_context_free(context);
+	local_node->api_context = NULL;
+	return 0;
 }
 
 /**
@@ -760,13 +1637,29 @@ int api_start (struct IpfsNode* local_node, int max_conns, int timeout)
  */
 int api_stop (struct IpfsNode *local_node)
 {
-	if (local_node->api_context->api_thread == 0) return 0;
-	shutdown(local_node->api_context->socket, SHUT_RDWR);
-	pthread_cancel(local_node->api_context->api_thread);
+	struct ApiContext *context = local_node->api_context;
+	int i;
+
+	if (context == NULL || context->api_thread == 0) return 0;
+
+	pthread_mutex_lock(&context->conns_lock);
+	context->shutting_down = 1;
+	pthread_cond_broadcast(&context->ready_cond);
+	pthread_mutex_unlock(&context->conns_lock);
+	if (write(context->wake_pipe[1], "", 1) != 1) {
+		libp2p_logger_error("api", "Unable to wake the API event loop.\n");
+	}
+
+	pthread_join(context->api_thread, NULL);
+	// workers finish the request they are serving.
+	for (i = 0 ; i < context->num_workers ; i++) {
+		pthread_join(context->workers[i], NULL);
+	}
 
 	api_connections_cleanup (local_node);
 
-	local_node->api_context->api_thread = 0;
+	api_context_free(context);
+	local_node->api_context = NULL;
 
 	return 1;
 }
@@ -3,21 +3,30 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <string.h>
 #include "libp2p/net/p2pnet.h"
 #include "libp2p/peer/peerstore.h"
 #include "ipfs/core/daemon.h"
 #include "ipfs/core/null.h" // for ipfs_null_shutdown
 #include "ipfs/core/ipfs_node.h"
 #include "ipfs/core/bootstrap.h"
+#include "ipfs/pin/gc.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 #include "ipfs/repo/init.h"
 #include "libp2p/utils/logger.h"
 
-int ipfs_daemon_start(char* repo_path) {
+/***
+ * Run the daemon until it is shut down
+ * @param repo_path the repo
+ * @param enable_gc true(1) to collect garbage in the background, every GCPeriod of the config
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_daemon_run(char* repo_path, int enable_gc) {
     int count_pths = 0, retVal = 0;
     pthread_t work_pths[MAX];
     struct IpfsNodeListenParams listen_param;
     struct MultiAddress* ma = NULL;
+    struct GcDaemon* gc_daemon = NULL;
 
     libp2p_logger_info("daemon", "Initializing daemon for %s...\n", repo_path);
 
@@ -39,6 +48,13 @@ int ipfs_daemon_start(char* repo_path) {
 
     local_node->routing->Bootstrap(local_node->routing);
 
+    if (enable_gc) {
+        unsigned long gc_period = GC_PERIOD_DEFAULT;
+        if (!ipfs_gc_parse_period(local_node->repo->config->datastore->gc_period, &gc_period))
+            libp2p_logger_info("daemon", "No GCPeriod in the config, collecting garbage every %lu seconds.\n", gc_period);
+        gc_daemon = ipfs_gc_daemon_start(local_node->repo, gc_period);
+    }
+
     libp2p_logger_info("daemon", "Daemon for %s is ready on port %d\n", listen_param.local_node->identity->peer->id, listen_param.port);
 
     // Wait for pthreads to finish.
@@ -53,6 +69,7 @@ int ipfs_daemon_start(char* repo_path) {
     exit:
 	libp2p_logger_debug("daemon", "Cleaning up daemon processes for %s\n", repo_path);
     // clean up
+    ipfs_gc_daemon_stop(gc_daemon);
     if (ma != NULL)
     	multiaddress_free(ma);
     if (local_node != NULL) {
@@ -62,6 +79,10 @@ int ipfs_daemon_start(char* repo_path) {
 
 }
 
+int ipfs_daemon_start(char* repo_path) {
+	return ipfs_daemon_run(repo_path, 0);
+}
+
 int ipfs_daemon_stop() {
 	return ipfs_null_shutdown();
 }
@@ -76,5 +97,10 @@ int ipfs_daemon (int argc, char **argv)
 		return 0;
 	}
 
-	return ipfs_daemon_start(repo_path);
+	int enable_gc = 0;
+	for(int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--enable-gc") == 0)
+			enable_gc = 1;
+
+	return ipfs_daemon_run(repo_path, enable_gc);
 }
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+
+#include "libp2p/os/memstream.h"
+#include "libp2p/utils/logger.h"
+#include "libp2p/utils/urlencode.h"
+#include "ipfs/blocks/blockstore.h"
+#include "ipfs/cid/cid.h"
+#include "ipfs/core/api.h"
+#include "ipfs/core/gateway.h"
+#include "ipfs/importer/exporter.h"
+#include "ipfs/importer/hamt.h"
+#include "ipfs/namesys/resolver.h"
+#include "ipfs/util/trace.h"
+
+/**
+ * The read-only gateway. Paths are resolved link by link from the root
+ * hash, and ranges of files are mapped to the blocks that hold them.
+ */
+
+int ipfs_core_gateway_is_path(const char* path)
+{
+	return cstrstart(path, GATEWAY_IPFS_PREFIX) || cstrstart(path, GATEWAY_IPNS_PREFIX);
+}
+
+/**
+ * Write all of a buffer, which can take more than one write.
+ * @param fd where to write.
+ * @param buf the bytes.
+ * @param size the number of bytes.
+ * @returns 1 when success or 0 if it fails.
+ */
+int ipfs_core_gateway_write(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (size > 0) {
+		n = write(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return 0;
+		}
+		p += n;
+		size -= n;
+	}
+	return 1;
+}
+
+/**
+ * Send bytes of a file straight to a socket, without copying them here.
+ * @param fd the socket.
+ * @param file the file.
+ * @param pos where the bytes start in the file.
+ * @param size the number of bytes.
+ * @returns 1 when success or 0 if it fails.
+ */
+int ipfs_core_gateway_sendfile(int fd, int file, off_t pos, size_t size)
+{
+	ssize_t n;
+
+	while (size > 0) {
+		n = sendfile(fd, file, &pos, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return 0;
+		}
+		size -= n;
+	}
+	return 1;
+}
+
+int ipfs_core_gateway_range_parse(const char* value, size_t size, size_t* first, size_t* last)
+{
+	char *end;
+	unsigned long long a, b;
+
+	if (value == NULL || !cstrstart(value, "bytes=")) {
+		return 0;
+	}
+	value += sizeof("bytes=") - 1;
+	if (strchr(value, ',') != NULL) {
+		return 0; // more than one range
+	}
+	if (*value == '-') {
+		// the last bytes of the file
+		b = strtoull(value + 1, &end, 10);
+		if (end == value + 1 || (*end != '\0' && *end != '\r')) {
+			return 0;
+		}
+		if (b == 0 || size == 0) {
+			return -1;
+		}
+		*first = b >= size ? 0 : size - b;
+		*last = size - 1;
+		return 1;
+	}
+	if (*value < '0' || *value > '9') {
+		return 0;
+	}
+	a = strtoull(value, &end, 10);
+	if (*end != '-') {
+		return 0;
+	}
+	value = end + 1;
+	if (*value == '\0' || *value == '\r') {
+		b = size - 1; // to the end of the file
+	} else {
+		b = strtoull(value, &end, 10);
+		if (end == value || (*end != '\0' && *end != '\r') || b < a) {
+			return 0;
+		}
+	}
+	if (a >= size) {
+		return -1;
+	}
+	*first = a;
+	*last = b >= size ? size - 1 : b;
+	return 1;
+}
+
+size_t ipfs_core_gateway_file_size(const struct UnixFS* unix_fs)
+{
+	struct UnixFSBlockSizeNode *block_size;
+	size_t size;
+
+	if (unix_fs->file_size > 0) {
+		return unix_fs->file_size;
+	}
+	size = unix_fs->bytes_size;
+	for (block_size = unix_fs->block_size_head; block_size != NULL; block_size = block_size->next) {
+		size += block_size->block_size;
+	}
+	return size;
+}
+
+int ipfs_core_gateway_send_node(struct IpfsNode* local_node, int fd, struct HashtableNode* node, size_t* offset, size_t* length);
+
+/**
+ * Send the part of the range that is below a link. A leaf stored here is
+ * sent from the file of its block.
+ * @param local_node the context.
+ * @param fd the socket.
+ * @param link the link to the next node of the file.
+ * @param offset where the range starts, relative to the node. Reduced by what the node holds.
+ * @param length what is left of the range. Reduced by what was sent.
+ * @returns 1 when success or 0 if it fails.
+ */
+int ipfs_core_gateway_send_link(struct IpfsNode* local_node, int fd, struct NodeLink* link, size_t* offset, size_t* length)
+{
+	struct HashtableNode *child = NULL;
+	int file, ok;
+	off_t pos;
+	size_t size, n;
+
+	if (ipfs_blockstore_locate_unixfs_data(link->hash, link->hash_size, local_node->repo, &file, &pos, &size)) {
+		if (*offset >= size) {
+			*offset -= size;
+			close(file);
+			return 1;
+		}
+		n = size - *offset;
+		if (n > *length) {
+			n = *length;
+		}
+		ok = ipfs_core_gateway_sendfile(fd, file, pos + *offset, n);
+		close(file);
+		*offset = 0;
+		*length -= n;
+		return ok;
+	}
+	if (!ipfs_exporter_get_node(local_node, link->hash, link->hash_size, &child)) {
+		libp2p_logger_error("gateway", "Unable to get a block of the file.\n");
+		return 0;
+	}
+	ok = ipfs_core_gateway_send_node(local_node, fd, child, offset, length);
+	ipfs_hashtable_node_free(child);
+	return ok;
+}
+
+/**
+ * Send the part of the range that is below a node. Its own data comes
+ * first, then what is below its links, in order.
+ * @param local_node the context.
+ * @param fd the socket.
+ * @param node the node.
+ * @param offset where the range starts, relative to the node. Reduced by what the node holds.
+ * @param length what is left of the range. Reduced by what was sent.
+ * @returns 1 when success or 0 if it fails.
+ */
+int ipfs_core_gateway_send_node(struct IpfsNode* local_node, int fd, struct HashtableNode* node, size_t* offset, size_t* length)
+{
+	struct UnixFS *unix_fs = NULL;
+	struct UnixFSBlockSizeNode *block_size = NULL;
+	struct NodeLink *link;
+	size_t n;
+	int ok = 1;
+
+	if (node->data_size > 0) {
+		if (!ipfs_unixfs_protobuf_decode(node->data, node->data_size, &unix_fs)) {
+			return 0;
+		}
+		if (*offset < unix_fs->bytes_size) {
+			n = unix_fs->bytes_size - *offset;
+			if (n > *length) {
+				n = *length;
+			}
+			ok = ipfs_core_gateway_write(fd, unix_fs->bytes + *offset, n);
+			*offset = 0;
+			*length -= n;
+		} else {
+			*offset -= unix_fs->bytes_size;
+		}
+		block_size = unix_fs->block_size_head;
+	}
+	for (link = node->head_link; ok && link != NULL && *length > 0; link = link->next) {
+		if (block_size != NULL) {
+			n = block_size->block_size;
+			block_size = block_size->next;
+			if (*offset >= n) {
+				*offset -= n; // the whole block is before the range
+				continue;
+			}
+		}
+		ok = ipfs_core_gateway_send_link(local_node, fd, link, offset, length);
+	}
+	if (unix_fs != NULL) {
+		ipfs_unixfs_free(unix_fs);
+	}
+	return ok;
+}
+
+int ipfs_core_gateway_send_range(struct IpfsNode* local_node, int fd, struct HashtableNode* node, size_t offset, size_t length)
+{
+	if (!ipfs_core_gateway_send_node(local_node, fd, node, &offset, &length)) {
+		return 0;
+	}
+	return length == 0;
+}
+
+/**
+ * Turn an /ipns/ path into the /ipfs/ path it points to.
+ * @param local_node the context.
+ * @param path the path, i.e. /ipns/<name>/dir/file
+ * @returns the /ipfs/ path, to be freed by the caller, or NULL if it fails.
+ */
+char *ipfs_core_gateway_resolve_ipns(struct IpfsNode* local_node, const char* path)
+{
+	const char *rest = strchr(path + sizeof(GATEWAY_IPNS_PREFIX) - 1, '/');
+	const char *prefix;
+	char *resolved = NULL, *result;
+	size_t name_size = rest ? (size_t)(rest - path) : strlen(path);
+	char name[name_size + 1];
+
+	memcpy(name, path, name_size);
+	name[name_size] = '\0';
+	if (rest == NULL) {
+		rest = "";
+	}
+	if (!ipfs_namesys_resolver_resolve(local_node, name, 1, &resolved)) {
+		return NULL;
+	}
+	// names can point to a bare hash
+	prefix = resolved[0] == '/' ? "" : GATEWAY_IPFS_PREFIX;
+	result = malloc(strlen(prefix) + strlen(resolved) + strlen(rest) + 1);
+	if (result) {
+		sprintf(result, "%s%s%s", prefix, resolved, rest);
+		if (!cstrstart(result, GATEWAY_IPFS_PREFIX)) {
+			free(result);
+			result = NULL;
+		}
+	}
+	free(resolved);
+	return result;
+}
+
+/**
+ * Find the node of an /ipfs/ path, following the links of directories by name.
+ * @param local_node the context.
+ * @param ipfs_path the path, i.e. /ipfs/<hash>/dir/file
+ * @param node where to put the node.
+ * @param name where to put the last part of the path, to be freed by the caller.
+ * @returns 1 when success or 0 if it was not found.
+ */
+int ipfs_core_gateway_find(struct IpfsNode* local_node, const char* ipfs_path, struct HashtableNode** node, char** name)
+{
+	struct HashtableNode *next;
+	struct NodeLink *link;
+	struct Cid *cid = NULL;
+	char *path, *segment, *last = "", *save = NULL;
+
+	*node = NULL;
+	*name = NULL;
+	path = strdup(ipfs_path + sizeof(GATEWAY_IPFS_PREFIX) - 1);
+	if (!path) {
+		return 0;
+	}
+	segment = strtok_r(path, "/", &save);
+	if (!segment || !ipfs_cid_decode_hash_from_base58((unsigned char*)segment, strlen(segment), &cid)) {
+		goto fail;
+	}
+	next = NULL;
+	if (!ipfs_exporter_get_node(local_node, cid->hash, cid->hash_length, &next)) {
+		goto fail;
+	}
+	*node = next;
+	while ((segment = strtok_r(NULL, "/", &save)) != NULL) {
+		next = NULL;
+		if (ipfs_hamt_is_shard(*node)) {
+			int found = ipfs_hamt_find(*node, segment, local_node, &link)
+					&& ipfs_exporter_get_node(local_node, link->hash, link->hash_size, &next);
+			ipfs_node_link_free(link);
+			if (!found) {
+				goto fail;
+			}
+		} else {
+			if (!ipfs_hashtable_node_is_directory(*node)) {
+				goto fail;
+			}
+			link = ipfs_hashtable_node_get_link_by_name(*node, segment);
+			if (!link || !ipfs_exporter_get_node(local_node, link->hash, link->hash_size, &next)) {
+				goto fail;
+			}
+		}
+		ipfs_hashtable_node_free(*node);
+		*node = next;
+		last = segment;
+	}
+	*name = strdup(last);
+	if (!*name) {
+		goto fail;
+	}
+	ipfs_cid_free(cid);
+	free(path);
+	return 1;
+
+fail:
+	if (*node) {
+		ipfs_hashtable_node_free(*node);
+		*node = NULL;
+	}
+	if (cid) {
+		ipfs_cid_free(cid);
+	}
+	free(path);
+	return 0;
+}
+
+/**
+ * Guess the type of a file from its name.
+ * @param name the name of the file.
+ * @returns the content type.
+ */
+const char *ipfs_core_gateway_content_type(const char* name)
+{
+	static const char *types[][2] = {
+		{ ".html", "text/html; charset=utf-8" },
+		{ ".htm",  "text/html; charset=utf-8" },
+		{ ".css",  "text/css; charset=utf-8" },
+		{ ".js",   "application/javascript" },
+		{ ".json", "application/json" },
+		{ ".txt",  "text/plain; charset=utf-8" },
+		{ ".svg",  "image/svg+xml" },
+		{ ".png",  "image/png" },
+		{ ".jpg",  "image/jpeg" },
+		{ ".jpeg", "image/jpeg" },
+		{ ".gif",  "image/gif" },
+		{ ".pdf",  "application/pdf" },
+		{ ".mp4",  "video/mp4" },
+		{ NULL, NULL }
+	};
+	const char *ext = strrchr(name, '.');
+	int i;
+
+	if (ext) {
+		for (i = 0; types[i][0]; i++) {
+			if (strcasecmp(ext, types[i][0]) == 0) {
+				return types[i][1];
+			}
+		}
+	}
+	return "application/octet-stream";
+}
+
+/**
+ * Write text into html, escaping what would be markup.
+ * @param out where to write.
+ * @param text the text.
+ */
+void ipfs_core_gateway_html_escape(FILE *out, const char *text)
+{
+	for (; *text; text++) {
+		switch (*text) {
+			case '<': fputs("&lt;", out); break;
+			case '>': fputs("&gt;", out); break;
+			case '&': fputs("&amp;", out); break;
+			case '"': fputs("&quot;", out); break;
+			default: fputc(*text, out);
+		}
+	}
+}
+
+/**
+ * Write an entry of a directory listing.
+ * @param link the link to the entry.
+ * @param out where to write.
+ * @returns 1, to go on to the next entry.
+ */
+static int ipfs_core_gateway_dir_entry(struct NodeLink* link, void* out)
+{
+	char *href;
+
+	if (!link->name) {
+		return 1;
+	}
+	href = libp2p_utils_url_encode(link->name);
+	fputs("<li><a href=\"", out);
+	ipfs_core_gateway_html_escape(out, href ? href : link->name);
+	fputs("\">", out);
+	ipfs_core_gateway_html_escape(out, link->name);
+	fprintf(out, "</a> %lu</li>\n", (unsigned long)link->t_size);
+	free(href);
+	return 1;
+}
+
+/**
+ * Build the html page that lists the links of a directory.
+ * @param local_node the context, to get the shards of a sharded directory.
+ * @param node the directory.
+ * @param path the path of the directory, as requested.
+ * @param size where to put the size of the page.
+ * @returns the page, to be freed by the caller, or NULL if it fails.
+ */
+char *ipfs_core_gateway_dir_listing(struct IpfsNode* local_node, struct HashtableNode* node, const char* path, size_t *size)
+{
+	struct NodeLink *link;
+	char *page = NULL;
+	int ok = 1;
+	FILE *out = open_memstream(&page, size);
+
+	if (!out) {
+		return NULL;
+	}
+	fputs("<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>", out);
+	ipfs_core_gateway_html_escape(out, path);
+	fputs("</title></head><body>\n<h1>Index of ", out);
+	ipfs_core_gateway_html_escape(out, path);
+	fputs("</h1>\n<ul>\n", out);
+	if (ipfs_hamt_is_shard(node)) {
+		ok = ipfs_hamt_foreach(node, local_node, ipfs_core_gateway_dir_entry, out);
+	} else {
+		for (link = node->head_link; link != NULL; link = link->next) {
+			ipfs_core_gateway_dir_entry(link, out);
+		}
+	}
+	fputs("</ul>\n</body></html>\n", out);
+	if (fclose(out) != 0 || !ok) {
+		free(page);
+		return NULL;
+	}
+	return page;
+}
+
+/**
+ * Write the head of a gateway response.
+ * @param local_node the context, for the headers set in the config.
+ * @param fd the socket.
+ * @param req the request being answered.
+ * @param status the status, i.e. "200 OK".
+ * @param content_type the type of the body.
+ * @param content_length the size of the body.
+ * @param etag the hash of what is sent.
+ * @param immutable true if what is sent can never change.
+ * @param content_range the value of the Content-Range header, or NULL.
+ * @param keep_alive true if the connection stays open after the response.
+ * @returns 1 when success or 0 if it fails.
+ */
+int ipfs_core_gateway_send_head(struct IpfsNode* local_node, int fd, struct s_request *req, const char *status,
+		const char *content_type, size_t content_length, const char *etag, int immutable,
+		const char *content_range, int keep_alive)
+{
+	struct HTTPHeaders *headers = NULL;
+	char *head = NULL;
+	size_t head_size = 0;
+	FILE *out = open_memstream(&head, &head_size);
+	int i, ok;
+
+	if (!out) {
+		return 0;
+	}
+	fprintf(out, "%s %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %lu\r\n"
+		"Accept-Ranges: bytes\r\n"
+		"ETag: \"%s\"\r\n"
+		"X-Ipfs-Path: %s\r\n"
+		, req->buf + req->http_ver, status, content_type, (unsigned long)content_length, etag, req->buf + req->path);
+	if (immutable) {
+		fputs("Cache-Control: " GATEWAY_CACHE_IMMUTABLE "\r\n", out);
+	}
+	if (content_range) {
+		fprintf(out, "Content-Range: %s\r\n", content_range);
+	}
+	if (local_node->repo->config->gateway) {
+		headers = local_node->repo->config->gateway->http_headers;
+	}
+	for (i = 0; headers && i < headers->num_elements; i++) {
+		fprintf(out, "%s: %s\r\n", headers->headers[i]->header, headers->headers[i]->value);
+	}
+	fprintf(out, "Server: c-ipfs/0.0.0-dev\r\n"
+		"X-Ipfs-Trace: %016llx\r\n"
+		"Connection: %s\r\n"
+		"\r\n"
+		, (unsigned long long)ipfs_util_trace_id(), keep_alive ? "keep-alive" : "close");
+	if (fclose(out) != 0) {
+		free(head);
+		return 0;
+	}
+	libp2p_logger_debug("gateway", "resp = {\n%s\n}\n", head);
+	ok = ipfs_core_gateway_write(fd, head, head_size);
+	free(head);
+	return ok;
+}
+
+int ipfs_core_gateway_process(struct IpfsNode* local_node, int fd, struct s_request* req, int keep_alive)
+{
+	struct HashtableNode *node = NULL, *index = NULL;
+	struct NodeLink *link;
+	struct UnixFS *unix_fs = NULL;
+	char *path, *ipfs_path = NULL, *name = NULL, *page = NULL;
+	char *p, etag[100], content_range[80];
+	const char *content_type;
+	size_t size = 0, first = 0, last = 0;
+	int head_only, immutable, r;
+
+	head_only = strcmp(req->buf + req->method, "HEAD") == 0;
+	path = libp2p_utils_url_decode(req->buf + req->path);
+	if (!path) {
+		write_cstr(fd, HTTP_500);
+		return 0;
+	}
+	immutable = cstrstart(path, GATEWAY_IPFS_PREFIX);
+	if (immutable) {
+		ipfs_path = strdup(path);
+	} else {
+		ipfs_path = ipfs_core_gateway_resolve_ipns(local_node, path);
+	}
+	if (!ipfs_path || !ipfs_core_gateway_find(local_node, ipfs_path, &node, &name)) {
+		write_cstr(fd, HTTP_404);
+		keep_alive = 0;
+		goto exit;
+	}
+
+	if (ipfs_hashtable_node_is_directory(node) || ipfs_hamt_is_shard(node)) {
+		if (path[strlen(path) - 1] != '/') {
+			// so that relative links in the directory work
+			char resp[MAX_READ];
+			snprintf(resp, sizeof(resp), "%s 301 Moved Permanently\r\n"
+				"Location: %s/\r\n"
+				"Content-Length: 0\r\n"
+				"Connection: close\r\n"
+				"\r\n"
+				, req->buf + req->http_ver, req->buf + req->path);
+			ipfs_core_gateway_write(fd, resp, strlen(resp));
+			keep_alive = 0;
+			goto exit;
+		}
+		if (ipfs_hamt_is_shard(node)) {
+			struct NodeLink *found = NULL;
+			if (!ipfs_hamt_find(node, "index.html", local_node, &found)
+					|| !ipfs_exporter_get_node(local_node, found->hash, found->hash_size, &index)) {
+				index = NULL;
+			}
+			ipfs_node_link_free(found);
+		} else {
+			link = ipfs_hashtable_node_get_link_by_name(node, "index.html");
+			if (!link || !ipfs_exporter_get_node(local_node, link->hash, link->hash_size, &index)) {
+				index = NULL;
+			}
+		}
+		if (index) {
+			ipfs_hashtable_node_free(node);
+			node = index;
+			free(name);
+			name = strdup("index.html");
+		} else {
+			ipfs_cid_hash_to_base58(node->hash, node->hash_size, (unsigned char*)etag, sizeof(etag));
+			page = ipfs_core_gateway_dir_listing(local_node, node, path, &size);
+			if (!page) {
+				write_cstr(fd, HTTP_500);
+				keep_alive = 0;
+				goto exit;
+			}
+			if (!ipfs_core_gateway_send_head(local_node, fd, req, "200 OK", "text/html; charset=utf-8", size, etag, immutable, NULL, keep_alive)
+					|| (!head_only && !ipfs_core_gateway_write(fd, page, size))) {
+				keep_alive = 0;
+			}
+			goto exit;
+		}
+	}
+
+	if (!ipfs_cid_hash_to_base58(node->hash, node->hash_size, (unsigned char*)etag, sizeof(etag))) {
+		write_cstr(fd, HTTP_500);
+		keep_alive = 0;
+		goto exit;
+	}
+	p = header_value_cmp(req, "If-None-Match:", "\"");
+	if (p && strncmp(p + 1, etag, strlen(etag)) == 0 && p[strlen(etag) + 1] == '"') {
+		char resp[MAX_READ];
+		snprintf(resp, sizeof(resp), "%s 304 Not Modified\r\n"
+			"ETag: \"%s\"\r\n"
+			"Connection: %s\r\n"
+			"\r\n"
+			, req->buf + req->http_ver, etag, keep_alive ? "keep-alive" : "close");
+		if (!ipfs_core_gateway_write(fd, resp, strlen(resp))) {
+			keep_alive = 0;
+		}
+		goto exit;
+	}
+
+	if (node->data_size > 0 && !ipfs_unixfs_protobuf_decode(node->data, node->data_size, &unix_fs)) {
+		write_cstr(fd, HTTP_500);
+		keep_alive = 0;
+		goto exit;
+	}
+	size = unix_fs ? ipfs_core_gateway_file_size(unix_fs) : 0;
+	content_type = ipfs_core_gateway_content_type(name);
+
+	r = ipfs_core_gateway_range_parse(str_tok(req->buf + req->header, "Range:"), size, &first, &last);
+	if (r < 0) {
+		char resp[MAX_READ];
+		snprintf(resp, sizeof(resp), "%s 416 Range Not Satisfiable\r\n"
+			"Content-Range: bytes */%lu\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: close\r\n"
+			"\r\n"
+			, req->buf + req->http_ver, (unsigned long)size);
+		ipfs_core_gateway_write(fd, resp, strlen(resp));
+		keep_alive = 0;
+		goto exit;
+	}
+	if (r > 0) {
+		snprintf(content_range, sizeof(content_range), "bytes %lu-%lu/%lu", (unsigned long)first, (unsigned long)last, (unsigned long)size);
+		r = ipfs_core_gateway_send_head(local_node, fd, req, "206 Partial Content", content_type, last - first + 1, etag, immutable, content_range, keep_alive);
+		size = last - first + 1;
+	} else {
+		r = ipfs_core_gateway_send_head(local_node, fd, req, "200 OK", content_type, size, etag, immutable, NULL, keep_alive);
+	}
+	if (!r) {
+		keep_alive = 0;
+	} else if (!head_only && size > 0 && !ipfs_core_gateway_send_range(local_node, fd, node, first, size)) {
+		// the head was sent, closing tells the client the body is short
+		libp2p_logger_error("gateway", "Unable to send the whole file.\n");
+		keep_alive = 0;
+	}
+
+exit:
+	if (unix_fs) {
+		ipfs_unixfs_free(unix_fs);
+	}
+	if (node) {
+		ipfs_hashtable_node_free(node);
+	}
+	free(page);
+	free(name);
+	free(ipfs_path);
+	free(path);
+	return keep_alive;
+}
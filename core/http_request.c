@@ -1,15 +1,24 @@
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include "libp2p/os/memstream.h"
 #include "libp2p/utils/vector.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/cid/cid.h"
+#include "ipfs/core/api.h"
 #include "ipfs/core/http_request.h"
+#include "ipfs/exchange/bitswap/bitswap.h"
+#include "ipfs/exchange/bitswap/peer_request_queue.h"
 #include "ipfs/importer/exporter.h"
+#include "ipfs/merkledag/node.h"
 #include "ipfs/namesys/resolver.h"
 #include "ipfs/namesys/publisher.h"
+#include "ipfs/pin/gc.h"
 #include "ipfs/routing/routing.h"
+#include "ipfs/util/memory.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
 
 /**
  * Handles HttpRequest and HttpParam
@@ -63,6 +72,9 @@ struct HttpResponse* ipfs_core_http_response_new() {
 		response->content_type = NULL;
 		response->bytes = NULL;
 		response->bytes_size = 0;
+		response->stream_body = NULL;
+		response->stream_context = NULL;
+		response->stream_context_free = NULL;
 	}
 	return response;
 }
@@ -72,6 +84,8 @@ void ipfs_core_http_response_free(struct HttpResponse* response) {
 		// NOTE: content_type should not be dynamically allocated
 		if (response->bytes != NULL)
 			free(response->bytes);
+		if (response->stream_context != NULL && response->stream_context_free != NULL)
+			response->stream_context_free(response->stream_context);
 		free(response);
 	}
 }
@@ -150,6 +164,21 @@ int ipfs_core_http_process_name(struct IpfsNode* local_node, struct HttpRequest*
 	return retVal;
 }
 
+/***
+ * Write the file of a HashtableNode, and the nodes it links to
+ * @param local_node the context
+ * @param context the HashtableNode
+ * @param out where to write the file
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_object_cat_stream(struct IpfsNode* local_node, void* context, FILE* out) {
+	return ipfs_exporter_cat_node((struct HashtableNode*)context, local_node, out);
+}
+
+void ipfs_core_http_object_cat_free(void* context) {
+	ipfs_hashtable_node_free((struct HashtableNode*)context);
+}
+
 /***
  * Handle processing of the "object" command
  * @param local_node the context
@@ -169,13 +198,24 @@ int ipfs_core_http_process_object(struct IpfsNode* local_node, struct HttpReques
 				cid = NULL;
 				return 0;
 			}
+			// find the block now, so that a missing one is a 404. The rest is streamed.
+			struct HashtableNode* read_node = NULL;
+			if (!ipfs_exporter_get_node(local_node, cid->hash, cid->hash_length, &read_node)) {
+				ipfs_cid_free(cid);
+				return 0;
+			}
+			ipfs_cid_free(cid);
 			*response = ipfs_core_http_response_new();
 			struct HttpResponse* res = *response;
+			if (res == NULL) {
+				ipfs_hashtable_node_free(read_node);
+				return 0;
+			}
 			res->content_type = "application/json";
-			FILE* response_file = open_memstream((char**)&res->bytes, &res->bytes_size);
-			retVal = ipfs_exporter_object_cat_to_file(local_node, cid->hash, cid->hash_length, response_file);
-			ipfs_cid_free(cid);
-			fclose(response_file);
+			res->stream_body = ipfs_core_http_object_cat_stream;
+			res->stream_context = read_node;
+			res->stream_context_free = ipfs_core_http_object_cat_free;
+			retVal = 1;
 		}
 	}
 	return retVal;
@@ -355,6 +395,124 @@ int ipfs_core_http_process_swarm(struct IpfsNode* local_node, struct HttpRequest
 	return retVal;
 }
 
+/***
+ * Collect the garbage of the repo, at a rate that leaves room for the rest of the node
+ * @param local_node the context
+ * @param request the request
+ * @param resp where to put the results
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_process_repo_gc(struct IpfsNode* local_node, struct HttpRequest* request, struct HttpResponse** resp) {
+	struct GcOptions options = { GC_BATCH_SIZE, GC_RATE, NULL };
+	struct GcResult result;
+	if (!ipfs_gc_collect(local_node->repo, &options, &result))
+		return 0;
+	*resp = ipfs_core_http_response_new();
+	struct HttpResponse* response = *resp;
+	if (response == NULL)
+		return 0;
+	response->content_type = "application/json";
+	char* json = "{ \"Removed\": %lu, \"Freed\": %llu, \"Kept\": %lu }";
+	response->bytes_size = strlen(json) + 60;
+	response->bytes = (uint8_t*) malloc(response->bytes_size);
+	if (response->bytes == NULL) {
+		response->bytes_size = 0;
+		response->content_type = NULL;
+		return 0;
+	}
+	response->bytes_size = sprintf((char*)response->bytes, json, (unsigned long)result.removed, result.bytes_freed, (unsigned long)result.kept);
+	return 1;
+}
+
+int ipfs_core_http_process_repo(struct IpfsNode* local_node, struct HttpRequest* request, struct HttpResponse** response) {
+	int retVal = 0;
+	if (request->sub_command != NULL && strcmp(request->sub_command, "gc") == 0) {
+		retVal = ipfs_core_http_process_repo_gc(local_node, request, response);
+	}
+	return retVal;
+}
+
+/***
+ * Write the metrics of the node, in the Prometheus text format
+ * @param local_node the context
+ * @param context not used
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_metrics_stream(struct IpfsNode* local_node, void* context, FILE* out) {
+	if (!ipfs_util_metrics_write(out) || !ipfs_util_memory_write(out))
+		return 0;
+	if (local_node->api_context != NULL && !api_metrics_write(local_node->api_context, out))
+		return 0;
+	if (local_node->exchange != NULL) {
+		struct BitswapContext* bitswapContext = (struct BitswapContext*)local_node->exchange->exchangeContext;
+		if (!ipfs_bitswap_peer_request_queue_metrics(bitswapContext->peerRequestQueue, out))
+			return 0;
+	}
+	return 1;
+}
+
+/***
+ * Answer /api/v0/metrics
+ * @param local_node the context
+ * @param request the request
+ * @param response the response, whose body is written as it is sent
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_process_metrics(struct IpfsNode* local_node, struct HttpRequest* request, struct HttpResponse** response) {
+	*response = ipfs_core_http_response_new();
+	if (*response == NULL)
+		return 0;
+	(*response)->content_type = METRICS_CONTENT_TYPE;
+	(*response)->stream_body = ipfs_core_http_metrics_stream;
+	return 1;
+}
+
+/***
+ * Write the spans in the ring buffer, as Chrome trace JSON
+ * @param local_node the context
+ * @param context the trace to write, or NULL for all of them
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_trace_stream(struct IpfsNode* local_node, void* context, FILE* out) {
+	return ipfs_util_trace_write(out, context != NULL ? *(uint64_t*)context : 0);
+}
+
+/***
+ * Answer /api/v0/trace, with an optional argument of the trace to write,
+ * as found in the X-Ipfs-Trace header of a response
+ * @param local_node the context
+ * @param request the request
+ * @param response the response, whose body is written as it is sent
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_core_http_process_trace(struct IpfsNode* local_node, struct HttpRequest* request, struct HttpResponse** response) {
+	uint64_t* trace_id = NULL;
+	if (request->arguments->total > 0) {
+		char* arg = (char*)libp2p_utils_vector_get(request->arguments, 0);
+		char* end = NULL;
+		trace_id = (uint64_t*) malloc(sizeof(uint64_t));
+		if (trace_id == NULL)
+			return 0;
+		*trace_id = strtoull(arg, &end, 16);
+		if (end == arg || *end != '\0') {
+			free(trace_id);
+			return 0;
+		}
+	}
+	*response = ipfs_core_http_response_new();
+	if (*response == NULL) {
+		free(trace_id);
+		return 0;
+	}
+	(*response)->content_type = "application/json";
+	(*response)->stream_body = ipfs_core_http_trace_stream;
+	(*response)->stream_context = trace_id;
+	(*response)->stream_context_free = free;
+	return 1;
+}
+
 /***
  * Process the parameters passed in from an http request
  * @param local_node the context
@@ -375,6 +533,12 @@ int ipfs_core_http_request_process(struct IpfsNode* local_node, struct HttpReque
 		retVal = ipfs_core_http_process_dht(local_node, request, response);
 	} else if (strcmp(request->command, "swarm") == 0) {
 		retVal = ipfs_core_http_process_swarm(local_node, request, response);
+	} else if (strcmp(request->command, "repo") == 0) {
+		retVal = ipfs_core_http_process_repo(local_node, request, response);
+	} else if (strcmp(request->command, "metrics") == 0) {
+		retVal = ipfs_core_http_process_metrics(local_node, request, response);
+	} else if (strcmp(request->command, "trace") == 0) {
+		retVal = ipfs_core_http_process_trace(local_node, request, response);
 	}
 	return retVal;
 }
@@ -407,143 +571,241 @@ char* ipfs_core_http_request_build_url_start(struct IpfsNode* local_node) {
 }
 
 /***
- * Adds commands to url
- * @param request the request
- * @param url the starting url, and will hold the results (i.e. http://127.0.0.1:5001/api/v0/<command>/<sub_command>
- * @returns true(1) on success, otherwise false(0)
+ * Build a new HttpClient, that keeps its connection to the API open between requests
+ * @param local_node the context, for the address of the API
+ * @returns the new client, or NULL on error
+ */
+struct HttpClient* ipfs_core_http_client_new(struct IpfsNode* local_node) {
+	struct HttpClient* client = (struct HttpClient*) malloc(sizeof(struct HttpClient));
+	if (client == NULL)
+		return NULL;
+	client->base_url = ipfs_core_http_request_build_url_start(local_node);
+	client->url = NULL;
+	client->url_size = 0;
+	client->curl = curl_easy_init();
+	if (client->base_url == NULL || client->curl == NULL) {
+		ipfs_core_http_client_free(client);
+		return NULL;
+	}
+	// requests are small, don't wait to fill a packet
+	curl_easy_setopt(client->curl, CURLOPT_TCP_NODELAY, 1L);
+	curl_easy_setopt(client->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(client->curl, CURLOPT_NOSIGNAL, 1L);
+	pthread_mutex_init(&client->lock, NULL);
+	return client;
+}
+
+/***
+ * Free the resources of a HttpClient, closing its connection
+ * @param client the client
  */
-int ipfs_core_http_request_add_commands(struct HttpRequest* request, char** url) {
-	// command
-	int addl_length = strlen(request->command) + 2;
-	char* string1 = (char*) malloc(strlen(*url) + addl_length);
-	if (string1 != NULL) {
-		sprintf(string1, "%s/%s", *url, request->command);
-		free(*url);
-		*url = string1;
-		// sub_command
-		if (request->sub_command != NULL) {
-			addl_length = strlen(request->sub_command) + 2;
-			string1 = (char*) malloc(strlen(*url) + addl_length);
-			sprintf(string1, "%s/%s", *url, request->sub_command);
-			free(*url);
-			*url = string1;
+void ipfs_core_http_client_free(struct HttpClient* client) {
+	if (client != NULL) {
+		if (client->curl != NULL) {
+			curl_easy_cleanup(client->curl);
+			pthread_mutex_destroy(&client->lock);
 		}
+		free(client->base_url);
+		free(client->url);
+		free(client);
 	}
-	return string1 != NULL;
 }
 
+static pthread_mutex_t http_client_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /***
- * Add parameters and arguments to the URL
+ * Get the client of the node, building it on first use
+ * @param local_node the context
+ * @returns the client, or NULL on error
+ */
+struct HttpClient* ipfs_core_http_client_get(struct IpfsNode* local_node) {
+	pthread_mutex_lock(&http_client_lock);
+	if (local_node->http_client == NULL)
+		local_node->http_client = ipfs_core_http_client_new(local_node);
+	pthread_mutex_unlock(&http_client_lock);
+	return local_node->http_client;
+}
+
+/***
+ * Build the url of a request in the buffer of the client, that is reused between requests
+ * (i.e. http://127.0.0.1:5001/api/v0/<command>/<sub_command>/<name>=<value>?arg=<arg>)
+ * @param client the client
  * @param request the request
- * @param url the url to continue to build
+ * @returns true(1) on success, otherwise false(0)
  */
-int ipfs_core_http_request_add_parameters(struct HttpRequest* request, char** url) {
-	// params
+int ipfs_core_http_request_build_url(struct HttpClient* client, struct HttpRequest* request) {
+	size_t size = strlen(client->base_url) + strlen(request->command) + 2;
+	if (request->sub_command != NULL)
+		size += strlen(request->sub_command) + 1;
 	if (request->params != NULL) {
 		for (int i = 0; i < request->params->total; i++) {
 			struct HttpParam* curr_param = (struct HttpParam*) libp2p_utils_vector_get(request->params, i);
-			int len = strlen(curr_param->name) + strlen(curr_param->value) + 2;
-			char* str = (char*) malloc(strlen(*url) + len);
-			if (str == NULL) {
-				return 0;
-			}
-			sprintf(str, "%s/%s=%s", *url, curr_param->name, curr_param->value);
-			free(*url);
-			*url = str;
+			size += strlen(curr_param->name) + strlen(curr_param->value) + 2;
 		}
 	}
-	// args
 	if (request->arguments != NULL) {
-		int isFirst = 1;
-		for(int i = 0; i < request->arguments->total; i++) {
-			char* arg = (char*) libp2p_utils_vector_get(request->arguments, i);
-			int len = strlen(arg) + strlen(*url) + 6;
-			char* str = (char*) malloc(len);
-			if (str == NULL)
-				return 0;
-			if (isFirst)
-				sprintf(str, "%s?arg=%s", *url, arg);
-			else
-				sprintf(str, "%s&arg=%s", *url, arg);
-			free(*url);
-			*url = str;
+		for (int i = 0; i < request->arguments->total; i++)
+			size += strlen((char*) libp2p_utils_vector_get(request->arguments, i)) + 5;
+	}
+	if (size > client->url_size) {
+		char* url = (char*) realloc(client->url, size);
+		if (url == NULL)
+			return 0;
+		client->url = url;
+		client->url_size = size;
+	}
+
+	char* pos = client->url;
+	pos += sprintf(pos, "%s/%s", client->base_url, request->command);
+	if (request->sub_command != NULL)
+		pos += sprintf(pos, "/%s", request->sub_command);
+	if (request->params != NULL) {
+		for (int i = 0; i < request->params->total; i++) {
+			struct HttpParam* curr_param = (struct HttpParam*) libp2p_utils_vector_get(request->params, i);
+			pos += sprintf(pos, "/%s=%s", curr_param->name, curr_param->value);
 		}
 	}
+	if (request->arguments != NULL) {
+		for (int i = 0; i < request->arguments->total; i++)
+			pos += sprintf(pos, "%sarg=%s", i == 0 ? "?" : "&", (char*) libp2p_utils_vector_get(request->arguments, i));
+	}
 	return 1;
 }
 
 struct curl_string {
+	CURL* curl;
 	char* ptr;
 	size_t len;
+	size_t size; // what is allocated for ptr
 };
 
 size_t curl_cb(void* ptr, size_t size, size_t nmemb, struct curl_string* str) {
 	size_t new_len = str->len + size * nmemb;
-	str->ptr = realloc(str->ptr, new_len + 1);
-	if (str->ptr != NULL) {
-		memcpy(str->ptr + str->len, ptr, size*nmemb);
-		str->ptr[new_len] = '\0';
-		str->len = new_len;
-	}
+	if (new_len + 1 > str->size) {
+		size_t new_size = str->size;
+		if (new_size == 0) {
+			// start with the whole body, if the daemon said how large it is
+			curl_off_t content_length = -1;
+			curl_easy_getinfo(str->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+			new_size = content_length > 0 ? (size_t)content_length + 1 : HTTP_CLIENT_BUFFER_SIZE;
+		}
+		while (new_size < new_len + 1)
+			new_size *= 2;
+		char* new_ptr = realloc(str->ptr, new_size);
+		if (new_ptr == NULL)
+			return 0; // makes curl fail the transfer
+		str->ptr = new_ptr;
+		str->size = new_size;
+	}
+	memcpy(str->ptr + str->len, ptr, size*nmemb);
+	str->ptr[new_len] = '\0';
+	str->len = new_len;
 	return size * nmemb;
 }
 
-/**
- * Do an HTTP Get to the local API
+size_t curl_stream_cb(void* ptr, size_t size, size_t nmemb, FILE* out) {
+	return fwrite(ptr, size, nmemb, out);
+}
+
+/***
+ * Send a request to the local API on the connection of the client of the node
  * @param local_node the context
  * @param request the request
- * @param result the results
- * @param result_size the size of the results
- * @returns true(1) on success, false(0) on error
+ * @param data the post data, or NULL to do a GET
+ * @param data_size the length of data
+ * @param write_cb called with each piece of the response
+ * @param write_data passed to write_cb
+ * @returns true(1) if the API answered with success, false(0) otherwise
  */
-int ipfs_core_http_request_get(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t *result_size) {
+int ipfs_core_http_request_perform(struct IpfsNode* local_node, struct HttpRequest* request, char* data, size_t data_size,
+		size_t (*write_cb)(void*, size_t, size_t, void*), void* write_data) {
 	if (request == NULL || request->command == NULL)
 		return 0;
 
-	char* url = ipfs_core_http_request_build_url_start(local_node);
-	if (url == NULL)
+	struct HttpClient* client = ipfs_core_http_client_get(local_node);
+	if (client == NULL)
 		return 0;
 
-	if (!ipfs_core_http_request_add_commands(request, &url)) {
-		free(url);
-		return 0;
+	struct curl_httppost *post = NULL, *last = NULL;
+	if (data != NULL) {
+		CURLFORMcode curl_form_ret = curl_formadd(&post,		&last,
+							CURLFORM_COPYNAME,	"filename",
+							CURLFORM_PTRCONTENTS,	data,
+							CURLFORM_CONTENTTYPE,	"application/octet-stream",
+							CURLFORM_FILENAME,	"",
+							CURLFORM_CONTENTSLENGTH,	(long)data_size,
+							CURLFORM_END);
+		if (CURL_FORMADD_OK != curl_form_ret) {
+			libp2p_logger_error("http_request", "curl_formadd returned %d.\n", (int)curl_form_ret);
+			return 0;
+		}
 	}
 
-	if (!ipfs_core_http_request_add_parameters(request, &url)) {
-		free(url);
-		return 0;
-	}
+	pthread_mutex_lock(&client->lock);
+	CURLcode res = CURLE_OUT_OF_MEMORY;
+	long response_code = 0;
+	if (ipfs_core_http_request_build_url(client, request)) {
+		curl_easy_setopt(client->curl, CURLOPT_URL, client->url);
+		curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, write_cb);
+		curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, write_data);
+		if (post != NULL)
+			curl_easy_setopt(client->curl, CURLOPT_HTTPPOST, post);
+		else
+			curl_easy_setopt(client->curl, CURLOPT_HTTPGET, 1L);
+		// the connection of the last request is used again, if it is still open
+		res = curl_easy_perform(client->curl);
+		curl_easy_getinfo(client->curl, CURLINFO_RESPONSE_CODE, &response_code);
+		if (res != CURLE_OK)
+			libp2p_logger_error("http_request", "Results of [%s] returned failure. Return value: %d.\n", client->url, res);
+		else if (response_code >= 400)
+			libp2p_logger_debug("http_request", "Results of [%s] returned status %ld.\n", client->url, response_code);
+	}
+	pthread_mutex_unlock(&client->lock);
+	if (post != NULL)
+		curl_formfree(post);
+	return res == CURLE_OK && response_code < 400;
+}
 
-	// do the GET using libcurl
-	CURL *curl;
-	CURLcode res;
+/***
+ * Send a request to the local API, and keep the response in memory
+ */
+int ipfs_core_http_request_buffered(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t* result_size, char *data, size_t data_size) {
 	struct curl_string s;
+	s.curl = NULL;
+	s.ptr = NULL;
 	s.len = 0;
-	s.ptr = malloc(1);
-	s.ptr[0] = '\0';
+	s.size = 0;
 
-	curl = curl_easy_init();
-	if (!curl) {
+	struct HttpClient* client = ipfs_core_http_client_get(local_node);
+	if (client == NULL)
+		return 0;
+	s.curl = client->curl;
+	if (!ipfs_core_http_request_perform(local_node, request, data, data_size, (size_t (*)(void*, size_t, size_t, void*))curl_cb, &s)) {
+		free(s.ptr);
 		return 0;
 	}
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
-	res = curl_easy_perform(curl);
-	curl_easy_cleanup(curl);
-	if (res == CURLE_OK) {
-		if (strcmp(s.ptr, "404 page not found") != 0) {
-			*result = s.ptr;
-			*result_size = s.len;
-		}
-		else
-			res = -1;
-	} else {
-		libp2p_logger_error("http_request", "Results of [%s] returned failure. Return value: %d.\n", url, res);
-		if (s.ptr != NULL)
-			free(s.ptr);
+	if (s.ptr == NULL) {
+		// an empty response
+		s.ptr = malloc(1);
+		if (s.ptr == NULL)
+			return 0;
+		s.ptr[0] = '\0';
 	}
-	return res == CURLE_OK;
+	*result = s.ptr;
+	*result_size = s.len;
+	return 1;
+}
+
+/**
+ * Do an HTTP Get to the local API
+ * @param local_node the context
+ * @param request the request
+ * @param result the results
+ * @param result_size the size of the results
+ * @returns true(1) on success, false(0) on error
+ */
+int ipfs_core_http_request_get(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t *result_size) {
+	return ipfs_core_http_request_buffered(local_node, request, result, result_size, NULL, 0);
 }
 
 /**
@@ -557,72 +819,22 @@ int ipfs_core_http_request_get(struct IpfsNode* local_node, struct HttpRequest*
  * @returns true(1) on success, false(0) on error
  */
 int ipfs_core_http_request_post(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t* result_size, char *data, size_t data_size) {
-	if (request == NULL || request->command == NULL || data == NULL)
-		return 0;
-
-	char* url = ipfs_core_http_request_build_url_start(local_node);
-	if (url == NULL)
+	if (data == NULL)
 		return 0;
+	return ipfs_core_http_request_buffered(local_node, request, result, result_size, data, data_size);
+}
 
-	if (!ipfs_core_http_request_add_commands(request, &url)) {
-		free(url);
-		return 0;
-	}
-
-	if (!ipfs_core_http_request_add_parameters(request, &url)) {
-		free(url);
-		return 0;
-	}
-
-	// do the POST using libcurl
-	CURL *curl;
-	CURLcode res;
-	struct curl_string s;
-	s.len = 0;
-	s.ptr = malloc(1);
-	s.ptr[0] = '\0';
-
-	struct curl_httppost *post = NULL, *last = NULL;
-	CURLFORMcode curl_form_ret = curl_formadd(&post,		&last,
-						CURLFORM_COPYNAME,	"filename",
-						CURLFORM_PTRCONTENTS,	data,
-						CURLFORM_CONTENTTYPE,	"application/octet-stream",
-						CURLFORM_FILENAME,	"",
-						CURLFORM_CONTENTSLENGTH,	data_size,
-						CURLFORM_END);
-
-
-
-	if (CURL_FORMADD_OK != curl_form_ret) {
-		// i'm always getting curl_form_ret == 4 here
-		// it means CURL_FORMADD_UNKNOWN_OPTION
-		// what i'm doing wrong?
-		fprintf(stderr, "curl_form_ret = %d\n", (int)curl_form_ret);
-		return 0;
-	}
-
-	curl = curl_easy_init();
-	if (!curl) {
+/**
+ * Do an HTTP Post to the local API, and write the response to a stream as it arrives
+ * @param local_node the context
+ * @param request the request
+ * @param data the array with post data
+ * @param data_size the data length
+ * @param out where to write the response
+ * @returns true(1) on success, false(0) on error
+ */
+int ipfs_core_http_request_post_stream(struct IpfsNode* local_node, struct HttpRequest* request, char *data, size_t data_size, FILE* out) {
+	if (data == NULL || out == NULL)
 		return 0;
-	}
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
-	curl_easy_setopt(curl, CURLOPT_HTTPPOST, post);
-	res = curl_easy_perform(curl);
-	curl_easy_cleanup(curl);
-	if (res == CURLE_OK) {
-		if (strcmp(s.ptr, "404 page not found") != 0) {
-			*result = s.ptr;
-			*result_size = s.len;
-		}
-		else
-			res = -1;
-	} else {
-		//libp2p_logger_error("http_request", "Results of [%s] returned failure. Return value: %d.\n", url, res);
-		fprintf(stderr, "Results of [%s] returned failure. Return value: %d.\n", url, res);
-		if (s.ptr != NULL)
-			free(s.ptr);
-	}
-	return res == CURLE_OK;
+	return ipfs_core_http_request_perform(local_node, request, data, data_size, (size_t (*)(void*, size_t, size_t, void*))curl_stream_cb, out);
 }
@@ -10,9 +10,11 @@
 #include "libp2p/yamux/yamux.h"
 #include "ipfs/core/api.h"
 #include "ipfs/core/client_api.h"
+#include "ipfs/core/http_request.h"
 #include "ipfs/core/ipfs_node.h"
 #include "ipfs/exchange/bitswap/bitswap.h"
 #include "ipfs/journal/journal.h"
+#include "ipfs/namesys/routing.h"
 
 struct IpfsNode* ipfs_node_new() {
 	struct IpfsNode* node = malloc(sizeof(struct IpfsNode));
@@ -27,6 +29,8 @@ struct IpfsNode* ipfs_node_new() {
 		node->repo = NULL;
 		node->routing = NULL;
 		node->api_context = NULL;
+		node->http_client = NULL;
+		node->ipns_cache = ipfs_routing_cache_new(DefaultResolverCacheSize);
 	}
 	return node;
 }
@@ -104,7 +108,7 @@ int ipfs_node_online_new(const char* repo_path, struct IpfsNode** node) {
 	local_node->dialer = libp2p_conn_dialer_new(local_node->identity->peer, local_node->peerstore, &local_node->identity->private_key, local_node->swarm);
 
 	// fire up the API
-	api_start(local_node, 10, 5);
+	api_start(local_node, 256, 5);
 
 	return 1;
 }
@@ -165,6 +169,9 @@ int ipfs_node_free(struct IpfsNode* node) {
 	if (node != NULL) {
 		if (node->api_context != NULL && node->api_context->api_thread != 0)
 			api_stop(node);
+		// stop the protocol handlers first, as they may still be using the rest
+		if (node->protocol_handlers != NULL)
+			ipfs_node_online_protocol_handlers_free(node->protocol_handlers);
 		if (node->exchange != NULL) {
 			node->exchange->Close(node->exchange);
 		}
@@ -174,8 +181,6 @@ int ipfs_node_free(struct IpfsNode* node) {
 			libp2p_peerstore_free(node->peerstore);
 		if (node->repo != NULL)
 			ipfs_repo_fsrepo_free(node->repo);
-		if (node->protocol_handlers != NULL)
-			ipfs_node_online_protocol_handlers_free(node->protocol_handlers);
 		if (node->mode == MODE_ONLINE) {
 			ipfs_routing_online_free(node->routing);
 		}
@@ -185,6 +190,10 @@ int ipfs_node_free(struct IpfsNode* node) {
 		if (node->blockstore != NULL) {
 			ipfs_blockstore_free(node->blockstore);
 		}
+		if (node->ipns_cache != NULL)
+			ipfs_routing_cache_free(node->ipns_cache);
+		if (node->http_client != NULL)
+			ipfs_core_http_client_free(node->http_client);
 		free(node);
 	}
 	return 1;
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/utils/logger.h"
+#include "ipfs/core/multipart.h"
+
+/**
+ * A streaming parser for multipart/form-data (RFC 2046 / RFC 7578).
+ *
+ * The boundary is looked for one byte at a time, so it is found even when
+ * it is split between two reads. As a boundary cannot contain CR, a partial
+ * match that fails can only start again at the byte that broke it.
+ */
+
+struct MultipartParser* ipfs_core_multipart_new(const char* boundary,
+		int (*on_part)(void*, const char*),
+		int (*on_data)(void*, const uint8_t*, size_t),
+		int (*on_part_end)(void*),
+		void* context) {
+	if (boundary == NULL)
+		return NULL;
+	size_t boundary_size = strlen(boundary);
+	if (boundary_size == 0 || boundary_size > 70 || strpbrk(boundary, "\r\n") != NULL) {
+		libp2p_logger_error("multipart", "Invalid boundary.\n");
+		return NULL;
+	}
+	struct MultipartParser* parser = (struct MultipartParser*) malloc(sizeof(struct MultipartParser));
+	if (parser == NULL)
+		return NULL;
+	parser->delimiter_size = boundary_size + 4;
+	parser->delimiter = (char*) malloc(parser->delimiter_size + 1);
+	if (parser->delimiter == NULL) {
+		free(parser);
+		return NULL;
+	}
+	strcpy(parser->delimiter, "\r\n--");
+	strcpy(&parser->delimiter[4], boundary);
+	// the body starts with the first boundary, without the CRLF before it
+	parser->match = 2;
+	parser->state = MULTIPART_PREAMBLE;
+	parser->header_size = 0;
+	parser->on_part = on_part;
+	parser->on_data = on_data;
+	parser->on_part_end = on_part_end;
+	parser->context = context;
+	return parser;
+}
+
+void ipfs_core_multipart_free(struct MultipartParser* parser) {
+	if (parser != NULL) {
+		free(parser->delimiter);
+		free(parser);
+	}
+}
+
+int ipfs_core_multipart_done(struct MultipartParser* parser) {
+	return parser->state == MULTIPART_END;
+}
+
+/***
+ * Pass data on, if we are in a part. Bytes before the first boundary are dropped.
+ */
+static int ipfs_core_multipart_emit(struct MultipartParser* parser, const uint8_t* data, size_t data_size) {
+	if (parser->state != MULTIPART_DATA || data_size == 0 || parser->on_data == NULL)
+		return 1;
+	return parser->on_data(parser->context, data, data_size);
+}
+
+/***
+ * Find the filename in the headers of a part
+ * @param header the headers, which are changed to terminate the filename
+ * @returns the filename, or NULL if there is none
+ */
+static char* ipfs_core_multipart_filename(char* header) {
+	char* pos = strstr(header, "filename=");
+	char* end = NULL;
+	if (pos == NULL)
+		return NULL;
+	pos += 9;
+	if (*pos == '"') {
+		pos++;
+		end = strchr(pos, '"');
+	} else {
+		end = pos + strcspn(pos, ";\r\n");
+	}
+	if (end == NULL)
+		return NULL;
+	*end = 0;
+	return pos;
+}
+
+int ipfs_core_multipart_feed(struct MultipartParser* parser, const uint8_t* data, size_t data_size) {
+	size_t i = 0;
+	size_t run = 0;
+
+	while (i < data_size) {
+		switch (parser->state) {
+			case (MULTIPART_PREAMBLE):
+			case (MULTIPART_DATA):
+				run = i;
+				for (; i < data_size; i++) {
+					if (data[i] == (uint8_t)parser->delimiter[parser->match]) {
+						if (parser->match == 0 && !ipfs_core_multipart_emit(parser, &data[run], i - run))
+							return 0;
+						parser->match++;
+						run = i + 1;
+						if (parser->match == parser->delimiter_size)
+							break;
+					} else if (parser->match > 0) {
+						// what matched was data after all
+						if (!ipfs_core_multipart_emit(parser, (uint8_t*)parser->delimiter, parser->match))
+							return 0;
+						parser->match = 0;
+						run = i;
+						if (data[i] == (uint8_t)parser->delimiter[0]) {
+							parser->match = 1;
+							run = i + 1;
+						}
+					}
+				}
+				if (parser->match == parser->delimiter_size) {
+					i++;
+					parser->match = 0;
+					if (parser->state == MULTIPART_DATA && parser->on_part_end != NULL && !parser->on_part_end(parser->context))
+						return 0;
+					parser->state = MULTIPART_AFTER_BOUNDARY;
+					parser->header_size = 0;
+				} else if (!ipfs_core_multipart_emit(parser, &data[run], i - run)) {
+					return 0;
+				}
+				break;
+			case (MULTIPART_AFTER_BOUNDARY):
+				// the boundary line may be padded with whitespace
+				if (parser->header_size == 0 && (data[i] == ' ' || data[i] == '\t')) {
+					i++;
+					break;
+				}
+				parser->header[parser->header_size++] = data[i++];
+				if (parser->header_size == 2) {
+					if (memcmp(parser->header, "--", 2) == 0) {
+						parser->state = MULTIPART_END;
+					} else if (memcmp(parser->header, "\r\n", 2) == 0) {
+						parser->state = MULTIPART_HEADERS;
+						parser->header_size = 0;
+					} else {
+						libp2p_logger_error("multipart", "Unexpected bytes after boundary.\n");
+						return 0;
+					}
+				}
+				break;
+			case (MULTIPART_HEADERS):
+				if (parser->header_size == MULTIPART_MAX_HEADER) {
+					libp2p_logger_error("multipart", "Headers of part are too long.\n");
+					return 0;
+				}
+				parser->header[parser->header_size++] = data[i++];
+				parser->header[parser->header_size] = 0;
+				if ((parser->header_size == 2 && memcmp(parser->header, "\r\n", 2) == 0)
+						|| (parser->header_size >= 4 && memcmp(&parser->header[parser->header_size - 4], "\r\n\r\n", 4) == 0)) {
+					parser->state = MULTIPART_DATA;
+					if (parser->on_part != NULL && !parser->on_part(parser->context, ipfs_core_multipart_filename(parser->header)))
+						return 0;
+				}
+				break;
+			default:
+				// anything after the last boundary is ignored
+				i = data_size;
+				break;
+		}
+	}
+	return 1;
+}
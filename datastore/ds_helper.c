@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include "libp2p/crypto/encoding/base32.h"
 #include "ipfs/datastore/ds_helper.h"
+#include "ipfs/multibase/multibase.h"
 /**
  * Generate a base32 key based on the passed in binary_array (which is normally a multihash)
  * @param binary_array what to base the key on
@@ -17,13 +18,8 @@
 int ipfs_datastore_helper_ds_key_from_binary(const unsigned char* binary_array, size_t array_length,
 		unsigned char* results, size_t max_results_length, size_t* results_length) {
 
-	size_t encoded_length = libp2p_crypto_encoding_base32_encode_size(array_length);
-	if (encoded_length > max_results_length)
-		return 0;
-
-	*results_length = max_results_length;
-	int retVal = libp2p_crypto_encoding_base32_encode(binary_array, array_length, results, results_length);
-	if (retVal == 0) {
+	// the key libp2p_crypto_encoding_base32_encode makes, 5 bytes at a time
+	if (!multibase_base32_encode_upper(binary_array, array_length, results, max_results_length, results_length)) {
 		*results_length = 0;
 		return 0;
 	}
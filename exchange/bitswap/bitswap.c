@@ -16,6 +16,7 @@
 #include "ipfs/exchange/bitswap/network.h"
 #include "ipfs/exchange/bitswap/peer_request_queue.h"
 #include "ipfs/exchange/bitswap/want_manager.h"
+#include "ipfs/util/trace.h"
 
 int ipfs_bitswap_can_handle(const struct StreamMessage* msg) {
 	if (msg == NULL || msg->data == NULL || msg->data_size == 0)
@@ -90,6 +91,7 @@ struct Exchange* ipfs_bitswap_new(struct IpfsNode* ipfs_node) {
 		exchange->GetBlock = ipfs_bitswap_get_block;
 		exchange->GetBlockAsync = ipfs_bitswap_get_block_async;
 		exchange->GetBlocks = ipfs_bitswap_get_blocks;
+		exchange->GetBlocksAsync = ipfs_bitswap_get_blocks_async;
 
 		// Start the threads for the network
 		ipfs_bitswap_engine_start(bitswapContext);
@@ -172,6 +174,7 @@ int ipfs_bitswap_has_block(struct Exchange* exchange, struct Block* block) {
  * @returns true(1) if found, false(0) if not
  */
 int ipfs_bitswap_get_block(struct Exchange* exchange, struct Cid* cid, struct Block** block) {
+	IPFS_TRACE_SPAN("ipfs_bitswap_get_block");
 	struct BitswapContext* bitswapContext = (struct BitswapContext*)exchange->exchangeContext;
 	if (bitswapContext != NULL) {
 		// check locally first
@@ -187,6 +190,7 @@ int ipfs_bitswap_get_block(struct Exchange* exchange, struct Cid* cid, struct Bl
 		wantlist_session->context = (void*)bitswapContext->ipfsNode;
 		struct WantListQueueEntry* want_entry = ipfs_bitswap_want_manager_add(bitswapContext, cid, wantlist_session);
 		if (want_entry != NULL) {
+			IPFS_TRACE_SPAN("ipfs_bitswap_wait");
 			// loop waiting for it to fill
 			while(1) {
 				if (want_entry->block != NULL) {
@@ -247,3 +251,51 @@ int ipfs_bitswap_get_blocks(struct Exchange* exchange, struct Libp2pVector* Cids
 	// TODO: Implement this method
 	return 0;
 }
+
+/**
+ * Implements the Exchange->GetBlocksAsync method
+ * Every block that we do not have is added to the local wantlist. If we know who
+ * has the blocks, the wants are sent to that peer in one message, instead of
+ * looking up providers for each block.
+ * @param exchange the exchange
+ * @param cids a vector of Cid
+ * @param provider the peer that has the blocks (can be NULL)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_bitswap_get_blocks_async(struct Exchange* exchange, struct Libp2pVector* cids, struct Libp2pPeer* provider) {
+	struct BitswapContext* bitswapContext = (struct BitswapContext*)exchange->exchangeContext;
+	if (bitswapContext == NULL || cids == NULL)
+		return 0;
+	struct PeerRequest* peer_request = NULL;
+	if (provider != NULL)
+		peer_request = ipfs_peer_request_queue_find_peer(bitswapContext->peerRequestQueue, provider);
+	int wanted = 0;
+	for(int i = 0; i < cids->total; i++) {
+		struct Cid* cid = (struct Cid*) libp2p_utils_vector_get(cids, i);
+		// check locally first
+		struct Block* block = NULL;
+		if (bitswapContext->ipfsNode->blockstore->Get(bitswapContext->ipfsNode->blockstore->blockstoreContext, cid, &block)) {
+			ipfs_block_free(block);
+			continue;
+		}
+		struct WantListSession* wantlist_session = ipfs_bitswap_wantlist_session_new();
+		wantlist_session->type = WANTLIST_SESSION_TYPE_LOCAL;
+		wantlist_session->context = (void*)bitswapContext->ipfsNode;
+		struct WantListQueueEntry* want_entry = ipfs_bitswap_want_manager_add(bitswapContext, cid, wantlist_session);
+		if (want_entry == NULL)
+			continue;
+		if (peer_request != NULL) {
+			// we will ask the provider directly, so the engine does not need to look for providers
+			want_entry->asked_network = 1;
+			struct CidEntry* cid_entry = ipfs_bitswap_peer_request_cid_entry_new();
+			cid_entry->cid = ipfs_cid_copy(cid);
+			libp2p_utils_vector_add(peer_request->cids_we_want, cid_entry);
+		}
+		wanted++;
+	}
+	if (peer_request != NULL && wanted > 0) {
+		libp2p_logger_debug("bitswap", "Requesting %d blocks from %s in one message.\n", wanted, libp2p_peer_id_to_string(provider));
+		ipfs_bitswap_peer_request_process_entry(bitswapContext, peer_request);
+	}
+	return 1;
+}
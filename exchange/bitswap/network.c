@@ -10,6 +10,7 @@
 #include "libp2p/utils/logger.h"
 #include "ipfs/exchange/bitswap/network.h"
 #include "ipfs/exchange/bitswap/peer_request_queue.h"
+#include "ipfs/exchange/bitswap/wantlist_queue.h"
 
 /****
  * send a message to a particular peer
@@ -104,30 +105,38 @@ int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struc
 	struct BitswapMessage* message = NULL;
 	if (!ipfs_bitswap_message_protobuf_decode(&bytes[start], bytes_length - start, &message))
 		return 0;
+	// get the peer
+	struct Libp2pPeer* peer = NULL;
+	struct PeerRequest* peerRequest = NULL;
+	if (sessionContext->remote_peer_id != NULL) {
+		peer = libp2p_peerstore_get_or_add_peer_by_id(node->peerstore, (unsigned char*)sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
+		if (peer == NULL) {
+			libp2p_logger_error("bitswap_network", "Unable to find or add peer %s of length %d to peerstore.\n", sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
+		} else {
+			// find the queue (adds it if it is not there)
+			peerRequest = ipfs_peer_request_queue_find_peer(bitswapContext->peerRequestQueue, peer);
+		}
+	}
 	// process the message
 	// payload - what we want
 	if (message->payload != NULL) {
 		for(int i = 0; i < message->payload->total; i++) {
 			struct Block* blk = (struct Block*)libp2p_utils_vector_get(message->payload, i);
+			// a block we did not ask for, or already have, is a duplicate
+			struct WantListQueueEntry* queueEntry = ipfs_bitswap_wantlist_queue_find(bitswapContext->localWantlist, blk->cid);
+			if (queueEntry == NULL || queueEntry->block != NULL)
+				ipfs_bitswap_peer_request_count(peerRequest, PEER_REQUEST_DUPLICATES_RECEIVED, 1);
+			ipfs_bitswap_peer_request_count(peerRequest, PEER_REQUEST_BLOCKS_RECEIVED, 1);
 			// we need a copy of the block so it survives the destruction of the message
 			node->exchange->HasBlock(node->exchange, ipfs_block_copy(blk));
 		}
 	}
 	// wantlist - what they want
 	if (message->wantlist != NULL && message->wantlist->entries != NULL && message->wantlist->entries->total > 0) {
-		// get the peer
-		if (sessionContext->remote_peer_id == NULL) {
-			ipfs_bitswap_message_free(message);
-			return 0;
-		}
-		struct Libp2pPeer* peer = libp2p_peerstore_get_or_add_peer_by_id(node->peerstore, (unsigned char*)sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
-		if (peer == NULL) {
-			libp2p_logger_error("bitswap_network", "Unable to find or add peer %s of length %d to peerstore.\n", sessionContext->remote_peer_id, strlen(sessionContext->remote_peer_id));
+		if (peerRequest == NULL) {
 			ipfs_bitswap_message_free(message);
 			return 0;
 		}
-		// find the queue (adds it if it is not there)
-		struct PeerRequest* peerRequest = ipfs_peer_request_queue_find_peer(bitswapContext->peerRequestQueue, peer);
 		for(int i = 0; i < message->wantlist->entries->total; i++) {
 			struct WantlistEntry* entry = (struct WantlistEntry*) libp2p_utils_vector_get(message->wantlist->entries, i);
 			// turn the "block" back into a cid
@@ -138,6 +147,8 @@ int ipfs_bitswap_network_handle_message(const struct IpfsNode* node, const struc
 				ipfs_bitswap_message_free(message);
 				return 0;
 			}
+			if (!entry->cancel)
+				ipfs_bitswap_peer_request_count(peerRequest, PEER_REQUEST_WANTS_RECEIVED, 1);
 			ipfs_bitswap_network_adjust_cid_queue(peerRequest->cids_they_want, cid, entry->cancel);
 		}
 	}
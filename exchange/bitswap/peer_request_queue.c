@@ -10,6 +10,9 @@
 #include "ipfs/exchange/bitswap/peer_request_queue.h"
 #include "ipfs/exchange/bitswap/message.h"
 #include "ipfs/exchange/bitswap/network.h"
+#include "ipfs/util/memory.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
 
 /***
  * Allocate memory for CidEntry
@@ -31,7 +34,7 @@ struct CidEntry* ipfs_bitswap_peer_request_cid_entry_new() {
  */
 struct PeerRequest* ipfs_bitswap_peer_request_new() {
 	int retVal = 0;
-	struct PeerRequest* request = (struct PeerRequest*) malloc(sizeof(struct PeerRequest));
+	struct PeerRequest* request = (struct PeerRequest*) ipfs_util_memory_alloc(MEMORY_TAG_EXCHANGE, sizeof(struct PeerRequest));
 	if (request != NULL) {
 		request->cids_they_want = libp2p_utils_vector_new(1);
 		if (request->cids_they_want == NULL)
@@ -43,6 +46,8 @@ struct PeerRequest* ipfs_bitswap_peer_request_new() {
 		if (request->blocks_we_want_to_send == NULL)
 			goto exit;
 		request->peer = NULL;
+		for(int i = 0; i < PEER_REQUEST_COUNT_MAX; i++)
+			request->counts[i] = 0;
 	}
 	retVal = 1;
 	exit:
@@ -53,7 +58,7 @@ struct PeerRequest* ipfs_bitswap_peer_request_new() {
 			libp2p_utils_vector_free(request->cids_they_want);
 		if (request->cids_we_want != NULL)
 			libp2p_utils_vector_free(request->cids_we_want);
-		free(request);
+		ipfs_util_memory_free(MEMORY_TAG_EXCHANGE, request);
 		request = NULL;
 	}
 	return request;
@@ -95,7 +100,7 @@ int ipfs_bitswap_peer_request_free(struct PeerRequest* request) {
 		}
 		libp2p_utils_vector_free(request->blocks_we_want_to_send);
 		request->blocks_we_want_to_send = NULL;
-		free(request);
+		ipfs_util_memory_free(MEMORY_TAG_EXCHANGE, request);
 
 	}
 	return 1;
@@ -144,6 +149,8 @@ int ipfs_bitswap_peer_request_queue_add(struct PeerRequestQueue* queue, struct P
 		entry->current = request;
 		pthread_mutex_lock(&queue->queue_mutex);
 		entry->prior = queue->last;
+		if (queue->last != NULL)
+			queue->last->next = entry;
 		queue->last = entry;
 		if (queue->first == NULL) {
 			queue->first = entry;
@@ -259,6 +266,9 @@ struct PeerRequest* ipfs_bitswap_peer_request_queue_pop(struct PeerRequestQueue*
 				// move to the end of the queue
 				if (queue->first->next != NULL) {
 					queue->first = queue->first->next;
+					queue->first->prior = NULL;
+					entry->next = NULL;
+					entry->prior = queue->last;
 					queue->last->next = entry;
 					queue->last = entry;
 				}
@@ -384,6 +394,7 @@ int ipfs_bitswap_peer_request_process_entry(const struct BitswapContext* context
 	if (need_to_connect) {
 		if (!connected) {
 			// connect
+			IPFS_TRACE_SPAN("libp2p_peer_connect");
 			connected = libp2p_peer_connect(context->ipfsNode->dialer, request->peer, context->ipfsNode->peerstore, context->ipfsNode->repo->config->datastore, 0);
 		}
 		if (connected) {
@@ -396,6 +407,10 @@ int ipfs_bitswap_peer_request_process_entry(const struct BitswapContext* context
 			ipfs_bitswap_message_add_wantlist_items(msg, request->cids_we_want);
 			// send message
 			if (ipfs_bitswap_network_send_message(context, request->peer, msg)) {
+				if (msg->wantlist != NULL && msg->wantlist->entries != NULL)
+					ipfs_bitswap_peer_request_count(request, PEER_REQUEST_WANTS_SENT, msg->wantlist->entries->total);
+				if (msg->payload != NULL)
+					ipfs_bitswap_peer_request_count(request, PEER_REQUEST_BLOCKS_SENT, msg->payload->total);
 				ipfs_bitswap_message_free(msg);
 				return 1;
 			}
@@ -405,6 +420,64 @@ int ipfs_bitswap_peer_request_process_entry(const struct BitswapContext* context
 	return 0;
 }
 
+/***
+ * Count something exchanged with a peer, both for the peer and in the totals of the metrics
+ * @param request the PeerRequest of the peer, can be NULL to only count the total
+ * @param what what to count
+ * @param amount how many
+ */
+void ipfs_bitswap_peer_request_count(struct PeerRequest* request, enum PeerRequestCount what, uint64_t amount) {
+	if (request != NULL)
+		__atomic_fetch_add(&request->counts[what], amount, __ATOMIC_RELAXED);
+	ipfs_util_metrics_add(METRICS_BITSWAP_WANTS_SENT + what, amount);
+}
+
+/***
+ * Write the length of the queue and the counts of each peer in it, as metrics
+ * @param queue the queue
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_bitswap_peer_request_queue_metrics(struct PeerRequestQueue* queue, FILE* out) {
+	static const char* names[PEER_REQUEST_COUNT_MAX][2] = {
+		{ "ipfs_bitswap_peer_wants_sent_total", "Wantlist entries sent to a peer." },
+		{ "ipfs_bitswap_peer_wants_received_total", "Wantlist entries received from a peer." },
+		{ "ipfs_bitswap_peer_blocks_sent_total", "Blocks sent to a peer." },
+		{ "ipfs_bitswap_peer_blocks_received_total", "Blocks received from a peer." },
+		{ "ipfs_bitswap_peer_duplicates_received_total", "Blocks received from a peer that were not wanted, or were already received." }
+	};
+	int retVal = 1;
+	int length = 0;
+
+	pthread_mutex_lock(&queue->queue_mutex);
+	for(struct PeerRequestEntry* current = queue->first; current != NULL; current = current->next)
+		length++;
+	if (!ipfs_util_metrics_write_header(out, "ipfs_bitswap_peer_request_queue_length", "gauge", "Peers in the bitswap request queue.")
+			|| fprintf(out, "ipfs_bitswap_peer_request_queue_length %d\n", length) < 0) {
+		retVal = 0;
+		goto exit;
+	}
+	for(int i = 0; i < PEER_REQUEST_COUNT_MAX; i++) {
+		if (!ipfs_util_metrics_write_header(out, names[i][0], "counter", names[i][1])) {
+			retVal = 0;
+			goto exit;
+		}
+		for(struct PeerRequestEntry* current = queue->first; current != NULL; current = current->next) {
+			struct Libp2pPeer* peer = current->current->peer;
+			if (peer == NULL || peer->id == NULL)
+				continue;
+			if (fprintf(out, "%s{peer=\"%.*s\"} %llu\n", names[i][0], (int)peer->id_size, peer->id,
+					(unsigned long long)__atomic_load_n(&current->current->counts[i], __ATOMIC_RELAXED)) < 0) {
+				retVal = 0;
+				goto exit;
+			}
+		}
+	}
+	exit:
+	pthread_mutex_unlock(&queue->queue_mutex);
+	return retVal;
+}
+
 /***
  * Find a PeerRequest related to a peer. If one is not found, it is created.
  *
@@ -3,6 +3,7 @@
 #include "libp2p/utils/vector.h"
 #include "ipfs/exchange/bitswap/wantlist_queue.h"
 #include "ipfs/exchange/bitswap/peer_request_queue.h"
+#include "ipfs/util/memory.h"
 
 /**
  * Implementation of the WantlistQueue
@@ -156,11 +157,11 @@ struct WantListQueueEntry* ipfs_bitswap_wantlist_queue_pop(struct WantListQueue*
  * @returns a new WantListQueueEntry
  */
 struct WantListQueueEntry* ipfs_bitswap_wantlist_queue_entry_new() {
-	struct WantListQueueEntry* entry = (struct WantListQueueEntry*) malloc(sizeof(struct WantListQueueEntry));
+	struct WantListQueueEntry* entry = (struct WantListQueueEntry*) ipfs_util_memory_alloc(MEMORY_TAG_EXCHANGE, sizeof(struct WantListQueueEntry));
 	if (entry != NULL) {
 		entry->sessionsRequesting = libp2p_utils_vector_new(1);
 		if (entry->sessionsRequesting == NULL) {
-			free(entry);
+			ipfs_util_memory_free(MEMORY_TAG_EXCHANGE, entry);
 			return NULL;
 		}
 		entry->block = NULL;
@@ -191,7 +192,7 @@ int ipfs_bitswap_wantlist_queue_entry_free(struct WantListQueueEntry* entry) {
 			libp2p_utils_vector_free(entry->sessionsRequesting);
 			entry->sessionsRequesting = NULL;
 		}
-		free(entry);
+		ipfs_util_memory_free(MEMORY_TAG_EXCHANGE, entry);
 	}
 	return 1;
 }
@@ -220,7 +221,7 @@ int ipfs_bitswap_wantlist_session_compare(const struct WantListSession* a, const
  * @returns the newly allocated WantListSession
  */
 struct WantListSession* ipfs_bitswap_wantlist_session_new() {
-	struct WantListSession* ret = (struct WantListSession*) malloc(sizeof(struct WantListSession));
+	struct WantListSession* ret = (struct WantListSession*) ipfs_util_memory_alloc(MEMORY_TAG_EXCHANGE, sizeof(struct WantListSession));
 	if (ret != NULL) {
 		ret->context = NULL;
 		ret->type = WANTLIST_SESSION_TYPE_LOCAL;
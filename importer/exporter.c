@@ -7,17 +7,22 @@
 #include "ipfs/importer/exporter.h"
 #include "ipfs/merkledag/merkledag.h"
 #include "ipfs/merkledag/node.h"
+#include "ipfs/merkledag/walker.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 #include "ipfs/repo/init.h"
 #include "ipfs/core/ipfs_node.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/namesys/name.h"
 #include "ipfs/repo/fsrepo/jsmn.h"
+#include "ipfs/util/trace.h"
 
 /**
  * pull objects from ipfs
  */
 
+// the blocks of a file fetched ahead of writing it
+#define EXPORTER_PREFETCH 4
+
 /***
  * Helper method to retrieve a protobuf'd Node from the router
  * @param local_node the context
@@ -28,6 +33,7 @@
  */
 int ipfs_exporter_get_node(struct IpfsNode* local_node, const unsigned char* hash, const size_t hash_size,
 		struct HashtableNode** result) {
+	IPFS_TRACE_SPAN("ipfs_exporter_get_node");
 	unsigned char *buffer = NULL;
 	size_t buffer_size = 0;
 	int retVal = 0;
@@ -64,6 +70,33 @@ int ipfs_exporter_get_node(struct IpfsNode* local_node, const unsigned char* has
 	return retVal;
 }
 
+/***
+ * A merkledag_fetch_func that gets the blocks through the router
+ * @param context the IpfsNode
+ */
+static int ipfs_exporter_walk_fetch(void* context, const unsigned char* hash, size_t hash_size, struct HashtableNode** node) {
+	return ipfs_exporter_get_node((struct IpfsNode*)context, hash, hash_size, node);
+}
+
+/***
+ * Write the bytes of a node of a file
+ * @param node the node
+ * @param file where to write
+ * @returns true(1) on success, false(0) if it is not unixfs, or the reader has gone away
+ */
+static int ipfs_exporter_write_node(struct HashtableNode* node, FILE* file) {
+	struct UnixFS* unix_fs;
+	if (!ipfs_unixfs_protobuf_decode(node->data, node->data_size, &unix_fs)) {
+		return 0;
+	}
+	if (fwrite(unix_fs->bytes, 1, unix_fs->bytes_size, file) != unix_fs->bytes_size) {
+		ipfs_unixfs_free(unix_fs);
+		return 0;
+	}
+	ipfs_unixfs_free(unix_fs);
+	return 1;
+}
+
 /***
  * Get a file by its hash, and write the data to a filestream
  * @param hash the base58 multihash of the cid
@@ -71,6 +104,7 @@ int ipfs_exporter_get_node(struct IpfsNode* local_node, const unsigned char* has
  * @param local_node the context
  */
 int ipfs_exporter_to_filestream(const unsigned char* hash, FILE* file_descriptor, struct IpfsNode* local_node) {
+	IPFS_TRACE_SPAN("ipfs_exporter_to_filestream");
 
 	// convert hash to cid
 	struct Cid* cid = NULL;
@@ -88,44 +122,9 @@ int ipfs_exporter_to_filestream(const unsigned char* hash, FILE* file_descriptor
 	// no longer need the cid
 	ipfs_cid_free(cid);
 
-	if (read_node->head_link == NULL) {
-		// convert the node's data into a UnixFS data block
-		struct UnixFS* unix_fs;
-		ipfs_unixfs_protobuf_decode(read_node->data, read_node->data_size, &unix_fs);
-		size_t bytes_written = fwrite(unix_fs->bytes, 1, unix_fs->bytes_size, file_descriptor);
-		if (bytes_written != unix_fs->bytes_size) {
-			ipfs_hashtable_node_free(read_node);
-			ipfs_unixfs_free(unix_fs);
-			return 0;
-		}
-		ipfs_unixfs_free(unix_fs);
-	} else {
-		struct NodeLink* link = read_node->head_link;
-		struct HashtableNode* link_node = NULL;
-		while (link != NULL) {
-			if ( !ipfs_exporter_get_node(local_node, link->hash, link->hash_size, &link_node)) {
-				ipfs_hashtable_node_free(read_node);
-				return 0;
-			}
-			struct UnixFS* unix_fs;
-			ipfs_unixfs_protobuf_decode(link_node->data, link_node->data_size, &unix_fs);
-			size_t bytes_written = fwrite(unix_fs->bytes, 1, unix_fs->bytes_size, file_descriptor);
-			if (bytes_written != unix_fs->bytes_size) {
-				ipfs_hashtable_node_free(link_node);
-				ipfs_hashtable_node_free(read_node);
-				ipfs_unixfs_free(unix_fs);
-				return 0;
-			}
-			ipfs_hashtable_node_free(link_node);
-			ipfs_unixfs_free(unix_fs);
-			link = link->next;
-		}
-	}
-
-	if (read_node != NULL)
-		ipfs_hashtable_node_free(read_node);
-
-	return 1;
+	int retVal = ipfs_exporter_cat_node(read_node, local_node, file_descriptor);
+	ipfs_hashtable_node_free(read_node);
+	return retVal;
 }
 
 
@@ -226,34 +225,38 @@ int ipfs_exporter_object_get(int argc, char** argv) {
  * @returns true(1) on success, false(0) otherwise
  */
 int ipfs_exporter_cat_node(struct HashtableNode* node, struct IpfsNode* local_node, FILE *file) {
-	// process this node, then move on to the links
+	IPFS_TRACE_SPAN("ipfs_exporter_cat_node");
+	// process this node, then the ones below it, in order. A chunk that
+	// is linked to twice is written twice, so the walk is not unique.
+	struct MerkledagWalkOptions options = { MERKLEDAG_WALK_DEPTH_FIRST, 0, 0, EXPORTER_PREFETCH, NULL };
+	struct MerkledagWalker* walker = NULL;
+	int retVal = 0;
 
-	// build the unixfs
-	struct UnixFS* unix_fs;
-	if (!ipfs_unixfs_protobuf_decode(node->data, node->data_size, &unix_fs)) {
+	if (!ipfs_exporter_write_node(node, file))
 		return 0;
-	}
-	for(size_t i = 0LU; i < unix_fs->bytes_size; i++) {
-		fprintf(file, "%c", unix_fs->bytes[i]);
-	}
-	ipfs_unixfs_free(unix_fs);
-	// process links
-	struct NodeLink* current = node->head_link;
-	while (current != NULL) {
-		// find the node
+	if (node->head_link == NULL)
+		return 1;
+	walker = ipfs_merkledag_walker_new(ipfs_exporter_walk_fetch, local_node, &options);
+	if (walker == NULL || !ipfs_merkledag_walker_push_links(walker, node))
+		goto exit;
+	for(;;) {
 		struct HashtableNode* child_node = NULL;
-		if (!ipfs_exporter_get_node(local_node, current->hash, current->hash_size, &child_node)) {
-			return 0;
-		}
-		ipfs_exporter_cat_node(child_node, local_node, file);
-		ipfs_hashtable_node_free(child_node);
-		current = current->next;
+		int found = ipfs_merkledag_walker_next(walker, NULL, NULL, &child_node, NULL);
+		if (found < 0)
+			goto exit;
+		if (found == 0)
+			break;
+		if (!ipfs_exporter_write_node(child_node, file))
+			goto exit;
 	}
-
-	return 1;
+	retVal = 1;
+	exit:
+	ipfs_merkledag_walker_free(walker);
+	return retVal;
 }
 
 int ipfs_exporter_object_cat_to_file(struct IpfsNode *local_node, unsigned char* hash, int hash_size, FILE* file) {
+	IPFS_TRACE_SPAN("ipfs_exporter_object_cat_to_file");
 	struct HashtableNode* read_node = NULL;
 
 	// find block
@@ -266,6 +269,29 @@ int ipfs_exporter_object_cat_to_file(struct IpfsNode *local_node, unsigned char*
 	return retVal;
 }
 
+/***
+ * Where the response of the API to a cat goes
+ */
+struct ExporterCatOutput {
+	FILE* out;
+	size_t bytes; // written so far
+};
+
+/***
+ * Write a piece of the response of the API to a cat, counting it
+ * @param ptr the bytes
+ * @param size the size of each item
+ * @param nmemb the number of items
+ * @param data the ExporterCatOutput
+ * @returns the number of items written
+ */
+static size_t ipfs_exporter_cat_write(void* ptr, size_t size, size_t nmemb, void* data) {
+	struct ExporterCatOutput* output = (struct ExporterCatOutput*)data;
+	size_t written = fwrite(ptr, size, nmemb, output->out);
+	output->bytes += written * size;
+	return written;
+}
+
 /***
  * Called from the command line with ipfs cat [hash]. Retrieves the object
  * pointed to by hash, and displays its raw block data to the console
@@ -306,20 +332,20 @@ int ipfs_exporter_object_cat(struct CliArguments* args, FILE* output_file) {
 			}
 		}
 		struct HttpRequest* request = ipfs_core_http_request_new();
-		char* response = NULL;
 		request->command = "object";
 		request->sub_command = "get";
 		request->arguments = libp2p_utils_vector_new(1);
 		libp2p_utils_vector_add(request->arguments, hash);
-		size_t response_size = 0;
-		int retVal = ipfs_core_http_request_post(local_node, request, &response, &response_size, "", 0);
-		if (response != NULL && response_size > 0) {
-			fwrite(response, 1, response_size, output_file);
-			free(response);
-		} else {
+		// the file goes to the output as it arrives
+		struct ExporterCatOutput output;
+		output.out = output_file;
+		output.bytes = 0;
+		int retVal = ipfs_core_http_request_perform(local_node, request, "", 0, ipfs_exporter_cat_write, &output);
+		ipfs_core_http_request_free(request);
+		if (retVal && output.bytes == 0) {
+			libp2p_logger_error("exporter", "The API returned nothing for %s.\n", hash);
 			retVal = 0;
 		}
-		ipfs_core_http_request_free(request);
 		return retVal;
 	} else {
 		libp2p_logger_debug("exporter", "API not available, using direct access.\n");
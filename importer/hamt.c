@@ -0,0 +1,397 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/utils/logger.h"
+#include "ipfs/importer/exporter.h"
+#include "ipfs/importer/hamt.h"
+#include "ipfs/merkledag/merkledag.h"
+#include "ipfs/multihash/multihash.h"
+#include "ipfs/unixfs/unixfs.h"
+
+/***
+ * The layout of the shards of a directory
+ */
+struct HamtLayout {
+	int bits; // of the hash, used by each level
+	int width; // the number of hex digits of a slot in a link name
+	int max_depth; // the number of levels the hash is enough for
+	int hash_function; // the multihash code the shards are hashed with, that of the directory, when building
+};
+
+/***
+ * An entry of the directory being sharded
+ */
+struct HamtEntry {
+	uint64_t hash;
+	struct NodeLink* link;
+};
+
+static uint64_t ipfs_hamt_rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t ipfs_hamt_fmix(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/***
+ * Hash a name the way go-ipfs does, with the first 64 bits of murmur3 x64 128
+ * @param name the name
+ * @returns the hash, of which the high bits pick the slot of the root shard
+ */
+static uint64_t ipfs_hamt_hash(const char* name) {
+	const uint8_t* data = (const uint8_t*)name;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	size_t length = strlen(name);
+	size_t blocks = length / 16;
+	uint64_t h1 = 0, h2 = 0, k1, k2;
+
+	for (size_t i = 0; i < blocks; i++) {
+		k1 = k2 = 0;
+		for (int j = 7; j >= 0; j--) {
+			k1 = (k1 << 8) | data[i * 16 + j];
+			k2 = (k2 << 8) | data[i * 16 + 8 + j];
+		}
+		k1 *= c1; k1 = ipfs_hamt_rotl(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = ipfs_hamt_rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = ipfs_hamt_rotl(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = ipfs_hamt_rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+	const uint8_t* tail = &data[blocks * 16];
+	k1 = k2 = 0;
+	for (int j = (int)(length & 15) - 1; j >= 8; j--)
+		k2 = (k2 << 8) | tail[j];
+	for (int j = (int)(length & 15) > 8 ? 7 : (int)(length & 15) - 1; j >= 0; j--)
+		k1 = (k1 << 8) | tail[j];
+	if ((length & 15) > 8) {
+		k2 *= c2; k2 = ipfs_hamt_rotl(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+	if ((length & 15) > 0) {
+		k1 *= c1; k1 = ipfs_hamt_rotl(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+	h1 ^= length;
+	h2 ^= length;
+	h1 += h2;
+	h2 += h1;
+	h1 = ipfs_hamt_fmix(h1);
+	h2 = ipfs_hamt_fmix(h2);
+	return h1 + h2;
+}
+
+/***
+ * Work out the layout from the fanout
+ * @param fanout the number of slots of a shard
+ * @param layout where to put it
+ * @returns true(1) on success, false(0) if the fanout isn't one this can read
+ */
+static int ipfs_hamt_layout(unsigned long long fanout, struct HamtLayout* layout) {
+	if (fanout < 2 || fanout > 65536 || (fanout & (fanout - 1)) != 0)
+		return 0;
+	layout->bits = 0;
+	while ((1ULL << layout->bits) < fanout)
+		layout->bits++;
+	layout->width = 0;
+	for (unsigned long long v = fanout - 1; v != 0; v >>= 4)
+		layout->width++;
+	layout->max_depth = 64 / layout->bits;
+	layout->hash_function = IPFS_MULTIHASH_SHA2_256;
+	return 1;
+}
+
+/***
+ * The slot of a hash in a shard
+ * @param hash the hash of the name
+ * @param depth the level of the shard, 0 for the root
+ * @param layout the layout
+ * @returns the slot
+ */
+static unsigned int ipfs_hamt_slot(uint64_t hash, int depth, const struct HamtLayout* layout) {
+	return (unsigned int)(hash >> (64 - layout->bits * (depth + 1))) & ((1U << layout->bits) - 1);
+}
+
+/***
+ * Read what a shard says about itself
+ * @param node the node
+ * @param layout where to put the layout, can be NULL
+ * @returns true(1) if it is a shard (of a layout this can read, if one was asked for)
+ */
+static int ipfs_hamt_read_shard(struct HashtableNode* node, struct HamtLayout* layout) {
+	struct UnixFS* unix_fs = NULL;
+	int retVal = 0;
+
+	if (node == NULL || node->data_size < 2)
+		return 0;
+	if (!ipfs_unixfs_protobuf_decode(node->data, node->data_size, &unix_fs))
+		return 0;
+	if (unix_fs->data_type == UNIXFS_HAMTSHARD) {
+		retVal = 1;
+		if (layout != NULL) {
+			if (unix_fs->hash_type != HAMT_HASH_MURMUR3 || !ipfs_hamt_layout(unix_fs->fanout, layout)) {
+				libp2p_logger_error("hamt", "Shard with hash type %llu and fanout %llu is not supported.\n",
+						unix_fs->hash_type, unix_fs->fanout);
+				retVal = 0;
+			}
+		}
+	}
+	ipfs_unixfs_free(unix_fs);
+	return retVal;
+}
+
+int ipfs_hamt_is_shard(struct HashtableNode* node) {
+	return ipfs_hamt_read_shard(node, NULL);
+}
+
+/***
+ * Get a shard, from the repo if it is there, otherwise from the network
+ * @param local_node the context
+ * @param hash the hash of the shard
+ * @param hash_size the length of the hash
+ * @param node where to put it
+ * @returns true(1) on success
+ */
+static int ipfs_hamt_get_node(const struct IpfsNode* local_node, const unsigned char* hash, size_t hash_size, struct HashtableNode** node) {
+	*node = NULL;
+	if (ipfs_merkledag_get(hash, hash_size, node, local_node->repo))
+		return 1;
+	if (local_node->routing == NULL)
+		return 0;
+	return ipfs_exporter_get_node((struct IpfsNode*)local_node, hash, hash_size, node);
+}
+
+/***
+ * Put the UnixFS data of a shard in a node
+ * @param node the shard
+ * @param bitfield which slots are used, big endian, as go-ipfs has it
+ * @returns true(1) on success
+ */
+static int ipfs_hamt_set_data(struct HashtableNode* node, const unsigned char* bitfield, size_t bitfield_size) {
+	struct UnixFS* unix_fs = NULL;
+	int retVal = 0;
+
+	if (!ipfs_unixfs_new(&unix_fs))
+		return 0;
+	unix_fs->data_type = UNIXFS_HAMTSHARD;
+	unix_fs->hash_type = HAMT_HASH_MURMUR3;
+	unix_fs->fanout = HAMT_FANOUT;
+	// without the leading zeros, like a big integer
+	while (bitfield_size > 0 && bitfield[0] == 0) {
+		bitfield++;
+		bitfield_size--;
+	}
+	if (bitfield_size > 0) {
+		unix_fs->bytes = malloc(bitfield_size);
+		if (unix_fs->bytes == NULL) {
+			ipfs_unixfs_free(unix_fs);
+			return 0;
+		}
+		memcpy(unix_fs->bytes, bitfield, bitfield_size);
+		unix_fs->bytes_size = bitfield_size;
+	}
+	size_t protobuf_size = ipfs_unixfs_protobuf_encode_size(unix_fs);
+	unsigned char protobuf[protobuf_size];
+	if (ipfs_unixfs_protobuf_encode(unix_fs, protobuf, protobuf_size, &protobuf_size))
+		retVal = ipfs_hashtable_node_set_data(node, protobuf, protobuf_size);
+	ipfs_unixfs_free(unix_fs);
+	return retVal;
+}
+
+static int ipfs_hamt_entry_compare(const void* a, const void* b) {
+	const struct HamtEntry* x = (const struct HamtEntry*)a;
+	const struct HamtEntry* y = (const struct HamtEntry*)b;
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return strcmp(x->link->name, y->link->name);
+}
+
+/***
+ * Build a shard, and store the shards below it
+ * @param entries the entries of this shard, sorted by hash, so each slot is a run of them
+ * @param count the number of entries
+ * @param depth the level of the shard, 0 for the root
+ * @param layout the layout
+ * @param fs_repo where to store the shards below
+ * @param shard where to put the shard, which is not stored
+ * @param bytes_written incremented by what is written to the repo
+ * @returns true(1) on success
+ */
+static int ipfs_hamt_build(struct HamtEntry* entries, size_t count, int depth, const struct HamtLayout* layout,
+		struct FSRepo* fs_repo, struct HashtableNode** shard, size_t* bytes_written) {
+	unsigned char bitfield[HAMT_FANOUT / 8];
+	char prefix[layout->width + 1];
+	size_t end;
+
+	memset(bitfield, 0, sizeof(bitfield));
+	if (!ipfs_hashtable_node_new(shard))
+		return 0;
+	(*shard)->hash_function = layout->hash_function;
+	for (size_t i = 0; i < count; i = end) {
+		unsigned int slot = ipfs_hamt_slot(entries[i].hash, depth, layout);
+		struct NodeLink* link = NULL;
+		for (end = i + 1; end < count && ipfs_hamt_slot(entries[end].hash, depth, layout) == slot; end++)
+			;
+		bitfield[sizeof(bitfield) - 1 - slot / 8] |= 1 << (slot % 8);
+		sprintf(prefix, "%0*X", layout->width, slot);
+		if (end - i == 1) {
+			// the entry itself
+			struct NodeLink* entry = entries[i].link;
+			char name[layout->width + strlen(entry->name) + 1];
+			sprintf(name, "%s%s", prefix, entry->name);
+			if (!ipfs_node_link_create(name, entry->hash, entry->hash_size, &link))
+				goto fail;
+			link->t_size = entry->t_size;
+		} else {
+			// the shard below
+			struct HashtableNode* child = NULL;
+			size_t child_bytes = 0;
+			if (depth + 1 >= layout->max_depth) {
+				libp2p_logger_error("hamt", "The names %s and %s have the same hash.\n", entries[i].link->name, entries[i + 1].link->name);
+				goto fail;
+			}
+			if (!ipfs_hamt_build(&entries[i], end - i, depth + 1, layout, fs_repo, &child, bytes_written))
+				goto fail;
+			if (!ipfs_merkledag_add(child, fs_repo, &child_bytes)
+					|| !ipfs_node_link_create(prefix, child->hash, child->hash_size, &link)) {
+				ipfs_hashtable_node_free(child);
+				goto fail;
+			}
+			*bytes_written += child_bytes;
+			link->t_size = child_bytes;
+			for (size_t j = i; j < end; j++)
+				link->t_size += entries[j].link->t_size;
+			ipfs_hashtable_node_free(child);
+		}
+		ipfs_hashtable_node_add_link(*shard, link);
+	}
+	if (!ipfs_hamt_set_data(*shard, bitfield, sizeof(bitfield)))
+		goto fail;
+	return 1;
+
+	fail:
+	ipfs_hashtable_node_free(*shard);
+	*shard = NULL;
+	return 0;
+}
+
+int ipfs_hamt_shard_directory(struct HashtableNode** directory, struct FSRepo* fs_repo, size_t* bytes_written) {
+	struct HamtLayout layout;
+	struct HashtableNode* root = NULL;
+	struct HamtEntry* entries;
+	size_t count = 0;
+
+	*bytes_written = 0;
+	ipfs_hamt_layout(HAMT_FANOUT, &layout);
+	layout.hash_function = (*directory)->hash_function;
+	entries = malloc(sizeof(struct HamtEntry) * ((*directory)->link_count + 1));
+	if (entries == NULL)
+		return 0;
+	for (struct NodeLink* link = (*directory)->head_link; link != NULL; link = link->next) {
+		if (link->name == NULL) {
+			// can't be found by name, so it isn't an entry
+			continue;
+		}
+		entries[count].hash = ipfs_hamt_hash(link->name);
+		entries[count].link = link;
+		count++;
+	}
+	qsort(entries, count, sizeof(struct HamtEntry), ipfs_hamt_entry_compare);
+	for (size_t i = 1; i < count; i++) {
+		if (strcmp(entries[i - 1].link->name, entries[i].link->name) == 0) {
+			libp2p_logger_error("hamt", "The directory has %s twice.\n", entries[i].link->name);
+			free(entries);
+			return 0;
+		}
+	}
+	int retVal = ipfs_hamt_build(entries, count, 0, &layout, fs_repo, &root, bytes_written);
+	free(entries);
+	if (!retVal)
+		return 0;
+	libp2p_logger_debug("hamt", "Sharded a directory of %lu entries.\n", (unsigned long)count);
+	ipfs_hashtable_node_free(*directory);
+	*directory = root;
+	return 1;
+}
+
+int ipfs_hamt_find(struct HashtableNode* shard, const char* name, const struct IpfsNode* local_node, struct NodeLink** link) {
+	struct HamtLayout layout;
+	struct HashtableNode* current = shard;
+	struct HashtableNode* next = NULL;
+	uint64_t hash = ipfs_hamt_hash(name);
+	int retVal = 0;
+
+	*link = NULL;
+	if (!ipfs_hamt_read_shard(shard, &layout))
+		return 0;
+	char key[layout.width + strlen(name) + 1];
+	for (int depth = 0; depth < layout.max_depth; depth++) {
+		sprintf(key, "%0*X%s", layout.width, ipfs_hamt_slot(hash, depth, &layout), name);
+		struct NodeLink* found = ipfs_hashtable_node_get_link_by_name(current, key);
+		if (found != NULL) {
+			if (ipfs_node_link_create((char*)name, found->hash, found->hash_size, link)) {
+				(*link)->t_size = found->t_size;
+				retVal = 1;
+			}
+			break;
+		}
+		// not in this shard, so maybe in the one below
+		key[layout.width] = 0;
+		found = ipfs_hashtable_node_get_link_by_name(current, key);
+		if (found == NULL || !ipfs_hamt_get_node(local_node, found->hash, found->hash_size, &next))
+			break;
+		if (current != shard)
+			ipfs_hashtable_node_free(current);
+		current = next;
+		if (!ipfs_hamt_is_shard(current))
+			break;
+	}
+	if (current != shard)
+		ipfs_hashtable_node_free(current);
+	return retVal;
+}
+
+/***
+ * Go through the entries of a shard, and the shards below it
+ * @param shard the shard
+ * @param layout the layout
+ * @param local_node the context
+ * @param func what to call
+ * @param arg passed to func
+ * @returns true(1) if all entries were seen
+ */
+static int ipfs_hamt_foreach_shard(struct HashtableNode* shard, const struct HamtLayout* layout, const struct IpfsNode* local_node,
+		int (*func)(struct NodeLink* link, void* arg), void* arg) {
+	for (struct NodeLink* current = shard->head_link; current != NULL; current = current->next) {
+		if (current->name == NULL || strlen(current->name) < layout->width)
+			continue;
+		if (strlen(current->name) > layout->width) {
+			struct NodeLink entry = *current;
+			entry.name = &current->name[layout->width];
+			entry.next = NULL;
+			if (!func(&entry, arg))
+				return 0;
+		} else {
+			struct HashtableNode* child = NULL;
+			if (!ipfs_hamt_get_node(local_node, current->hash, current->hash_size, &child))
+				return 0;
+			int retVal = ipfs_hamt_is_shard(child) && ipfs_hamt_foreach_shard(child, layout, local_node, func, arg);
+			ipfs_hashtable_node_free(child);
+			if (!retVal)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+int ipfs_hamt_foreach(struct HashtableNode* shard, const struct IpfsNode* local_node, int (*func)(struct NodeLink* link, void* arg), void* arg) {
+	struct HamtLayout layout;
+	if (!ipfs_hamt_read_shard(shard, &layout))
+		return 0;
+	return ipfs_hamt_foreach_shard(shard, &layout, local_node, func, arg);
+}
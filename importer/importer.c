@@ -6,8 +6,11 @@
 #include <string.h>
 #include <pthread.h>
 
+#include "ipfs/importer/hamt.h"
 #include "ipfs/importer/importer.h"
 #include "ipfs/merkledag/merkledag.h"
+#include "ipfs/multihash/multihash.h"
+#include "ipfs/pin/pin.h"
 #include "libp2p/os/utils.h"
 #include "ipfs/cmd/cli.h"
 #include "ipfs/core/ipfs_node.h"
@@ -53,15 +56,14 @@ int ipfs_importer_add_filesize_to_data_section(struct HashtableNode* node, size_
 }
 
 /**
- * read the next chunk of bytes, create a node, and add a link to the node in the passed-in node
- * @param file the file handle
+ * create a node from a chunk of bytes, and add a link to the node in the passed-in node
+ * NOTE: a chunk of MAX_DATA_SIZE bytes means that more chunks follow
+ * @param buffer the bytes
+ * @param bytes_read the number of bytes
  * @param node the node to add to
- * @returns number of bytes read
+ * @returns true(1) on success
  */
-size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct FSRepo* fs_repo, size_t* total_size, size_t* bytes_written) {
-	unsigned char buffer[MAX_DATA_SIZE];
-	size_t bytes_read = fread(buffer, 1, MAX_DATA_SIZE, file);
-
+int ipfs_import_chunk_data(const unsigned char* buffer, size_t bytes_read, struct HashtableNode* parent_node, struct FSRepo* fs_repo, size_t* total_size, size_t* bytes_written) {
 	// structs used by this method
 	struct UnixFS* new_unixfs = NULL;
 	struct HashtableNode* new_node = NULL;
@@ -72,7 +74,7 @@ size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct F
 		return 0;
 	new_unixfs->data_type = UNIXFS_FILE;
 	new_unixfs->file_size = bytes_read;
-	if (ipfs_unixfs_add_data(&buffer[0], bytes_read, new_unixfs) == 0) {
+	if (ipfs_unixfs_add_data((unsigned char*)buffer, bytes_read, new_unixfs) == 0) {
 		ipfs_unixfs_free(new_unixfs);
 		return 0;
 	}
@@ -100,6 +102,7 @@ size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct F
 		if (ipfs_hashtable_node_new_from_data(protobuf, *bytes_written, &new_node) == 0) {
 			return 0;
 		}
+		new_node->hash_function = parent_node->hash_function;
 		// persist
 		size_t size_of_node = 0;
 		if (ipfs_merkledag_add(new_node, fs_repo, &size_of_node) == 0) {
@@ -134,6 +137,7 @@ size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct F
 			if (ipfs_hashtable_node_new_from_data(protobuf, *bytes_written, &new_node) == 0) {
 				return 0;
 			}
+			new_node->hash_function = parent_node->hash_function;
 			// persist
 			if (ipfs_merkledag_add(new_node, fs_repo, &size_of_node) == 0) {
 				ipfs_hashtable_node_free(new_node);
@@ -160,6 +164,21 @@ size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct F
 		*bytes_written += size_of_node;
 	} // add to parent vs add as link
 
+	return 1;
+}
+
+/**
+ * read the next chunk of bytes, create a node, and add a link to the node in the passed-in node
+ * @param file the file handle
+ * @param node the node to add to
+ * @returns number of bytes read
+ */
+size_t ipfs_import_chunk(FILE* file, struct HashtableNode* parent_node, struct FSRepo* fs_repo, size_t* total_size, size_t* bytes_written) {
+	unsigned char buffer[MAX_DATA_SIZE];
+	size_t bytes_read = fread(buffer, 1, MAX_DATA_SIZE, file);
+
+	if (!ipfs_import_chunk_data(buffer, bytes_read, parent_node, fs_repo, total_size, bytes_written))
+		return 0;
 	return bytes_read;
 }
 
@@ -183,6 +202,21 @@ int ipfs_import_print_node_results(const struct HashtableNode* node, const char*
 }
 
 
+/***
+ * Tell the network that we have a node, and the nodes it links to
+ * @param local_node the context
+ * @param htn the node
+ */
+static void ipfs_import_provide(struct IpfsNode* local_node, struct HashtableNode* htn) {
+	local_node->routing->Provide(local_node->routing, htn->hash, htn->hash_size);
+	// notify the network of the subnodes too
+	struct NodeLink *nl = htn->head_link;
+	while (nl != NULL) {
+		local_node->routing->Provide(local_node->routing, nl->hash, nl->hash_size);
+		nl = nl->next;
+	}
+}
+
 /**
  * Creates a node based on an incoming file or directory
  * NOTE: this can be called recursively for directories
@@ -196,9 +230,10 @@ int ipfs_import_print_node_results(const struct HashtableNode* node, const char*
  * @param fs_repo the ipfs repository
  * @param bytes_written number of bytes written to disk
  * @param recursive true if we should navigate directories
+ * @param hash_function the multihash code of the function to hash the nodes with
  * @returns true(1) on success
  */
-int ipfs_import_file(const char* root_dir, const char* fileName, struct HashtableNode** parent_node, struct IpfsNode* local_node, size_t* bytes_written, int recursive) {
+int ipfs_import_file_with_hash(const char* root_dir, const char* fileName, struct HashtableNode** parent_node, struct IpfsNode* local_node, size_t* bytes_written, int recursive, int hash_function) {
 	/**
 	 * NOTE: When this function completes, parent_node will be either:
 	 * 1) the complete file, in the case of a small file (<256k-ish)
@@ -237,6 +272,7 @@ int ipfs_import_file(const char* root_dir, const char* fileName, struct Hashtabl
 				free(file);
 			return 0;
 		}
+		(*parent_node)->hash_function = hash_function;
 		// get list of files
 		struct FileList* first = os_utils_list_directory(fileName);
 		struct FileList* next = first;
@@ -252,7 +288,7 @@ int ipfs_import_file(const char* root_dir, const char* fileName, struct Hashtabl
 				os_utils_filepath_join(fileName, next->file_name, full_file_name, filename_len);
 				// adjust root directory
 
-				if (ipfs_import_file(new_root_dir, full_file_name, &file_node, local_node, bytes_written, recursive) == 0) {
+				if (ipfs_import_file_with_hash(new_root_dir, full_file_name, &file_node, local_node, bytes_written, recursive, hash_function) == 0) {
 					ipfs_hashtable_node_free(*parent_node);
 					os_utils_free_file_list(first);
 					if (file != NULL)
@@ -279,6 +315,19 @@ int ipfs_import_file(const char* root_dir, const char* fileName, struct Hashtabl
 				next = next->next;
 			} // while going through files
 		}
+		// a directory too big for one block is split into shards
+		if (ipfs_hashtable_node_protobuf_encode_size(*parent_node) > HAMT_SHARD_THRESHOLD) {
+			size_t shard_bytes = 0;
+			if (!ipfs_hamt_shard_directory(parent_node, local_node->repo, &shard_bytes)) {
+				ipfs_hashtable_node_free(*parent_node);
+				os_utils_free_file_list(first);
+				if (file != NULL)
+					free(file);
+				if (path != NULL)
+					free (path);
+				return 0;
+			}
+		}
 		// save the parent_node (the directory)
 		size_t bytes_written;
 		ipfs_merkledag_add(*parent_node, local_node->repo, &bytes_written);
@@ -294,8 +343,10 @@ int ipfs_import_file(const char* root_dir, const char* fileName, struct Hashtabl
 			return 0;
 		retVal = ipfs_hashtable_node_new(parent_node);
 		if (retVal == 0) {
+			fclose(file);
 			return 0;
 		}
+		(*parent_node)->hash_function = hash_function;
 
 		// add all nodes (will be called multiple times for large files)
 		while ( bytes_read == MAX_DATA_SIZE) {
@@ -306,19 +357,113 @@ int ipfs_import_file(const char* root_dir, const char* fileName, struct Hashtabl
 		fclose(file);
 	}
 
-	// notify the network
-	struct HashtableNode *htn = *parent_node;
-	local_node->routing->Provide(local_node->routing, htn->hash, htn->hash_size);
-	// notify the network of the subnodes too
-	struct NodeLink *nl = htn->head_link;
-	while (nl != NULL) {
-		local_node->routing->Provide(local_node->routing, nl->hash, nl->hash_size);
-		nl = nl->next;
+	ipfs_import_provide(local_node, *parent_node);
+
+	return 1;
+}
+
+/**
+ * Creates a node based on an incoming file or directory, hashed with sha2-256
+ * @param root_dir the directory for where to look for the file
+ * @param file_name the file (or directory) to import
+ * @param parent_node the root node (has links to others in case this is a large file and is split)
+ * @param fs_repo the ipfs repository
+ * @param bytes_written number of bytes written to disk
+ * @param recursive true if we should navigate directories
+ * @returns true(1) on success
+ */
+int ipfs_import_file(const char* root_dir, const char* fileName, struct HashtableNode** parent_node, struct IpfsNode* local_node, size_t* bytes_written, int recursive) {
+	return ipfs_import_file_with_hash(root_dir, fileName, parent_node, local_node, bytes_written, recursive, IPFS_MULTIHASH_SHA2_256);
+}
+
+/***
+ * Start an import of a file that arrives in pieces
+ * @param local_node the context
+ * @returns a new ImportStream, or NULL on error
+ */
+struct ImportStream* ipfs_import_stream_new(struct IpfsNode* local_node) {
+	struct ImportStream* stream = (struct ImportStream*) malloc(sizeof(struct ImportStream));
+	if (stream == NULL)
+		return NULL;
+	stream->local_node = local_node;
+	stream->add_started = ipfs_repo_fsrepo_add_begin(local_node->repo);
+	stream->node = NULL;
+	stream->buffer_size = 0;
+	stream->total_size = 0;
+	stream->bytes_written = 0;
+	stream->buffer = (unsigned char*) malloc(MAX_DATA_SIZE);
+	if (stream->buffer == NULL || ipfs_hashtable_node_new(&stream->node) == 0) {
+		ipfs_import_stream_free(stream);
+		return NULL;
 	}
+	return stream;
+}
 
+/***
+ * Add bytes to the file. Each time a chunk is full, it is written to the datastore.
+ * @param stream the ImportStream
+ * @param data the bytes
+ * @param data_size the number of bytes
+ * @returns true(1) on success
+ */
+int ipfs_import_stream_write(struct ImportStream* stream, const uint8_t* data, size_t data_size) {
+	while (data_size > 0) {
+		size_t len = MAX_DATA_SIZE - stream->buffer_size;
+		if (len > data_size)
+			len = data_size;
+		memcpy(&stream->buffer[stream->buffer_size], data, len);
+		stream->buffer_size += len;
+		data += len;
+		data_size -= len;
+		if (stream->buffer_size == MAX_DATA_SIZE) {
+			size_t written = 0;
+			if (!ipfs_import_chunk_data(stream->buffer, stream->buffer_size, stream->node, stream->local_node->repo, &stream->total_size, &written))
+				return 0;
+			stream->bytes_written += written;
+			stream->buffer_size = 0;
+		}
+	}
 	return 1;
 }
 
+/***
+ * Write what is left, pin the file, and tell the network about it
+ * @param stream the ImportStream
+ * @param node where to put the node of the file (the caller frees it)
+ * @returns true(1) on success
+ */
+int ipfs_import_stream_finish(struct ImportStream* stream, struct HashtableNode** node) {
+	size_t written = 0;
+	// a chunk smaller than MAX_DATA_SIZE (even empty) ends the file
+	if (!ipfs_import_chunk_data(stream->buffer, stream->buffer_size, stream->node, stream->local_node->repo, &stream->total_size, &written))
+		return 0;
+	stream->bytes_written += written;
+	stream->buffer_size = 0;
+	if (!ipfs_pin_add(stream->local_node->repo, stream->node->hash, stream->node->hash_size, Recursive))
+		return 0;
+	ipfs_repo_fsrepo_add_end(stream->local_node->repo, stream->add_started);
+	stream->add_started = 0;
+	ipfs_import_provide(stream->local_node, stream->node);
+	*node = stream->node;
+	stream->node = NULL;
+	return 1;
+}
+
+/***
+ * Free resources of an ImportStream
+ * @param stream the ImportStream
+ */
+void ipfs_import_stream_free(struct ImportStream* stream) {
+	if (stream != NULL) {
+		ipfs_repo_fsrepo_add_end(stream->local_node->repo, stream->add_started);
+		if (stream->node != NULL)
+			ipfs_hashtable_node_free(stream->node);
+		if (stream->buffer != NULL)
+			free(stream->buffer);
+		free(stream);
+	}
+}
+
 /**
  * Pulls list of files from command line parameters
  * @param argc number of command line parameters
@@ -366,6 +511,26 @@ int ipfs_import_is_recursive(int argc, char** argv) {
 	return 0;
 }
 
+/**
+ * See which hash function was asked for on the command line with --hash=<name>
+ * @param argc number of command line parameters
+ * @param argv command line parameters
+ * @param hash_function where to put its multihash code, sha2-256 if none was asked for
+ * @returns true(1) on success, false(0) if the function is not known
+ */
+int ipfs_import_hash_function(int argc, char** argv, int* hash_function) {
+	*hash_function = IPFS_MULTIHASH_SHA2_256;
+	for(int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--hash=", 7) == 0) {
+			const struct MultihashFunction* function = ipfs_multihash_function_by_name(&argv[i][7]);
+			if (function == NULL)
+				return 0;
+			*hash_function = function->code;
+		}
+	}
+	return 1;
+}
+
 /**
  * called from the command line to import multiple files or directories
  * @param argc the number of arguments
@@ -376,7 +541,8 @@ int ipfs_import_files(struct CliArguments* args) {
 	 * Param 0: ipfs
 	 * param 1: add
 	 * param 2: -r (optional)
-	 * param 3: directoryname
+	 * param 3: --hash=<name> (optional)
+	 * param 4: directoryname
 	 */
 	struct IpfsNode* local_node = NULL;
 	char* repo_path = NULL;
@@ -388,6 +554,11 @@ int ipfs_import_files(struct CliArguments* args) {
 	struct HashtableNode* directory_entry = NULL;
 
 	int recursive = ipfs_import_is_recursive(args->argc, args->argv);
+	int hash_function = IPFS_MULTIHASH_SHA2_256;
+	if (!ipfs_import_hash_function(args->argc, args->argv, &hash_function)) {
+		fprintf(stderr, "Unknown hash function. Use sha2-256, blake2b-256 or blake3.\n");
+		return 0;
+	}
 
 	// parse the command line
 	first = ipfs_import_get_filelist(args);
@@ -428,8 +599,14 @@ int ipfs_import_files(struct CliArguments* args) {
 			if (current->file_name[0] != '-') { // not a switch
 				os_utils_split_filename(current->file_name, &path, &filename);
 				size_t bytes_written = 0;
-				if (!ipfs_import_file(NULL, current->file_name, &directory_entry, local_node, &bytes_written, recursive))
+				// what is written is kept from the garbage collector until it is pinned
+				int add_started = ipfs_repo_fsrepo_add_begin(local_node->repo);
+				if (!ipfs_import_file_with_hash(NULL, current->file_name, &directory_entry, local_node, &bytes_written, recursive, hash_function)
+						|| !ipfs_pin_add(local_node->repo, directory_entry->hash, directory_entry->hash_size, Recursive)) {
+					ipfs_repo_fsrepo_add_end(local_node->repo, add_started);
 					goto exit;
+				}
+				ipfs_repo_fsrepo_add_end(local_node->repo, add_started);
 				ipfs_import_print_node_results(directory_entry, filename);
 				// cleanup
 				if (path != NULL) {
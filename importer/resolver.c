@@ -4,6 +4,7 @@
 #include <pthread.h>
 #include <unistd.h>
 
+#include "ipfs/importer/hamt.h"
 #include "ipfs/importer/resolver.h"
 #include "libp2p/utils/logger.h"
 #include "libp2p/crypto/encoding/base58.h"
@@ -17,6 +18,7 @@
 #include "multiaddr/multiaddr.h"
 #include "libp2p/record/message.h"
 #include "libp2p/conn/dialer.h"
+#include "ipfs/util/trace.h"
 
 /**
  * return the next chunk of a path
@@ -118,6 +120,7 @@ int ipfs_resolver_is_remote(const char* path, const struct FSRepo* fs_repo) {
  * @returns the node, or NULL if not found
  */
 struct HashtableNode* ipfs_resolver_remote_get(const char* path, struct HashtableNode* from, const struct IpfsNode* ipfs_node) {
+	IPFS_TRACE_SPAN("ipfs_resolver_remote_get");
 	// parse the path
 	const char* temp = ipfs_resolver_remove_path_prefix(path, ipfs_node->repo);
 	if (temp == NULL)
@@ -140,7 +143,11 @@ struct HashtableNode* ipfs_resolver_remote_get(const char* path, struct Hashtabl
 		//TODO: We don't have the peer address. Ask the swarm for the data related to the hash
 		return NULL;
 	}
-	if (!libp2p_peer_connect(ipfs_node->dialer, peer, ipfs_node->peerstore, ipfs_node->repo->config->datastore, 10))
+	struct TraceSpan dial;
+	ipfs_util_trace_begin(&dial, "libp2p_peer_connect");
+	int connected = libp2p_peer_connect(ipfs_node->dialer, peer, ipfs_node->peerstore, ipfs_node->repo->config->datastore, 10);
+	ipfs_util_trace_end(&dial);
+	if (!connected)
 		return NULL;
 	struct Stream* kademlia_stream = libp2p_conn_dialer_get_stream(ipfs_node->dialer, peer, "kademlia");
 	if (kademlia_stream == NULL)
@@ -185,6 +192,7 @@ struct HashtableNode* ipfs_resolver_remote_get(const char* path, struct Hashtabl
  * @returns what we are looking for, or NULL if it wasn't found
  */
 struct HashtableNode* ipfs_resolver_get(const char* path, struct HashtableNode* from, const struct IpfsNode* ipfs_node) {
+	IPFS_TRACE_SPAN("ipfs_resolver_get");
 
 	struct FSRepo* fs_repo = ipfs_node->repo;
 
@@ -239,35 +247,42 @@ struct HashtableNode* ipfs_resolver_get(const char* path, struct HashtableNode*
 		}
 	} else {
 		// we were passed a node. If it is a directory, see if what we're looking for is in it
-		if (ipfs_hashtable_node_is_directory(from)) {
-			struct NodeLink* curr_link = from->head_link;
-			while (curr_link != NULL) {
-				// if it matches the name, we found what we're looking for.
-				// If so, load up the node by its hash
-				if (strcmp(curr_link->name, path_section) == 0) {
-					if (ipfs_merkledag_get(curr_link->hash, curr_link->hash_size, &current_node, fs_repo) == 0) {
-						free(path_section);
-						return NULL;
-					}
-					if (strlen(path_section) == strlen(path)) {
-						// we are at the end of our search
-						ipfs_hashtable_node_free(from);
-						from = NULL;
-						free(path_section);
-						return current_node;
-					} else {
-						char* next_path_section;
-						ipfs_resolver_next_path(&path[strlen(path_section)], &next_path_section);
-						free(path_section);
-						// if we're at the end of the path, return the node
-						// continue looking for the next part of the path
-						ipfs_hashtable_node_free(from);
-						from = NULL;
-						struct HashtableNode* newNode = ipfs_resolver_get(next_path_section, current_node, ipfs_node);
-						return newNode;
-					}
+		int sharded = ipfs_hamt_is_shard(from);
+		if (sharded || ipfs_hashtable_node_is_directory(from)) {
+			struct NodeLink* curr_link = NULL;
+			if (sharded) {
+				// a copy, from the shards along the hash of the name
+				ipfs_hamt_find(from, path_section, ipfs_node, &curr_link);
+			} else {
+				curr_link = ipfs_hashtable_node_get_link_by_name(from, path_section);
+			}
+			// if it matches the name, we found what we're looking for.
+			// If so, load up the node by its hash
+			if (curr_link != NULL) {
+				int found = ipfs_merkledag_get(curr_link->hash, curr_link->hash_size, &current_node, fs_repo);
+				if (sharded)
+					ipfs_node_link_free(curr_link);
+				if (found == 0) {
+					free(path_section);
+					return NULL;
+				}
+				if (strlen(path_section) == strlen(path)) {
+					// we are at the end of our search
+					ipfs_hashtable_node_free(from);
+					from = NULL;
+					free(path_section);
+					return current_node;
+				} else {
+					char* next_path_section;
+					ipfs_resolver_next_path(&path[strlen(path_section)], &next_path_section);
+					free(path_section);
+					// if we're at the end of the path, return the node
+					// continue looking for the next part of the path
+					ipfs_hashtable_node_free(from);
+					from = NULL;
+					struct HashtableNode* newNode = ipfs_resolver_get(next_path_section, current_node, ipfs_node);
+					return newNode;
 				}
-				curr_link = curr_link->next;
 			}
 		} else {
 			// we're asking for a file from an object that is not a directory. Bail.
@@ -5,9 +5,14 @@
 #ifndef __IPFS_BLOCKS_BLOCKSTORE_H__
 #define __IPFS_BLOCKS_BLOCKSTORE_H__
 
+#include <sys/types.h>
+
 #include "ipfs/cid/cid.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 
+// the size of the datastore key of a multihash, the base32 of it and a NULL
+#define IPFS_BLOCKSTORE_KEY_SIZE(hash_length) (((hash_length) * 8 + 4) / 5 + 1)
+
 struct BlockstoreContext {
 	const struct FSRepo* fs_repo;
 };
@@ -94,4 +99,34 @@ int ipfs_blockstore_get_unixfs(const unsigned char* hash, size_t hash_length, st
 int ipfs_blockstore_put_node(const struct HashtableNode* node, const struct FSRepo* fs_repo, size_t* bytes_written);
 int ipfs_blockstore_get_node(const unsigned char* hash, size_t hash_length, struct HashtableNode** node, const struct FSRepo* fs_repo);
 
+/***
+ * Find where the data of a UnixFS leaf is within the file of its block
+ * @param hash the hash of the node
+ * @param hash_length the length of the hash
+ * @param fs_repo where the block is stored
+ * @param fd the open file of the block, to be closed by the caller
+ * @param offset where the data starts in the file
+ * @param size the number of bytes of data
+ * @returns true(1) if the block is stored here and is a leaf with data, false(0) otherwise
+ */
+int ipfs_blockstore_locate_unixfs_data(const unsigned char* hash, size_t hash_length, const struct FSRepo* fs_repo, int* fd, off_t* offset, size_t* size);
+
+/***
+ * Write the datastore key of a block, which is the base32 of its multihash, without allocating
+ * @param hash the multihash
+ * @param hash_length the length of the multihash
+ * @param key where to put the key, of at least IPFS_BLOCKSTORE_KEY_SIZE(hash_length) bytes
+ * @param key_size the size of key
+ * @returns true(1) on success, false(0) if key is too small
+ */
+int ipfs_blockstore_hash_to_key(const unsigned char* hash, size_t hash_length, char* key, size_t key_size);
+
+/***
+ * Build the full path of the file of a block
+ * @param fs_repo the repo
+ * @param filename the name of the file, the base32 of the multihash
+ * @returns the path, to be freed by the caller, or NULL on error
+ */
+char* ipfs_blockstore_path_get(const struct FSRepo* fs_repo, const char* filename);
+
 #endif
@@ -6,6 +6,7 @@
 #define __IPFS_CID_CID_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "protobuf.h"
 
 // these are multicodec packed content types. They should match
@@ -43,9 +44,27 @@ struct Cid {
 	size_t hash_length; // the length of hash
 };
 
+/***
+ * A set of cids, keyed by the multihash. An open addressing hash table whose
+ * slots say where in the arena the multihash was copied, so once the set
+ * has room, adding allocates nothing.
+ */
+struct CidSetSlot {
+    uint32_t code; // the hash of the multihash. 0 if the slot is empty, 1 if it was removed
+    uint32_t offset; // where the multihash is in the arena
+    uint16_t hash_length;
+    uint16_t version;
+    int32_t codec;
+};
+
 struct CidSet {
-    struct Cid *cid;
-    struct CidSet *next;
+    struct CidSetSlot *slots;
+    size_t capacity; // the number of slots, a power of 2
+    size_t count; // the cids in the set
+    size_t used; // the slots that are not empty, removed ones included
+    unsigned char *arena; // the multihashes, at most 4GB
+    size_t arena_size;
+    size_t arena_used;
 };
 
 /***
@@ -139,13 +158,55 @@ char* ipfs_cid_to_string(const struct Cid* cid, char **result);
  */
 int ipfs_cid_cast(const unsigned char* incoming, size_t incoming_size, struct Cid* cid);
 
+/***
+ * Create an empty set
+ * @returns the set, or NULL
+ */
 struct CidSet *ipfs_cid_set_new ();
+
+/***
+ * Free a set
+ * @param set the set, set to NULL
+ */
 void ipfs_cid_set_destroy (struct CidSet **set);
+
+/***
+ * Add a cid. The multihash is copied.
+ * @param set the set
+ * @param cid the cid
+ * @param visit if false, and the multihash is already there, its version and codec are replaced with those of cid
+ * @returns 0 on success, otherwise an error code
+ */
 int ipfs_cid_set_add (struct CidSet *set, struct Cid *cid, int visit);
+
+/***
+ * Check if a cid's multihash is in the set
+ * @returns true(1) if it is there
+ */
 int ipfs_cid_set_has (struct CidSet *set, struct Cid *cid);
+
+/***
+ * Remove a cid's multihash from the set
+ * @returns true(1) if it was there
+ */
 int ipfs_cid_set_remove (struct CidSet *set, struct Cid *cid);
+
+/***
+ * @returns the number of cids in the set
+ */
 int ipfs_cid_set_len (struct CidSet *set);
+
+/***
+ * Copy the multihashes of the set
+ * @returns a NULL terminated array of copies, each followed by a 0. Free each, and the array
+ */
 unsigned char **ipfs_cid_set_keys (struct CidSet *set);
+
+/***
+ * Call func with each cid in the set, stopping when it returns non-zero. The
+ * Cid passed only lives for the call, and func must not change the set.
+ * @returns what func returned last
+ */
 int ipfs_cid_set_foreach (struct CidSet *set, int (*func)(struct Cid *));
 
 /**
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdio.h>
+#include <time.h>
 #include "ipfs/core/ipfs_node.h"
 
 #ifdef __x86_64__
@@ -12,6 +14,23 @@
 #define MAX_READ (32*1024) // 32k
 #define MAX_CHUNK (32*1024) // 32k
 
+#define API_WORKERS 4 // threads that serve requests
+#define API_MAX_EVENTS 64 // events taken from epoll at once
+
+// epoll data of the sockets that are not connections
+#define API_EVENT_LISTEN UINT64_MAX
+#define API_EVENT_WAKE (UINT64_MAX - 1)
+
+// the state of an entry in the connection table
+#define API_CONN_FREE 0
+#define API_CONN_WAITING 1 // in epoll, waiting for a request
+#define API_CONN_BUSY 2 // being served by a worker
+
+// what api_body_read gives when more of the body has not arrived yet
+#define API_AGAIN (-2)
+
+struct ApiUpload;
+
 struct ApiContext {
 	int socket;
 	uint32_t ipv4;
@@ -21,12 +40,29 @@ struct ApiContext {
 	pthread_mutex_t conns_lock;
 	int conns_count;
 	pthread_t api_thread;
+	int epoll_fd;
+	int wake_pipe[2]; // written to by api_stop to wake the event loop
+	int shutting_down;
 	struct s_conns {
 		int socket;
 		uint32_t ipv4;
 		uint16_t port;
-		pthread_t pthread;
-	} **conns;
+		int state;
+		time_t last_active;
+		char *buf; // bytes read that are not yet a full request
+		size_t buf_len;
+		size_t buf_size;
+		struct ApiUpload *upload; // an upload that waits in epoll for more of its body
+	} *conns;
+	int *free_slots; // a stack of unused indexes of conns
+	int free_count;
+	int *ready; // a ring of indexes of conns that have data to be served
+	int ready_head;
+	int ready_count;
+	pthread_cond_t ready_cond;
+	int num_workers;
+	int busy_workers; // workers serving a connection
+	pthread_t *workers;
 };
 
 struct s_request {
@@ -45,12 +81,25 @@ struct s_request {
 	size_t boundary_size;
 };
 
+/**
+ * The body of a request that is read as it is used
+ */
+struct ApiBody {
+	struct s_conns *conn; // the bytes are read from here
+	int chunked;
+	int in_chunk; // the data of a chunk is being read
+	int done; // the last chunk was read
+	size_t remaining; // bytes left in the body, or in the current chunk
+};
+
 #define API_V0_START	"/api/v0/"
+#define API_METRICS_PATH	"/debug/metrics/prometheus" // the same as /api/v0/metrics
 
 #define WEBUI_ADDR	"/ipfs/QmPhnvn747LqwPYMJmQVorMaGbMSgA7mRRoyyZYz3DoZRQ/"
 
 #define HTTP_301	"HTTP/1.1 301 Moved Permanently\r\n" \
 			"Location: %s\r\n" \
+			"Connection: close\r\n" \
 			"Content-Type: text/html\r\n\r\n" \
 			"<a href=\"%s\">Moved Permanently</a>.\r\n\r\n"
 
@@ -87,8 +136,19 @@ struct s_request {
 #define cstrstart(a,b) (memcmp(a,b,sizeof(b)-1)==0)
 #define strstart(a,b) (memcmp(a,b,strlen(b))==0)
 
+size_t write_dual(int fd, char *str1, char *str2);
+char *str_tok(char *str, char *tok);
+char *header_value_cmp(struct s_request *req, char *header, char *value);
+void api_json_escape(FILE *out, const char *text);
 int api_send_resp_chunks(int fd, void *buf, size_t size);
-void *api_connection_thread (void *ptr);
+int api_metrics_histogram(struct s_request *req);
+int api_metrics_write(struct ApiContext *context, FILE *out);
+FILE *api_chunk_stream_open(int fd);
+int api_request_parse(char *data, size_t len, struct s_request *req, size_t *used);
+int api_request_parse_header(char *data, size_t len, struct s_request *req, size_t *used);
+int api_request_parse_body(char *data, size_t len, struct s_request *req, size_t *used);
+ssize_t api_body_read(struct ApiBody *body, char *out, size_t size);
+void *api_worker_thread (void *ptr);
 void api_connections_cleanup (struct IpfsNode* node);
 void *api_listen_thread (void *ptr);
 int api_start (struct IpfsNode* local_node, int max_conns, int timeout);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/merkledag/node.h"
+#include "ipfs/unixfs/unixfs.h"
+
+/***
+ * A read-only HTTP gateway, served by the API server. Files and directories
+ * are found by path, i.e. /ipfs/<hash>/dir/file or /ipns/<name>/dir/file
+ */
+
+#define GATEWAY_IPFS_PREFIX "/ipfs/"
+#define GATEWAY_IPNS_PREFIX "/ipns/"
+
+// what is under /ipfs/ can never change, so it can be kept for a year
+#define GATEWAY_CACHE_IMMUTABLE "public, max-age=29030400, immutable"
+
+struct s_request;
+
+/***
+ * See if a path is served by the gateway
+ * @param path the path of the request
+ * @returns true(1) if the path starts with /ipfs/ or /ipns/
+ */
+int ipfs_core_gateway_is_path(const char* path);
+
+/***
+ * Parse the value of a Range header. Only one range of bytes is supported,
+ * anything else is ignored and the whole file is sent.
+ * @param value the value of the header (i.e. "bytes=0-499")
+ * @param size the size of the file
+ * @param first the first byte of the range
+ * @param last the last byte of the range
+ * @returns 1 if there is a range, 0 if the whole file should be sent, -1 if the range is outside of the file
+ */
+int ipfs_core_gateway_range_parse(const char* value, size_t size, size_t* first, size_t* last);
+
+/***
+ * The size of the file below a node
+ * @param unix_fs the data section of the node
+ * @returns the number of bytes of the file
+ */
+size_t ipfs_core_gateway_file_size(const struct UnixFS* unix_fs);
+
+/***
+ * Send part of the file below a node. Blocks that end before the part are
+ * skipped using the sizes kept by their parent, without being fetched.
+ * @param local_node the context
+ * @param fd where to send the bytes
+ * @param node the node of the file
+ * @param offset where the part starts within the file
+ * @param length the number of bytes to send
+ * @returns true(1) if all the bytes were sent, false(0) otherwise
+ */
+int ipfs_core_gateway_send_range(struct IpfsNode* local_node, int fd, struct HashtableNode* node, size_t offset, size_t length);
+
+/***
+ * Answer a GET or HEAD of a gateway path
+ * @param local_node the context
+ * @param fd the socket of the client
+ * @param req the request
+ * @param keep_alive true(1) if the client wants to keep the connection
+ * @returns true(1) if the connection can be kept open, false(0) if it must be closed
+ */
+int ipfs_core_gateway_process(struct IpfsNode* local_node, int fd, struct s_request* req, int keep_alive);
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stdio.h>
+#include <pthread.h>
 #include "ipfs/core/ipfs_node.h"
 
+#define HTTP_CLIENT_BUFFER_SIZE 4096 // where a response starts, when its size is not known
+
 /***
  * A name/value pair of http parameters
  */
@@ -22,11 +26,30 @@ struct HttpRequest {
 
 /***
  * A struct to hold the response to be sent via http
+ * NOTE: A large body should be streamed. Instead of filling bytes, set
+ * stream_body, which is called after the headers are sent, and writes the
+ * body to a stream that sends each buffer full as it fills.
  */
 struct HttpResponse {
 	char* content_type; // a const char, not dynamically allocated
 	uint8_t* bytes; // dynamically allocated
 	size_t bytes_size;
+	// writes the body. Returns true(1) on success, false(0) otherwise
+	int (*stream_body)(struct IpfsNode* local_node, void* context, FILE* out);
+	void* stream_context; // passed to stream_body
+	void (*stream_context_free)(void* context); // frees stream_context, can be NULL
+};
+
+/***
+ * A client of the local API. It keeps its connection open, so requests
+ * after the first don't have to connect again.
+ */
+struct HttpClient {
+	void* curl; // the CURL handle, that holds the connection
+	char* base_url; // i.e. http://127.0.0.1:5001/api/v0
+	char* url; // the url of the current request, reused
+	size_t url_size; // what is allocated for url
+	pthread_mutex_t lock; // one request at a time on the connection
 };
 
 /***
@@ -66,6 +89,31 @@ void ipfs_core_http_param_free(struct HttpParam* param);
  */
 int ipfs_core_http_request_process(struct IpfsNode* local_node, struct HttpRequest* request, struct HttpResponse** response);
 
+/***
+ * Send a request to the local API on the connection of the client of the node
+ * @param local_node the context
+ * @param request the request
+ * @param data the post data, or NULL to do a GET
+ * @param data_size the length of data
+ * @param write_cb called with each piece of the response
+ * @param write_data passed to write_cb
+ * @returns true(1) if the API answered with success, false(0) otherwise
+ */
+int ipfs_core_http_request_perform(struct IpfsNode* local_node, struct HttpRequest* request, char* data, size_t data_size,
+		size_t (*write_cb)(void*, size_t, size_t, void*), void* write_data);
+
+/***
+ * Send a request to the local API, and keep the response in memory
+ * @param local_node the context
+ * @param request the request
+ * @param result the response, to be freed by the caller
+ * @param result_size the length of the response
+ * @param data the post data, or NULL to do a GET
+ * @param data_size the length of data
+ * @returns true(1) if the API answered with success, false(0) otherwise
+ */
+int ipfs_core_http_request_buffered(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t* result_size, char *data, size_t data_size);
+
 /**
  * Do an HTTP Get to the local API
  * @param local_node the context
@@ -87,3 +135,42 @@ int ipfs_core_http_request_get(struct IpfsNode* local_node, struct HttpRequest*
  * @returns true(1) on success, false(0) on error
  */
 int ipfs_core_http_request_post(struct IpfsNode* local_node, struct HttpRequest* request, char** result, size_t* result_size, char *data, size_t data_size);
+
+/**
+ * Do an HTTP Post to the local API, and write the response to a stream as it arrives
+ * @param local_node the context
+ * @param request the request
+ * @param data the array with post data
+ * @param data_size the data length
+ * @param out where to write the response
+ * @returns true(1) on success, false(0) on error
+ */
+int ipfs_core_http_request_post_stream(struct IpfsNode* local_node, struct HttpRequest* request, char *data, size_t data_size, FILE* out);
+
+/***
+ * Build a new HttpClient, that keeps its connection to the API open between requests
+ * @param local_node the context, for the address of the API
+ * @returns the new client, or NULL on error
+ */
+struct HttpClient* ipfs_core_http_client_new(struct IpfsNode* local_node);
+
+/***
+ * Free the resources of a HttpClient, closing its connection
+ * @param client the client
+ */
+void ipfs_core_http_client_free(struct HttpClient* client);
+
+/***
+ * Get the client of the node, building it on first use
+ * @param local_node the context
+ * @returns the client, or NULL on error
+ */
+struct HttpClient* ipfs_core_http_client_get(struct IpfsNode* local_node);
+
+/***
+ * Build the url of a request in the buffer of the client, that is reused between requests
+ * @param client the client
+ * @param request the request
+ * @returns true(1) on success, otherwise false(0)
+ */
+int ipfs_core_http_request_build_url(struct HttpClient* client, struct HttpRequest* request);
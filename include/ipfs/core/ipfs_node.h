@@ -41,6 +41,8 @@ struct IpfsNode {
 	struct ApiContext* api_context;
 	struct Dialer* dialer;
 	struct SwarmContext* swarm;
+	struct routingResolver* ipns_cache; // recently resolved IPNS names
+	struct HttpClient* http_client; // the connection to the API, when it is available
 	//struct Pinner pinning; // an interface
 	//struct Mount** mounts;
 	// TODO: Add more here
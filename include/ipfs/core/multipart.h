@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/***
+ * A parser for multipart/form-data bodies that is fed the body as it
+ * arrives. Only the headers of one part are held in memory, the data of the
+ * parts is passed on as it is found.
+ */
+
+#define MULTIPART_MAX_HEADER 1024 // the longest headers a part can have
+
+// states of the parser
+#define MULTIPART_PREAMBLE 0 // before the first boundary
+#define MULTIPART_AFTER_BOUNDARY 1 // a boundary was found, is it the last?
+#define MULTIPART_HEADERS 2 // reading the headers of a part
+#define MULTIPART_DATA 3 // passing on the data of a part
+#define MULTIPART_END 4 // the last boundary was found
+
+struct MultipartParser {
+	char* delimiter; // CRLF, "--", and the boundary
+	size_t delimiter_size;
+	size_t match; // how much of the delimiter matched so far
+	int state;
+	char header[MULTIPART_MAX_HEADER + 1];
+	size_t header_size;
+	// called when the headers of a part have been read. filename can be NULL
+	int (*on_part)(void* context, const char* filename);
+	// called with the data of the current part, in pieces
+	int (*on_data)(void* context, const uint8_t* data, size_t data_size);
+	// called when the current part ends
+	int (*on_part_end)(void* context);
+	void* context;
+};
+
+/***
+ * Build a new MultipartParser
+ * @param boundary the boundary from the Content-Type header
+ * @param on_part called when a part starts
+ * @param on_data called with the data of a part
+ * @param on_part_end called when a part ends
+ * @param context passed to the callbacks
+ * @returns the parser, or NULL on error
+ */
+struct MultipartParser* ipfs_core_multipart_new(const char* boundary,
+		int (*on_part)(void*, const char*),
+		int (*on_data)(void*, const uint8_t*, size_t),
+		int (*on_part_end)(void*),
+		void* context);
+
+/***
+ * Give the parser the next bytes of the body
+ * @param parser the parser
+ * @param data the bytes
+ * @param data_size the number of bytes
+ * @returns true(1) on success, false(0) if the body is malformed or a callback failed
+ */
+int ipfs_core_multipart_feed(struct MultipartParser* parser, const uint8_t* data, size_t data_size);
+
+/***
+ * See if the last boundary has been found
+ * @param parser the parser
+ * @returns true(1) if the whole body was parsed
+ */
+int ipfs_core_multipart_done(struct MultipartParser* parser);
+
+/***
+ * Free resources of a MultipartParser
+ * @param parser the parser
+ */
+void ipfs_core_multipart_free(struct MultipartParser* parser);
@@ -87,3 +87,15 @@ int ipfs_bitswap_get_block_async(struct Exchange* exchange, struct Cid* cid, str
  * @param true(1) on success, false(0) otherwise
  */
 int ipfs_bitswap_get_blocks(struct Exchange* exchange, struct Libp2pVector* cids, struct Libp2pVector** blocks);
+
+/***
+ * Retrieve a collection of blocks from the BitswapNetwork asynchronously
+ * Note: Blocks already in the local blockstore are skipped. If a provider is
+ * given, the rest are requested from it in one message.
+ *
+ * @param exchange the exchange
+ * @param cids a collection of Cid structs
+ * @param provider a peer that is known to have the blocks (can be NULL)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_bitswap_get_blocks_async(struct Exchange* exchange, struct Libp2pVector* cids, struct Libp2pPeer* provider);
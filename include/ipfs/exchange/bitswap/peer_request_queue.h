@@ -5,6 +5,8 @@
  */
 
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "libp2p/peer/peer.h"
 #include "ipfs/exchange/bitswap/bitswap.h"
 #include "ipfs/blocks/block.h"
@@ -16,6 +18,16 @@ struct CidEntry {
 	int request_has_been_sent;
 };
 
+// what is counted for each peer, in the order of the bitswap counters of the metrics
+enum PeerRequestCount {
+	PEER_REQUEST_WANTS_SENT,
+	PEER_REQUEST_WANTS_RECEIVED,
+	PEER_REQUEST_BLOCKS_SENT,
+	PEER_REQUEST_BLOCKS_RECEIVED,
+	PEER_REQUEST_DUPLICATES_RECEIVED,
+	PEER_REQUEST_COUNT_MAX
+};
+
 struct PeerRequest {
 	pthread_mutex_t request_mutex;
 	struct Libp2pPeer* peer;
@@ -27,6 +39,8 @@ struct PeerRequest {
 	struct Libp2pVector* blocks_we_want_to_send;
 	// blocks they sent us are processed immediately, so no queue necessary
 	// although the cid can go in cids_we_want again, with a cancel flag
+	// what was exchanged with the peer, see ipfs_bitswap_peer_request_count
+	uint64_t counts[PEER_REQUEST_COUNT_MAX];
 };
 
 struct PeerRequestEntry {
@@ -126,6 +140,22 @@ struct PeerRequestEntry* ipfs_bitswap_peer_request_entry_new();
  */
 int ipfs_bitswap_peer_request_entry_free(struct PeerRequestEntry* entry);
 
+/***
+ * Count something exchanged with a peer, both for the peer and in the totals of the metrics
+ * @param request the PeerRequest of the peer, can be NULL to only count the total
+ * @param what what to count
+ * @param amount how many
+ */
+void ipfs_bitswap_peer_request_count(struct PeerRequest* request, enum PeerRequestCount what, uint64_t amount);
+
+/***
+ * Write the length of the queue and the counts of each peer in it, as metrics
+ * @param queue the queue
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_bitswap_peer_request_queue_metrics(struct PeerRequestQueue* queue, FILE* out);
+
 /****
  * Handle a PeerRequest
  * @param context the BitswapContext
@@ -8,6 +8,7 @@
 #include "ipfs/blocks/block.h"
 #include "ipfs/cid/cid.h"
 #include "libp2p/utils/vector.h"
+#include "libp2p/peer/peer.h"
 
 /**
  * These are methods that the local IPFS daemon (or client)
@@ -48,6 +49,17 @@ struct Exchange {
 	 */
 	int (*GetBlocks)(struct Exchange* exchange, struct Libp2pVector* Cids, struct Libp2pVector** blocks);
 
+	/**
+	 * Retrieve several blocks from peers asynchronously. All blocks that are
+	 * not available locally are requested at once.
+	 *
+	 * @param exchange the exchange
+	 * @param Cids a vector of hashes for the blocks to be retrieved
+	 * @param provider a peer that is known to have the blocks (can be NULL)
+	 * @returns true(1) on success, false(0) otherwise
+	 */
+	int (*GetBlocksAsync)(struct Exchange* exchange, struct Libp2pVector* Cids, struct Libp2pPeer* provider);
+
 	/**
 	 * Announces the existance of a block to this bitswap service. The service will
 	 * potentially notify its peers.
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/merkledag/node.h"
+#include "ipfs/repo/fsrepo/fs_repo.h"
+
+/***
+ * Directories too big for one block are split into shards, which make a
+ * HAMT (hash array mapped trie), like go-ipfs does. The names are hashed,
+ * and the first byte of the hash picks a slot of the root shard, the second
+ * one of the shard below it, and so on. A slot holds either one entry, as a
+ * link named with the slot in hex and then the name ("1Ffile.txt"), or the
+ * shard below it, as a link named with only the slot ("1F").
+ *
+ * So a lookup only fetches the shards on the path of the hash of the name.
+ */
+
+// the multihash code of the hash of the names, 64 bits of murmur3
+#define HAMT_HASH_MURMUR3 0x22
+// the number of slots of the shards that are made here
+#define HAMT_FANOUT 256
+// a directory that would encode to more than this is sharded
+#define HAMT_SHARD_THRESHOLD (256 * 1024)
+
+/***
+ * Determine if a node is a shard of a directory
+ * @param node the node
+ * @returns true(1) if it is a HAMT shard
+ */
+int ipfs_hamt_is_shard(struct HashtableNode* node);
+
+/***
+ * Split a directory into shards. The shards below the root are stored.
+ * @param directory the directory, which is freed and replaced by the root shard, which is not stored
+ * @param fs_repo where to store the shards
+ * @param bytes_written the number of bytes written to the repo
+ * @returns true(1) on success, otherwise false(0), and the directory is left as it was
+ */
+int ipfs_hamt_shard_directory(struct HashtableNode** directory, struct FSRepo* fs_repo, size_t* bytes_written);
+
+/***
+ * Find an entry of a sharded directory by name
+ * @param shard the root shard
+ * @param name the name
+ * @param local_node the context, to get the shards below the root from
+ * @param link where to put a copy of the link to the entry, to be freed with ipfs_node_link_free
+ * @returns true(1) if it was found, otherwise false(0)
+ */
+int ipfs_hamt_find(struct HashtableNode* shard, const char* name, const struct IpfsNode* local_node, struct NodeLink** link);
+
+/***
+ * Go through the entries of a sharded directory, in the order of their hashes
+ * @param shard the root shard
+ * @param local_node the context, to get the shards below the root from
+ * @param func called with each link, named as the entry, which is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all entries were seen, false(0) if func stopped, or a shard couldn't be read
+ */
+int ipfs_hamt_foreach(struct HashtableNode* shard, const struct IpfsNode* local_node, int (*func)(struct NodeLink* link, void* arg), void* arg);
@@ -22,6 +22,63 @@
  */
 int ipfs_import_file(const char* root, const char* fileName, struct HashtableNode** parent_node, struct IpfsNode *local_node, size_t* bytes_written, int recursive);
 
+/**
+ * Creates a node based on an incoming file or directory, as ipfs_import_file does,
+ * with the nodes hashed by another function than sha2-256
+ * @param root_dir the directory for where to look for the file
+ * @param file_name the file (or directory) to import
+ * @param parent_node the root node (has links to others in case this is a large file and is split)
+ * @param fs_repo the ipfs repository
+ * @param bytes_written number of bytes written to disk
+ * @param recursive true if we should navigate directories
+ * @param hash_function the multihash code of the function, i.e. IPFS_MULTIHASH_BLAKE3
+ * @returns true(1) on success
+ */
+int ipfs_import_file_with_hash(const char* root, const char* fileName, struct HashtableNode** parent_node, struct IpfsNode *local_node, size_t* bytes_written, int recursive, int hash_function);
+
+/***
+ * A file that is imported as it arrives, a chunk at a time
+ */
+struct ImportStream {
+	struct IpfsNode* local_node;
+	struct HashtableNode* node; // the file, with links to the chunks written so far. Its hash_function is that of the chunks too.
+	unsigned char* buffer; // the chunk being filled
+	size_t buffer_size; // bytes in buffer
+	size_t total_size; // size of the chunks linked so far
+	size_t bytes_written; // bytes written to disk
+	int add_started; // what ipfs_repo_fsrepo_add_begin returned, until the file is pinned
+};
+
+/***
+ * Start an import of a file that arrives in pieces
+ * @param local_node the context
+ * @returns a new ImportStream, or NULL on error
+ */
+struct ImportStream* ipfs_import_stream_new(struct IpfsNode* local_node);
+
+/***
+ * Add bytes to the file. Each time a chunk is full, it is written to the datastore.
+ * @param stream the ImportStream
+ * @param data the bytes
+ * @param data_size the number of bytes
+ * @returns true(1) on success
+ */
+int ipfs_import_stream_write(struct ImportStream* stream, const uint8_t* data, size_t data_size);
+
+/***
+ * Write what is left, pin the file, and tell the network about it
+ * @param stream the ImportStream
+ * @param node where to put the node of the file (the caller frees it)
+ * @returns true(1) on success
+ */
+int ipfs_import_stream_finish(struct ImportStream* stream, struct HashtableNode** node);
+
+/***
+ * Free resources of an ImportStream
+ * @param stream the ImportStream
+ */
+void ipfs_import_stream_free(struct ImportStream* stream);
+
 /**
  * called from the command line
  * @param argc the number of arguments
@@ -4,12 +4,17 @@
 
 #include "libp2p/conn/session.h"
 #include "ipfs/core/ipfs_node.h"
+#include "ipfs/journal/journal_message.h"
 #include "libp2p/net/protocol.h"
+#include "ipfs/repo/fsrepo/journalstore.h"
 
 /**
  * The journal protocol attempts to keep a journal in sync with other (approved) nodes
  */
 
+// the maximum number of journal records sent in one JournalMessage
+#define JOURNAL_SYNC_BATCH_SIZE 256
+
 /***
  * See if we can handle this message
  * @param incoming the incoming message
@@ -30,7 +35,7 @@ int ipfs_journal_shutdown_handler(void* context);
  * @param incoming the message
  * @param incoming_size the size of the message
  * @param session_context details of the remote peer
- * @param protocol_context in this case, an IpfsNode
+ * @param protocol_context in this case, a JournalContext
  * @returns 0 if the caller should not continue looping, <0 on error, >0 on success
  */
 int ipfs_journal_handle_message(const struct StreamMessage* msg, struct Stream* stream, void* protocol_context) ;
@@ -43,8 +48,38 @@ int ipfs_journal_handle_message(const struct StreamMessage* msg, struct Stream*
 struct Libp2pProtocolHandler* ipfs_journal_build_protocol_handler(const struct IpfsNode* local_node);
 
 /***
- * Send a journal message to a remote peer
+ * Send journal messages to a remote peer. Starting where the peer last acknowledged,
+ * all newer journal records are sent in batches of JOURNAL_SYNC_BATCH_SIZE.
  * @param replication_peer the peer to send it to
  * @returns true(1) on success, false(0) otherwise.
  */
 int ipfs_journal_sync(struct IpfsNode* local_node, struct ReplicationPeer* replication_peer);
+
+/***
+ * Build the messages that answer summaries of a journal: the entries that are not
+ * in them, and, after the last of the summaries, the entries after them. Each
+ * message says how far through our journal it is, never past an entry the peer
+ * is not known to have.
+ * @param database the datastore
+ * @param incoming the message with the summaries
+ * @param send called with each message (which the caller still frees)
+ * @param arg passed to send
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_reconcile_records(struct Datastore* database, const struct JournalMessage* incoming, int (*send)(struct JournalMessage*, void*), void* arg);
+
+/***
+ * Retrieve the records that come after a position in the journalstore, oldest first
+ * @param database the reference to the opened db
+ * @param position the timestamp and hash of the last record already seen (hash may be empty to start at that timestamp)
+ * @param max_records the maximum number of records to retrieve
+ * @returns a vector of struct JournalRecord (can be empty), or NULL on error
+ */
+struct Libp2pVector* ipfs_journal_get_after(struct Datastore* database, const struct JournalRecord* position, int max_records);
+
+/***
+ * Free a vector of JournalRecord
+ * @param records the vector
+ * @returns true(1)
+ */
+int ipfs_journal_free_records(struct Libp2pVector* records);
@@ -0,0 +1,107 @@
+#pragma once
+/***
+ * Retrieves blocks that a remote journal says we are missing. Root blocks
+ * are requested together, and the missing blocks below them are requested
+ * in the background a level at a time, as the blocks above them arrive.
+ * Blocks below that are already here are walked through, as what is below
+ * them may not be.
+ */
+#include <pthread.h>
+
+#include "libp2p/peer/peer.h"
+#include "libp2p/utils/vector.h"
+#include "ipfs/core/ipfs_node.h"
+
+// how long to wait for one level of blocks to arrive (in seconds)
+#define JOURNAL_FETCH_TIMEOUT 60
+// blocks looked up in the datastore in each transaction
+#define JOURNAL_FETCH_BATCH_SIZE 256
+
+/***
+ * Counters that show how replication is progressing
+ */
+struct JournalFetchProgress {
+	unsigned long blocks_wanted; // blocks requested from the network
+	unsigned long blocks_received; // requested blocks that have arrived
+	unsigned long blocks_failed; // requested blocks that did not arrive in time
+	unsigned long levels; // DAG levels processed
+	int active_fetches; // fetches still running
+};
+
+/***
+ * State shared between the journal protocol handler and its fetches
+ */
+struct JournalContext {
+	struct IpfsNode* local_node;
+	pthread_mutex_t fetch_mutex;
+	pthread_cond_t fetch_done;
+	int shutting_down;
+	struct JournalFetchProgress progress;
+};
+
+/***
+ * A block that we need, and the time the remote journal has for it
+ */
+struct JournalFetchItem {
+	uint8_t* hash;
+	size_t hash_size;
+	unsigned long long remote_timestamp; // 0 for children, as they are not in the journal
+};
+
+/***
+ * Create a new JournalContext
+ * @param local_node the context
+ * @returns a new JournalContext, or NULL on error
+ */
+struct JournalContext* ipfs_journal_context_new(struct IpfsNode* local_node);
+
+/***
+ * Wait for running fetches to stop, and free the JournalContext
+ * @param context the JournalContext
+ * @returns true(1)
+ */
+int ipfs_journal_context_free(struct JournalContext* context);
+
+/***
+ * Create a new JournalFetchItem (the hash is copied)
+ * @param hash the hash of the block
+ * @param hash_size the size of the hash
+ * @param remote_timestamp the time in the remote journal
+ * @returns the new JournalFetchItem, or NULL on error
+ */
+struct JournalFetchItem* ipfs_journal_fetch_item_new(const uint8_t* hash, size_t hash_size, unsigned long long remote_timestamp);
+
+/***
+ * Free a JournalFetchItem
+ * @param item the item
+ * @returns true(1)
+ */
+int ipfs_journal_fetch_item_free(struct JournalFetchItem* item);
+
+/***
+ * Of a list of hashes, find which are not in the local datastore, using one
+ * database transaction
+ * @param local_node the context
+ * @param items a vector of JournalFetchItem
+ * @param missing a vector that is filled with the items that were not found (still owned by items)
+ * @returns the number of missing items, or -1 on error
+ */
+int ipfs_journal_fetch_find_missing(struct IpfsNode* local_node, struct Libp2pVector* items, struct Libp2pVector* missing);
+
+/***
+ * Request blocks from the provider, and start a background fetch that
+ * waits for them and retrieves their missing children
+ * @param context the JournalContext
+ * @param items a vector of JournalFetchItem (ownership is taken)
+ * @param provider the peer that sent the journal (can be NULL)
+ * @returns true(1) if the fetch was started, false(0) otherwise
+ */
+int ipfs_journal_fetch_start(struct JournalContext* context, struct Libp2pVector* items, struct Libp2pPeer* provider);
+
+/***
+ * Get a copy of the replication progress counters
+ * @param context the JournalContext
+ * @param progress where to put the counters
+ * @returns true(1)
+ */
+int ipfs_journal_fetch_progress(struct JournalContext* context, struct JournalFetchProgress* progress);
@@ -5,16 +5,82 @@
 
 #include "libp2p/utils/vector.h"
 
+// the number of seconds covered by each JournalSummary
+#define JOURNAL_SUMMARY_WINDOW 3600
+// the size of a JournalSummary filter, in bits per journal entry
+#define JOURNAL_SUMMARY_BITS_PER_ENTRY 10
+// the number of bits set for each journal entry
+#define JOURNAL_SUMMARY_NUM_HASHES 7
+// the most summaries sent in one JournalMessage
+#define JOURNAL_SUMMARY_BATCH_SIZE 64
+// summaries are split into another JournalMessage before one grows past this many bytes
+#define JOURNAL_MESSAGE_MAX_SIZE (1024 * 1024)
+
+// the flags of a JournalMessage
+// the last of the messages of summaries. The sender has no entries after its end_epoch
+// that are not in them, as it has none at all after its end_epoch.
+#define JOURNAL_MESSAGE_LAST_SUMMARY 1
+// the summaries answer summaries the receiver sent, so they are not answered with more
+#define JOURNAL_MESSAGE_REPLY 2
+// the sender has the receiver's journal up to the position
+#define JOURNAL_MESSAGE_ACK 4
+
+/***
+ * A Bloom filter of the hashes in the journal within a time window.
+ * A peer that receives one sends back the entries it has in that
+ * window that are not in the filter. The filter can be wrong about an
+ * entry being there, so the digest (the sum of the entry digests) confirms it.
+ */
+struct JournalSummary {
+	unsigned long long start_epoch;
+	unsigned long long end_epoch;
+	unsigned long long num_entries;
+	unsigned long long num_hashes;
+	unsigned long long seed;
+	unsigned long long digest;
+	uint8_t* filter;
+	size_t filter_size; // in bytes
+};
+
 struct JournalMessage {
 	unsigned long long current_epoch;
 	unsigned long long start_epoch;
 	unsigned long long end_epoch;
 	struct Libp2pVector* journal_entries;
+	// JournalSummary structs. If there are any, start_epoch to end_epoch is the
+	// range that they cover, and windows without a summary have no entries
+	struct Libp2pVector* summaries;
+	int flags; // JOURNAL_MESSAGE_*
+	// with entries, the sender has sent its journal up to here, which the receiver
+	// acknowledges. With JOURNAL_MESSAGE_ACK, what is acknowledged.
+	unsigned long long position_epoch;
+	uint8_t* position_hash;
+	size_t position_hash_size;
 };
 
 struct JournalMessage* ipfs_journal_message_new();
 int ipfs_journal_message_free(struct JournalMessage* message);
 
+/***
+ * Set the position of a JournalMessage
+ * @param message the JournalMessage
+ * @param timestamp the timestamp of the journal record
+ * @param hash the hash of the journal record
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_message_set_position(struct JournalMessage* message, unsigned long long timestamp, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Split a JournalMessage of summaries into messages of at most JOURNAL_SUMMARY_BATCH_SIZE
+ * summaries and about JOURNAL_MESSAGE_MAX_SIZE bytes. Together they cover what the
+ * message covered, and only the last has JOURNAL_MESSAGE_LAST_SUMMARY.
+ * @param message the JournalMessage, whose summaries are moved to the new messages
+ * @param flags other flags for every new message, i.e. JOURNAL_MESSAGE_REPLY
+ * @returns a vector of JournalMessage (at least one), or NULL on error
+ */
+struct Libp2pVector* ipfs_journal_message_split_summaries(struct JournalMessage* message, int flags);
+
 /**
  * Determine the maximum size of a protobuf'd JournalMessage
  * @param message the JournalMessage
@@ -40,3 +106,47 @@ int ipfs_journal_message_encode(struct JournalMessage* entry, uint8_t *buffer, s
  * @returns true(1) on success, false(0) otherwise
  */
 int ipfs_journal_message_decode(const uint8_t *incoming, size_t incoming_size, struct JournalMessage **results);
+
+/***
+ * Allocate a JournalSummary with a filter sized for a number of entries
+ * @param start_epoch the beginning of the time window
+ * @param end_epoch the end of the time window
+ * @param num_entries the number of entries that will be added
+ * @param seed varies the bits used, so false positives differ between summaries
+ * @returns the new JournalSummary, or NULL on error
+ */
+struct JournalSummary* ipfs_journal_summary_new(unsigned long long start_epoch, unsigned long long end_epoch, unsigned long long num_entries, unsigned long long seed);
+
+/***
+ * Free the resources of a JournalSummary
+ * @param summary the JournalSummary
+ * @returns true(1)
+ */
+int ipfs_journal_summary_free(struct JournalSummary* summary);
+
+/***
+ * Add a hash to the filter of a JournalSummary
+ * @param summary the JournalSummary
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_summary_add(struct JournalSummary* summary, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Determine if a hash is (probably) in the filter of a JournalSummary
+ * @param summary the JournalSummary
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns true(1) if the hash is probably there, false(0) if it certainly is not
+ */
+int ipfs_journal_summary_contains(const struct JournalSummary* summary, const uint8_t* hash, size_t hash_size);
+
+/***
+ * The digest of one hash, as added to the digest of a JournalSummary
+ * @param summary the JournalSummary (for its seed)
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns the digest
+ */
+unsigned long long ipfs_journal_summary_entry_digest(const struct JournalSummary* summary, const uint8_t* hash, size_t hash_size);
@@ -7,6 +7,8 @@
 
 #include "ipfs/cid/cid.h"
 
+struct Block;
+
 /*====================================================================================
  *
  * Structures
@@ -22,6 +24,14 @@ struct NodeLink
 	struct NodeLink* next;
 };
 
+/***
+ * The links of a node, sorted by name, then by where they are in the list
+ */
+struct NodeLinkIndex {
+	struct NodeLink* link;
+	size_t position;
+};
+
 struct HashtableNode
 {
 	// saved in protobuf
@@ -33,8 +43,19 @@ struct HashtableNode
 	// a base32 representation of the multihash
 	unsigned char* hash;
 	size_t hash_size;
+	// the multihash code of the function the node is hashed with when it is added
+	int hash_function;
+	// kept by the functions below, so change the links only through them
+	struct NodeLink* tail_link;
+	size_t link_count;
+	struct NodeLinkIndex* link_index; // the links sorted by name, built by a lookup, dropped when the links change
+	// set by a decode. What points into these is freed with them, not on its own.
+	unsigned char* arena; // the decoded links, their names, and their hashes and the data if not in block
+	size_t arena_size;
+	struct Block* block; // the block a view decode points into, freed with the node
 };
 
+
 /*====================================================================================
  *
  * Functions
@@ -116,7 +137,8 @@ size_t ipfs_hashtable_node_protobuf_encode_size(const struct HashtableNode* node
 int ipfs_hashtable_node_protobuf_encode(const struct HashtableNode* node, unsigned char* buffer, size_t max_buffer_length, size_t* bytes_written);
 
 /***
- * Decode a stream of bytes into a Node structure
+ * Decode a stream of bytes into a Node structure. The links, their names and
+ * hashes, and the data are copied into one allocation, the node's arena.
  * @param buffer where to get the bytes from
  * @param buffer_length the length of buffer
  * @param node pointer to the Node to be created
@@ -124,6 +146,16 @@ int ipfs_hashtable_node_protobuf_encode(const struct HashtableNode* node, unsign
  */
 int ipfs_hashtable_node_protobuf_decode(unsigned char* buffer, size_t buffer_length, struct HashtableNode** node);
 
+/***
+ * Decode the data of a block into a Node structure, without copying the data
+ * or the link hashes. They point into the block, which the node then owns, and
+ * frees when it is freed. The links and their names are in the node's arena.
+ * @param block the block. On success, it belongs to the node. On failure, it is still the caller's.
+ * @param node pointer to the Node to be created
+ * @returns true(1) on success
+ */
+int ipfs_hashtable_node_protobuf_decode_view(struct Block* block, struct HashtableNode** node);
+
 /*====================================================================================
  * Node Functions
  *===================================================================================*/
@@ -189,9 +221,11 @@ unsigned char * ipfs_hashtable_node_get_data(struct HashtableNode * N);
 int ipfs_hashtable_node_free(struct HashtableNode * N);
 
 /*ipfs_node_get_link_by_name
- * Returns a copy of the link with given name
+ * Returns the link with given name. The first lookup of a node with many links
+ * sorts them by name, so the ones after it are a binary search.
  * @param Name: (char * name) searches for link with this name
- * Returns the link struct if it's found otherwise returns NULL
+ * Returns the link struct if it's found otherwise returns NULL. If more than one
+ * link has the name, the first of them.
  */
 struct NodeLink * ipfs_hashtable_node_get_link_by_name(struct HashtableNode * N, char * Name);
 
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "ipfs/cid/cid.h"
+#include "ipfs/merkledag/node.h"
+
+/***
+ * Walk the DAG below some blocks without recursion, depth or breadth first.
+ *
+ * Depth first visits a block before the blocks it links to, in the order of
+ * the links, so the chunks of a file come in the order of its bytes. A walk
+ * can visit each block once, however many blocks link to it, or every time
+ * it is linked to, as a file that repeats a chunk needs. Blocks can be
+ * fetched ahead of the walk by a few threads, which helps when fetching
+ * means asking the network.
+ */
+
+#define MERKLEDAG_WALK_DEPTH_FIRST 0
+#define MERKLEDAG_WALK_BREADTH_FIRST 1
+// the most threads that fetch ahead of a walk
+#define MERKLEDAG_WALK_PREFETCH_MAX 16
+// returned by the callback of ipfs_merkledag_walk to not follow the links of a block
+#define MERKLEDAG_WALK_SKIP 2
+
+/***
+ * Get a block of the DAG. Called from the prefetch threads too.
+ * @param context what the walker was given
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param node where to put the block
+ * @returns true(1) on success, false(0) if it couldn't be had
+ */
+typedef int (*merkledag_fetch_func)(void* context, const unsigned char* hash, size_t hash_size, struct HashtableNode** node);
+
+struct MerkledagWalkOptions {
+	int order; // MERKLEDAG_WALK_DEPTH_FIRST or MERKLEDAG_WALK_BREADTH_FIRST
+	int unique; // visit each block once, however many blocks link to it
+	int skip_missing; // visit a block that can't be fetched without a node, instead of failing
+	int prefetch; // the threads that fetch ahead, 0 to fetch a block when it is visited
+	struct CidSet* seen; // the blocks seen by a unique walk, NULL for the walker to keep its own
+};
+
+struct MerkledagWalker;
+
+/***
+ * Start a walk. Blocks to walk from are added with ipfs_merkledag_walker_push.
+ * @param fetch how to get the blocks
+ * @param context passed to fetch
+ * @param options how to walk, NULL for depth first, each block once, fetched when visited
+ * @returns the walker, or NULL on error
+ */
+struct MerkledagWalker* ipfs_merkledag_walker_new(merkledag_fetch_func fetch, void* context, const struct MerkledagWalkOptions* options);
+
+/***
+ * Add a block to walk from, even if it was seen already
+ * @param walker the walker
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) on success, false(0) if out of memory
+ */
+int ipfs_merkledag_walker_push(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size);
+
+/***
+ * Add the blocks a node links to, as if the node was visited. For walking
+ * below a node that is already at hand.
+ * @param walker the walker
+ * @param node the node
+ * @returns true(1) on success, false(0) if out of memory
+ */
+int ipfs_merkledag_walker_push_links(struct MerkledagWalker* walker, const struct HashtableNode* node);
+
+/***
+ * Visit the next block. Its links are followed on the next call, unless
+ * ipfs_merkledag_walker_skip is called first.
+ * @param walker the walker
+ * @param hash where to put the multihash of the block, good until the next call. Can be NULL.
+ * @param hash_size where to put the length of hash. Can be NULL.
+ * @param node where to put the block, which belongs to the walker and is good until the next call.
+ * NULL if it is missing and options->skip_missing. Can be NULL.
+ * @param depth where to put the number of links from where the walk started. Can be NULL.
+ * @returns 1 for a block, 0 when there are no more, -1 on error, or if a block couldn't be fetched
+ */
+int ipfs_merkledag_walker_next(struct MerkledagWalker* walker, const unsigned char** hash, size_t* hash_size,
+		struct HashtableNode** node, int* depth);
+
+/***
+ * Don't follow the links of the block visited last
+ * @param walker the walker
+ */
+void ipfs_merkledag_walker_skip(struct MerkledagWalker* walker);
+
+/***
+ * Stop the prefetch threads, and free the walker
+ * @param walker the walker, can be NULL
+ */
+void ipfs_merkledag_walker_free(struct MerkledagWalker* walker);
+
+/***
+ * Walk the DAG below a block, the block included
+ * @param fetch how to get the blocks
+ * @param context passed to fetch
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param options how to walk, NULL for depth first, each block once, fetched when visited
+ * @param func called with each block, and the number of links from the first one. The node is NULL if
+ * it is missing and options->skip_missing. Returns false(0) to stop, or MERKLEDAG_WALK_SKIP to not follow its links.
+ * @param arg passed to func
+ * @returns true(1) if the walk went through, false(0) if func stopped it, or on error
+ */
+int ipfs_merkledag_walk(merkledag_fetch_func fetch, void* context, const unsigned char* hash, size_t hash_size,
+		const struct MerkledagWalkOptions* options,
+		int (*func)(const unsigned char* hash, size_t hash_size, struct HashtableNode* node, int depth, void* arg), void* arg);
+
+/***
+ * A merkledag_fetch_func that gets the blocks from the local repo
+ * @param fs_repo the FSRepo
+ */
+int ipfs_merkledag_walk_fetch_repo(void* fs_repo, const unsigned char* hash, size_t hash_size, struct HashtableNode** node);
@@ -9,9 +9,18 @@
 #define MULTIBASE_BASE8 '7'
 #define MULTIBASE_BASE10 '9'
 #define MULTIBASE_BASE16 'f'
+#define MULTIBASE_BASE32 'b'
+#define MULTIBASE_BASE32_UPPER 'B'
 #define MULTIBASE_BASE58_FLICKR 'Z'
 #define MULTIBASE_BASE58_BTC 'z'
 
+// the size of a sha2-256 multihash, the hash of a CIDv0
+#define MULTIBASE_MULTIHASH_SIZE 34
+// the length of the base32 of a sha2-256 multihash, as in the datastore keys
+#define MULTIBASE_BASE32_MULTIHASH_LENGTH 55
+// the length of the base58 of a sha2-256 multihash, as in a CIDv0 ("Qm...")
+#define MULTIBASE_BASE58_CIDV0_LENGTH 46
+
 /**
  * Encode data in multibase format
  * @param base the format to use (i.e. MULTIBASE_BASE58_BTC)
@@ -44,4 +53,41 @@ int multibase_encode_size(const char base, const unsigned char* incoming, size_t
  */
 int multibase_decode(const unsigned char* incoming, size_t incoming_length, unsigned char* results, size_t results_max_length, size_t* results_length);
 
+/***
+ * Calculates the size of the buffer neccessary to decode the incoming byte array
+ * @param base the encoding to use
+ * @param incoming the incoming array of bytes
+ * @param incoming_length the length of the array in bytes
+ * @returns the appropriate size of the buffer
+ */
+int multibase_decode_size(const char base, const unsigned char* incoming, size_t incoming_length);
+
+/***
+ * The length of the upper case base32 of some bytes, without padding
+ * @param incoming_length the number of bytes
+ * @returns the number of characters
+ */
+size_t multibase_base32_encode_size(size_t incoming_length);
+
+/***
+ * Encode bytes in upper case base32 without padding or a multibase prefix,
+ * as the datastore keys are. Nothing is allocated.
+ * @param incoming the bytes to encode
+ * @param incoming_length the number of bytes
+ * @param results where to put the characters. A NULL is added if there is room.
+ * @param results_max_length the size of the results buffer
+ * @param results_length the number of characters written
+ * @returns true(1) on success, false(0) if the buffer is too small
+ */
+int multibase_base32_encode_upper(const unsigned char* incoming, size_t incoming_length, unsigned char* results, size_t results_max_length, size_t* results_length);
+
+/***
+ * Decode the base58 of a CIDv0, a sha2-256 multihash, without allocating
+ * @param incoming the MULTIBASE_BASE58_CIDV0_LENGTH characters
+ * @param incoming_length the number of characters
+ * @param results where to put the MULTIBASE_MULTIHASH_SIZE bytes of the multihash
+ * @returns true(1) on success, false(0) if it is not the base58 of a sha2-256 multihash
+ */
+int multibase_base58_decode_cidv0(const unsigned char* incoming, size_t incoming_length, unsigned char* results);
+
 #endif
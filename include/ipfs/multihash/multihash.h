@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+
+/***
+ * The hash functions blocks can be named by, and the multihashes of them.
+ *
+ * A hash in a node, a link or a Cid is a sha2-256 digest, as it always was,
+ * unless it was made by another function here. Then it is the whole
+ * multihash, so the function is known from the hash itself.
+ *
+ * sha2-256 uses the SHA extensions of the CPU where it has them, which is
+ * found out when it is first called.
+ */
+
+// multihash codes
+#define IPFS_MULTIHASH_SHA2_256 0x12
+#define IPFS_MULTIHASH_BLAKE3 0x1e
+#define IPFS_MULTIHASH_BLAKE2B_256 0xb220
+// the size of the digests of all the functions here
+#define IPFS_MULTIHASH_DIGEST_SIZE 32
+// the biggest multihash of the functions here, a code of 3 bytes, the length, and the digest
+#define IPFS_MULTIHASH_MAX_SIZE (3 + 1 + IPFS_MULTIHASH_DIGEST_SIZE)
+
+struct MultihashFunction {
+	int code; // the multihash code
+	const char* name; // as on the command line, i.e. "sha2-256"
+	int (*digest)(const unsigned char* data, size_t data_size, unsigned char* digest);
+};
+
+/***
+ * Find a hash function by its code
+ * @param code the multihash code
+ * @returns the function, or NULL if it is not one of these
+ */
+const struct MultihashFunction* ipfs_multihash_function_get(int code);
+
+/***
+ * Find a hash function by its name
+ * @param name the name, i.e. "blake2b-256"
+ * @returns the function, or NULL if it is not one of these
+ */
+const struct MultihashFunction* ipfs_multihash_function_by_name(const char* name);
+
+/***
+ * Hash data into the form a node or a Cid keeps: the digest for sha2-256, the whole multihash otherwise
+ * @param code the multihash code of the function
+ * @param data the data to hash
+ * @param data_size the number of bytes
+ * @param hash where to put the hash, of at least IPFS_MULTIHASH_MAX_SIZE bytes
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) if the function is not one of these
+ */
+int ipfs_multihash_hash(int code, const unsigned char* data, size_t data_size, unsigned char* hash, size_t* hash_size);
+
+/***
+ * Find the function a hash that a node or a Cid keeps was made with
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns the multihash code
+ */
+int ipfs_multihash_hash_code(const unsigned char* hash, size_t hash_size);
+
+/***
+ * Turn the hash a node or a Cid keeps into a multihash
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @param multihash where to put the multihash
+ * @param max_multihash_size the size of the multihash buffer
+ * @param multihash_size the size of the multihash
+ * @returns true(1) on success, false(0) if the buffer is too small
+ */
+int ipfs_multihash_wrap(const unsigned char* hash, size_t hash_size, unsigned char* multihash, size_t max_multihash_size, size_t* multihash_size);
+
+/***
+ * Find the hash a node or a Cid keeps within a multihash. Nothing is copied.
+ * @param multihash the multihash
+ * @param multihash_size the size of the multihash
+ * @param hash where to put where the hash starts within the multihash
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) if it is not a multihash
+ */
+int ipfs_multihash_unwrap(const unsigned char* multihash, size_t multihash_size, const unsigned char** hash, size_t* hash_size);
+
+/***
+ * The sha2-256 of some data, with the SHA extensions of the CPU if it has them
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1) on success
+ */
+int ipfs_multihash_sha256(const unsigned char* data, size_t data_size, unsigned char* digest);
+
+/***
+ * What ipfs_multihash_sha256 computes with on this CPU
+ * @returns "sha-ni" or "generic"
+ */
+const char* ipfs_multihash_sha256_implementation();
+
+/***
+ * The blake2b-256 of some data (RFC 7693, a 32 byte digest)
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1)
+ */
+int ipfs_multihash_blake2b_256(const unsigned char* data, size_t data_size, unsigned char* digest);
+
+/***
+ * The blake3 of some data, its default 32 byte output
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1)
+ */
+int ipfs_multihash_blake3(const unsigned char* data, size_t data_size, unsigned char* digest);
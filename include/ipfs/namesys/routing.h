@@ -5,24 +5,47 @@
     #include "ipfs/util/time.h"
     #include "ipfs/namesys/pb.h"
 
+    #include <pthread.h>
+    #include <stdint.h>
+
     #define DefaultResolverCacheTTL 60 // a minute
+    #define DefaultResolverCacheSize 128
 
     struct cacheEntry {
         char *key;
         char *value;
         struct timespec eol;
+        uint32_t hash;
+        struct cacheEntry *bucket_next; // next entry in the same hash bucket
+        struct cacheEntry *prev; // more recently used
+        struct cacheEntry *next; // less recently used
     };
 
+    // a hash table of cacheEntry, with the entries also in a list
+    // ordered by use, so the least recently used can be evicted.
     struct routingResolver {
         int cachesize;
-        int next;
-        struct cacheEntry **data;
+        int count;
+        int num_buckets; // always a power of 2
+        struct cacheEntry **buckets;
+        struct cacheEntry *head; // most recently used
+        struct cacheEntry *tail; // least recently used
+        pthread_mutex_t lock;
     };
 
     struct libp2p_routing_value_store { // dummy declaration, not implemented yet.
         void *missing;
     };
 
+    // allocate a cache that holds up to cachesize entries. 0 disables caching.
+    struct routingResolver* ipfs_routing_cache_new (int cachesize);
+    int ipfs_routing_cache_free (struct routingResolver *cache);
+    // returns a copy of the value (the caller frees it), or NULL if not found or expired.
+    char* ipfs_routing_cache_lookup (struct routingResolver *cache, const char *key);
+    // add or replace an entry that is valid until eol. Evicts the least recently used if full.
+    int ipfs_routing_cache_insert (struct routingResolver *cache, const char *key, const char *value, const struct timespec *eol);
+    // how long a resolved record may be cached: its TTL (or the default), but never past its EOL.
+    int ipfs_routing_cache_eol (struct ipns_entry *ientry, struct timespec *eol);
     char* ipfs_routing_cache_get (char *key, struct ipns_entry *ientry);
     void ipfs_routing_cache_set (char *key, char *value, struct ipns_entry *ientry);
     struct routingResolver* ipfs_namesys_new_routing_resolver (struct libp2p_routing_value_store *route, int cachesize);
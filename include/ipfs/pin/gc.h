@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "ipfs/cmd/cli.h"
+#include "ipfs/repo/fsrepo/fs_repo.h"
+
+/***
+ * Garbage collection of the blocks that are not pinned.
+ *
+ * Everything reachable from the pins is marked, then the datastore is gone
+ * through a batch at a time. Each batch of blocks that were not marked is
+ * deleted from the datastore (and the journal) in one transaction, and then
+ * from the blockstore. Between batches the collector can sleep, so it deletes
+ * no more than a number of blocks a second.
+ *
+ * Blocks written while a collection runs are kept, as they may belong to
+ * content that is being added and is not pinned yet.
+ *
+ * A repo from before pins has the roots of its blocks pinned first. Until
+ * that is done, nothing is collected.
+ */
+
+// records looked at, and at most deleted, in each transaction of the sweep
+#define GC_BATCH_SIZE 256
+// blocks deleted a second at most, when the node is busy doing other things
+#define GC_RATE 2000
+// seconds between collections of the background collector, when the config has no GCPeriod
+#define GC_PERIOD_DEFAULT (60 * 60)
+
+struct GcOptions {
+	int batch_size; // records looked at in each transaction
+	int rate; // blocks deleted a second at most, 0 for no limit
+	const int* stop; // if not NULL, the collection stops early once it is true
+};
+
+struct GcResult {
+	size_t marked; // blocks reachable from the pins
+	size_t kept; // blocks not reachable, but written while the collection ran
+	size_t removed; // blocks deleted
+	unsigned long long bytes_freed; // the size of the files of the blocks deleted
+};
+
+/***
+ * Delete the blocks that are not reachable from a pin
+ * @param fs_repo the repo
+ * @param options how to go about it, NULL for batches of GC_BATCH_SIZE and no rate limit
+ * @param result what was done, can be NULL
+ * @returns true(1) on success, false(0) on error, if stopped, or if another collection is running
+ */
+int ipfs_gc_collect(struct FSRepo* fs_repo, const struct GcOptions* options, struct GcResult* result);
+
+/***
+ * Parse a period such as "1h", "30m" or "1h30m"
+ * @param in the period. Units are h, m and s.
+ * @param seconds the period in seconds
+ * @returns true(1) on success, false(0) if it is not a period
+ */
+int ipfs_gc_parse_period(const char* in, unsigned long* seconds);
+
+/***
+ * Start collecting garbage in the background, every period, at GC_RATE
+ * @param fs_repo the repo
+ * @param period the seconds between collections
+ * @returns the background collector, or NULL on error
+ */
+struct GcDaemon* ipfs_gc_daemon_start(struct FSRepo* fs_repo, unsigned long period);
+
+/***
+ * Stop the background collector, stopping a collection that is running, and free it
+ * @param daemon the background collector, can be NULL
+ */
+void ipfs_gc_daemon_stop(struct GcDaemon* daemon);
+
+/***
+ * Handle "ipfs repo gc" from the command line. If the daemon is running, it collects.
+ * @param args the command line arguments
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_repo_gc(struct CliArguments* args);
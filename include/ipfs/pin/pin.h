@@ -1,8 +1,12 @@
 #ifndef IPFS_PIN_H
     #define IPFS_PIN_H
 
+    #include <stddef.h>
     #include "ipfs/util/errs.h"
 
+    struct FSRepo;
+    struct CliArguments;
+
     #ifdef IPFS_PIN_C
         const char *ipfs_pin_linkmap[] = {
             "recursive",
@@ -40,8 +44,32 @@
     // Return array index or -1 if fail.
     PinMode ipfs_string_to_pin_mode (char *str);
     int ipfs_pin_is_pinned (struct Pinned *p);
+    // Describe how a block is pinned. Returns a string to be freed, or NULL on error.
+    char *ipfs_pin_pinned_msg (struct Pinned *p);
     // Find out if the child is in the hash.
     int ipfs_pin_has_child (struct FSRepo *ds,
                             unsigned char *hash,  size_t hash_size,
                             unsigned char *child, size_t child_size);
+    // Pin a block. Recursive keeps everything it links to as well.
+    int ipfs_pin_add (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, PinMode mode);
+    // Pin a block from the journal of another node recursively, unless something keeps it
+    // already. Such pins below it are dropped, as it keeps what they did, and it is
+    // dropped in turn once a block above it is replicated, unless it is pinned again with ipfs_pin_add.
+    int ipfs_pin_add_replicated (struct FSRepo *repo, const unsigned char *hash, size_t hash_size);
+    // Unpin a block. Returns true if it was pinned.
+    int ipfs_pin_remove (struct FSRepo *repo, const unsigned char *hash, size_t hash_size);
+    // Find how a block itself is pinned. Returns NotPinned if it isn't.
+    PinMode ipfs_pin_get_mode (struct FSRepo *repo, const unsigned char *hash, size_t hash_size);
+    // Find how a block is pinned, itself or below a recursive pin. p->Key and p->Via
+    // are to be freed with ipfs_cid_free. Returns false on error.
+    int ipfs_pin_find (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, struct Pinned *p);
+    // Call func with each pin, until it returns false. The hash is only good during the call.
+    int ipfs_pin_foreach (struct FSRepo *repo,
+                          int (*func)(const unsigned char *hash, size_t hash_size, PinMode mode, void *arg),
+                          void *arg);
+    // A repo from before pins has blocks that nothing pins. Pin their roots, the blocks
+    // no other block links to, recursively. Does nothing if they are pinned already.
+    int ipfs_pin_upgrade (struct FSRepo *repo);
+    // Handle "ipfs pin add|rm|ls" from the command line.
+    int ipfs_pin (struct CliArguments *args);
 #endif // IPFS_PIN_H
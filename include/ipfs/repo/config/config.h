@@ -27,6 +27,14 @@ struct Ipns {
 	int resolve_cache_size;
 };
 
+// how the LMDB datastore is opened. Kept with the Datastore settings in the config file.
+struct Lmdb {
+	char* map_size; // MapSize, i.e. "64MB"
+	char* sync_mode; // SyncMode: full, nometasync, nosync or writemap
+	int sync_interval; // SyncInterval, seconds
+	int no_readahead; // NoReadahead
+};
+
 struct Reprovider {
 	char* interval;
 };
@@ -34,6 +42,7 @@ struct Reprovider {
 struct RepoConfig {
 	struct Identity* identity;
 	struct Datastore* datastore;
+	struct Lmdb lmdb;
 	struct Filestore* filestore;
 	struct Addresses* addresses;
 	struct Mounts mounts;
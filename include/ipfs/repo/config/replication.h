@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "libp2p/utils/vector.h"
 #include "libp2p/peer/peer.h"
 
@@ -7,11 +9,18 @@ struct ReplicationPeer {
 	struct Libp2pPeer* peer;
 	unsigned long long lastConnect;
 	unsigned long long lastJournalTime;
+	// the hash of the last journal record sent. Together with lastJournalTime, where to resume
+	uint8_t* lastJournalHash;
+	size_t lastJournalHashSize;
+	// true(1) once the progress has been read from the journalstore
+	int progressLoaded;
 };
 
 struct Replication {
 	int announce;
 	int announce_minutes;
+	// true(1) to send Bloom filter summaries of the journal on first contact instead of every entry
+	int reconcile;
 	struct Libp2pVector* replication_peers;
 };
 
@@ -4,6 +4,7 @@
 #ifndef fs_repo_h
 #define fs_repo_h
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include "ipfs/repo/config/config.h"
@@ -11,6 +12,20 @@
 #include "ipfs/merkledag/node.h"
 #include "ipfs/blocks/block.h"
 
+struct CidSet;
+
+/**
+ * What the garbage collector shares with those who write to the repo.
+ * Content that is being added is not pinned until it is all written, so
+ * the collector must not sweep what is written while it runs.
+ */
+struct FSRepoGc {
+	pthread_mutex_t lock;
+	pthread_cond_t adds_done;
+	int adds; // adds that began before the collection, which it waits for
+	struct CidSet* written; // while a collection runs, the blocks written since it began
+};
+
 /**
  * a structure to hold the repo info
  */
@@ -19,6 +34,7 @@ struct FSRepo {
 	char* path;
 	struct IOCloser* lock_file;
 	struct RepoConfig* config;
+	struct FSRepoGc* gc;
 };
 
 /**
@@ -67,6 +83,28 @@ int ipfs_repo_fsrepo_free(struct FSRepo* config);
  */
 int ipfs_repo_fsrepo_init(struct FSRepo* config);
 
+/***
+ * Begin adding content, which will be pinned once it is all written
+ * @param fs_repo the repo
+ * @returns what to give to ipfs_repo_fsrepo_add_end
+ */
+int ipfs_repo_fsrepo_add_begin(const struct FSRepo* fs_repo);
+
+/***
+ * The content is pinned, or the add failed
+ * @param fs_repo the repo
+ * @param started what ipfs_repo_fsrepo_add_begin returned
+ */
+void ipfs_repo_fsrepo_add_end(const struct FSRepo* fs_repo, int started);
+
+/***
+ * Tell a running garbage collector that a block is being written, so it is kept
+ * @param fs_repo the repo
+ * @param hash the multihash of the block
+ * @param hash_length the length of hash
+ */
+void ipfs_repo_fsrepo_gc_keep(const struct FSRepo* fs_repo, const unsigned char* hash, size_t hash_length);
+
 /***
  * Write a block to the datastore and blockstore
  * @param block the block to write
@@ -10,6 +10,20 @@
 #include "libp2p/db/datastore.h"
 #include "ipfs/repo/fsrepo/lmdb_cursor.h"
 
+/**
+ * The journalstore key is the timestamp as 8 big-endian bytes followed by the hash,
+ * so records sort by time and never collide. The value is the pin and pending flags.
+ */
+#define JOURNALSTORE_TABLE "JOURNALSTORE_V2"
+// the original table, keyed by a varint timestamp with the hash in the value
+#define JOURNALSTORE_V1_TABLE "JOURNALSTORE"
+// how far through the journal each replication peer has been sent
+#define JOURNALSTORE_PEERS_TABLE "JOURNALPEERS"
+#define JOURNALSTORE_TIMESTAMP_SIZE 8
+#define JOURNALSTORE_MAX_HASH_SIZE 128
+#define JOURNALSTORE_MAX_KEY_SIZE (JOURNALSTORE_TIMESTAMP_SIZE + JOURNALSTORE_MAX_HASH_SIZE)
+#define JOURNALSTORE_VALUE_SIZE 2
+
 struct JournalRecord {
 	unsigned long long timestamp; // the timestamp of the file
 	int pin; // true if it is to be stored, false if it is to be deleted
@@ -31,10 +45,25 @@ int lmdb_journal_record_free(struct JournalRecord* rec);
 int lmdb_journalstore_cursor_open(void* db_handle, struct lmdb_trans_cursor **cursor, struct MDB_txn *trans_to_use);
 
 /**
- * Read a record from the cursor
+ * Read a record from the cursor. If (record) contains a hash and op is CURSOR_FIRST,
+ * it will look for the exact record. Otherwise the cursor is moved and the record
+ * found is placed in (record), reusing the struct if it was already allocated.
+ * @param crsr the lmdb_trans_cursor
+ * @param op the cursor operation (i.e. CURSOR_FIRST, CURSOR_NEXT, CURSOR_LAST, CURSOR_PREVIOUS)
+ * @param record the record (will allocate a new one if *record is NULL)
+ * @returns true(1) if something was found, false(0) otherwise)
  */
 int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *cursor, enum DatastoreCursorOp op, struct JournalRecord** record);
 
+/***
+ * Position the cursor at the first record with a timestamp equal to or after the one requested.
+ * @param tc the cursor
+ * @param timestamp the earliest timestamp wanted
+ * @param record where to put the record found (will allocate a new one if *record is NULL)
+ * @returns true(1) if a record was found, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_seek(struct lmdb_trans_cursor *tc, unsigned long long timestamp, struct JournalRecord** record);
+
 /***
  * Write the record at the cursor
  * @param crsr the cursor
@@ -50,8 +79,22 @@ int lmdb_journalstore_cursor_close(struct lmdb_trans_cursor *cursor, int commitT
 
 int journal_record_free(struct JournalRecord* rec);
 
+/***
+ * Write a journal record
+ * @param journalstore_cursor the cursor (a transaction will be created if necessary)
+ * @param journalstore_record the record to write
+ * @returns true(1) on success, false(0) otherwise
+ */
 int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord *journalstore_record);
 
+/***
+ * Remove a journal record
+ * @param journalstore_cursor the cursor (must have an open transaction)
+ * @param journalstore_record the record to remove (timestamp and hash are used)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_journal_delete(struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord *journalstore_record);
+
 /***
  * Attempt to get a specific record identified by its timestamp and bytes
  * @param handle a handle to the database engine
@@ -61,11 +104,70 @@ int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor,
  */
 int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord **journalstore_record);
 
+/***
+ * Build the composite key for a journal record
+ * @param journal_record the record
+ * @param buffer where the key bytes will be written (JOURNALSTORE_MAX_KEY_SIZE bytes)
+ * @param db_key the resultant key, which points into buffer
+ * @returns true(1) on success, false(0) if the hash is too large
+ */
+int lmdb_journalstore_generate_key(const struct JournalRecord* journal_record, uint8_t* buffer, struct MDB_val *db_key);
+
 /***
  * Convert the JournalRec struct into a lmdb key and lmdb value
  * @param journal_record the record to convert
+ * @param key_buffer memory for the key (JOURNALSTORE_MAX_KEY_SIZE bytes)
+ * @param value_buffer memory for the value (JOURNALSTORE_VALUE_SIZE bytes)
  * @param db_key where to store the key information
  * @param db_value where to store the value information
+ * @returns true(1) on success, false(0) otherwise
  */
-int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, struct MDB_val* db_key, struct MDB_val *db_value);
+int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, uint8_t* key_buffer, uint8_t* value_buffer,
+		struct MDB_val* db_key, struct MDB_val *db_value);
 
+/***
+ * Build a JournalRecord from a key/value pair from the db
+ * @param db_key the key
+ * @param db_value the value
+ * @param journal_record where to store the results
+ * @reutrns true(1) on success, false(0) on error
+ */
+int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MDB_val *db_value, struct JournalRecord **journal_record);
+
+/***
+ * Move records from the original JOURNALSTORE table into the composite keyed table
+ * @param txn the (write) transaction to do the work in
+ * @param journal_db the already opened composite keyed table
+ * @returns true(1) on success or if there is nothing to upgrade, false(0) otherwise
+ */
+int lmdb_journalstore_upgrade(MDB_txn *txn, MDB_dbi journal_db);
+
+
+/***
+ * Compare two records in the order their keys are stored in the journalstore
+ * (by timestamp, then by hash)
+ * @param a the first record
+ * @param b the second record
+ * @returns <0 if a comes before b, 0 if they are the same, >0 if a comes after b
+ */
+int lmdb_journalstore_composite_key_compare(const struct JournalRecord *a, const struct JournalRecord *b);
+
+/***
+ * Retrieve how far through our journal a replication peer has been sent
+ * @param handle the database context
+ * @param peer_id the id of the peer
+ * @param peer_id_size the length of peer_id
+ * @param position where to put the timestamp and hash of the last record sent (allocated if *position is NULL)
+ * @returns true(1) if the peer was found, false(0) otherwise
+ */
+int lmdb_journalstore_get_peer_progress(void* handle, const uint8_t* peer_id, size_t peer_id_size, struct JournalRecord** position);
+
+/***
+ * Remember how far through our journal a replication peer has been sent
+ * @param handle the database context
+ * @param peer_id the id of the peer
+ * @param peer_id_size the length of peer_id
+ * @param position the timestamp and hash of the last record sent
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_set_peer_progress(void* handle, const uint8_t* peer_id, size_t peer_id_size, const struct JournalRecord* position);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <pthread.h>
+
 #include "lmdb.h"
 
 struct lmdb_context {
@@ -7,6 +9,25 @@ struct lmdb_context {
 	MDB_txn *current_transaction;
 	MDB_dbi *datastore_db;
 	MDB_dbi *journal_db;
+	MDB_dbi *journal_peers_db;
+	MDB_dbi *pins_db;
+	MDB_dbi *pin_refs_db;
+	MDB_dbi *pins_replicated_db;
+	MDB_dbi pins_upgrade_db;
+	int pins_upgrade; // the repo is from before pins, and the roots of its blocks are not pinned yet
+	// held for reading by every thread with a transaction open, and for writing to grow the map
+	pthread_rwlock_t resize_lock;
+	size_t map_size;
+	size_t map_size_max; // the map does not grow past this
+	int map_full; // a write ran out of room, grow when the transactions are done
+	int map_resizes; // the times the map grew
+	unsigned int env_flags; // what mdb_env_open was given, decides if a sync is needed
+	// flushes to disk every sync_interval seconds, when commits don't
+	pthread_t sync_thread;
+	pthread_mutex_t sync_lock;
+	pthread_cond_t sync_cond;
+	int sync_running;
+	int sync_interval;
 };
 
 struct lmdb_trans_cursor {
@@ -3,6 +3,11 @@
 #include "lmdb.h"
 #include "libp2p/db/datastore.h"
 
+// the size of the map when the config does not give one. It grows when nearly full.
+#define REPO_FSREPO_LMDB_MAP_SIZE (64UL << 20)
+// the seconds between syncs to disk, when commits don't sync
+#define REPO_FSREPO_LMDB_SYNC_INTERVAL 30
+
 /***
  * Places the LMDB methods into the datastore's function pointers
  * @param datastore the datastore to fill
@@ -12,9 +17,15 @@ int repo_fsrepo_lmdb_cast(struct Datastore* datastore);
 
 /**
  * Open an lmdb database with the given parameters.
- * Note: for now, the parameters are not used
+ * The parameters are "Name=value" strings:
+ *   MapSize: the size the map starts at, i.e. "64MB". It doubles when nearly full, up to the datastore's StorageMax
+ *   SyncMode: full, nometasync, nosync or writemap. The datastore's NoSync is the same as nosync
+ *   SyncInterval: with a SyncMode other than full, seconds between syncs to disk. 0 for none
+ *   NoReadahead: true to turn off the OS readahead, which only helps sequential reads
  * @param argc number of parameters in the following array
  * @param argv an array of parameters
+ * @param datastore the datastore struct
+ * @returns true(1) on success, false(0) otherwise
  */
 int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore);
 
@@ -33,3 +44,66 @@ int repo_fsrepo_lmdb_close(struct Datastore* datastore);
  * @returns true(1) on success
  */
 int repo_fsrepo_lmdb_create_directory(struct Datastore* datastore);
+
+/***
+ * Retrieve many records from the database using one read transaction
+ * @param keys the keys to look for
+ * @param key_sizes the length of each key
+ * @param num_keys the number of keys (and key sizes)
+ * @param records an array of num_keys pointers. Each will be the record, or NULL if the key was not found
+ * @param datastore where to look for the data
+ * @returns the number of keys found, or -1 on error
+ */
+int repo_fsrepo_lmdb_get_many(const unsigned char** keys, const size_t* key_sizes, int num_keys, struct DatastoreRecord** records, const struct Datastore* datastore);
+
+/***
+ * Retrieve the records that follow a key, in key order, using one read transaction.
+ * Meant for going through the whole datastore a batch at a time.
+ * @param after the key to start after, or NULL to start at the beginning
+ * @param after_size the length of after
+ * @param records an array of max pointers, filled with the records found
+ * @param max the most records to retrieve
+ * @param datastore where to look for the data
+ * @returns the number of records found, which is less than max at the end, or -1 on error
+ */
+int repo_fsrepo_lmdb_get_after(const unsigned char* after, size_t after_size, struct DatastoreRecord** records, int max, const struct Datastore* datastore);
+
+/***
+ * Delete many records, and their journal entries, in one write transaction
+ * @param records the records to delete. The key and timestamp are used.
+ * @param num_records the number of records
+ * @param datastore the datastore
+ * @returns the number of records deleted, or -1 on error, when nothing is deleted
+ */
+int repo_fsrepo_lmdb_delete_many(struct DatastoreRecord** records, int num_records, const struct Datastore* datastore);
+
+/***
+ * Start a transaction, counting it for the metrics
+ * @param env the database environment
+ * @param parent the parent transaction, can be NULL
+ * @param flags flags for mdb_txn_begin
+ * @param txn the new transaction
+ * @returns what mdb_txn_begin returned, 0 on success
+ */
+int repo_fsrepo_lmdb_txn_begin(MDB_env* env, MDB_txn* parent, unsigned int flags, MDB_txn** txn);
+
+/***
+ * Commit a transaction, timing it for the metrics
+ * @param txn the transaction
+ * @returns what mdb_txn_commit returned, 0 on success
+ */
+int repo_fsrepo_lmdb_txn_commit(MDB_txn* txn);
+
+/***
+ * Abort a transaction
+ * @param txn the transaction
+ */
+void repo_fsrepo_lmdb_txn_abort(MDB_txn* txn);
+
+/***
+ * Parse a size such as "64MB", "10GB" or "512KiB". The units are powers of 1024.
+ * @param in the size
+ * @param result the size in bytes
+ * @returns true(1) on success, false(0) if it is not a size
+ */
+int repo_fsrepo_lmdb_parse_size(const char* in, size_t* result);
@@ -0,0 +1,185 @@
+#pragma once
+/**
+ * Piggyback on the datastore to keep the pins
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lmdb.h"
+#include "ipfs/repo/fsrepo/lmdb_cursor.h"
+
+/**
+ * The pinstore key is the multihash of the pinned block. The value is
+ * one byte, the PinMode (Recursive or Direct).
+ */
+#define PINSTORE_TABLE "PINS"
+
+/**
+ * The index of what the recursive pins keep. It is DUPSORT, the key is the
+ * multihash of a block below a recursive pin, and there is a value for each
+ * recursive pin it is below, the multihash of the pin. Puts and deletes of
+ * the same pairs can be repeated, so a pin that was stopped half way can be
+ * done again, or undone.
+ */
+#define PINSTORE_REFS_TABLE "PINREFS"
+
+/**
+ * The recursive pins made for blocks that arrived from the journal of another
+ * node, rather than asked for. The key is the multihash of the pin, the value
+ * is empty. Such a pin is dropped once another recursive pin keeps the block.
+ */
+#define PINSTORE_REPLICATED_TABLE "PINREPL"
+
+/**
+ * Made when a repo from before pins is opened, and dropped once the roots of
+ * its blocks are pinned. While it is there, nothing may be collected.
+ */
+#define PINSTORE_UPGRADE_TABLE "PINUPGRADE"
+
+/***
+ * Called as the databases are opened. If the PINS table is new, but the
+ * datastore has blocks, the repo is from before pins, and the roots of its
+ * blocks need to be pinned before anything is collected.
+ * @param db_context the database context, with the datastore opened in its current transaction
+ * @param pins_created true(1) if the PINS table did not exist before
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade(struct lmdb_context* db_context, int pins_created);
+
+/***
+ * Determine if the roots of the blocks of a repo from before pins still need to be pinned
+ * @param handle the database context
+ * @returns true(1) if they do, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade_pending(void* handle);
+
+/***
+ * The roots of the blocks of a repo from before pins are pinned
+ * @param handle the database context
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade_done(void* handle);
+
+/***
+ * Pin a block, or change how it is pinned
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode the PinMode
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_put(void* handle, const uint8_t* hash, size_t hash_size, int mode);
+
+/***
+ * Look up a pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode where to put the PinMode
+ * @returns true(1) if the block is pinned, false(0) otherwise
+ */
+int lmdb_pinstore_get(void* handle, const uint8_t* hash, size_t hash_size, int* mode);
+
+/***
+ * Remove a pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) if it was pinned, false(0) otherwise
+ */
+int lmdb_pinstore_delete(void* handle, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Go through the pins, in one read transaction
+ * @param handle the database context
+ * @param func called with each pin. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all pins were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, int mode, void* arg), void* arg);
+
+/***
+ * Remember that a recursive pin was made for a block from the journal of another node
+ * @param handle the database context
+ * @param hash the multihash of the pin
+ * @param hash_size the length of hash
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_replicated_put(void* handle, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Forget that a pin was made for a block from the journal of another node
+ * @param handle the database context
+ * @param hash the multihash of the pin
+ * @param hash_size the length of hash
+ * @returns true(1) if it was, false(0) otherwise
+ */
+int lmdb_pinstore_replicated_delete(void* handle, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Go through the pins made for blocks from the journal of another node, in one read transaction
+ * @param handle the database context
+ * @param func called with each pin. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all pins were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_replicated_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, void* arg), void* arg);
+
+/***
+ * Add to the index the blocks below a recursive pin, in one transaction
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hashes the multihashes of the blocks below it
+ * @param hash_sizes the lengths of hashes
+ * @param count the number of hashes
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_refs_put(void* handle, const uint8_t* root, size_t root_size, uint8_t** hashes, size_t* hash_sizes, int count);
+
+/***
+ * Remove from the index the blocks below a recursive pin, in one transaction
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hashes the multihashes of the blocks below it
+ * @param hash_sizes the lengths of hashes
+ * @param count the number of hashes
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_refs_delete(void* handle, const uint8_t* root, size_t root_size, uint8_t** hashes, size_t* hash_sizes, int count);
+
+/***
+ * Determine if a block is below a recursive pin, from the index
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) if it is, false(0) otherwise
+ */
+int lmdb_pinstore_refs_has(void* handle, const uint8_t* root, size_t root_size, const uint8_t* hash, size_t hash_size);
+
+/***
+ * Find how a block is pinned: itself, or because it is below a recursive pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode where to put the PinMode, Indirect if it is below a recursive pin
+ * @param via where to put the multihash of the recursive pin it is below, can be NULL
+ * @param via_max the room in via
+ * @param via_size where to put the length of via
+ * @returns true(1) if the block is pinned, false(0) otherwise
+ */
+int lmdb_pinstore_find(void* handle, const uint8_t* hash, size_t hash_size, int* mode, uint8_t* via, size_t via_max, size_t* via_size);
+
+/***
+ * Go through the blocks that are only pinned because they are below a
+ * recursive pin, in one read transaction
+ * @param handle the database context
+ * @param func called with each block. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all blocks were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_refs_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, void* arg), void* arg);
@@ -13,12 +13,15 @@
  *		File = 2;
  *		Metadata = 3;
  *		Symlink = 4;
+ *		HAMTShard = 5;
  *	}
  *
  *	required DataType Type = 1;
  *	optional bytes Data = 2;
  *	optional uint64 filesize = 3;
  *	repeated uint64 blocksizes = 4;
+ *	optional uint64 hashType = 5;
+ *	optional uint64 fanout = 6;
  * }
  *
  * message Metadata {
@@ -31,7 +34,8 @@ enum UnixFSDataType {
 	UNIXFS_DIRECTORY,
 	UNIXFS_FILE,
 	UNIXFS_METADATA,
-	UNIXFS_SYMLINK
+	UNIXFS_SYMLINK,
+	UNIXFS_HAMTSHARD // a part of a big directory, see ipfs/importer/hamt.h
 };
 
 struct UnixFSBlockSizeNode {
@@ -45,6 +49,8 @@ struct UnixFS {
 	unsigned char* bytes; // an array of bytes
 	size_t file_size; // when saving files that have been chunked
 	struct UnixFSBlockSizeNode* block_size_head; // a linked list of block sizes
+	unsigned long long hash_type; // for a HAMT shard, the multihash code of the hash of the names
+	unsigned long long fanout; // for a HAMT shard, how many slots it has
 	unsigned char* hash; // not saved
 	size_t hash_length; // not saved
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/***
+ * Memory accounting. The small structs that are made and freed on every
+ * operation are allocated with a tag for the part of the node that owns them,
+ * and the allocations, frees and bytes of each tag are counted as metrics.
+ *
+ * What is allocated with ipfs_util_memory_alloc must be freed with
+ * ipfs_util_memory_free and the same tag. The bytes counted are what the
+ * allocator really gave, so a mismatch only makes the counts wrong.
+ */
+
+enum MemoryTag {
+	MEMORY_TAG_BLOCKS, // Block
+	MEMORY_TAG_CID, // Cid
+	MEMORY_TAG_MERKLEDAG, // HashtableNode, NodeLink
+	MEMORY_TAG_EXCHANGE, // WantListQueueEntry, WantListSession, PeerRequest
+	MEMORY_TAG_REPO, // JournalRecord, lmdb_trans_cursor, encoded records
+	MEMORY_TAG_MAX
+};
+
+/***
+ * Allocate memory, counting it against a tag
+ * @param tag who the memory is for
+ * @param size the number of bytes
+ * @returns the memory, or NULL
+ */
+void* ipfs_util_memory_alloc(enum MemoryTag tag, size_t size);
+
+/***
+ * Free memory allocated by ipfs_util_memory_alloc
+ * @param tag the tag it was allocated with
+ * @param ptr the memory, can be NULL
+ */
+void ipfs_util_memory_free(enum MemoryTag tag, void* ptr);
+
+/***
+ * Write the live bytes and objects, and the allocations, of each tag as metrics
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_util_memory_write(FILE* out);
+
+/***
+ * Write what is still allocated, by tag. Meant for shutdown, when whatever is
+ * left was leaked.
+ * @param out where to write
+ * @returns the number of objects still allocated
+ */
+size_t ipfs_util_memory_report(FILE* out);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ipfs/util/memory.h"
+
+/***
+ * Counters and latency histograms of the internals of the node, written out
+ * in the Prometheus text format.
+ *
+ * Each thread counts in its own shard, so counting is a plain add to memory
+ * only that thread writes, without locks or atomic read-modify-write. A scrape
+ * adds up the shards of all the threads.
+ */
+
+enum MetricsCounter {
+	METRICS_BLOCKSTORE_GET_BYTES,
+	METRICS_BLOCKSTORE_PUT_BYTES,
+	METRICS_BLOCKSTORE_GET_MISSES,
+	METRICS_LMDB_TXN_BEGIN,
+	METRICS_LMDB_TXN_COMMIT,
+	METRICS_LMDB_TXN_FAILED,
+	METRICS_BITSWAP_WANTS_SENT,
+	METRICS_BITSWAP_WANTS_RECEIVED,
+	METRICS_BITSWAP_BLOCKS_SENT,
+	METRICS_BITSWAP_BLOCKS_RECEIVED,
+	METRICS_BITSWAP_DUPLICATES_RECEIVED,
+	METRICS_GC_BLOCKS_REMOVED,
+	METRICS_GC_BYTES_FREED,
+	// one of each for every MemoryTag, written by ipfs_util_memory_write
+	METRICS_MEMORY_ALLOCATIONS,
+	METRICS_MEMORY_ALLOCATED_BYTES = METRICS_MEMORY_ALLOCATIONS + MEMORY_TAG_MAX,
+	METRICS_MEMORY_FREES = METRICS_MEMORY_ALLOCATED_BYTES + MEMORY_TAG_MAX,
+	METRICS_MEMORY_FREED_BYTES = METRICS_MEMORY_FREES + MEMORY_TAG_MAX,
+	METRICS_COUNTER_MAX = METRICS_MEMORY_FREED_BYTES + MEMORY_TAG_MAX
+};
+
+enum MetricsHistogram {
+	METRICS_BLOCKSTORE_GET_SECONDS,
+	METRICS_BLOCKSTORE_PUT_SECONDS,
+	METRICS_LMDB_COMMIT_SECONDS,
+	METRICS_ROUTING_QUERY_SECONDS,
+	// API requests, by command
+	METRICS_API_ADD_SECONDS,
+	METRICS_API_DHT_SECONDS,
+	METRICS_API_GATEWAY_SECONDS,
+	METRICS_API_METRICS_SECONDS,
+	METRICS_API_NAME_SECONDS,
+	METRICS_API_OBJECT_SECONDS,
+	METRICS_API_SWARM_SECONDS,
+	METRICS_API_OTHER_SECONDS,
+	METRICS_HISTOGRAM_MAX
+};
+
+// the upper bounds of the buckets of every histogram, in seconds
+#define METRICS_BUCKETS { 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5 }
+#define METRICS_BUCKET_COUNT 10
+
+// the Content-Type of what ipfs_util_metrics_write writes
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+
+/***
+ * A monotonic clock, to time what is put in a histogram
+ * @returns the time in nanoseconds
+ */
+uint64_t ipfs_util_metrics_now();
+
+/***
+ * Add to a counter
+ * @param counter the counter
+ * @param value what to add
+ */
+void ipfs_util_metrics_add(enum MetricsCounter counter, uint64_t value);
+
+/***
+ * Put the time since start in a histogram
+ * @param histogram the histogram
+ * @param start what ipfs_util_metrics_now returned when the timing started
+ */
+void ipfs_util_metrics_observe(enum MetricsHistogram histogram, uint64_t start);
+
+/***
+ * Read a counter
+ * @param counter the counter
+ * @returns its value, summed over the threads
+ */
+uint64_t ipfs_util_metrics_counter(enum MetricsCounter counter);
+
+/***
+ * Write the HELP and TYPE lines of a metric
+ * @param out where to write
+ * @param name the name of the metric
+ * @param type counter, gauge or histogram
+ * @param help what the metric is
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_util_metrics_write_header(FILE* out, const char* name, const char* type, const char* help);
+
+/***
+ * Write all counters and histograms, summed over the threads
+ * @param out where to write
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_util_metrics_write(FILE* out);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/***
+ * Spans that show where the time of a request went, kept in a ring buffer
+ * and written out in the Chrome trace format (chrome://tracing, Perfetto).
+ *
+ * A span started while another is open on the same thread is its child, and
+ * belongs to the same trace. So a request opens one span, and everything
+ * called to answer it (resolver, exchange, routing, blockstore) shows up
+ * beneath it without the trace being passed around.
+ */
+
+// the number of spans kept. A power of 2.
+#define TRACE_RING_SIZE 8192
+
+struct TraceSpan {
+	const char* name; // a string that outlives the span, i.e. a literal
+	uint64_t trace_id; // the span id of the first span of the trace
+	uint64_t span_id;
+	uint64_t parent_id; // 0 if it is the first span of the trace
+	uint64_t start; // nanoseconds, from ipfs_util_metrics_now
+	struct TraceSpan* parent; // the span that was open when this one started
+};
+
+/***
+ * Start a span on this thread. It must be ended on this thread, in the reverse
+ * order it was started.
+ * @param span the span, usually on the stack
+ * @param name what is being timed, a string that outlives the span
+ */
+void ipfs_util_trace_begin(struct TraceSpan* span, const char* name);
+
+/***
+ * End a span, and record it in the ring buffer
+ * @param span the span
+ */
+void ipfs_util_trace_end(struct TraceSpan* span);
+
+/***
+ * Time the rest of the enclosing block, ending the span on every way out of it
+ * @param name what is being timed, a string literal
+ */
+#define IPFS_TRACE_SPAN(name) \
+	struct TraceSpan trace_span __attribute__((cleanup(ipfs_util_trace_end))); \
+	ipfs_util_trace_begin(&trace_span, name)
+
+/***
+ * The trace this thread is in
+ * @returns the trace id, or 0 if no span is open
+ */
+uint64_t ipfs_util_trace_id();
+
+/***
+ * Write the spans in the ring buffer as Chrome trace JSON, oldest first
+ * @param out where to write
+ * @param trace_id only write the spans of this trace, or 0 for all of them
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_util_trace_write(FILE* out, uint64_t trace_id);
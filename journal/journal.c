@@ -2,13 +2,17 @@
  * The journal protocol attempts to keep a journal in sync with other (approved) nodes
  */
 #include <pthread.h>
+#include <string.h>
 
 #include "libp2p/crypto/encoding/base58.h"
 #include "libp2p/os/utils.h"
+#include "libp2p/net/connectionstream.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/journal/journal.h"
 #include "ipfs/journal/journal_message.h"
 #include "ipfs/journal/journal_entry.h"
+#include "ipfs/journal/journal_fetch.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
 #include "ipfs/repo/fsrepo/journalstore.h"
 #include "ipfs/repo/config/replication.h"
 
@@ -37,7 +41,7 @@ int ipfs_journal_can_handle(const struct StreamMessage* msg) {
  * @returns true(1)
  */
 int ipfs_journal_shutdown_handler(void* context) {
-	return 1;
+	return ipfs_journal_context_free((struct JournalContext*)context);
 }
 
 /***
@@ -48,7 +52,11 @@ int ipfs_journal_shutdown_handler(void* context) {
 struct Libp2pProtocolHandler* ipfs_journal_build_protocol_handler(const struct IpfsNode* local_node) {
 	struct Libp2pProtocolHandler* handler = (struct Libp2pProtocolHandler*) malloc(sizeof(struct Libp2pProtocolHandler));
 	if (handler != NULL) {
-		handler->context = (void*)local_node;
+		handler->context = (void*)ipfs_journal_context_new((struct IpfsNode*)local_node);
+		if (handler->context == NULL) {
+			free(handler);
+			return NULL;
+		}
 		handler->CanHandle = ipfs_journal_can_handle;
 		handler->HandleMessage = ipfs_journal_handle_message;
 		handler->Shutdown = ipfs_journal_shutdown_handler;
@@ -82,11 +90,15 @@ struct Libp2pVector* ipfs_journal_get_last(struct Datastore* database, int n) {
 		do {
 			libp2p_logger_debug("journal", "Adding record to the vector.\n");
 			libp2p_utils_vector_add(vector, rec);
+			// the record is now owned by the vector
+			rec = NULL;
 			if (!lmdb_journalstore_cursor_get(cursor, CURSOR_PREVIOUS, &rec)) {
 				break;
 			}
 			i++;
 		} while(i < n);
+		// the loop may have read one record more than was needed
+		lmdb_journal_record_free(rec);
 		libp2p_logger_debug("journal", "Closing journalstore cursor.\n");
 		lmdb_journalstore_cursor_close(cursor, 1);
 	} else {
@@ -95,6 +107,42 @@ struct Libp2pVector* ipfs_journal_get_last(struct Datastore* database, int n) {
 	return vector;
 }
 
+/***
+ * Retrieve the records that come after a position in the journalstore, oldest first
+ * @param database the reference to the opened db
+ * @param position the timestamp and hash of the last record already seen (hash may be empty to start at that timestamp)
+ * @param max_records the maximum number of records to retrieve
+ * @returns a vector of struct JournalRecord (can be empty), or NULL on error
+ */
+struct Libp2pVector* ipfs_journal_get_after(struct Datastore* database, const struct JournalRecord* position, int max_records) {
+	struct Libp2pVector* vector = libp2p_utils_vector_new(1);
+	if (vector == NULL) {
+		libp2p_logger_error("journal", "Unable to allocate vector for ipfs_journal_get_after.\n");
+		return NULL;
+	}
+	struct lmdb_trans_cursor *cursor = NULL;
+	if (!lmdb_journalstore_cursor_open(database->datastore_context, &cursor, NULL)) {
+		libp2p_logger_error("journal", "Unable to open a cursor for the journalstore.\n");
+		libp2p_utils_vector_free(vector);
+		return NULL;
+	}
+	struct JournalRecord* rec = NULL;
+	int found = lmdb_journalstore_cursor_seek(cursor, position->timestamp, &rec);
+	// skip what was already sent (records within the same second that sort before the position)
+	while (found && position->hash_size > 0 && lmdb_journalstore_composite_key_compare(rec, position) <= 0) {
+		found = lmdb_journalstore_cursor_get(cursor, CURSOR_NEXT, &rec);
+	}
+	while (found && vector->total < max_records) {
+		libp2p_utils_vector_add(vector, rec);
+		// the record is now owned by the vector
+		rec = NULL;
+		found = lmdb_journalstore_cursor_get(cursor, CURSOR_NEXT, &rec);
+	}
+	lmdb_journal_record_free(rec);
+	lmdb_journalstore_cursor_close(cursor, 1);
+	return vector;
+}
+
 int ipfs_journal_free_records(struct Libp2pVector* records) {
 	if (records != NULL) {
 		for (int i = 0; i < records->total; i++) {
@@ -113,24 +161,441 @@ int ipfs_journal_send_message(struct IpfsNode* node, struct Libp2pPeer* peer, st
 		return 0;
 	// protobuf the message
 	size_t msg_size = ipfs_journal_message_encode_size(message);
-	uint8_t msg[msg_size];
-	if (!ipfs_journal_message_encode(message, &msg[0], msg_size, &msg_size))
+	uint8_t* msg = (uint8_t*) malloc(msg_size);
+	if (msg == NULL)
+		return 0;
+	if (!ipfs_journal_message_encode(message, msg, msg_size, &msg_size)) {
+		free(msg);
 		return 0;
+	}
 	// send the header
 	char* header = "/ipfs/journalio/1.0.0\n";
 	struct StreamMessage outgoing;
 	outgoing.data = (uint8_t*)header;
 	outgoing.data_size = strlen(header);
-	if (!peer->sessionContext->default_stream->write(peer->sessionContext, &outgoing))
+	if (!peer->sessionContext->default_stream->write(peer->sessionContext, &outgoing)) {
+		free(msg);
 		return 0;
+	}
 	// send the message
 	outgoing.data = msg;
 	outgoing.data_size = msg_size;
-	return peer->sessionContext->default_stream->write(peer->sessionContext, &outgoing);
+	int retVal = peer->sessionContext->default_stream->write(peer->sessionContext, &outgoing);
+	free(msg);
+	return retVal;
+}
+
+/***
+ * Build a journal message from journal records
+ * @param journal_records a vector of JournalRecord
+ * @returns a new JournalMessage, or NULL on error
+ */
+struct JournalMessage* ipfs_journal_build_message(struct Libp2pVector* journal_records) {
+	struct JournalMessage* message = ipfs_journal_message_new();
+	if (message == NULL)
+		return NULL;
+	for(int i = 0; i < journal_records->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
+		if (rec->timestamp > message->end_epoch)
+			message->end_epoch = rec->timestamp;
+		if (message->start_epoch == 0 || rec->timestamp < message->start_epoch)
+			message->start_epoch = rec->timestamp;
+		struct JournalEntry* entry = ipfs_journal_entry_new();
+		entry->timestamp = rec->timestamp;
+		entry->pin = 1;
+		entry->hash_size = rec->hash_size;
+		entry->hash = (uint8_t*) malloc(entry->hash_size);
+		if (entry->hash == NULL) {
+			// out of memory
+			ipfs_journal_entry_free(entry);
+			ipfs_journal_message_free(message);
+			return NULL;
+		}
+		memcpy(entry->hash, rec->hash, entry->hash_size);
+		libp2p_utils_vector_add(message->journal_entries, entry);
+	}
+	return message;
+}
+
+/***
+ * Remember the last record that a replication peer acknowledged, both in
+ * memory and in the journalstore
+ * @param local_node the context
+ * @param replication_peer the peer
+ * @param rec the last record acknowledged
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_set_progress(struct IpfsNode* local_node, struct ReplicationPeer* replication_peer, const struct JournalRecord* rec) {
+	replication_peer->lastJournalTime = rec->timestamp;
+	if (replication_peer->lastJournalHash != NULL)
+		free(replication_peer->lastJournalHash);
+	replication_peer->lastJournalHashSize = 0;
+	replication_peer->lastJournalHash = (uint8_t*) malloc(rec->hash_size);
+	if (replication_peer->lastJournalHash == NULL)
+		return 0;
+	memcpy(replication_peer->lastJournalHash, rec->hash, rec->hash_size);
+	replication_peer->lastJournalHashSize = rec->hash_size;
+	return lmdb_journalstore_set_peer_progress(local_node->repo->config->datastore->datastore_context,
+			(uint8_t*)replication_peer->peer->id, replication_peer->peer->id_size, rec);
+}
+
+/***
+ * Load the replication progress of a peer from the journalstore (only done once per peer)
+ * @param local_node the context
+ * @param replication_peer the peer
+ */
+void ipfs_journal_load_progress(struct IpfsNode* local_node, struct ReplicationPeer* replication_peer) {
+	if (replication_peer->progressLoaded)
+		return;
+	struct JournalRecord* rec = NULL;
+	if (lmdb_journalstore_get_peer_progress(local_node->repo->config->datastore->datastore_context,
+			(uint8_t*)replication_peer->peer->id, replication_peer->peer->id_size, &rec)) {
+		replication_peer->lastJournalTime = rec->timestamp;
+		if (replication_peer->lastJournalHash != NULL)
+			free(replication_peer->lastJournalHash);
+		// take ownership of the hash
+		replication_peer->lastJournalHash = rec->hash;
+		replication_peer->lastJournalHashSize = rec->hash_size;
+		rec->hash = NULL;
+		rec->hash_size = 0;
+	}
+	lmdb_journal_record_free(rec);
+	replication_peer->progressLoaded = 1;
+}
+
+/***
+ * Add the hashes of a group of journal records (all in the same time window)
+ * to a message as a JournalSummary
+ * @param message the message
+ * @param window_records a vector of JournalRecord (the records are freed, the vector emptied)
+ * @param seed the seed for the filter
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_add_summary(struct JournalMessage* message, struct Libp2pVector* window_records, unsigned long long seed) {
+	if (window_records->total == 0)
+		return 1;
+	struct JournalRecord* first = (struct JournalRecord*) libp2p_utils_vector_get(window_records, 0);
+	unsigned long long window_start = first->timestamp - (first->timestamp % JOURNAL_SUMMARY_WINDOW);
+	struct JournalSummary* summary = ipfs_journal_summary_new(window_start, window_start + JOURNAL_SUMMARY_WINDOW - 1, window_records->total, seed);
+	for(int i = 0; i < window_records->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(window_records, i);
+		if (summary != NULL)
+			ipfs_journal_summary_add(summary, rec->hash, rec->hash_size);
+		lmdb_journal_record_free(rec);
+	}
+	// empty the vector
+	while (window_records->total > 0)
+		libp2p_utils_vector_delete(window_records, window_records->total - 1);
+	if (summary == NULL)
+		return 0;
+	libp2p_utils_vector_add(message->summaries, summary);
+	return 1;
+}
+
+/***
+ * Build a message that summarizes the whole journal, one JournalSummary per time window
+ * @param database the datastore
+ * @param seed the seed for the filters
+ * @param last where to put the last journal record (NULL if the journal is empty)
+ * @returns the new JournalMessage, or NULL on error
+ */
+struct JournalMessage* ipfs_journal_build_summary_message(struct Datastore* database, unsigned long long seed, struct JournalRecord** last) {
+	*last = NULL;
+	struct JournalMessage* message = ipfs_journal_message_new();
+	struct Libp2pVector* window_records = libp2p_utils_vector_new(1);
+	if (message == NULL || window_records == NULL) {
+		ipfs_journal_message_free(message);
+		libp2p_utils_vector_free(window_records);
+		return NULL;
+	}
+	struct JournalRecord position;
+	position.timestamp = 0;
+	position.hash = NULL;
+	position.hash_size = 0;
+	uint8_t last_hash[JOURNALSTORE_MAX_HASH_SIZE];
+	unsigned long long current_window = 0;
+	int retVal = 1;
+	for(;;) {
+		struct Libp2pVector* journal_records = ipfs_journal_get_after(database, &position, JOURNAL_SYNC_BATCH_SIZE);
+		if (journal_records == NULL) {
+			retVal = 0;
+			break;
+		}
+		int total = journal_records->total;
+		for(int i = 0; i < total; i++) {
+			struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
+			unsigned long long window = rec->timestamp / JOURNAL_SUMMARY_WINDOW;
+			if (window != current_window && !ipfs_journal_add_summary(message, window_records, seed))
+				retVal = 0;
+			current_window = window;
+			// remember where we are
+			if (rec->hash_size <= JOURNALSTORE_MAX_HASH_SIZE) {
+				position.timestamp = rec->timestamp;
+				memcpy(last_hash, rec->hash, rec->hash_size);
+				position.hash = last_hash;
+				position.hash_size = rec->hash_size;
+			}
+			// the record is now owned by window_records
+			libp2p_utils_vector_add(window_records, rec);
+		}
+		libp2p_utils_vector_free(journal_records);
+		if (total < JOURNAL_SYNC_BATCH_SIZE || !retVal)
+			break;
+	}
+	if (retVal)
+		retVal = ipfs_journal_add_summary(message, window_records, seed);
+	ipfs_journal_free_records(window_records);
+	if (!retVal) {
+		ipfs_journal_message_free(message);
+		return NULL;
+	}
+	message->start_epoch = 0;
+	message->end_epoch = position.timestamp;
+	if (position.hash_size > 0) {
+		*last = lmdb_journal_record_new();
+		if (*last != NULL) {
+			(*last)->timestamp = position.timestamp;
+			(*last)->hash = (uint8_t*) malloc(position.hash_size);
+			if ((*last)->hash != NULL) {
+				memcpy((*last)->hash, position.hash, position.hash_size);
+				(*last)->hash_size = position.hash_size;
+			}
+		}
+	}
+	return message;
+}
+
+/***
+ * Send summaries of our journal to a peer, which will send back what we are missing.
+ * They are split into messages of a bounded size.
+ * @param local_node the context
+ * @param peer the peer to send to
+ * @param flags 0, or JOURNAL_MESSAGE_REPLY if they answer the summaries of the peer
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_send_summary(struct IpfsNode* local_node, struct Libp2pPeer* peer, int flags) {
+	struct JournalRecord* last = NULL;
+	unsigned long long now = os_utils_gmtime();
+	struct JournalMessage* message = ipfs_journal_build_summary_message(local_node->repo->config->datastore, now, &last);
+	if (message == NULL)
+		return 0;
+	int empty = (last == NULL);
+	lmdb_journal_record_free(last);
+	if (empty && !(flags & JOURNAL_MESSAGE_REPLY)) {
+		// the journal is empty. A reply is still sent, so the peer sends us its entries.
+		ipfs_journal_message_free(message);
+		return 1;
+	}
+	message->current_epoch = now;
+	int summaries = message->summaries->total;
+	struct Libp2pVector* batches = ipfs_journal_message_split_summaries(message, flags);
+	ipfs_journal_message_free(message);
+	if (batches == NULL)
+		return 0;
+	int retVal = 1;
+	for(int i = 0; i < batches->total; i++) {
+		struct JournalMessage* batch = (struct JournalMessage*) libp2p_utils_vector_get(batches, i);
+		if (retVal)
+			retVal = ipfs_journal_send_message(local_node, peer, batch);
+		ipfs_journal_message_free(batch);
+	}
+	libp2p_logger_debug("journal", "Sent %d journal summaries in %d messages to %s.\n", summaries, batches->total, libp2p_peer_id_to_string(peer));
+	libp2p_utils_vector_free(batches);
+	return retVal;
 }
 
 /***
- * Send a journal message to a remote peer
+ * Decide about the entries a summary says the peer probably has. They are
+ * confirmed if, with them, we have as many entries in the window as the peer,
+ * with the same digest. Otherwise the peer may not have them, and they are
+ * moved to the missing entries.
+ * @param summary the summary of the window (can be NULL)
+ * @param unconfirmed the records in the window that the filter holds (emptied)
+ * @param digest the sum of the entry digests of the unconfirmed records
+ * @param missing where to put the records that are not confirmed
+ */
+static void ipfs_journal_confirm_window(const struct JournalSummary* summary, struct Libp2pVector* unconfirmed, unsigned long long digest, struct Libp2pVector* missing) {
+	int confirmed = summary != NULL && summary->num_entries == (unsigned long long)unconfirmed->total && summary->digest == digest;
+	for(int i = 0; i < unconfirmed->total; i++) {
+		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(unconfirmed, i);
+		if (confirmed)
+			lmdb_journal_record_free(rec);
+		else
+			libp2p_utils_vector_add(missing, rec);
+	}
+	while (unconfirmed->total > 0)
+		libp2p_utils_vector_delete(unconfirmed, unconfirmed->total - 1);
+}
+
+/***
+ * Build the messages that answer summaries of a journal: the entries that are not
+ * in them, and, after the last of the summaries, the entries after them. Each
+ * message says how far through our journal it is. That is never past an entry
+ * the peer is not known to have, so an acknowledgment does not skip it.
+ * @param database the datastore
+ * @param incoming the message with the summaries
+ * @param send called with each message (which the caller still frees)
+ * @param arg passed to send
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_reconcile_records(struct Datastore* database, const struct JournalMessage* incoming, int (*send)(struct JournalMessage*, void*), void* arg) {
+	int last_summary = (incoming->flags & JOURNAL_MESSAGE_LAST_SUMMARY) != 0;
+	// where we are in the journal
+	struct JournalRecord position;
+	position.timestamp = incoming->start_epoch;
+	position.hash = NULL;
+	position.hash_size = 0;
+	uint8_t last_hash[JOURNALSTORE_MAX_HASH_SIZE];
+	// what has been decided about, which is what is sent as the position
+	struct JournalRecord decided;
+	decided.timestamp = incoming->start_epoch;
+	decided.hash = NULL;
+	decided.hash_size = 0;
+	uint8_t decided_hash[JOURNALSTORE_MAX_HASH_SIZE];
+	int current_summary = 0;
+	const struct JournalSummary* window_summary = NULL;
+	unsigned long long window_digest = 0;
+	int retVal = 1;
+	struct Libp2pVector* missing = libp2p_utils_vector_new(1);
+	struct Libp2pVector* unconfirmed = libp2p_utils_vector_new(1);
+	if (missing == NULL || unconfirmed == NULL) {
+		libp2p_utils_vector_free(missing);
+		libp2p_utils_vector_free(unconfirmed);
+		return 0;
+	}
+	for(;;) {
+		struct Libp2pVector* journal_records = ipfs_journal_get_after(database, &position, JOURNAL_SYNC_BATCH_SIZE);
+		if (journal_records == NULL) {
+			retVal = 0;
+			break;
+		}
+		int total = journal_records->total;
+		int done = total < JOURNAL_SYNC_BATCH_SIZE;
+		for(int i = 0; i < total; i++) {
+			struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
+			if (rec->timestamp > incoming->end_epoch && !last_summary) {
+				// in the summaries of a later message
+				done = 1;
+				lmdb_journal_record_free(rec);
+				continue;
+			}
+			// find the summary for this time (summaries are in order)
+			struct JournalSummary* summary = NULL;
+			while (current_summary < incoming->summaries->total) {
+				summary = (struct JournalSummary*) libp2p_utils_vector_get(incoming->summaries, current_summary);
+				if (summary->end_epoch >= rec->timestamp)
+					break;
+				current_summary++;
+				summary = NULL;
+			}
+			if (summary != NULL && summary->start_epoch > rec->timestamp)
+				summary = NULL;
+			if (summary != window_summary) {
+				ipfs_journal_confirm_window(window_summary, unconfirmed, window_digest, missing);
+				window_summary = summary;
+				window_digest = 0;
+			}
+			if (rec->hash_size <= JOURNALSTORE_MAX_HASH_SIZE) {
+				position.timestamp = rec->timestamp;
+				memcpy(last_hash, rec->hash, rec->hash_size);
+				position.hash = last_hash;
+				position.hash_size = rec->hash_size;
+			}
+			if (summary == NULL || !ipfs_journal_summary_contains(summary, rec->hash, rec->hash_size)) {
+				// they do not have it
+				libp2p_utils_vector_add(missing, rec);
+			} else {
+				// they probably have it
+				window_digest += ipfs_journal_summary_entry_digest(summary, rec->hash, rec->hash_size);
+				libp2p_utils_vector_add(unconfirmed, rec);
+			}
+			if (unconfirmed->total == 0 && position.hash_size > 0) {
+				decided.timestamp = position.timestamp;
+				memcpy(decided_hash, position.hash, position.hash_size);
+				decided.hash = decided_hash;
+				decided.hash_size = position.hash_size;
+			}
+		}
+		libp2p_utils_vector_free(journal_records);
+		if (done && unconfirmed->total > 0) {
+			ipfs_journal_confirm_window(window_summary, unconfirmed, window_digest, missing);
+			if (position.hash_size > 0) {
+				decided.timestamp = position.timestamp;
+				memcpy(decided_hash, position.hash, position.hash_size);
+				decided.hash = decided_hash;
+				decided.hash_size = position.hash_size;
+			}
+		}
+		// send what we have so far. The last message is sent even if empty, for the peer to acknowledge.
+		if (missing->total >= JOURNAL_SYNC_BATCH_SIZE || (done && (missing->total > 0 || decided.hash_size > 0))) {
+			struct JournalMessage* message = ipfs_journal_build_message(missing);
+			if (message == NULL || !ipfs_journal_message_set_position(message, decided.timestamp, decided.hash, decided.hash_size)) {
+				ipfs_journal_message_free(message);
+				retVal = 0;
+				break;
+			}
+			message->current_epoch = os_utils_gmtime();
+			retVal = send(message, arg);
+			ipfs_journal_message_free(message);
+			while (missing->total > 0) {
+				lmdb_journal_record_free((struct JournalRecord*) libp2p_utils_vector_get(missing, missing->total - 1));
+				libp2p_utils_vector_delete(missing, missing->total - 1);
+			}
+			if (!retVal)
+				break;
+		}
+		if (done)
+			break;
+	}
+	ipfs_journal_free_records(missing);
+	ipfs_journal_free_records(unconfirmed);
+	return retVal;
+}
+
+struct JournalReconcileContext {
+	struct IpfsNode* local_node;
+	struct Libp2pPeer* peer;
+	int sent;
+};
+
+/***
+ * Send a message of reconciled entries to the peer
+ * @param message the message
+ * @param arg the JournalReconcileContext
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_reconcile_send(struct JournalMessage* message, void* arg) {
+	struct JournalReconcileContext* context = (struct JournalReconcileContext*) arg;
+	context->sent += message->journal_entries->total;
+	return ipfs_journal_send_message(context->local_node, context->peer, message);
+}
+
+/***
+ * A peer sent summaries of its journal. Send it the entries that are not in them,
+ * and, after the last of its summaries, the entries after them. Each message says
+ * how far through our journal it is, for the peer to acknowledge.
+ * @param local_node the context
+ * @param incoming the message with the summaries
+ * @param peer the peer that sent the summaries
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_journal_reconcile(struct IpfsNode* local_node, struct JournalMessage* incoming, struct Libp2pPeer* peer) {
+	if (!repo_config_replication_approved_node(local_node->repo->config->replication, peer)) {
+		libp2p_logger_error("journal", "Received journal summaries from %s, which is not a replication peer.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	struct JournalReconcileContext context;
+	context.local_node = local_node;
+	context.peer = peer;
+	context.sent = 0;
+	int retVal = ipfs_journal_reconcile_records(local_node->repo->config->datastore, incoming, ipfs_journal_reconcile_send, &context);
+	libp2p_logger_debug("journal", "Reconciled %d summaries. Sent %d entries to %s.\n", incoming->summaries->total, context.sent, libp2p_peer_id_to_string(peer));
+	return retVal;
+}
+
+/***
+ * Send journal messages to a remote peer. Starting where the peer last acknowledged,
+ * all newer journal records are sent in batches of JOURNAL_SYNC_BATCH_SIZE.
  * @param replication_peer the peer to send it to
  * @returns true(1) on success, false(0) otherwise.
  */
@@ -152,47 +617,71 @@ int ipfs_journal_sync(struct IpfsNode* local_node, struct ReplicationPeer* repli
 		return 0;
 	}
 
-	// grab the last 10? files
-	struct Libp2pVector* journal_records = ipfs_journal_get_last(local_node->repo->config->datastore, 10);
-	if (journal_records == NULL || journal_records->total == 0) {
-		// nothing to do
-		libp2p_logger_debug("journal", "There are no journal records to process.\n");
+	ipfs_journal_load_progress(local_node, replication_peer);
+
+	// until the peer acknowledges some of our journal, send summaries. It sends back what we
+	// are missing and its own summaries, and acknowledges what we then send.
+	if (local_node->repo->config->replication->reconcile && replication_peer->lastJournalTime == 0 && replication_peer->lastJournalHashSize == 0) {
+		if (!ipfs_journal_send_summary(local_node, peer, 0))
+			return 0;
 		replication_peer->lastConnect = os_utils_gmtime();
 		return 1;
 	}
-	// build the message
-	struct JournalMessage* message = ipfs_journal_message_new();
-	for(int i = 0; i < journal_records->total; i++) {
-		struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, i);
-		if (rec->timestamp > message->end_epoch)
-			message->end_epoch = rec->timestamp;
-		if (message->start_epoch == 0 || rec->timestamp < message->start_epoch)
-			message->start_epoch = rec->timestamp;
-		struct JournalEntry* entry = ipfs_journal_entry_new();
-		entry->timestamp = rec->timestamp;
-		entry->pin = 1;
-		entry->hash_size = rec->hash_size;
-		entry->hash = (uint8_t*) malloc(entry->hash_size);
-		if (entry->hash == NULL) {
-			// out of memory
+
+	// where to start. The progress is saved as the peer acknowledges what is sent.
+	struct JournalRecord position;
+	uint8_t position_hash[JOURNALSTORE_MAX_HASH_SIZE];
+	position.timestamp = replication_peer->lastJournalTime;
+	position.hash = position_hash;
+	position.hash_size = 0;
+	if (replication_peer->lastJournalHashSize <= JOURNALSTORE_MAX_HASH_SIZE) {
+		memcpy(position_hash, replication_peer->lastJournalHash, replication_peer->lastJournalHashSize);
+		position.hash_size = replication_peer->lastJournalHashSize;
+	}
+	int retVal = 1;
+	int batches = 0;
+	for(;;) {
+		struct JournalRecord* last = NULL;
+		struct Libp2pVector* journal_records = ipfs_journal_get_after(local_node->repo->config->datastore, &position, JOURNAL_SYNC_BATCH_SIZE);
+		if (journal_records == NULL) {
+			retVal = 0;
+			break;
+		}
+		if (journal_records->total == 0) {
+			// nothing (more) to do
+			libp2p_logger_debug("journal", "There are no more journal records to send. %d batches sent.\n", batches);
+			ipfs_journal_free_records(journal_records);
+			replication_peer->lastConnect = os_utils_gmtime();
+			break;
+		}
+		// build the message
+		last = (struct JournalRecord*) libp2p_utils_vector_get(journal_records, journal_records->total - 1);
+		struct JournalMessage* message = ipfs_journal_build_message(journal_records);
+		if (message == NULL || last->hash_size > JOURNALSTORE_MAX_HASH_SIZE
+				|| !ipfs_journal_message_set_position(message, last->timestamp, last->hash, last->hash_size)) {
 			ipfs_journal_message_free(message);
 			ipfs_journal_free_records(journal_records);
-			return 0;
+			retVal = 0;
+			break;
 		}
-		memcpy(entry->hash, rec->hash, entry->hash_size);
-		libp2p_utils_vector_add(message->journal_entries, entry);
-	}
-	// send the message
-	message->current_epoch = os_utils_gmtime();
-	libp2p_logger_debug("journal", "Sending message to %s.\n", libp2p_peer_id_to_string(peer));
-	int retVal = ipfs_journal_send_message(local_node, peer, message);
-	if (retVal) {
-		replication_peer->lastConnect = message->current_epoch;
-		replication_peer->lastJournalTime = message->end_epoch;
+		// send the message
+		message->current_epoch = os_utils_gmtime();
+		libp2p_logger_debug("journal", "Sending message of %d records to %s.\n", journal_records->total, libp2p_peer_id_to_string(peer));
+		retVal = ipfs_journal_send_message(local_node, peer, message);
+		if (retVal) {
+			replication_peer->lastConnect = message->current_epoch;
+			position.timestamp = last->timestamp;
+			memcpy(position_hash, last->hash, last->hash_size);
+			position.hash_size = last->hash_size;
+			batches++;
+		}
+		int more = retVal && journal_records->total == JOURNAL_SYNC_BATCH_SIZE;
+		// clean up
+		ipfs_journal_message_free(message);
+		ipfs_journal_free_records(journal_records);
+		if (!more)
+			break;
 	}
-	// clean up
-	ipfs_journal_message_free(message);
-	ipfs_journal_free_records(journal_records);
 
 	return retVal;
 }
@@ -227,23 +716,19 @@ int ipfs_journal_todo_free(struct JournalToDo *in) {
 }
 
 /***
- * Loop through the incoming message, looking for what may need to change
- * @param local_node the context
- * @param incoming the incoming JournalMessage
- * @param todo_vector a Libp2pVector that gets allocated and filled with JournalToDo structs
- * @returns true(1) on success, false(0) otherwise
+ * Decide what to do with a batch of the entries of a message
+ * @param incoming the message
+ * @param start the index of the first entry of the batch
+ * @param total the number of entries in the batch
+ * @param datastore_records what the datastore has for each entry, or NULL (they are freed)
+ * @param todos where to add the JournalToDos
  */
-int ipfs_journal_build_todo(struct IpfsNode* local_node, struct JournalMessage* incoming, struct Libp2pVector** todo_vector) {
-	*todo_vector = libp2p_utils_vector_new(1);
-	if (*todo_vector == NULL)
-		return -1;
-	struct Libp2pVector *todos = *todo_vector;
-	// for every file in message
-	for(int i = 0; i < incoming->journal_entries->total; i++) {
-		struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, i);
-		// do we have the file?
-		struct DatastoreRecord *datastore_record = NULL;
-		if (!local_node->repo->config->datastore->datastore_get(entry->hash, entry->hash_size, &datastore_record, local_node->repo->config->datastore)) {
+static void ipfs_journal_build_todo_batch(struct JournalMessage* incoming, int start, int total, struct DatastoreRecord** datastore_records, struct Libp2pVector* todos) {
+	// for every file in the batch
+	for(int i = 0; i < total; i++) {
+		struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, start + i);
+		struct DatastoreRecord *datastore_record = datastore_records[i];
+		if (datastore_record == NULL) {
 			struct JournalToDo* td = ipfs_journal_todo_new();
 			td->action = JOURNAL_ENTRY_NEEDED;
 			td->hash = entry->hash;
@@ -262,8 +747,39 @@ int ipfs_journal_build_todo(struct IpfsNode* local_node, struct JournalMessage*
 				td->remote_timestamp = entry->timestamp;
 				libp2p_utils_vector_add(todos, td);
 			}
+			libp2p_datastore_record_free(datastore_record);
+		}
+	}
+}
+
+/***
+ * Loop through the incoming message, looking for what may need to change
+ * @param local_node the context
+ * @param incoming the incoming JournalMessage
+ * @param todo_vector a Libp2pVector that gets allocated and filled with JournalToDo structs
+ * @returns 0 on success, -1 on error
+ */
+int ipfs_journal_build_todo(struct IpfsNode* local_node, struct JournalMessage* incoming, struct Libp2pVector** todo_vector) {
+	*todo_vector = libp2p_utils_vector_new(1);
+	if (*todo_vector == NULL)
+		return -1;
+	struct Libp2pVector *todos = *todo_vector;
+	// do we have the files? Look them up a batch at a time, as the message can hold any number
+	const unsigned char* keys[JOURNAL_SYNC_BATCH_SIZE];
+	size_t key_sizes[JOURNAL_SYNC_BATCH_SIZE];
+	struct DatastoreRecord* datastore_records[JOURNAL_SYNC_BATCH_SIZE];
+	for(int start = 0; start < incoming->journal_entries->total; start += JOURNAL_SYNC_BATCH_SIZE) {
+		int total = incoming->journal_entries->total - start;
+		if (total > JOURNAL_SYNC_BATCH_SIZE)
+			total = JOURNAL_SYNC_BATCH_SIZE;
+		for(int i = 0; i < total; i++) {
+			struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(incoming->journal_entries, start + i);
+			keys[i] = entry->hash;
+			key_sizes[i] = entry->hash_size;
 		}
-		libp2p_datastore_record_free(datastore_record);
+		if (repo_fsrepo_lmdb_get_many(keys, key_sizes, total, datastore_records, local_node->repo->config->datastore) < 0)
+			return -1;
+		ipfs_journal_build_todo_batch(incoming, start, total, datastore_records, todos);
 	}
 	// TODO: get all files of same second
 	// are they perhaps missing something?
@@ -301,11 +817,63 @@ int ipfs_journal_adjust_time(struct JournalToDo* todo, struct IpfsNode* local_no
 	return 1;
 }
 
+/***
+ * A peer acknowledged our journal up to a position. Sync from there from now on.
+ * @param local_node the context
+ * @param message the message with the position
+ * @param peer the peer that sent it
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_handle_ack(struct IpfsNode* local_node, struct JournalMessage* message, struct Libp2pPeer* peer) {
+	struct ReplicationPeer* replication_peer = repo_config_get_replication_peer(local_node->repo->config->replication, peer);
+	if (replication_peer == NULL) {
+		libp2p_logger_error("journal", "Received a journal acknowledgement from %s, which is not a replication peer.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	ipfs_journal_load_progress(local_node, replication_peer);
+	struct JournalRecord acked;
+	acked.timestamp = message->position_epoch;
+	acked.hash = message->position_hash;
+	acked.hash_size = message->position_hash_size;
+	struct JournalRecord progress;
+	progress.timestamp = replication_peer->lastJournalTime;
+	progress.hash = replication_peer->lastJournalHash;
+	progress.hash_size = replication_peer->lastJournalHashSize;
+	// acknowledgements of earlier messages can come late
+	if (acked.hash_size == 0 || acked.hash_size > JOURNALSTORE_MAX_HASH_SIZE
+			|| lmdb_journalstore_composite_key_compare(&acked, &progress) <= 0)
+		return 1;
+	if (!ipfs_journal_set_progress(local_node, replication_peer, &acked)) {
+		libp2p_logger_error("journal", "Unable to save replication progress for peer %s.\n", libp2p_peer_id_to_string(peer));
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Tell a peer we have its journal up to the position of a message it sent
+ * @param local_node the context
+ * @param incoming the message it sent
+ * @param peer the peer
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_send_ack(struct IpfsNode* local_node, struct JournalMessage* incoming, struct Libp2pPeer* peer) {
+	struct JournalMessage* message = ipfs_journal_message_new();
+	if (message == NULL)
+		return 0;
+	message->current_epoch = os_utils_gmtime();
+	message->flags = JOURNAL_MESSAGE_ACK;
+	int retVal = ipfs_journal_message_set_position(message, incoming->position_epoch, incoming->position_hash, incoming->position_hash_size)
+			&& ipfs_journal_send_message(local_node, peer, message);
+	ipfs_journal_message_free(message);
+	return retVal;
+}
+
 /***
  * Handles a message
  * @param incoming_msg the message
  * @param session_context details of the remote peer
- * @param protocol_context in this case, an IpfsNode
+ * @param protocol_context in this case, a JournalContext
  * @returns 0 if the caller should not continue looping, <0 on error, >0 on success
  */
 int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct Stream* stream, void* protocol_context) {
@@ -332,7 +900,8 @@ int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct
 		libp2p_stream_message_free(msg);
 		msg = NULL;
 	}
-	struct IpfsNode* local_node = (struct IpfsNode*)protocol_context;
+	struct JournalContext* journal_context = (struct JournalContext*)protocol_context;
+	struct IpfsNode* local_node = journal_context->local_node;
 	// un-protobuf the message
 	struct JournalMessage* message = NULL;
 	if (!ipfs_journal_message_decode(incoming_pos, pos_size, &message))
@@ -350,22 +919,58 @@ int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct
 		return -1;
 	}
 	struct Libp2pVector* todo_vector = NULL;
-	ipfs_journal_build_todo(local_node, message, &todo_vector);
+	if (ipfs_journal_build_todo(local_node, message, &todo_vector) < 0) {
+		libp2p_logger_error("journal", "Unable to compare incoming journal to the datastore.\n");
+		if (todo_vector != NULL) {
+			for(int i = 0; i < todo_vector->total; i++)
+				ipfs_journal_todo_free((struct JournalToDo*) libp2p_utils_vector_get(todo_vector, i));
+			libp2p_utils_vector_free(todo_vector);
+		}
+		if (second_read)
+			free(incoming_pos);
+		ipfs_journal_message_free(message);
+		return -1;
+	}
+	// who sent this
+	struct Libp2pPeer* provider = NULL;
+	struct SessionContext* session_context = libp2p_net_connection_get_session_context(stream);
+	if (session_context != NULL && session_context->remote_peer_id != NULL)
+		provider = libp2p_peerstore_get_or_add_peer_by_id(local_node->peerstore, (unsigned char*)session_context->remote_peer_id, strlen(session_context->remote_peer_id));
+	if (message->flags & JOURNAL_MESSAGE_ACK) {
+		// they have our journal up to the position
+		if (provider == NULL)
+			libp2p_logger_error("journal", "Received a journal acknowledgement from an unknown peer.\n");
+		else
+			ipfs_journal_handle_ack(local_node, message, provider);
+	} else if (message->summaries->total > 0 || (message->flags & JOURNAL_MESSAGE_LAST_SUMMARY)) {
+		// if they sent summaries, send them what they do not have
+		if (provider == NULL) {
+			libp2p_logger_error("journal", "Received journal summaries from an unknown peer.\n");
+		} else if (!ipfs_journal_reconcile(local_node, message, provider)) {
+			libp2p_logger_error("journal", "Unable to reconcile journal with %s.\n", libp2p_peer_id_to_string(provider));
+		} else if ((message->flags & JOURNAL_MESSAGE_LAST_SUMMARY) && !(message->flags & JOURNAL_MESSAGE_REPLY)) {
+			// and send ours, so they send us what we do not have
+			if (!ipfs_journal_send_summary(local_node, provider, JOURNAL_MESSAGE_REPLY))
+				libp2p_logger_error("journal", "Unable to send journal summaries to %s.\n", libp2p_peer_id_to_string(provider));
+		}
+	}
+	// tell them how far through their journal we are
+	if (!(message->flags & JOURNAL_MESSAGE_ACK) && message->position_hash_size > 0 && provider != NULL) {
+		if (!ipfs_journal_send_ack(local_node, message, provider))
+			libp2p_logger_error("journal", "Unable to acknowledge journal of %s.\n", libp2p_peer_id_to_string(provider));
+	}
+	// the blocks we need are requested together from the peer that sent the journal
+	struct Libp2pVector* needed = libp2p_utils_vector_new(1);
 	// loop through todo items, and do the right thing
 	for(int i = 0; i < todo_vector->total; i++) {
 		struct JournalToDo *curr = (struct JournalToDo*) libp2p_utils_vector_get(todo_vector, i);
 		switch (curr->action) {
 			case (JOURNAL_ENTRY_NEEDED): {
-				// go get a file
-				struct Block* block = NULL;
-				struct Cid* cid = ipfs_cid_new(0, curr->hash, curr->hash_size, CID_DAG_PROTOBUF);
-				if (local_node->exchange->GetBlockAsync(local_node->exchange, cid, &block)) {
-					// set timestamp (if we got the block already, but we probably didn't)
-					if (block != NULL)
-						ipfs_journal_adjust_time(curr, local_node);
-				}
-				ipfs_cid_free(cid);
-				ipfs_block_free(block);
+				struct JournalFetchItem* item = ipfs_journal_fetch_item_new(curr->hash, curr->hash_size, curr->remote_timestamp);
+				if (item != NULL && needed != NULL)
+					libp2p_utils_vector_add(needed, item);
+				else
+					ipfs_journal_fetch_item_free(item);
 			}
 			break;
 			case (JOURNAL_TIME_ADJUST): {
@@ -378,8 +983,18 @@ int ipfs_journal_handle_message(const struct StreamMessage* incoming_msg, struct
 			break;
 		}
 	}
+	if (needed != NULL && needed->total > 0) {
+		libp2p_logger_debug("journal", "Requesting %d missing blocks.\n", needed->total);
+		// this takes ownership of needed
+		ipfs_journal_fetch_start(journal_context, needed, provider);
+	} else {
+		libp2p_utils_vector_free(needed);
+	}
 	//TODO: set new values in their ReplicationPeer struct
 
+	for(int i = 0; i < todo_vector->total; i++)
+		ipfs_journal_todo_free((struct JournalToDo*) libp2p_utils_vector_get(todo_vector, i));
+	libp2p_utils_vector_free(todo_vector);
 	ipfs_journal_message_free(message);
 
 	if (second_read)
@@ -0,0 +1,428 @@
+/**
+ * Retrieves the blocks (and their children) that a remote journal says we are missing
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // for sleep()
+#include <pthread.h>
+
+#include "libp2p/os/utils.h"
+#include "libp2p/utils/logger.h"
+#include "ipfs/cid/cid.h"
+#include "ipfs/journal/journal_fetch.h"
+#include "ipfs/merkledag/merkledag.h"
+#include "ipfs/merkledag/walker.h"
+#include "ipfs/pin/pin.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
+
+struct JournalFetchJob {
+	struct JournalContext* context;
+	struct Libp2pVector* items; // JournalFetchItems of the current level
+	struct Libp2pVector* roots; // JournalFetchItems from the journal, pinned once fetched
+	struct CidSet* seen; // the blocks walked through, so each is read once
+	struct Libp2pPeer* provider;
+	int add_started; // what ipfs_repo_fsrepo_add_begin returned
+};
+
+struct JournalContext* ipfs_journal_context_new(struct IpfsNode* local_node) {
+	struct JournalContext* context = (struct JournalContext*) malloc(sizeof(struct JournalContext));
+	if (context != NULL) {
+		context->local_node = local_node;
+		pthread_mutex_init(&context->fetch_mutex, NULL);
+		pthread_cond_init(&context->fetch_done, NULL);
+		context->shutting_down = 0;
+		memset(&context->progress, 0, sizeof(struct JournalFetchProgress));
+	}
+	return context;
+}
+
+int ipfs_journal_context_free(struct JournalContext* context) {
+	if (context != NULL) {
+		pthread_mutex_lock(&context->fetch_mutex);
+		context->shutting_down = 1;
+		while (context->progress.active_fetches > 0)
+			pthread_cond_wait(&context->fetch_done, &context->fetch_mutex);
+		pthread_mutex_unlock(&context->fetch_mutex);
+		pthread_cond_destroy(&context->fetch_done);
+		pthread_mutex_destroy(&context->fetch_mutex);
+		free(context);
+	}
+	return 1;
+}
+
+struct JournalFetchItem* ipfs_journal_fetch_item_new(const uint8_t* hash, size_t hash_size, unsigned long long remote_timestamp) {
+	struct JournalFetchItem* item = (struct JournalFetchItem*) malloc(sizeof(struct JournalFetchItem));
+	if (item != NULL) {
+		item->hash = (uint8_t*) malloc(hash_size);
+		if (item->hash == NULL) {
+			free(item);
+			return NULL;
+		}
+		memcpy(item->hash, hash, hash_size);
+		item->hash_size = hash_size;
+		item->remote_timestamp = remote_timestamp;
+	}
+	return item;
+}
+
+int ipfs_journal_fetch_item_free(struct JournalFetchItem* item) {
+	if (item != NULL) {
+		if (item->hash != NULL)
+			free(item->hash);
+		free(item);
+	}
+	return 1;
+}
+
+/***
+ * Free a vector of JournalFetchItem
+ * @param items the vector
+ */
+static void ipfs_journal_fetch_items_free(struct Libp2pVector* items) {
+	if (items != NULL) {
+		for(int i = 0; i < items->total; i++)
+			ipfs_journal_fetch_item_free((struct JournalFetchItem*) libp2p_utils_vector_get(items, i));
+		libp2p_utils_vector_free(items);
+	}
+}
+
+/***
+ * Whether the context is being freed. It is read under the lock it is written under.
+ * @param context the JournalContext
+ * @returns true(1) if the fetches should stop
+ */
+static int ipfs_journal_fetch_stopping(struct JournalContext* context) {
+	pthread_mutex_lock(&context->fetch_mutex);
+	int stopping = context->shutting_down;
+	pthread_mutex_unlock(&context->fetch_mutex);
+	return stopping;
+}
+
+int ipfs_journal_fetch_find_missing(struct IpfsNode* local_node, struct Libp2pVector* items, struct Libp2pVector* missing) {
+	// a batch at a time, as there can be any number
+	const unsigned char* keys[JOURNAL_FETCH_BATCH_SIZE];
+	size_t key_sizes[JOURNAL_FETCH_BATCH_SIZE];
+	struct DatastoreRecord* records[JOURNAL_FETCH_BATCH_SIZE];
+	int num_missing = 0;
+	for(int start = 0; start < items->total; start += JOURNAL_FETCH_BATCH_SIZE) {
+		int total = items->total - start;
+		if (total > JOURNAL_FETCH_BATCH_SIZE)
+			total = JOURNAL_FETCH_BATCH_SIZE;
+		for(int i = 0; i < total; i++) {
+			struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(items, start + i);
+			keys[i] = item->hash;
+			key_sizes[i] = item->hash_size;
+		}
+		if (repo_fsrepo_lmdb_get_many(keys, key_sizes, total, records, local_node->repo->config->datastore) < 0)
+			return -1;
+		for(int i = 0; i < total; i++) {
+			if (records[i] == NULL) {
+				libp2p_utils_vector_add(missing, libp2p_utils_vector_get(items, start + i));
+				num_missing++;
+			} else {
+				libp2p_datastore_record_free(records[i]);
+			}
+		}
+	}
+	return num_missing;
+}
+
+/***
+ * Ask the exchange for a group of blocks
+ * @param local_node the context
+ * @param items a vector of JournalFetchItem
+ * @param provider who to ask (can be NULL)
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_fetch_request(struct IpfsNode* local_node, struct Libp2pVector* items, struct Libp2pPeer* provider) {
+	if (items->total == 0)
+		return 1;
+	struct Libp2pVector* cids = libp2p_utils_vector_new(items->total);
+	if (cids == NULL)
+		return 0;
+	for(int i = 0; i < items->total; i++) {
+		struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(items, i);
+		libp2p_utils_vector_add(cids, ipfs_cid_new(0, item->hash, item->hash_size, CID_DAG_PROTOBUF));
+	}
+	int retVal = local_node->exchange->GetBlocksAsync(local_node->exchange, cids, provider);
+	for(int i = 0; i < cids->total; i++)
+		ipfs_cid_free((struct Cid*) libp2p_utils_vector_get(cids, i));
+	libp2p_utils_vector_free(cids);
+	return retVal;
+}
+
+/***
+ * A block has arrived. Give it the timestamp from the remote journal, if it is older than ours
+ * @param local_node the context
+ * @param item the block that arrived
+ */
+static void ipfs_journal_fetch_adjust_time(struct IpfsNode* local_node, struct JournalFetchItem* item) {
+	if (item->remote_timestamp == 0)
+		return;
+	struct Datastore* datastore = local_node->repo->config->datastore;
+	struct DatastoreRecord* datastore_record = NULL;
+	if (!datastore->datastore_get(item->hash, item->hash_size, &datastore_record, datastore))
+		return;
+	if (datastore_record->timestamp == 0 || datastore_record->timestamp > item->remote_timestamp) {
+		datastore_record->timestamp = item->remote_timestamp;
+		if (!datastore->datastore_put(datastore_record, datastore))
+			libp2p_logger_error("journal", "Unable to adjust time of fetched block.\n");
+	}
+	libp2p_datastore_record_free(datastore_record);
+}
+
+/***
+ * Wait for the blocks of a level to arrive
+ * @param job the job
+ * @param arrived where to put the items that arrived
+ * @returns the number of items that did not arrive in time
+ */
+static int ipfs_journal_fetch_wait(struct JournalFetchJob* job, struct Libp2pVector* arrived) {
+	struct JournalContext* context = job->context;
+	struct Libp2pVector* pending = job->items;
+	job->items = NULL;
+	unsigned long long deadline = os_utils_gmtime() + JOURNAL_FETCH_TIMEOUT;
+	while (pending->total > 0 && !ipfs_journal_fetch_stopping(context)) {
+		struct Libp2pVector* still_missing = libp2p_utils_vector_new(pending->total);
+		if (still_missing == NULL || ipfs_journal_fetch_find_missing(context->local_node, pending, still_missing) < 0) {
+			libp2p_utils_vector_free(still_missing);
+			break;
+		}
+		// anything that is not still missing has arrived
+		int received = 0;
+		for(int i = 0, j = 0; i < pending->total; i++) {
+			struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(pending, i);
+			if (j < still_missing->total && libp2p_utils_vector_get(still_missing, j) == item) {
+				j++;
+				continue;
+			}
+			ipfs_journal_fetch_adjust_time(context->local_node, item);
+			libp2p_utils_vector_add(arrived, item);
+			received++;
+		}
+		libp2p_utils_vector_free(pending);
+		pending = still_missing;
+		pthread_mutex_lock(&context->fetch_mutex);
+		context->progress.blocks_received += received;
+		pthread_mutex_unlock(&context->fetch_mutex);
+		if (pending->total == 0 || os_utils_gmtime() >= deadline)
+			break;
+		sleep(1);
+	}
+	int failed = pending->total;
+	ipfs_journal_fetch_items_free(pending);
+	return failed;
+}
+
+/***
+ * Find the blocks below the blocks that arrived that are not here. The blocks
+ * below that are here are walked through too, as what is below them may not be.
+ * @param job the job, which remembers the blocks walked through
+ * @param arrived the blocks that arrived
+ * @returns a vector of JournalFetchItem, or NULL on error
+ */
+static struct Libp2pVector* ipfs_journal_fetch_missing_below(struct JournalFetchJob* job, struct Libp2pVector* arrived) {
+	struct IpfsNode* local_node = job->context->local_node;
+	struct MerkledagWalkOptions options = { MERKLEDAG_WALK_DEPTH_FIRST, 1, 1, 0, job->seen };
+	struct Libp2pVector* unread = libp2p_utils_vector_new(1);
+	struct Libp2pVector* missing = libp2p_utils_vector_new(1);
+	struct MerkledagWalker* walker = ipfs_merkledag_walker_new(ipfs_merkledag_walk_fetch_repo, local_node->repo, &options);
+	int retVal = (unread != NULL && missing != NULL && walker != NULL);
+	for(int i = 0; retVal && i < arrived->total; i++) {
+		struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(arrived, i);
+		retVal = ipfs_merkledag_walker_push(walker, item->hash, item->hash_size);
+	}
+	while (retVal) {
+		const unsigned char* hash = NULL;
+		size_t hash_size = 0;
+		struct HashtableNode* node = NULL;
+		int found = ipfs_merkledag_walker_next(walker, &hash, &hash_size, &node, NULL);
+		if (found <= 0) {
+			retVal = (found == 0);
+			break;
+		}
+		if (node != NULL)
+			continue;
+		// not a node that could be read. Either not here, or a raw block.
+		struct JournalFetchItem* item = ipfs_journal_fetch_item_new(hash, hash_size, 0);
+		if (item == NULL)
+			retVal = 0;
+		else
+			libp2p_utils_vector_add(unread, item);
+	}
+	ipfs_merkledag_walker_free(walker);
+	if (retVal && ipfs_journal_fetch_find_missing(local_node, unread, missing) < 0)
+		retVal = 0;
+	if (unread != NULL) {
+		// the items in missing are no longer owned by unread
+		for(int i = 0, j = 0; i < unread->total; i++) {
+			struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(unread, i);
+			if (retVal && j < missing->total && libp2p_utils_vector_get(missing, j) == item)
+				j++;
+			else
+				ipfs_journal_fetch_item_free(item);
+		}
+		libp2p_utils_vector_free(unread);
+	}
+	if (!retVal) {
+		libp2p_utils_vector_free(missing);
+		return NULL;
+	}
+	return missing;
+}
+
+/***
+ * Pin the blocks from the journal that arrived, so a garbage collection keeps
+ * them and what is below them. The newest are pinned first, as they are
+ * usually the parents, and what is already below a recursive pin is skipped.
+ * A block that arrived before its parent loses its pin once the parent is pinned.
+ * @param local_node the context
+ * @param roots a vector of JournalFetchItem
+ */
+static void ipfs_journal_fetch_pin(struct IpfsNode* local_node, struct Libp2pVector* roots) {
+	struct Libp2pVector* missing = libp2p_utils_vector_new(1);
+	if (missing == NULL || ipfs_journal_fetch_find_missing(local_node, roots, missing) < 0) {
+		libp2p_utils_vector_free(missing);
+		return;
+	}
+	for(int i = roots->total - 1, j = missing->total - 1; i >= 0; i--) {
+		struct JournalFetchItem* root = (struct JournalFetchItem*) libp2p_utils_vector_get(roots, i);
+		if (j >= 0 && libp2p_utils_vector_get(missing, j) == root) {
+			j--;
+			continue;
+		}
+		if (!ipfs_pin_add_replicated(local_node->repo, root->hash, root->hash_size))
+			libp2p_logger_error("journal", "Unable to pin a replicated block.\n");
+	}
+	libp2p_utils_vector_free(missing);
+}
+
+/***
+ * A fetch, or one that did not start, is no longer waited for
+ * @param context the JournalContext
+ */
+static void ipfs_journal_fetch_finished(struct JournalContext* context) {
+	pthread_mutex_lock(&context->fetch_mutex);
+	context->progress.active_fetches--;
+	pthread_cond_broadcast(&context->fetch_done);
+	pthread_mutex_unlock(&context->fetch_mutex);
+}
+
+/***
+ * Walk down the DAG one level at a time, until nothing is missing
+ * @param param a JournalFetchJob
+ */
+static void* ipfs_journal_fetch_thread(void* param) {
+	struct JournalFetchJob* job = (struct JournalFetchJob*) param;
+	struct JournalContext* context = job->context;
+	while (job->items != NULL && job->items->total > 0 && !ipfs_journal_fetch_stopping(context)) {
+		struct Libp2pVector* arrived = libp2p_utils_vector_new(1);
+		if (arrived == NULL)
+			break;
+		int failed = ipfs_journal_fetch_wait(job, arrived);
+		// the next level is what is missing below what arrived
+		struct Libp2pVector* next_level = ipfs_journal_fetch_missing_below(job, arrived);
+		ipfs_journal_fetch_items_free(arrived);
+		if (next_level != NULL && next_level->total > 0) {
+			ipfs_journal_fetch_request(context->local_node, next_level, job->provider);
+		} else if (next_level != NULL) {
+			libp2p_utils_vector_free(next_level);
+			next_level = NULL;
+		}
+		job->items = next_level;
+		pthread_mutex_lock(&context->fetch_mutex);
+		context->progress.blocks_failed += failed;
+		if (next_level != NULL)
+			context->progress.blocks_wanted += next_level->total;
+		context->progress.levels++;
+		libp2p_logger_info("journal", "Replication progress: %lu of %lu blocks received, %lu failed, %lu levels.\n",
+				context->progress.blocks_received, context->progress.blocks_wanted, context->progress.blocks_failed, context->progress.levels);
+		pthread_mutex_unlock(&context->fetch_mutex);
+	}
+	ipfs_journal_fetch_items_free(job->items);
+	// what arrived is kept from here on
+	ipfs_journal_fetch_pin(context->local_node, job->roots);
+	ipfs_repo_fsrepo_add_end(context->local_node->repo, job->add_started);
+	ipfs_journal_fetch_items_free(job->roots);
+	ipfs_cid_set_destroy(&job->seen);
+	free(job);
+	ipfs_journal_fetch_finished(context);
+	return NULL;
+}
+
+int ipfs_journal_fetch_start(struct JournalContext* context, struct Libp2pVector* items, struct Libp2pPeer* provider) {
+	if (items == NULL)
+		return 0;
+	// counted as active in the same lock the context is freed under, so it is waited for
+	pthread_mutex_lock(&context->fetch_mutex);
+	int stopping = context->shutting_down;
+	if (items->total > 0 && !stopping)
+		context->progress.active_fetches++;
+	pthread_mutex_unlock(&context->fetch_mutex);
+	if (items->total == 0 || stopping) {
+		ipfs_journal_fetch_items_free(items);
+		return 0;
+	}
+	// ask for all of them at once
+	if (!ipfs_journal_fetch_request(context->local_node, items, provider)) {
+		libp2p_logger_error("journal", "Unable to request %d blocks from the exchange.\n", items->total);
+		ipfs_journal_fetch_items_free(items);
+		ipfs_journal_fetch_finished(context);
+		return 0;
+	}
+	struct JournalFetchJob* job = (struct JournalFetchJob*) malloc(sizeof(struct JournalFetchJob));
+	if (job == NULL) {
+		ipfs_journal_fetch_items_free(items);
+		ipfs_journal_fetch_finished(context);
+		return 0;
+	}
+	job->context = context;
+	job->items = items;
+	job->provider = provider;
+	job->seen = ipfs_cid_set_new();
+	// the blocks from the journal are pinned once the fetch is done
+	job->roots = libp2p_utils_vector_new(items->total);
+	for(int i = 0; job->roots != NULL && i < items->total; i++) {
+		struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(items, i);
+		struct JournalFetchItem* root = ipfs_journal_fetch_item_new(item->hash, item->hash_size, item->remote_timestamp);
+		if (root == NULL) {
+			ipfs_journal_fetch_items_free(job->roots);
+			job->roots = NULL;
+		} else {
+			libp2p_utils_vector_add(job->roots, root);
+		}
+	}
+	if (job->roots == NULL || job->seen == NULL) {
+		ipfs_journal_fetch_items_free(job->roots);
+		ipfs_cid_set_destroy(&job->seen);
+		ipfs_journal_fetch_items_free(items);
+		free(job);
+		ipfs_journal_fetch_finished(context);
+		return 0;
+	}
+	// a collection that starts meanwhile waits for the fetch, as it does for an add
+	job->add_started = ipfs_repo_fsrepo_add_begin(context->local_node->repo);
+	pthread_mutex_lock(&context->fetch_mutex);
+	context->progress.blocks_wanted += items->total;
+	pthread_mutex_unlock(&context->fetch_mutex);
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, ipfs_journal_fetch_thread, job) != 0) {
+		libp2p_logger_error("journal", "Unable to start thread to fetch blocks.\n");
+		ipfs_repo_fsrepo_add_end(context->local_node->repo, job->add_started);
+		ipfs_journal_fetch_items_free(job->roots);
+		ipfs_cid_set_destroy(&job->seen);
+		ipfs_journal_fetch_items_free(items);
+		free(job);
+		ipfs_journal_fetch_finished(context);
+		return 0;
+	}
+	pthread_detach(thread);
+	return 1;
+}
+
+int ipfs_journal_fetch_progress(struct JournalContext* context, struct JournalFetchProgress* progress) {
+	pthread_mutex_lock(&context->fetch_mutex);
+	memcpy(progress, &context->progress, sizeof(struct JournalFetchProgress));
+	pthread_mutex_unlock(&context->fetch_mutex);
+	return 1;
+}
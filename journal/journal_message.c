@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "ipfs/journal/journal_message.h"
 #include "ipfs/journal/journal_entry.h"
 #include "libp2p/utils/logger.h"
@@ -10,6 +12,11 @@ struct JournalMessage* ipfs_journal_message_new() {
 		message->end_epoch = 0;
 		message->start_epoch = 0;
 		message->journal_entries = libp2p_utils_vector_new(1);
+		message->summaries = libp2p_utils_vector_new(1);
+		message->flags = 0;
+		message->position_epoch = 0;
+		message->position_hash = NULL;
+		message->position_hash_size = 0;
 	}
 	return message;
 }
@@ -24,24 +31,319 @@ int ipfs_journal_message_free(struct JournalMessage* message) {
 			libp2p_utils_vector_free(message->journal_entries);
 			message->journal_entries = NULL;
 		}
+		if (message->summaries != NULL) {
+			for(int i = 0; i < message->summaries->total; i++) {
+				struct JournalSummary* summary = (struct JournalSummary*) libp2p_utils_vector_get(message->summaries, i);
+				ipfs_journal_summary_free(summary);
+			}
+			libp2p_utils_vector_free(message->summaries);
+			message->summaries = NULL;
+		}
+		if (message->position_hash != NULL)
+			free(message->position_hash);
 		free(message);
 	}
 	return 1;
 }
 
+struct JournalSummary* ipfs_journal_summary_new(unsigned long long start_epoch, unsigned long long end_epoch, unsigned long long num_entries, unsigned long long seed) {
+	struct JournalSummary* summary = (struct JournalSummary*) malloc(sizeof(struct JournalSummary));
+	if (summary != NULL) {
+		summary->start_epoch = start_epoch;
+		summary->end_epoch = end_epoch;
+		summary->num_entries = num_entries;
+		summary->num_hashes = JOURNAL_SUMMARY_NUM_HASHES;
+		summary->seed = seed;
+		summary->digest = 0;
+		summary->filter_size = (num_entries * JOURNAL_SUMMARY_BITS_PER_ENTRY + 7) / 8;
+		if (summary->filter_size < 8)
+			summary->filter_size = 8;
+		summary->filter = (uint8_t*) malloc(summary->filter_size);
+		if (summary->filter == NULL) {
+			free(summary);
+			return NULL;
+		}
+		memset(summary->filter, 0, summary->filter_size);
+	}
+	return summary;
+}
+
+int ipfs_journal_summary_free(struct JournalSummary* summary) {
+	if (summary != NULL) {
+		if (summary->filter != NULL)
+			free(summary->filter);
+		free(summary);
+	}
+	return 1;
+}
+
+/***
+ * Hash a journal hash (with the seed) to get the 2 values used to find the
+ * bits in the filter. Uses 64 bit FNV-1a, as the hashes are not
+ * guaranteed to be evenly distributed (they may have a multihash prefix)
+ * @param summary the JournalSummary
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @param h1 the first value
+ * @param h2 the second value (always odd)
+ */
+static void ipfs_journal_summary_hash(const struct JournalSummary* summary, const uint8_t* hash, size_t hash_size, uint64_t* h1, uint64_t* h2) {
+	uint64_t h = ipfs_journal_summary_entry_digest(summary, hash, hash_size);
+	*h1 = h & 0xffffffff;
+	*h2 = (h >> 32) | 1;
+}
+
+unsigned long long ipfs_journal_summary_entry_digest(const struct JournalSummary* summary, const uint8_t* hash, size_t hash_size) {
+	uint64_t h = 14695981039346656037ULL;
+	uint64_t seed = summary->seed;
+	for(int i = 0; i < 8; i++) {
+		h ^= (seed >> (i * 8)) & 0xff;
+		h *= 1099511628211ULL;
+	}
+	for(size_t i = 0; i < hash_size; i++) {
+		h ^= hash[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+int ipfs_journal_summary_add(struct JournalSummary* summary, const uint8_t* hash, size_t hash_size) {
+	if (summary == NULL || summary->filter_size == 0)
+		return 0;
+	uint64_t h1, h2;
+	uint64_t num_bits = summary->filter_size * 8;
+	ipfs_journal_summary_hash(summary, hash, hash_size, &h1, &h2);
+	for(unsigned long long i = 0; i < summary->num_hashes; i++) {
+		uint64_t bit = (h1 + i * h2) % num_bits;
+		summary->filter[bit / 8] |= 1 << (bit % 8);
+	}
+	summary->digest += ipfs_journal_summary_entry_digest(summary, hash, hash_size);
+	return 1;
+}
+
+int ipfs_journal_summary_contains(const struct JournalSummary* summary, const uint8_t* hash, size_t hash_size) {
+	if (summary == NULL || summary->filter_size == 0)
+		return 0;
+	uint64_t h1, h2;
+	uint64_t num_bits = summary->filter_size * 8;
+	ipfs_journal_summary_hash(summary, hash, hash_size, &h1, &h2);
+	for(unsigned long long i = 0; i < summary->num_hashes; i++) {
+		uint64_t bit = (h1 + i * h2) % num_bits;
+		if ( (summary->filter[bit / 8] & (1 << (bit % 8))) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Determine the maximum size of a protobuf'd JournalSummary
+ * @param summary the JournalSummary
+ * @returns the maximum size in bytes
+ */
+static int ipfs_journal_summary_encode_size(const struct JournalSummary* summary) {
+	// 6 varints and the filter
+	return 66 + 11 + summary->filter_size;
+}
+
+/***
+ * Protobuf a JournalSummary
+ * @param summary the JournalSummary
+ * @param buffer where to place the results
+ * @param max_buffer_size the amount of memory allocated for the buffer
+ * @param bytes_written the amount of the buffer used
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_summary_encode(const struct JournalSummary* summary, uint8_t *buffer, size_t max_buffer_size, size_t *bytes_written) {
+	/*
+	message JournalSummary {
+		int64 start_epoch = 1;
+		int64 end_epoch = 2;
+		int64 num_entries = 3;
+		int32 num_hashes = 4;
+		int64 seed = 5;
+		bytes filter = 6;
+		int64 digest = 7;
+	}
+	*/
+	*bytes_written = 0;
+	size_t bytes_used;
+	unsigned long long values[] = { summary->start_epoch, summary->end_epoch, summary->num_entries, summary->num_hashes, summary->seed };
+	for(int i = 0; i < 5; i++) {
+		if (!protobuf_encode_varint(i + 1, WIRETYPE_VARINT, values[i], &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+	}
+	if (!protobuf_encode_length_delimited(6, WIRETYPE_LENGTH_DELIMITED, (char*)summary->filter, summary->filter_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+		return 0;
+	*bytes_written += bytes_used;
+	if (!protobuf_encode_varint(7, WIRETYPE_VARINT, summary->digest, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+		return 0;
+	*bytes_written += bytes_used;
+	return 1;
+}
+
+/***
+ * Turn a protobuf'd JournalSummary into a JournalSummary
+ * @param incoming the incoming bytes
+ * @param incoming_size the size of the incoming buffer
+ * @param out where to put the new JournalSummary
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_journal_summary_decode(const uint8_t *incoming, size_t incoming_size, struct JournalSummary **out) {
+	size_t pos = 0;
+	int retVal = 0;
+
+	if ( (*out = ipfs_journal_summary_new(0, 0, 0, 0)) == NULL)
+		return 0;
+	struct JournalSummary* summary = *out;
+	free(summary->filter);
+	summary->filter = NULL;
+	summary->filter_size = 0;
+
+	while(pos < incoming_size) {
+		size_t bytes_read = 0;
+		int field_no;
+		enum WireType field_type;
+		if (protobuf_decode_field_and_type(&incoming[pos], incoming_size, &field_no, &field_type, &bytes_read) == 0)
+			goto exit;
+		pos += bytes_read;
+		switch(field_no) {
+			case (1):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->start_epoch, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (2):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->end_epoch, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (3):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->num_entries, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (4):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->num_hashes, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (5):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->seed, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (6):
+				if (summary->filter != NULL)
+					goto exit;
+				if (protobuf_decode_length_delimited(&incoming[pos], incoming_size - pos, (char**)&summary->filter, &summary->filter_size, &bytes_read) == 0)
+					goto exit;
+				break;
+			case (7):
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &summary->digest, &bytes_read) == 0)
+					goto exit;
+				break;
+			default:
+				libp2p_logger_error("journal_message", "Invalid field %d in journal summary protobuf.\n", field_no);
+				goto exit;
+		}
+		pos += bytes_read;
+	}
+	// a summary that cannot be checked against is of no use
+	retVal = summary->filter != NULL && summary->filter_size > 0 && summary->num_hashes > 0 && summary->num_hashes <= 32;
+
+exit:
+	if (retVal == 0) {
+		ipfs_journal_summary_free(*out);
+		*out = NULL;
+	}
+	return retVal;
+}
+
+int ipfs_journal_message_set_position(struct JournalMessage* message, unsigned long long timestamp, const uint8_t* hash, size_t hash_size) {
+	if (message->position_hash != NULL)
+		free(message->position_hash);
+	message->position_hash = NULL;
+	message->position_hash_size = 0;
+	message->position_epoch = timestamp;
+	if (hash_size > 0) {
+		message->position_hash = (uint8_t*) malloc(hash_size);
+		if (message->position_hash == NULL)
+			return 0;
+		memcpy(message->position_hash, hash, hash_size);
+		message->position_hash_size = hash_size;
+	}
+	return 1;
+}
+
+struct Libp2pVector* ipfs_journal_message_split_summaries(struct JournalMessage* message, int flags) {
+	struct Libp2pVector* batches = libp2p_utils_vector_new(1);
+	if (batches == NULL)
+		return NULL;
+	struct JournalMessage* batch = NULL;
+	size_t batch_size = 0;
+	unsigned long long start = message->start_epoch;
+	int i = 0;
+	while (i <= message->summaries->total) {
+		struct JournalSummary* summary = NULL;
+		size_t summary_size = 0;
+		if (i < message->summaries->total) {
+			summary = (struct JournalSummary*) libp2p_utils_vector_get(message->summaries, i);
+			summary_size = ipfs_journal_summary_encode_size(summary) + 11;
+		}
+		if (batch != NULL && summary != NULL && (batch->summaries->total >= JOURNAL_SUMMARY_BATCH_SIZE
+				|| batch_size + summary_size > JOURNAL_MESSAGE_MAX_SIZE)) {
+			// the next one starts after the windows of this one
+			start = batch->end_epoch + 1;
+			batch = NULL;
+		}
+		if (batch == NULL) {
+			batch = ipfs_journal_message_new();
+			if (batch == NULL) {
+				for(int j = 0; j < batches->total; j++) {
+					struct JournalMessage* m = (struct JournalMessage*) libp2p_utils_vector_get(batches, j);
+					// the summaries are still the message's
+					while (m->summaries->total > 0)
+						libp2p_utils_vector_delete(m->summaries, m->summaries->total - 1);
+					ipfs_journal_message_free(m);
+				}
+				libp2p_utils_vector_free(batches);
+				return NULL;
+			}
+			batch->current_epoch = message->current_epoch;
+			batch->start_epoch = start;
+			batch->flags = flags;
+			batch_size = ipfs_journal_message_encode_size(batch);
+			libp2p_utils_vector_add(batches, batch);
+		}
+		if (summary == NULL)
+			break;
+		libp2p_utils_vector_add(batch->summaries, summary);
+		batch->end_epoch = summary->end_epoch;
+		batch_size += summary_size;
+		i++;
+	}
+	// the summaries now belong to the batches
+	while (message->summaries->total > 0)
+		libp2p_utils_vector_delete(message->summaries, message->summaries->total - 1);
+	batch->end_epoch = message->end_epoch;
+	batch->flags |= JOURNAL_MESSAGE_LAST_SUMMARY;
+	return batches;
+}
+
 /**
  * Determine the maximum size of a protobuf'd JournalMessage
  * @param message the JournalMessage
  * @returns the maximum size of this message in bytes if it were protobuf'd
  */
 int ipfs_journal_message_encode_size(struct JournalMessage* message) {
-	// 3 epochs
-	int sz = 33;
+	// 3 epochs, the flags and the position
+	int sz = 66 + 11 + message->position_hash_size;
 	// journal entries
 	for (int i = 0; i < message->journal_entries->total; i++) {
 		struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(message->journal_entries, i);
 		sz += ipfs_journal_entry_encode_size(entry);
 	}
+	// summaries
+	for (int i = 0; i < message->summaries->total; i++) {
+		struct JournalSummary* summary = (struct JournalSummary*) libp2p_utils_vector_get(message->summaries, i);
+		sz += ipfs_journal_summary_encode_size(summary) + 11;
+	}
 	return sz;
 }
 
@@ -60,6 +362,10 @@ int ipfs_journal_message_encode(struct JournalMessage* message, uint8_t *buffer,
 		int32 start_epoch = 2;
 		int32 end_epoch = 3;
 		repeated JournalEntry journal_entries = 4;
+		repeated JournalSummary summaries = 5;
+		int32 flags = 6;
+		int64 position_epoch = 7;
+		bytes position_hash = 8;
 	}
 	*/
 	// sanity checks
@@ -94,6 +400,37 @@ int ipfs_journal_message_encode(struct JournalMessage* message, uint8_t *buffer,
 		}
 		*bytes_written += bytes_used;
 	}
+	// summaries
+	for (int i = 0; i < message->summaries->total; i++) {
+		struct JournalSummary* summary = (struct JournalSummary*) libp2p_utils_vector_get(message->summaries, i);
+		size_t temp_size = ipfs_journal_summary_encode_size(summary);
+		uint8_t* temp = (uint8_t*) malloc(temp_size);
+		if (temp == NULL)
+			return 0;
+		if (!ipfs_journal_summary_encode(summary, temp, temp_size, &temp_size)) {
+			free(temp);
+			return 0;
+		}
+		int success = protobuf_encode_length_delimited(5, WIRETYPE_LENGTH_DELIMITED, (char*)temp, temp_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used);
+		free(temp);
+		if (!success)
+			return 0;
+		*bytes_written += bytes_used;
+	}
+	// flags and position, only if there are any
+	if (message->flags != 0) {
+		if (!protobuf_encode_varint(6, WIRETYPE_VARINT, message->flags, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+	}
+	if (message->position_hash_size > 0) {
+		if (!protobuf_encode_varint(7, WIRETYPE_VARINT, message->position_epoch, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+		if (!protobuf_encode_length_delimited(8, WIRETYPE_LENGTH_DELIMITED, (char*)message->position_hash, message->position_hash_size, &buffer[*bytes_written], max_buffer_size - *bytes_written, &bytes_used))
+			return 0;
+		*bytes_written += bytes_used;
+	}
 	return 1;
 }
 
@@ -118,7 +455,7 @@ int ipfs_journal_message_decode(const uint8_t *incoming, size_t incoming_size, s
 		if (protobuf_decode_field_and_type(&incoming[pos], incoming_size, &field_no, &field_type, &bytes_read) == 0) {
 			goto exit;
 		}
-		if (field_no < 1 || field_no > 5) {
+		if (field_no < 1 || field_no > 8) {
 			libp2p_logger_error("journal_message", "Invalid character in journal_message protobuf at position %lu. Value: %02x\n", pos, incoming[pos]);
 		}
 		pos += bytes_read;
@@ -157,6 +494,41 @@ int ipfs_journal_message_decode(const uint8_t *incoming, size_t incoming_size, s
 				got_something = 1;
 				break;
 			}
+			case (5): { // summary
+				uint8_t *temp;
+				size_t temp_length;
+				if (protobuf_decode_length_delimited(&incoming[pos], incoming_size - pos, (char**)&temp, &temp_length, &bytes_read) == 0)
+					goto exit;
+				pos += bytes_read;
+				struct JournalSummary* summary = NULL;
+				int success = ipfs_journal_summary_decode(temp, temp_length, &summary);
+				free(temp);
+				if (!success)
+					goto exit;
+				libp2p_utils_vector_add((*out)->summaries, (void*)summary);
+				got_something = 1;
+				break;
+			}
+			case (6): { // flags
+				unsigned long long flags = 0;
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &flags, &bytes_read) == 0)
+					goto exit;
+				(*out)->flags = (int)flags;
+				pos += bytes_read;
+				break;
+			}
+			case (7): // position_epoch
+				if (protobuf_decode_varint(&incoming[pos], incoming_size - pos, &(*out)->position_epoch, &bytes_read) == 0)
+					goto exit;
+				pos += bytes_read;
+				break;
+			case (8): // position_hash
+				if ((*out)->position_hash != NULL)
+					goto exit;
+				if (protobuf_decode_length_delimited(&incoming[pos], incoming_size - pos, (char**)&(*out)->position_hash, &(*out)->position_hash_size, &bytes_read) == 0)
+					goto exit;
+				pos += bytes_read;
+				break;
 		}
 	}
 
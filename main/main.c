@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "libp2p/os/utils.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/repo/init.h"
 #include "ipfs/importer/importer.h"
@@ -10,6 +11,9 @@
 #include "ipfs/core/swarm.h"
 #include "ipfs/cmd/cli.h"
 #include "ipfs/namesys/name.h"
+#include "ipfs/pin/gc.h"
+#include "ipfs/pin/pin.h"
+#include "ipfs/util/memory.h"
 
 #ifdef __MINGW32__
     void bzero(void *s, size_t n)
@@ -71,6 +75,8 @@ void strip_quotes(int argc, char** argv) {
 #define GET 8
 #define NAME 9
 #define SWARM 10
+#define REPO 11
+#define PIN 12
 
 /**
  * Find out if this command line argument is part of a switch
@@ -151,6 +157,12 @@ int parse_arguments(int argc, char** argv) {
 	if (strcmp("swarm", argv[index]) == 0) {
 		return SWARM;
 	}
+	if (strcmp("repo", argv[index]) == 0) {
+		return REPO;
+	}
+	if (strcmp("pin", argv[index]) == 0) {
+		return PIN;
+	}
 	return -1;
 }
 
@@ -196,12 +208,21 @@ int main(int argc, char** argv) {
 			case (SWARM):
 				retVal = ipfs_swarm(args);
 				break;
+			case (REPO):
+				retVal = ipfs_repo_gc(args);
+				break;
+			case (PIN):
+				retVal = ipfs_pin(args);
+				break;
 			default:
 				libp2p_logger_error("main", "Invalid command line arguments.\n");
 				break;
 		}
 		cli_arguments_free(args);
 	}
+	// anything still allocated now was leaked
+	if (os_utils_getenv("IPFS_MEMORY_REPORT") != NULL)
+		ipfs_util_memory_report(stderr);
 	libp2p_logger_free();
 	exit(retVal == 1 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
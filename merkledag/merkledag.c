@@ -5,10 +5,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "libp2p/crypto/sha256.h"
-#include "mh/multihash.h"
-#include "mh/hashes.h"
 #include "ipfs/merkledag/merkledag.h"
+#include "ipfs/multihash/multihash.h"
 #include "ipfs/unixfs/unixfs.h"
 
 /***
@@ -71,15 +69,13 @@ int ipfs_merkledag_add(struct HashtableNode* node, struct FSRepo* fs_repo, size_
 		size_t bytes_encoded;
 		retVal = ipfs_hashtable_node_protobuf_encode(node, protobuf, protobuf_size, &bytes_encoded);
 
-		node->hash_size = 32;
-		node->hash = (unsigned char*)malloc(node->hash_size);
-		if (node->hash == NULL) {
+		// with the function the node was made with, sha2-256 unless it was told otherwise
+		unsigned char hash[IPFS_MULTIHASH_MAX_SIZE];
+		size_t hash_size = 0;
+		if (!ipfs_multihash_hash(node->hash_function, protobuf, bytes_encoded, hash, &hash_size))
 			return 0;
-		}
-		if (libp2p_crypto_hashing_sha256(protobuf, bytes_encoded, &node->hash[0]) == 0) {
-			free(node->hash);
+		if (!ipfs_hashtable_node_set_hash(node, hash, hash_size))
 			return 0;
-		}
 	}
 
 	// write to block store & datastore
@@ -130,8 +126,8 @@ int ipfs_merkledag_get(const unsigned char* hash, size_t hash_size, struct Hasht
 int ipfs_merkledag_get_by_multihash(const unsigned char* multihash, size_t multihash_length, struct HashtableNode** node, const struct FSRepo* fs_repo) {
 	// convert to hash
 	size_t hash_size = 0;
-	unsigned char* hash = NULL;
-	if (mh_multihash_digest(multihash, multihash_length, &hash, &hash_size) < 0) {
+	const unsigned char* hash = NULL;
+	if (!ipfs_multihash_unwrap(multihash, multihash_length, &hash, &hash_size)) {
 		return 0;
 	}
 	return ipfs_merkledag_get(hash, hash_size, node, fs_repo);
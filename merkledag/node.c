@@ -8,11 +8,15 @@
 #include <strings.h>
 #include "inttypes.h"
 
-#include "mh/multihash.h"
-#include "mh/hashes.h"
+#include "ipfs/blocks/block.h"
 #include "ipfs/cid/cid.h"
 #include "ipfs/merkledag/node.h"
+#include "ipfs/multihash/multihash.h"
 #include "ipfs/unixfs/unixfs.h"
+#include "ipfs/util/memory.h"
+
+// with fewer links than this, a lookup by name just walks the list
+#define NODE_LINK_INDEX_MIN 16
 
 extern char *strtok_r(char *, const char *, char **);
 
@@ -66,7 +70,7 @@ int ipfs_node_link_create(char * name, unsigned char * ahash, size_t hash_size,
 }
 
 int ipfs_node_link_new(struct NodeLink** node_link) {
-	*node_link = malloc(sizeof(struct NodeLink));
+	*node_link = ipfs_util_memory_alloc(MEMORY_TAG_MERKLEDAG, sizeof(struct NodeLink));
 	if (*node_link == NULL)
 		return 0;
 
@@ -89,7 +93,7 @@ int ipfs_node_link_free(struct NodeLink * node_link)
 			free(node_link->hash);
 		if (node_link->name != NULL)
 			free(node_link->name);
-		free(node_link);
+		ipfs_util_memory_free(MEMORY_TAG_MERKLEDAG, node_link);
 	}
 	return 1;
 }
@@ -131,9 +135,10 @@ int ipfs_node_link_protobuf_encode(const struct NodeLink* link, unsigned char* b
 	*bytes_written = 0;
 	// hash
 	if (link->hash_size > 0) {
-		size_t hash_length = mh_new_length(MH_H_SHA2_256, link->hash_size);
-		unsigned char hash[hash_length];
-		mh_new(hash, MH_H_SHA2_256, link->hash, link->hash_size);
+		size_t hash_length = 0;
+		unsigned char hash[link->hash_size + IPFS_MULTIHASH_MAX_SIZE];
+		if (!ipfs_multihash_wrap(link->hash, link->hash_size, hash, sizeof(hash), &hash_length))
+			return 0;
 		retVal = protobuf_encode_length_delimited(1, ipfs_node_link_message_fields[0], (char*)hash, hash_length, &buffer[*bytes_written], max_buffer_length - *bytes_written, &bytes_used);
 		if (retVal == 0) {
 			return 0;
@@ -192,17 +197,19 @@ int ipfs_node_link_protobuf_decode(unsigned char* buffer, size_t buffer_length,
 			case (1): { // hash
 				size_t hash_size = 0;
 				unsigned char* hash;
+				const unsigned char* link_hash = NULL;
 				if (protobuf_decode_length_delimited(&buffer[pos], buffer_length - pos, (char**)&hash, &hash_size, &bytes_read) == 0)
 					goto exit;
-				if (hash_size < 2) {
+				if (!ipfs_multihash_unwrap(hash, hash_size, &link_hash, &link->hash_size)) {
+					free(hash);
 					goto exit;
 				}
-				link->hash_size = hash_size - 2;
 				link->hash = (unsigned char*)malloc(link->hash_size);
 				if (link->hash == NULL) {
+					free(hash);
 					goto exit;
 				}
-				memcpy((char*)link->hash, (char*)&hash[2], link->hash_size);
+				memcpy((char*)link->hash, (char*)link_hash, link->hash_size);
 				free(hash);
 				pos += bytes_read;
 				break;
@@ -289,68 +296,209 @@ int ipfs_hashtable_node_protobuf_encode(const struct HashtableNode* node, unsign
 }
 
 /***
- * Decode a stream of bytes into a Node structure
- * @param buffer where to get the bytes from
- * @param buffer_length the length of buffer
- * @param node pointer to the Node to be created
- * @returns true(1) on success
+ * A field of a protobuf message, read without copying it
  */
-int ipfs_hashtable_node_protobuf_decode(unsigned char* buffer, size_t buffer_length, struct HashtableNode** node) {
-	/*
-	 * Field 1: data
-	 * Field 2: link
-	 */
-	size_t pos = 0;
-	int retVal = 0;
-	unsigned char* temp_buffer = NULL;
-	size_t temp_size;
-	struct NodeLink* temp_link = NULL;
+struct NodeProtobufField {
+	int field_no;
+	const unsigned char* bytes; // where a length delimited field is in the message
+	size_t size;
+	unsigned long long value; // a varint field
+};
 
-	if (buffer_length == 0)
-		goto exit;
+/***
+ * Read the next field of a message
+ * @param buffer the message
+ * @param buffer_length the length of the message
+ * @param pos where the field starts, moved past it
+ * @param field where to put the field
+ * @returns true(1) on success, false(0) if the message is cut short or the field is of a type nodes don't use
+ */
+static int ipfs_node_protobuf_next_field(const unsigned char* buffer, size_t buffer_length, size_t* pos, struct NodeProtobufField* field) {
+	size_t bytes_read = 0;
+	enum WireType field_type;
+	unsigned long long length = 0;
 
-	if (ipfs_hashtable_node_new(node) == 0)
-		goto exit;
+	if (protobuf_decode_field_and_type(&buffer[*pos], buffer_length - *pos, &field->field_no, &field_type, &bytes_read) == 0)
+		return 0;
+	*pos += bytes_read;
+	if (*pos >= buffer_length)
+		return 0;
+	field->bytes = NULL;
+	field->size = 0;
+	field->value = 0;
+	switch (field_type) {
+		case (WIRETYPE_VARINT):
+			if (protobuf_decode_varint(&buffer[*pos], buffer_length - *pos, &field->value, &bytes_read) == 0)
+				return 0;
+			*pos += bytes_read;
+			return 1;
+		case (WIRETYPE_LENGTH_DELIMITED):
+			if (protobuf_decode_varint(&buffer[*pos], buffer_length - *pos, &length, &bytes_read) == 0)
+				return 0;
+			*pos += bytes_read;
+			if (length > buffer_length - *pos)
+				return 0;
+			field->bytes = &buffer[*pos];
+			field->size = length;
+			*pos += length;
+			return 1;
+		default:
+			return 0;
+	}
+}
 
-	while(pos < buffer_length) {
-		size_t bytes_read = 0;
-		int field_no;
-		enum WireType field_type;
-		if (protobuf_decode_field_and_type(&buffer[pos], buffer_length, &field_no, &field_type, &bytes_read) == 0) {
-			goto exit;
-		}
-		pos += bytes_read;
-		switch(field_no) {
-			case (1): { // data
-				if (protobuf_decode_length_delimited(&buffer[pos], buffer_length - pos, (char**)&((*node)->data), &((*node)->data_size), &bytes_read) == 0)
-					goto exit;
-				pos += bytes_read;
-				break;
+/***
+ * Walk an encoded node. It is walked once to measure the arena, and again to
+ * fill it, so that the node and its links take one allocation.
+ * @param buffer the encoded node
+ * @param buffer_length the length of buffer
+ * @param view true(1) to leave the data and the link hashes in buffer, false(0) to copy them into the arena
+ * @param node NULL to measure, otherwise the node to fill, with an arena of the measured size
+ * @param arena_size where to put the size of the arena, when measuring
+ * @returns true(1) on success, false(0) if the node is badly encoded
+ */
+static int ipfs_hashtable_node_protobuf_walk(const unsigned char* buffer, size_t buffer_length, int view,
+		struct HashtableNode* node, size_t* arena_size) {
+	struct NodeProtobufField field, link_field;
+	size_t links = 0, bytes = 0;
+	struct NodeLink* link = NULL;
+	unsigned char* next = NULL;
+	size_t pos = 0;
+
+	if (node != NULL) {
+		link = (struct NodeLink*)node->arena;
+		next = node->arena + node->arena_size;
+	}
+	while (pos < buffer_length) {
+		if (!ipfs_node_protobuf_next_field(buffer, buffer_length, &pos, &field))
+			return 0;
+		if (field.field_no == 1 && field.bytes != NULL) { // data
+			if (view) {
+				if (node != NULL)
+					node->data = (unsigned char*)field.bytes;
+			} else if (node == NULL) {
+				bytes += field.size;
+			} else {
+				next -= field.size;
+				memcpy(next, field.bytes, field.size);
+				node->data = next;
 			}
-			case (2): {// links
-				if (protobuf_decode_length_delimited(&buffer[pos], buffer_length - pos, (char**)&temp_buffer, &temp_size, &bytes_read) == 0)
-					goto exit;
-				pos += bytes_read;
-				if (ipfs_node_link_protobuf_decode(temp_buffer, temp_size, &temp_link)) {
-					ipfs_hashtable_node_add_link(*node, temp_link);
+			if (node != NULL)
+				node->data_size = field.size;
+		} else if (field.field_no == 2 && field.bytes != NULL) { // link
+			size_t link_pos = 0;
+			if (node != NULL) {
+				link->hash = NULL;
+				link->hash_size = 0;
+				link->name = NULL;
+				link->t_size = 0;
+				link->next = NULL;
+			}
+			while (link_pos < field.size) {
+				if (!ipfs_node_protobuf_next_field(field.bytes, field.size, &link_pos, &link_field))
+					return 0;
+				if (link_field.field_no == 1 && link_field.bytes != NULL) { // hash, within the multihash
+					const unsigned char* link_hash = NULL;
+					size_t link_hash_size = 0;
+					if (!ipfs_multihash_unwrap(link_field.bytes, link_field.size, &link_hash, &link_hash_size))
+						return 0;
+					if (node == NULL) {
+						if (!view)
+							bytes += link_hash_size;
+					} else {
+						link->hash_size = link_hash_size;
+						if (view) {
+							link->hash = (unsigned char*)link_hash;
+						} else {
+							next -= link->hash_size;
+							memcpy(next, link_hash, link->hash_size);
+							link->hash = next;
+						}
+					}
+				} else if (link_field.field_no == 2 && link_field.bytes != NULL) { // name
+					if (node == NULL) {
+						bytes += link_field.size + 1;
+					} else {
+						next -= link_field.size + 1;
+						memcpy(next, link_field.bytes, link_field.size);
+						next[link_field.size] = 0;
+						link->name = (char*)next;
+					}
+				} else if (link_field.field_no == 3 && link_field.bytes == NULL) { // t_size
+					if (node != NULL)
+						link->t_size = link_field.value;
 				}
-				free(temp_buffer);
-				temp_buffer = NULL;
-				break;
 			}
+			if (node != NULL)
+				ipfs_hashtable_node_add_link(node, link++);
+			links++;
 		}
 	}
+	if (node == NULL)
+		*arena_size = links * sizeof(struct NodeLink) + bytes;
+	return 1;
+}
 
-	retVal = 1;
+/***
+ * Decode into a new node, putting the links in one allocation
+ * @param buffer the encoded node
+ * @param buffer_length the length of buffer
+ * @param view true(1) to point into buffer for the data and hashes
+ * @param node where to put the node
+ * @returns true(1) on success
+ */
+static int ipfs_hashtable_node_protobuf_decode_arena(const unsigned char* buffer, size_t buffer_length, int view, struct HashtableNode** node) {
+	size_t arena_size = 0;
 
-exit:
-	if (retVal == 0) {
-		ipfs_hashtable_node_free(*node);
+	*node = NULL;
+	if (buffer_length == 0)
+		return 0;
+	if (!ipfs_hashtable_node_protobuf_walk(buffer, buffer_length, view, NULL, &arena_size))
+		return 0;
+	if (ipfs_hashtable_node_new(node) == 0)
+		return 0;
+	if (arena_size > 0) {
+		(*node)->arena = ipfs_util_memory_alloc(MEMORY_TAG_MERKLEDAG, arena_size);
+		if ((*node)->arena == NULL) {
+			ipfs_hashtable_node_free(*node);
+			*node = NULL;
+			return 0;
+		}
+		(*node)->arena_size = arena_size;
 	}
-	if (temp_buffer != NULL)
-		free(temp_buffer);
+	// measured, so it can't fail
+	ipfs_hashtable_node_protobuf_walk(buffer, buffer_length, view, *node, NULL);
+	return 1;
+}
 
-	return retVal;
+/***
+ * Decode a stream of bytes into a Node structure
+ * @param buffer where to get the bytes from
+ * @param buffer_length the length of buffer
+ * @param node pointer to the Node to be created
+ * @returns true(1) on success
+ */
+int ipfs_hashtable_node_protobuf_decode(unsigned char* buffer, size_t buffer_length, struct HashtableNode** node) {
+	/*
+	 * Field 1: data
+	 * Field 2: link
+	 */
+	return ipfs_hashtable_node_protobuf_decode_arena(buffer, buffer_length, 0, node);
+}
+
+/***
+ * Decode the data of a block into a Node structure, pointing into the block
+ * @param block the block, which belongs to the node on success
+ * @param node pointer to the Node to be created
+ * @returns true(1) on success
+ */
+int ipfs_hashtable_node_protobuf_decode_view(struct Block* block, struct HashtableNode** node) {
+	if (block == NULL)
+		return 0;
+	if (!ipfs_hashtable_node_protobuf_decode_arena(block->data, block->data_length, 1, node))
+		return 0;
+	(*node)->block = block;
+	return 1;
 }
 
 /*====================================================================================
@@ -362,18 +510,58 @@ exit:
  */
 int ipfs_hashtable_node_new(struct HashtableNode** node)
 {
-	*node = (struct HashtableNode *)malloc(sizeof(struct HashtableNode));
+	*node = (struct HashtableNode *)ipfs_util_memory_alloc(MEMORY_TAG_MERKLEDAG, sizeof(struct HashtableNode));
 	if (*node == NULL)
 		return 0;
 	(*node)->hash = NULL;
 	(*node)->hash_size = 0;
+	(*node)->hash_function = IPFS_MULTIHASH_SHA2_256;
 	(*node)->data = NULL;
 	(*node)->data_size = 0;
 	(*node)->encoded = NULL;
 	(*node)->head_link = NULL;
+	(*node)->tail_link = NULL;
+	(*node)->link_count = 0;
+	(*node)->link_index = NULL;
+	(*node)->arena = NULL;
+	(*node)->arena_size = 0;
+	(*node)->block = NULL;
 	return 1;
 }
 
+/***
+ * Whether memory the node points to was allocated on its own, and so is freed
+ * on its own, or is in the node's arena or block
+ * @param node the node
+ * @param ptr what it points to
+ * @returns true(1) if ptr should be freed on its own, false(0) otherwise (NULL included)
+ */
+static int ipfs_hashtable_node_owns(const struct HashtableNode* node, const void* ptr) {
+	uintptr_t p = (uintptr_t)ptr;
+	if (ptr == NULL)
+		return 0;
+	if (node->arena != NULL && p >= (uintptr_t)node->arena && p < (uintptr_t)node->arena + node->arena_size)
+		return 0;
+	if (node->block != NULL && node->block->data != NULL && p >= (uintptr_t)node->block->data
+			&& p < (uintptr_t)node->block->data + node->block->data_length)
+		return 0;
+	return 1;
+}
+
+/***
+ * Free a link of a node, and whatever of it isn't in the node's arena or block
+ * @param node the node
+ * @param link the link
+ */
+static void ipfs_hashtable_node_link_free(const struct HashtableNode* node, struct NodeLink* link) {
+	if (ipfs_hashtable_node_owns(node, link->hash))
+		free(link->hash);
+	if (ipfs_hashtable_node_owns(node, link->name))
+		free(link->name);
+	if (ipfs_hashtable_node_owns(node, link))
+		ipfs_util_memory_free(MEMORY_TAG_MERKLEDAG, link);
+}
+
 /***
  * Allocates memory for a node, and sets the data section to indicate
  * that this node is a directory
@@ -439,6 +627,8 @@ int ipfs_hashtable_node_set_hash(struct HashtableNode* node, const unsigned char
 	if (hash_size > 0) { // don't bother if there is nothing to copy
 		memcpy(node->hash, hash, hash_size);
 		node->hash_size = hash_size;
+		// so that the node is hashed the same way if it is changed and added again
+		node->hash_function = ipfs_multihash_hash_code(hash, hash_size);
 	}
 	return 1;
 }
@@ -456,7 +646,7 @@ int ipfs_hashtable_node_set_data(struct HashtableNode* node, unsigned char * Dat
 	{
 		return 0;
 	}
-	if (node->data != NULL) {
+	if (ipfs_hashtable_node_owns(node, node->data)) {
 		free(node->data);
 	}
 	node->data = malloc(sizeof(unsigned char) * data_size);
@@ -498,13 +688,34 @@ unsigned char * ipfs_hashtable_node_get_data(struct HashtableNode * N)
 }
 
 struct NodeLink* ipfs_node_link_last(struct HashtableNode* node) {
-	struct NodeLink* current = node->head_link;
-	while(current != NULL) {
-		if (current->next == NULL)
-			break;
-		current = current->next;
-	}
-	return current;
+	return node->tail_link;
+}
+
+/***
+ * The links changed, so the index is out of date
+ * @param node the node
+ */
+static void ipfs_hashtable_node_drop_index(struct HashtableNode* node) {
+	free(node->link_index);
+	node->link_index = NULL;
+}
+
+/***
+ * Take a link out of the list, and free it
+ * @param node the node
+ * @param previous the link before it, NULL if it is the first
+ * @param current the link
+ */
+static void ipfs_hashtable_node_unlink(struct HashtableNode* node, struct NodeLink* previous, struct NodeLink* current) {
+	if (previous == NULL)
+		node->head_link = current->next;
+	else
+		previous->next = current->next;
+	if (node->tail_link == current)
+		node->tail_link = previous;
+	node->link_count--;
+	ipfs_hashtable_node_drop_index(node);
+	ipfs_hashtable_node_link_free(node, current);
 }
 
 int ipfs_node_remove_link(struct HashtableNode* node, struct NodeLink* toRemove) {
@@ -515,16 +726,7 @@ int ipfs_node_remove_link(struct HashtableNode* node, struct NodeLink* toRemove)
 		current = current->next;
 	}
 	if (current != NULL) {
-		if (previous == NULL) {
-			// we're trying to delete the head
-			previous = current->next;
-			ipfs_node_link_free(current);
-			node->head_link = previous;
-		} else {
-			// we're in the middle or end
-			previous = current->next;
-			ipfs_node_link_free(current);
-		}
+		ipfs_hashtable_node_unlink(node, previous, current);
 		return 1;
 	}
 	return 0;
@@ -544,15 +746,17 @@ int ipfs_hashtable_node_free(struct HashtableNode * N)
 		while (current != NULL) {
 			struct NodeLink* toDelete = current;
 			current = current->next;
-			ipfs_node_remove_link(N, toDelete);
+			ipfs_hashtable_node_link_free(N, toDelete);
 		}
+		N->head_link = NULL;
+		free(N->link_index);
 		if(N->hash != NULL)
 		{
 			free(N->hash);
 			N->hash = NULL;
 			N->hash_size = 0;
 		}
-		if (N->data) {
+		if (ipfs_hashtable_node_owns(N, N->data)) {
 			free(N->data);
 			N->data = NULL;
 			N->data_size = 0;
@@ -560,21 +764,79 @@ int ipfs_hashtable_node_free(struct HashtableNode * N)
 		if (N->encoded != NULL) {
 			free(N->encoded);
 		}
-		free(N);
+		ipfs_util_memory_free(MEMORY_TAG_MERKLEDAG, N->arena);
+		if (N->block != NULL)
+			ipfs_block_free(N->block);
+		ipfs_util_memory_free(MEMORY_TAG_MERKLEDAG, N);
 		N = NULL;
 	}
 	return 1;
 }
 
+/***
+ * Compare link names, where a link without a name comes first
+ * @returns < 0, 0 or > 0, like strcmp
+ */
+static int ipfs_node_link_name_compare(const char* a, const char* b) {
+	if (a == NULL || b == NULL)
+		return (a != NULL) - (b != NULL);
+	return strcmp(a, b);
+}
+
+static int ipfs_node_link_index_compare(const void* a, const void* b) {
+	const struct NodeLinkIndex* entry_a = (const struct NodeLinkIndex*)a;
+	const struct NodeLinkIndex* entry_b = (const struct NodeLinkIndex*)b;
+	int retVal = ipfs_node_link_name_compare(entry_a->link->name, entry_b->link->name);
+	if (retVal == 0)
+		retVal = (entry_a->position > entry_b->position) - (entry_a->position < entry_b->position);
+	return retVal;
+}
+
+/***
+ * Sort the links by name
+ * @param node the node
+ * @returns true(1) on success, false(0) if there was no memory for it
+ */
+static int ipfs_hashtable_node_build_index(struct HashtableNode* node) {
+	node->link_index = (struct NodeLinkIndex*) malloc(node->link_count * sizeof(struct NodeLinkIndex));
+	if (node->link_index == NULL)
+		return 0;
+	size_t position = 0;
+	for(struct NodeLink* current = node->head_link; current != NULL; current = current->next) {
+		node->link_index[position].link = current;
+		node->link_index[position].position = position;
+		position++;
+	}
+	qsort(node->link_index, node->link_count, sizeof(struct NodeLinkIndex), ipfs_node_link_index_compare);
+	return 1;
+}
+
 /*ipfs_node_get_link_by_name
- * Returns a copy of the link with given name
+ * Returns the link with given name. The first lookup of a node with many links
+ * sorts them by name, so the ones after it are a binary search.
  * @param Name: (char * name) searches for link with this name
- * Returns the link struct if it's found otherwise returns NULL
+ * Returns the link struct if it's found otherwise returns NULL. If more than one
+ * link has the name, the first of them.
  */
 struct NodeLink * ipfs_hashtable_node_get_link_by_name(struct HashtableNode * N, char * Name)
 {
+	if (N->link_count >= NODE_LINK_INDEX_MIN && (N->link_index != NULL || ipfs_hashtable_node_build_index(N))) {
+		// the first entry with the name
+		size_t low = 0;
+		size_t high = N->link_count;
+		while (low < high) {
+			size_t middle = low + (high - low) / 2;
+			if (ipfs_node_link_name_compare(N->link_index[middle].link->name, Name) < 0)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		if (low < N->link_count && ipfs_node_link_name_compare(N->link_index[low].link->name, Name) == 0)
+			return N->link_index[low].link;
+		return NULL;
+	}
 	struct NodeLink* current = N->head_link;
-	while(current != NULL && strcmp(Name, current->name) != 0) {
+	while(current != NULL && ipfs_node_link_name_compare(Name, current->name) != 0) {
 		current = current->next;
 	}
 	return current;
@@ -589,25 +851,13 @@ int ipfs_hashtable_node_remove_link_by_name(char * Name, struct HashtableNode *
 {
 	struct NodeLink* current = mynode->head_link;
 	struct NodeLink* previous = NULL;
-	while( (current != NULL)
-			&& (( Name == NULL && current->name != NULL )
-			|| ( Name != NULL && current->name == NULL )
-			|| ( Name != NULL && current->name != NULL && strcmp(Name, current->name) != 0) ) ) {
+	while(current != NULL && ipfs_node_link_name_compare(Name, current->name) != 0) {
 		previous = current;
 		current = current->next;
 	}
 	if (current != NULL) {
 		// we found it
-		if (previous == NULL) {
-			// we're first, use the next one (if there is one)
-			if (current->next != NULL)
-				mynode->head_link = current->next;
-		} else {
-			// we're somewhere in the middle, remove me from the list
-			previous->next = current->next;
-			ipfs_node_link_free(current);
-		}
-
+		ipfs_hashtable_node_unlink(mynode, previous, current);
 		return 1;
 	}
 	return 0;
@@ -621,19 +871,23 @@ int ipfs_hashtable_node_remove_link_by_name(char * Name, struct HashtableNode *
  */
 int ipfs_hashtable_node_add_link(struct HashtableNode* node, struct NodeLink * mylink)
 {
-	if(node->head_link != NULL) {
-		// add to existing by finding last one
-		struct NodeLink* current_end = node->head_link;
-		while(current_end->next != NULL) {
-			current_end = current_end->next;
-		}
-		// now we have the last one, add to it
-		current_end->next = mylink;
+	if (mylink == NULL)
+		return 0;
+	if(node->tail_link != NULL) {
+		node->tail_link->next = mylink;
 	}
 	else
 	{
 		node->head_link = mylink;
 	}
+	// mylink may be the start of a list of links
+	node->tail_link = mylink;
+	node->link_count++;
+	while (node->tail_link->next != NULL) {
+		node->tail_link = node->tail_link->next;
+		node->link_count++;
+	}
+	ipfs_hashtable_node_drop_index(node);
 	return 1;
 }
 
@@ -645,16 +899,9 @@ int ipfs_hashtable_node_add_link(struct HashtableNode* node, struct NodeLink * m
  */
 int ipfs_hashtable_node_new_from_link(struct NodeLink * mylink, struct HashtableNode** node)
 {
-	*node = (struct HashtableNode *) malloc(sizeof(struct HashtableNode));
-	if (*node == NULL)
+	if (ipfs_hashtable_node_new(node) == 0)
 		return 0;
-	(*node)->head_link = NULL;
 	ipfs_hashtable_node_add_link(*node, mylink);
-	(*node)->hash = NULL;
-	(*node)->hash_size = 0;
-	(*node)->data = NULL;
-	(*node)->data_size = 0;
-	(*node)->encoded = NULL;
 	return 1;
 }
 
@@ -0,0 +1,445 @@
+/**
+ * Walks of the DAG, without recursion
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libp2p/utils/logger.h"
+#include "ipfs/merkledag/merkledag.h"
+#include "ipfs/merkledag/walker.h"
+
+#define WALK_ENTRY_WAITING 0
+#define WALK_ENTRY_FETCHING 1
+#define WALK_ENTRY_FETCHED 2
+
+/***
+ * A block on its way to be visited
+ */
+struct MerkledagWalkEntry {
+	unsigned char* hash;
+	size_t hash_size;
+	int depth;
+	int state; // WALK_ENTRY_*
+	struct HashtableNode* node; // NULL until fetched, or if it couldn't be
+};
+
+struct MerkledagWalker {
+	merkledag_fetch_func fetch;
+	void* context;
+	struct MerkledagWalkOptions options;
+	struct CidSet* own_seen; // freed with the walker
+	// the blocks to visit. Taken from the tail when depth first, from the head when breadth first
+	struct MerkledagWalkEntry** entries;
+	size_t head;
+	size_t tail;
+	size_t capacity;
+	struct MerkledagWalkEntry* current; // the block visited last
+	int skip_current;
+	// the prefetch threads
+	pthread_t* threads;
+	int thread_count;
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t work; // there may be blocks to fetch
+	pthread_cond_t fetched; // a prefetch thread fetched a block
+};
+
+/***
+ * Fill in a Cid that points at a hash, to look it up in a CidSet
+ */
+static struct Cid* ipfs_merkledag_walk_cid(struct Cid* cid, const unsigned char* hash, size_t hash_size) {
+	cid->version = 0;
+	cid->codec = CID_DAG_PROTOBUF;
+	cid->hash = (unsigned char*)hash;
+	cid->hash_length = hash_size;
+	return cid;
+}
+
+static void ipfs_merkledag_walk_entry_free(struct MerkledagWalkEntry* entry) {
+	if (entry == NULL)
+		return;
+	if (entry->node != NULL)
+		ipfs_hashtable_node_free(entry->node);
+	free(entry->hash);
+	free(entry);
+}
+
+/***
+ * Remember a block as seen, when the walk is unique. The lock is held.
+ * @returns 1 if it was not seen before, 0 if it was, -1 if out of memory
+ */
+static int ipfs_merkledag_walker_see(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size) {
+	struct Cid cid;
+	if (!walker->options.unique)
+		return 1;
+	ipfs_merkledag_walk_cid(&cid, hash, hash_size);
+	if (ipfs_cid_set_has(walker->options.seen, &cid))
+		return 0;
+	return ipfs_cid_set_add(walker->options.seen, &cid, 1) == 0 ? 1 : -1;
+}
+
+/***
+ * Add a block to visit. The lock is held.
+ * @returns true(1) on success, false(0) if out of memory
+ */
+static int ipfs_merkledag_walker_add(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size, int depth) {
+	if (walker->tail == walker->capacity) {
+		if (walker->head > walker->capacity / 2) {
+			// what was taken from the head makes room
+			memmove(walker->entries, &walker->entries[walker->head], (walker->tail - walker->head) * sizeof(struct MerkledagWalkEntry*));
+			walker->tail -= walker->head;
+			walker->head = 0;
+		} else {
+			size_t capacity = walker->capacity == 0 ? 64 : walker->capacity * 2;
+			struct MerkledagWalkEntry** entries = (struct MerkledagWalkEntry**) realloc(walker->entries, capacity * sizeof(struct MerkledagWalkEntry*));
+			if (entries == NULL)
+				return 0;
+			walker->entries = entries;
+			walker->capacity = capacity;
+		}
+	}
+	struct MerkledagWalkEntry* entry = (struct MerkledagWalkEntry*) calloc(1, sizeof(struct MerkledagWalkEntry));
+	if (entry == NULL)
+		return 0;
+	entry->hash = (unsigned char*) malloc(hash_size);
+	if (entry->hash == NULL) {
+		free(entry);
+		return 0;
+	}
+	memcpy(entry->hash, hash, hash_size);
+	entry->hash_size = hash_size;
+	entry->depth = depth;
+	walker->entries[walker->tail++] = entry;
+	return 1;
+}
+
+/***
+ * Add the blocks a node links to, leaving out the ones seen before when the
+ * walk is unique. Depth first, they are added last to first, so the first
+ * one is visited first. The lock is held.
+ * @returns true(1) on success, false(0) if out of memory
+ */
+static int ipfs_merkledag_walker_add_links(struct MerkledagWalker* walker, const struct HashtableNode* node, int depth) {
+	struct NodeLink* link;
+	size_t count = 0;
+	int seen;
+	if (walker->options.order == MERKLEDAG_WALK_BREADTH_FIRST) {
+		for(link = node->head_link; link != NULL; link = link->next) {
+			if ((seen = ipfs_merkledag_walker_see(walker, link->hash, link->hash_size)) < 0)
+				return 0;
+			if (seen && !ipfs_merkledag_walker_add(walker, link->hash, link->hash_size, depth))
+				return 0;
+		}
+		return 1;
+	}
+	for(link = node->head_link; link != NULL; link = link->next)
+		count++;
+	if (count == 0)
+		return 1;
+	struct NodeLink** links = (struct NodeLink**) malloc(count * sizeof(struct NodeLink*));
+	if (links == NULL)
+		return 0;
+	// the first of links to the same block is the one that is kept
+	count = 0;
+	for(link = node->head_link; link != NULL; link = link->next) {
+		if ((seen = ipfs_merkledag_walker_see(walker, link->hash, link->hash_size)) < 0) {
+			free(links);
+			return 0;
+		}
+		if (seen)
+			links[count++] = link;
+	}
+	int retVal = 1;
+	while (count > 0 && retVal) {
+		count--;
+		retVal = ipfs_merkledag_walker_add(walker, links[count]->hash, links[count]->hash_size, depth);
+	}
+	free(links);
+	return retVal;
+}
+
+/***
+ * Find a block, among the next ones to be visited, for a prefetch thread to fetch. The lock is held.
+ * Only the next options.prefetch blocks are looked at. Depth first, the blocks fetched ahead that
+ * have links pushed above them fall out of them, so fetching continues with the new links.
+ * @returns the block, or NULL if there is none, or the next blocks are fetched ahead already
+ */
+static struct MerkledagWalkEntry* ipfs_merkledag_walker_next_to_fetch(struct MerkledagWalker* walker) {
+	size_t window = walker->options.prefetch;
+	for(size_t i = 0; i < window && i < walker->tail - walker->head; i++) {
+		struct MerkledagWalkEntry* entry = walker->options.order == MERKLEDAG_WALK_BREADTH_FIRST
+				? walker->entries[walker->head + i] : walker->entries[walker->tail - 1 - i];
+		if (entry->state == WALK_ENTRY_WAITING)
+			return entry;
+	}
+	return NULL;
+}
+
+static void* ipfs_merkledag_walker_thread(void* arg) {
+	struct MerkledagWalker* walker = (struct MerkledagWalker*)arg;
+	pthread_mutex_lock(&walker->lock);
+	while (!walker->stop) {
+		struct MerkledagWalkEntry* entry = ipfs_merkledag_walker_next_to_fetch(walker);
+		if (entry == NULL) {
+			pthread_cond_wait(&walker->work, &walker->lock);
+			continue;
+		}
+		entry->state = WALK_ENTRY_FETCHING;
+		pthread_mutex_unlock(&walker->lock);
+		struct HashtableNode* node = NULL;
+		if (!walker->fetch(walker->context, entry->hash, entry->hash_size, &node))
+			node = NULL;
+		pthread_mutex_lock(&walker->lock);
+		entry->node = node;
+		entry->state = WALK_ENTRY_FETCHED;
+		pthread_cond_broadcast(&walker->fetched);
+	}
+	pthread_mutex_unlock(&walker->lock);
+	return NULL;
+}
+
+/***
+ * Start a walk. Blocks to walk from are added with ipfs_merkledag_walker_push.
+ * @param fetch how to get the blocks
+ * @param context passed to fetch
+ * @param options how to walk, NULL for depth first, each block once, fetched when visited
+ * @returns the walker, or NULL on error
+ */
+struct MerkledagWalker* ipfs_merkledag_walker_new(merkledag_fetch_func fetch, void* context, const struct MerkledagWalkOptions* options) {
+	if (fetch == NULL)
+		return NULL;
+	struct MerkledagWalker* walker = (struct MerkledagWalker*) calloc(1, sizeof(struct MerkledagWalker));
+	if (walker == NULL)
+		return NULL;
+	walker->fetch = fetch;
+	walker->context = context;
+	if (options != NULL) {
+		walker->options = *options;
+	} else {
+		walker->options.order = MERKLEDAG_WALK_DEPTH_FIRST;
+		walker->options.unique = 1;
+	}
+	if (walker->options.prefetch < 0)
+		walker->options.prefetch = 0;
+	if (walker->options.prefetch > MERKLEDAG_WALK_PREFETCH_MAX)
+		walker->options.prefetch = MERKLEDAG_WALK_PREFETCH_MAX;
+	if (walker->options.unique && walker->options.seen == NULL) {
+		walker->own_seen = ipfs_cid_set_new();
+		if (walker->own_seen == NULL) {
+			free(walker);
+			return NULL;
+		}
+		walker->options.seen = walker->own_seen;
+	}
+	pthread_mutex_init(&walker->lock, NULL);
+	pthread_cond_init(&walker->work, NULL);
+	pthread_cond_init(&walker->fetched, NULL);
+	if (walker->options.prefetch > 0) {
+		walker->threads = (pthread_t*) malloc(walker->options.prefetch * sizeof(pthread_t));
+		if (walker->threads == NULL) {
+			ipfs_merkledag_walker_free(walker);
+			return NULL;
+		}
+		for(int i = 0; i < walker->options.prefetch; i++) {
+			if (pthread_create(&walker->threads[i], NULL, ipfs_merkledag_walker_thread, walker) != 0) {
+				libp2p_logger_error("walker", "Unable to start a prefetch thread.\n");
+				break;
+			}
+			walker->thread_count++;
+		}
+	}
+	return walker;
+}
+
+/***
+ * Add a block to walk from, even if it was seen already
+ * @param walker the walker
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) on success, false(0) if out of memory
+ */
+int ipfs_merkledag_walker_push(struct MerkledagWalker* walker, const unsigned char* hash, size_t hash_size) {
+	if (walker == NULL || hash == NULL)
+		return 0;
+	pthread_mutex_lock(&walker->lock);
+	int retVal = ipfs_merkledag_walker_see(walker, hash, hash_size) >= 0
+			&& ipfs_merkledag_walker_add(walker, hash, hash_size, 0);
+	pthread_cond_broadcast(&walker->work);
+	pthread_mutex_unlock(&walker->lock);
+	return retVal;
+}
+
+/***
+ * Add the blocks a node links to, as if the node was visited. For walking
+ * below a node that is already at hand.
+ * @param walker the walker
+ * @param node the node
+ * @returns true(1) on success, false(0) if out of memory
+ */
+int ipfs_merkledag_walker_push_links(struct MerkledagWalker* walker, const struct HashtableNode* node) {
+	if (walker == NULL || node == NULL)
+		return 0;
+	pthread_mutex_lock(&walker->lock);
+	int retVal = (node->hash == NULL || ipfs_merkledag_walker_see(walker, node->hash, node->hash_size) >= 0)
+			&& ipfs_merkledag_walker_add_links(walker, node, 1);
+	pthread_cond_broadcast(&walker->work);
+	pthread_mutex_unlock(&walker->lock);
+	return retVal;
+}
+
+/***
+ * Visit the next block. Its links are followed on the next call, unless
+ * ipfs_merkledag_walker_skip is called first.
+ * @param walker the walker
+ * @param hash where to put the multihash of the block, good until the next call. Can be NULL.
+ * @param hash_size where to put the length of hash. Can be NULL.
+ * @param node where to put the block, which belongs to the walker and is good until the next call.
+ * NULL if it is missing and options->skip_missing. Can be NULL.
+ * @param depth where to put the number of links from where the walk started. Can be NULL.
+ * @returns 1 for a block, 0 when there are no more, -1 on error, or if a block couldn't be fetched
+ */
+int ipfs_merkledag_walker_next(struct MerkledagWalker* walker, const unsigned char** hash, size_t* hash_size,
+		struct HashtableNode** node, int* depth) {
+	if (walker == NULL)
+		return -1;
+	pthread_mutex_lock(&walker->lock);
+	// follow the links of the block visited last
+	struct MerkledagWalkEntry* previous = walker->current;
+	walker->current = NULL;
+	if (previous != NULL && previous->node != NULL && !walker->skip_current
+			&& !ipfs_merkledag_walker_add_links(walker, previous->node, previous->depth + 1)) {
+		pthread_mutex_unlock(&walker->lock);
+		ipfs_merkledag_walk_entry_free(previous);
+		libp2p_logger_error("walker", "Out of memory.\n");
+		return -1;
+	}
+	walker->skip_current = 0;
+	if (walker->head == walker->tail) {
+		pthread_mutex_unlock(&walker->lock);
+		ipfs_merkledag_walk_entry_free(previous);
+		return 0;
+	}
+	struct MerkledagWalkEntry* entry;
+	if (walker->options.order == MERKLEDAG_WALK_BREADTH_FIRST) {
+		entry = walker->entries[walker->head++];
+		if (walker->head == walker->tail)
+			walker->head = walker->tail = 0;
+	} else {
+		entry = walker->entries[--walker->tail];
+	}
+	if (entry->state == WALK_ENTRY_WAITING) {
+		// not fetched ahead, fetch it now
+		entry->state = WALK_ENTRY_FETCHING;
+		pthread_cond_broadcast(&walker->work);
+		pthread_mutex_unlock(&walker->lock);
+		if (!walker->fetch(walker->context, entry->hash, entry->hash_size, &entry->node))
+			entry->node = NULL;
+		pthread_mutex_lock(&walker->lock);
+		entry->state = WALK_ENTRY_FETCHED;
+	}
+	while (entry->state != WALK_ENTRY_FETCHED)
+		pthread_cond_wait(&walker->fetched, &walker->lock);
+	walker->current = entry;
+	pthread_cond_broadcast(&walker->work);
+	pthread_mutex_unlock(&walker->lock);
+	ipfs_merkledag_walk_entry_free(previous);
+
+	if (entry->node == NULL && !walker->options.skip_missing) {
+		libp2p_logger_debug("walker", "Unable to fetch a block.\n");
+		return -1;
+	}
+	if (hash != NULL)
+		*hash = entry->hash;
+	if (hash_size != NULL)
+		*hash_size = entry->hash_size;
+	if (node != NULL)
+		*node = entry->node;
+	if (depth != NULL)
+		*depth = entry->depth;
+	return 1;
+}
+
+/***
+ * Don't follow the links of the block visited last
+ * @param walker the walker
+ */
+void ipfs_merkledag_walker_skip(struct MerkledagWalker* walker) {
+	if (walker != NULL)
+		walker->skip_current = 1;
+}
+
+/***
+ * Stop the prefetch threads, and free the walker
+ * @param walker the walker, can be NULL
+ */
+void ipfs_merkledag_walker_free(struct MerkledagWalker* walker) {
+	if (walker == NULL)
+		return;
+	pthread_mutex_lock(&walker->lock);
+	walker->stop = 1;
+	pthread_cond_broadcast(&walker->work);
+	pthread_mutex_unlock(&walker->lock);
+	// a thread finishes the block it is fetching first
+	for(int i = 0; i < walker->thread_count; i++)
+		pthread_join(walker->threads[i], NULL);
+	free(walker->threads);
+	for(size_t i = walker->head; i < walker->tail; i++)
+		ipfs_merkledag_walk_entry_free(walker->entries[i]);
+	free(walker->entries);
+	ipfs_merkledag_walk_entry_free(walker->current);
+	ipfs_cid_set_destroy(&walker->own_seen);
+	pthread_mutex_destroy(&walker->lock);
+	pthread_cond_destroy(&walker->work);
+	pthread_cond_destroy(&walker->fetched);
+	free(walker);
+}
+
+/***
+ * Walk the DAG below a block, the block included
+ * @param fetch how to get the blocks
+ * @param context passed to fetch
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param options how to walk, NULL for depth first, each block once, fetched when visited
+ * @param func called with each block, and the number of links from the first one. The node is NULL if
+ * it is missing and options->skip_missing. Returns false(0) to stop, or MERKLEDAG_WALK_SKIP to not follow its links.
+ * @param arg passed to func
+ * @returns true(1) if the walk went through, false(0) if func stopped it, or on error
+ */
+int ipfs_merkledag_walk(merkledag_fetch_func fetch, void* context, const unsigned char* hash, size_t hash_size,
+		const struct MerkledagWalkOptions* options,
+		int (*func)(const unsigned char* hash, size_t hash_size, struct HashtableNode* node, int depth, void* arg), void* arg) {
+	if (func == NULL)
+		return 0;
+	struct MerkledagWalker* walker = ipfs_merkledag_walker_new(fetch, context, options);
+	if (walker == NULL)
+		return 0;
+	int retVal = ipfs_merkledag_walker_push(walker, hash, hash_size);
+	while (retVal) {
+		const unsigned char* current_hash = NULL;
+		size_t current_hash_size = 0;
+		struct HashtableNode* node = NULL;
+		int depth = 0;
+		int found = ipfs_merkledag_walker_next(walker, &current_hash, &current_hash_size, &node, &depth);
+		if (found <= 0) {
+			retVal = found == 0;
+			break;
+		}
+		int result = func(current_hash, current_hash_size, node, depth, arg);
+		if (result == MERKLEDAG_WALK_SKIP)
+			ipfs_merkledag_walker_skip(walker);
+		else if (!result)
+			retVal = 0;
+	}
+	ipfs_merkledag_walker_free(walker);
+	return retVal;
+}
+
+/***
+ * A merkledag_fetch_func that gets the blocks from the local repo
+ * @param fs_repo the FSRepo
+ */
+int ipfs_merkledag_walk_fetch_repo(void* fs_repo, const unsigned char* hash, size_t hash_size, struct HashtableNode** node) {
+	return ipfs_merkledag_get(hash, hash_size, node, (const struct FSRepo*)fs_repo);
+}
@@ -1,5 +1,9 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 #include "ipfs/multibase/multibase.h"
 #include "libp2p/crypto/encoding/base58.h"
@@ -111,3 +115,153 @@ int multibase_decode_size(const char base, const unsigned char* incoming, size_t
 	}
 	return 0;
 }
+
+/***
+ * The length of the upper case base32 of some bytes, without padding
+ * @param incoming_length the number of bytes
+ * @returns the number of characters
+ */
+size_t multibase_base32_encode_size(size_t incoming_length) {
+	return (incoming_length * 8 + 4) / 5;
+}
+
+/***
+ * Turn 5 bytes into 8 base32 characters within one 64 bit word. The 5 bit
+ * groups are spread into the 8 bytes of the word (with one pdep where there
+ * is BMI2, with masks and shifts otherwise), and each byte is made a
+ * character with the same arithmetic on all of them: 'A' + n below 26,
+ * '2' + n - 26 from there.
+ * @param in the 5 bytes
+ * @param out where to put the 8 characters
+ */
+static inline void multibase_base32_encode_group(const unsigned char* in, unsigned char* out) {
+	uint64_t bits = ((uint64_t)in[0] << 32) | ((uint64_t)in[1] << 24) | ((uint64_t)in[2] << 16)
+			| ((uint64_t)in[3] << 8) | in[4];
+	uint64_t digits;
+#ifdef __BMI2__
+	digits = _pdep_u64(bits, 0x1F1F1F1F1F1F1F1FULL);
+#else
+	// halves of 20 bits into 32 bit lanes, then 10 bits into 16, then 5 into 8
+	digits = ((bits & 0xFFFFF00000ULL) << 12) | (bits & 0xFFFFFULL);
+	digits = ((digits & 0x000FFC00000FFC00ULL) << 6) | (digits & 0x000003FF000003FFULL);
+	digits = ((digits & 0x03E003E003E003E0ULL) << 3) | (digits & 0x001F001F001F001FULL);
+#endif
+	// 0x80 in each byte of 26 or more, as no byte carries into the next
+	uint64_t high = (digits + 0x6666666666666666ULL) & 0x8080808080808080ULL;
+	digits += 0x4141414141414141ULL - (high >> 7) * ('A' - '2' + 26);
+	// the first character is in the high byte
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	digits = __builtin_bswap64(digits);
+#endif
+	memcpy(out, &digits, 8);
+}
+
+/***
+ * Encode bytes in upper case base32 without padding or a multibase prefix,
+ * as the datastore keys are. Nothing is allocated.
+ * @param incoming the bytes to encode
+ * @param incoming_length the number of bytes
+ * @param results where to put the characters. A NULL is added if there is room.
+ * @param results_max_length the size of the results buffer
+ * @param results_length the number of characters written
+ * @returns true(1) on success, false(0) if the buffer is too small
+ */
+int multibase_base32_encode_upper(const unsigned char* incoming, size_t incoming_length, unsigned char* results, size_t results_max_length, size_t* results_length) {
+	size_t length = multibase_base32_encode_size(incoming_length);
+	size_t pos = 0;
+	size_t written = 0;
+
+	if (length > results_max_length)
+		return 0;
+	// whole groups straight into the results, while all 8 characters fit
+	for(; pos + 5 <= incoming_length && written + 8 <= results_max_length; pos += 5, written += 8)
+		multibase_base32_encode_group(&incoming[pos], &results[written]);
+	// the rest, padded with zero bits
+	while (pos < incoming_length) {
+		unsigned char in[5] = { 0 };
+		unsigned char out[8];
+		size_t count = incoming_length - pos < 5 ? incoming_length - pos : 5;
+		memcpy(in, &incoming[pos], count);
+		multibase_base32_encode_group(in, out);
+		pos += count;
+		count = multibase_base32_encode_size(pos) - written;
+		memcpy(&results[written], out, count);
+		written += count;
+	}
+	if (written < results_max_length)
+		results[written] = 0;
+	*results_length = written;
+	return 1;
+}
+
+/***
+ * The value of each base58 (bitcoin) character, -1 if it is not one
+ */
+static const signed char multibase_base58_values[128] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1,
+	-1,  9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
+	22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
+	-1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
+	47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
+};
+
+// 32 bit words that hold a multihash (34 bytes), the first only partly
+#define MULTIBASE_CIDV0_WORDS 9
+
+/***
+ * Decode the base58 of a CIDv0, a sha2-256 multihash, without allocating.
+ * The number is built in 32 bit words, 5 characters at a time, as 58^5
+ * fits in 32 bits.
+ * @param incoming the MULTIBASE_BASE58_CIDV0_LENGTH characters
+ * @param incoming_length the number of characters
+ * @param results where to put the MULTIBASE_MULTIHASH_SIZE bytes of the multihash
+ * @returns true(1) on success, false(0) if it is not the base58 of a sha2-256 multihash
+ */
+int multibase_base58_decode_cidv0(const unsigned char* incoming, size_t incoming_length, unsigned char* results) {
+	uint32_t words[MULTIBASE_CIDV0_WORDS] = { 0 };
+	size_t pos = 0;
+
+	if (incoming_length != MULTIBASE_BASE58_CIDV0_LENGTH)
+		return 0;
+	// the first group takes what is left over, so the others are of 5
+	size_t count = incoming_length % 5;
+	if (count == 0)
+		count = 5;
+	while (pos < incoming_length) {
+		uint32_t value = 0;
+		uint32_t multiplier = 1;
+		for(size_t i = 0; i < count; i++) {
+			unsigned char c = incoming[pos + i];
+			if (c >= 128 || multibase_base58_values[c] < 0)
+				return 0;
+			value = value * 58 + multibase_base58_values[c];
+			multiplier *= 58;
+		}
+		pos += count;
+		count = 5;
+		uint64_t carry = value;
+		for(int i = MULTIBASE_CIDV0_WORDS - 1; i >= 0; i--) {
+			carry += (uint64_t)words[i] * multiplier;
+			words[i] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		if (carry != 0)
+			return 0;
+	}
+	// 34 bytes are the low 16 bits of the first word, and the rest
+	if (words[0] > 0xFFFF)
+		return 0;
+	results[0] = words[0] >> 8;
+	results[1] = words[0];
+	for(int i = 1; i < MULTIBASE_CIDV0_WORDS; i++) {
+		results[4 * i - 2] = words[i] >> 24;
+		results[4 * i - 1] = words[i] >> 16;
+		results[4 * i] = words[i] >> 8;
+		results[4 * i + 1] = words[i];
+	}
+	// a sha2-256 multihash
+	return results[0] == 0x12 && results[1] == 0x20;
+}
@@ -0,0 +1,111 @@
+/***
+ * blake2b-256, as RFC 7693 has it: blake2b with a digest of 32 bytes and no key
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "ipfs/multihash/multihash.h"
+
+static const uint64_t ipfs_multihash_blake2b_iv[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint8_t ipfs_multihash_blake2b_sigma[12][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+	{ 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+	{ 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+	{ 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+	{ 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+	{ 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+	{ 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+	{ 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+	{ 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+};
+
+static inline uint64_t ipfs_multihash_blake2b_rotr(uint64_t x, int n) {
+	return (x >> n) | (x << (64 - n));
+}
+
+static inline uint64_t ipfs_multihash_blake2b_load(const unsigned char* in) {
+	uint64_t x = 0;
+	for(int i = 7; i >= 0; i--)
+		x = (x << 8) | in[i];
+	return x;
+}
+
+#define IPFS_MULTIHASH_BLAKE2B_G(a, b, c, d, x, y) do { \
+	v[a] = v[a] + v[b] + (x); \
+	v[d] = ipfs_multihash_blake2b_rotr(v[d] ^ v[a], 32); \
+	v[c] = v[c] + v[d]; \
+	v[b] = ipfs_multihash_blake2b_rotr(v[b] ^ v[c], 24); \
+	v[a] = v[a] + v[b] + (y); \
+	v[d] = ipfs_multihash_blake2b_rotr(v[d] ^ v[a], 16); \
+	v[c] = v[c] + v[d]; \
+	v[b] = ipfs_multihash_blake2b_rotr(v[b] ^ v[c], 63); \
+} while (0)
+
+/***
+ * Mix a block of 128 bytes into the state
+ * @param h the 8 words of the state
+ * @param block the block
+ * @param bytes the number of bytes hashed, this block included
+ * @param last whether it is the last block
+ */
+static void ipfs_multihash_blake2b_compress(uint64_t* h, const unsigned char* block, uint64_t bytes, int last) {
+	uint64_t v[16];
+	uint64_t m[16];
+
+	for(int i = 0; i < 16; i++)
+		m[i] = ipfs_multihash_blake2b_load(&block[8 * i]);
+	for(int i = 0; i < 8; i++) {
+		v[i] = h[i];
+		v[i + 8] = ipfs_multihash_blake2b_iv[i];
+	}
+	v[12] ^= bytes;
+	if (last)
+		v[14] = ~v[14];
+	for(int r = 0; r < 12; r++) {
+		const uint8_t* s = ipfs_multihash_blake2b_sigma[r];
+		IPFS_MULTIHASH_BLAKE2B_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+		IPFS_MULTIHASH_BLAKE2B_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+		IPFS_MULTIHASH_BLAKE2B_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+		IPFS_MULTIHASH_BLAKE2B_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+		IPFS_MULTIHASH_BLAKE2B_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+		IPFS_MULTIHASH_BLAKE2B_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+		IPFS_MULTIHASH_BLAKE2B_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+		IPFS_MULTIHASH_BLAKE2B_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+	}
+	for(int i = 0; i < 8; i++)
+		h[i] ^= v[i] ^ v[i + 8];
+}
+
+/***
+ * The blake2b-256 of some data (RFC 7693, a 32 byte digest)
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1)
+ */
+int ipfs_multihash_blake2b_256(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	uint64_t h[8];
+	unsigned char last[128];
+	size_t pos = 0;
+
+	memcpy(h, ipfs_multihash_blake2b_iv, sizeof(h));
+	// the parameters: the digest size, no key, a fanout and a depth of 1
+	h[0] ^= 0x01010000 ^ IPFS_MULTIHASH_DIGEST_SIZE;
+	// all but the last block, which is never empty unless the data is
+	for(; data_size - pos > 128; pos += 128)
+		ipfs_multihash_blake2b_compress(h, &data[pos], pos + 128, 0);
+	memset(last, 0, sizeof(last));
+	if (data_size > pos)
+		memcpy(last, &data[pos], data_size - pos);
+	ipfs_multihash_blake2b_compress(h, last, data_size, 1);
+	for(int i = 0; i < IPFS_MULTIHASH_DIGEST_SIZE; i++)
+		digest[i] = h[i / 8] >> (8 * (i % 8));
+	return 1;
+}
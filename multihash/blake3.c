@@ -0,0 +1,181 @@
+/***
+ * blake3, its default 32 byte output, of data that is all at hand
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "ipfs/multihash/multihash.h"
+
+#define IPFS_MULTIHASH_BLAKE3_BLOCK 64
+#define IPFS_MULTIHASH_BLAKE3_CHUNK 1024
+// enough chaining values for the chunks of any size_t of data
+#define IPFS_MULTIHASH_BLAKE3_STACK 64
+
+#define IPFS_MULTIHASH_BLAKE3_CHUNK_START 1
+#define IPFS_MULTIHASH_BLAKE3_CHUNK_END 2
+#define IPFS_MULTIHASH_BLAKE3_PARENT 4
+#define IPFS_MULTIHASH_BLAKE3_ROOT 8
+
+static const uint32_t ipfs_multihash_blake3_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// the order of the message words in each of the 7 rounds
+static const uint8_t ipfs_multihash_blake3_schedule[7][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+/***
+ * What the last compression of a chunk or a parent is made from. It is
+ * compressed once it is known whether it is the root.
+ */
+struct Blake3Output {
+	uint32_t cv[8];
+	uint32_t block[16];
+	uint64_t counter;
+	uint32_t block_size;
+	uint32_t flags;
+};
+
+static inline uint32_t ipfs_multihash_blake3_rotr(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+#define IPFS_MULTIHASH_BLAKE3_G(a, b, c, d, x, y) do { \
+	v[a] = v[a] + v[b] + (x); \
+	v[d] = ipfs_multihash_blake3_rotr(v[d] ^ v[a], 16); \
+	v[c] = v[c] + v[d]; \
+	v[b] = ipfs_multihash_blake3_rotr(v[b] ^ v[c], 12); \
+	v[a] = v[a] + v[b] + (y); \
+	v[d] = ipfs_multihash_blake3_rotr(v[d] ^ v[a], 8); \
+	v[c] = v[c] + v[d]; \
+	v[b] = ipfs_multihash_blake3_rotr(v[b] ^ v[c], 7); \
+} while (0)
+
+/***
+ * Compress a block into a new chaining value
+ * @param cv the 8 words of the chaining value, replaced by the new one
+ * @param block the 16 words of the block
+ * @param counter the chunk the block is in, 0 for a parent
+ * @param block_size the bytes of the block that are data
+ * @param flags what the block is
+ */
+static void ipfs_multihash_blake3_compress(uint32_t* cv, const uint32_t* block, uint64_t counter, uint32_t block_size, uint32_t flags) {
+	uint32_t v[16];
+
+	memcpy(v, cv, 8 * sizeof(uint32_t));
+	memcpy(&v[8], ipfs_multihash_blake3_iv, 4 * sizeof(uint32_t));
+	v[12] = (uint32_t)counter;
+	v[13] = (uint32_t)(counter >> 32);
+	v[14] = block_size;
+	v[15] = flags;
+	for(int r = 0; r < 7; r++) {
+		const uint8_t* s = ipfs_multihash_blake3_schedule[r];
+		IPFS_MULTIHASH_BLAKE3_G(0, 4, 8, 12, block[s[0]], block[s[1]]);
+		IPFS_MULTIHASH_BLAKE3_G(1, 5, 9, 13, block[s[2]], block[s[3]]);
+		IPFS_MULTIHASH_BLAKE3_G(2, 6, 10, 14, block[s[4]], block[s[5]]);
+		IPFS_MULTIHASH_BLAKE3_G(3, 7, 11, 15, block[s[6]], block[s[7]]);
+		IPFS_MULTIHASH_BLAKE3_G(0, 5, 10, 15, block[s[8]], block[s[9]]);
+		IPFS_MULTIHASH_BLAKE3_G(1, 6, 11, 12, block[s[10]], block[s[11]]);
+		IPFS_MULTIHASH_BLAKE3_G(2, 7, 8, 13, block[s[12]], block[s[13]]);
+		IPFS_MULTIHASH_BLAKE3_G(3, 4, 9, 14, block[s[14]], block[s[15]]);
+	}
+	for(int i = 0; i < 8; i++)
+		cv[i] = v[i] ^ v[i + 8];
+}
+
+/***
+ * Read up to a block of bytes as little endian words, the rest zero
+ */
+static void ipfs_multihash_blake3_words(const unsigned char* data, size_t size, uint32_t* block) {
+	memset(block, 0, 16 * sizeof(uint32_t));
+	for(size_t i = 0; i < size; i++)
+		block[i / 4] |= (uint32_t)data[i] << (8 * (i % 4));
+}
+
+/***
+ * Compress all but the last block of a chunk, and keep the last for later
+ * @param data the chunk
+ * @param size its size, no more than a chunk
+ * @param counter which chunk it is
+ * @param output where to put what the last block is compressed from
+ */
+static void ipfs_multihash_blake3_chunk(const unsigned char* data, size_t size, uint64_t counter, struct Blake3Output* output) {
+	uint32_t flags = IPFS_MULTIHASH_BLAKE3_CHUNK_START;
+
+	memcpy(output->cv, ipfs_multihash_blake3_iv, sizeof(output->cv));
+	for(; size > IPFS_MULTIHASH_BLAKE3_BLOCK; data += IPFS_MULTIHASH_BLAKE3_BLOCK, size -= IPFS_MULTIHASH_BLAKE3_BLOCK) {
+		ipfs_multihash_blake3_words(data, IPFS_MULTIHASH_BLAKE3_BLOCK, output->block);
+		ipfs_multihash_blake3_compress(output->cv, output->block, counter, IPFS_MULTIHASH_BLAKE3_BLOCK, flags);
+		flags = 0;
+	}
+	ipfs_multihash_blake3_words(data, size, output->block);
+	output->counter = counter;
+	output->block_size = size;
+	output->flags = flags | IPFS_MULTIHASH_BLAKE3_CHUNK_END;
+}
+
+/***
+ * What a parent of two chaining values is compressed from
+ */
+static void ipfs_multihash_blake3_parent(const uint32_t* left, const uint32_t* right, struct Blake3Output* output) {
+	memcpy(output->cv, ipfs_multihash_blake3_iv, sizeof(output->cv));
+	memcpy(output->block, left, 8 * sizeof(uint32_t));
+	memcpy(&output->block[8], right, 8 * sizeof(uint32_t));
+	output->counter = 0;
+	output->block_size = IPFS_MULTIHASH_BLAKE3_BLOCK;
+	output->flags = IPFS_MULTIHASH_BLAKE3_PARENT;
+}
+
+/***
+ * The chaining value of what is not the root
+ */
+static void ipfs_multihash_blake3_cv(struct Blake3Output* output, uint32_t* cv) {
+	memcpy(cv, output->cv, 8 * sizeof(uint32_t));
+	ipfs_multihash_blake3_compress(cv, output->block, output->counter, output->block_size, output->flags);
+}
+
+/***
+ * The blake3 of some data, its default 32 byte output
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1)
+ */
+int ipfs_multihash_blake3(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	// the chaining values of the subtrees that are whole, the biggest first
+	uint32_t stack[IPFS_MULTIHASH_BLAKE3_STACK][8];
+	int stack_size = 0;
+	struct Blake3Output output;
+	uint32_t cv[8];
+	uint64_t chunk = 0;
+
+	// the chunks before the last, each merged with the subtrees it completes
+	for(; data_size > IPFS_MULTIHASH_BLAKE3_CHUNK; data += IPFS_MULTIHASH_BLAKE3_CHUNK, data_size -= IPFS_MULTIHASH_BLAKE3_CHUNK) {
+		ipfs_multihash_blake3_chunk(data, IPFS_MULTIHASH_BLAKE3_CHUNK, chunk, &output);
+		ipfs_multihash_blake3_cv(&output, cv);
+		chunk++;
+		for(uint64_t total = chunk; (total & 1) == 0; total >>= 1) {
+			ipfs_multihash_blake3_parent(stack[--stack_size], cv, &output);
+			ipfs_multihash_blake3_cv(&output, cv);
+		}
+		memcpy(stack[stack_size++], cv, sizeof(cv));
+	}
+	// the last chunk, then the parents up to the root
+	ipfs_multihash_blake3_chunk(data, data_size, chunk, &output);
+	while (stack_size > 0) {
+		ipfs_multihash_blake3_cv(&output, cv);
+		ipfs_multihash_blake3_parent(stack[--stack_size], cv, &output);
+	}
+	memcpy(cv, output.cv, sizeof(cv));
+	ipfs_multihash_blake3_compress(cv, output.block, 0, output.block_size, output.flags | IPFS_MULTIHASH_BLAKE3_ROOT);
+	for(int i = 0; i < IPFS_MULTIHASH_DIGEST_SIZE; i++)
+		digest[i] = cv[i / 4] >> (8 * (i % 4));
+	return 1;
+}
@@ -0,0 +1,163 @@
+/***
+ * The hash functions blocks can be named by, and the multihashes of them
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "varint.h"
+#include "ipfs/multihash/multihash.h"
+
+static const struct MultihashFunction ipfs_multihash_functions[] = {
+	{ IPFS_MULTIHASH_SHA2_256, "sha2-256", ipfs_multihash_sha256 },
+	{ IPFS_MULTIHASH_BLAKE2B_256, "blake2b-256", ipfs_multihash_blake2b_256 },
+	{ IPFS_MULTIHASH_BLAKE3, "blake3", ipfs_multihash_blake3 },
+};
+
+#define IPFS_MULTIHASH_FUNCTIONS (sizeof(ipfs_multihash_functions) / sizeof(struct MultihashFunction))
+
+/***
+ * Find a hash function by its code
+ * @param code the multihash code
+ * @returns the function, or NULL if it is not one of these
+ */
+const struct MultihashFunction* ipfs_multihash_function_get(int code) {
+	for(size_t i = 0; i < IPFS_MULTIHASH_FUNCTIONS; i++)
+		if (ipfs_multihash_functions[i].code == code)
+			return &ipfs_multihash_functions[i];
+	return NULL;
+}
+
+/***
+ * Find a hash function by its name
+ * @param name the name, i.e. "blake2b-256"
+ * @returns the function, or NULL if it is not one of these
+ */
+const struct MultihashFunction* ipfs_multihash_function_by_name(const char* name) {
+	for(size_t i = 0; i < IPFS_MULTIHASH_FUNCTIONS; i++)
+		if (strcmp(ipfs_multihash_functions[i].name, name) == 0)
+			return &ipfs_multihash_functions[i];
+	return NULL;
+}
+
+/***
+ * Read the code and the length at the start of a multihash
+ * @param multihash the multihash
+ * @param multihash_size its size
+ * @param code where to put the code
+ * @param header_size where to put the number of bytes of the code and the length
+ * @returns true(1) if the length is that of what follows, false(0) otherwise
+ */
+static int ipfs_multihash_header(const unsigned char* multihash, size_t multihash_size, int* code, size_t* header_size) {
+	size_t code_bytes = 0;
+	size_t length_bytes = 0;
+	uint64_t value = varint_decode(multihash, multihash_size, &code_bytes);
+	if (code_bytes == 0 || code_bytes >= multihash_size)
+		return 0;
+	uint64_t length = varint_decode(&multihash[code_bytes], multihash_size - code_bytes, &length_bytes);
+	if (length_bytes == 0 || length != multihash_size - code_bytes - length_bytes)
+		return 0;
+	*code = (int)value;
+	*header_size = code_bytes + length_bytes;
+	return 1;
+}
+
+/***
+ * Whether a hash a node or a Cid keeps is a whole multihash, of one of the functions
+ * here other than sha2-256. A hash of 32 bytes is always a sha2-256 digest.
+ */
+static int ipfs_multihash_is_whole(const unsigned char* hash, size_t hash_size, int* code) {
+	size_t header_size = 0;
+	if (hash_size == IPFS_MULTIHASH_DIGEST_SIZE || !ipfs_multihash_header(hash, hash_size, code, &header_size))
+		return 0;
+	return *code != IPFS_MULTIHASH_SHA2_256 && ipfs_multihash_function_get(*code) != NULL
+			&& hash_size - header_size == IPFS_MULTIHASH_DIGEST_SIZE;
+}
+
+/***
+ * Hash data into the form a node or a Cid keeps: the digest for sha2-256, the whole multihash otherwise
+ * @param code the multihash code of the function
+ * @param data the data to hash
+ * @param data_size the number of bytes
+ * @param hash where to put the hash, of at least IPFS_MULTIHASH_MAX_SIZE bytes
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) if the function is not one of these
+ */
+int ipfs_multihash_hash(int code, const unsigned char* data, size_t data_size, unsigned char* hash, size_t* hash_size) {
+	const struct MultihashFunction* function = ipfs_multihash_function_get(code);
+	size_t header_size = 0;
+	if (function == NULL)
+		return 0;
+	if (code != IPFS_MULTIHASH_SHA2_256) {
+		if (varint_encode(code, hash, IPFS_MULTIHASH_MAX_SIZE, &header_size) == NULL)
+			return 0;
+		hash[header_size++] = IPFS_MULTIHASH_DIGEST_SIZE;
+	}
+	if (!function->digest(data, data_size, &hash[header_size]))
+		return 0;
+	*hash_size = header_size + IPFS_MULTIHASH_DIGEST_SIZE;
+	return 1;
+}
+
+/***
+ * Find the function a hash that a node or a Cid keeps was made with
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @returns the multihash code
+ */
+int ipfs_multihash_hash_code(const unsigned char* hash, size_t hash_size) {
+	int code = 0;
+	if (ipfs_multihash_is_whole(hash, hash_size, &code))
+		return code;
+	return IPFS_MULTIHASH_SHA2_256;
+}
+
+/***
+ * Turn the hash a node or a Cid keeps into a multihash
+ * @param hash the hash
+ * @param hash_size the size of the hash
+ * @param multihash where to put the multihash
+ * @param max_multihash_size the size of the multihash buffer
+ * @param multihash_size the size of the multihash
+ * @returns true(1) on success, false(0) if the buffer is too small
+ */
+int ipfs_multihash_wrap(const unsigned char* hash, size_t hash_size, unsigned char* multihash, size_t max_multihash_size, size_t* multihash_size) {
+	int code = 0;
+	if (ipfs_multihash_is_whole(hash, hash_size, &code)) {
+		if (hash_size > max_multihash_size)
+			return 0;
+		memcpy(multihash, hash, hash_size);
+		*multihash_size = hash_size;
+		return 1;
+	}
+	// a sha2-256 digest, or what was kept as if it was one
+	if (hash_size > 127 || hash_size + 2 > max_multihash_size)
+		return 0;
+	multihash[0] = IPFS_MULTIHASH_SHA2_256;
+	multihash[1] = hash_size;
+	memcpy(&multihash[2], hash, hash_size);
+	*multihash_size = hash_size + 2;
+	return 1;
+}
+
+/***
+ * Find the hash a node or a Cid keeps within a multihash. Nothing is copied.
+ * @param multihash the multihash
+ * @param multihash_size the size of the multihash
+ * @param hash where to put where the hash starts within the multihash
+ * @param hash_size the size of the hash
+ * @returns true(1) on success, false(0) if it is not a multihash
+ */
+int ipfs_multihash_unwrap(const unsigned char* multihash, size_t multihash_size, const unsigned char** hash, size_t* hash_size) {
+	int code = 0;
+	if (ipfs_multihash_is_whole(multihash, multihash_size, &code)) {
+		*hash = multihash;
+		*hash_size = multihash_size;
+		return 1;
+	}
+	// the digest, after a code and a length of a byte each, as it always was
+	if (multihash_size < 2)
+		return 0;
+	*hash = &multihash[2];
+	*hash_size = multihash_size - 2;
+	return 1;
+}
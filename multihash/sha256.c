@@ -0,0 +1,173 @@
+/***
+ * sha2-256, with the SHA extensions of x86 CPUs where they are, and the
+ * libp2p implementation elsewhere
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "libp2p/crypto/sha256.h"
+#include "ipfs/multihash/multihash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IPFS_MULTIHASH_SHA_NI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef IPFS_MULTIHASH_SHA_NI
+
+static const uint32_t ipfs_multihash_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/***
+ * Run 64 byte blocks through the state with the SHA instructions. The
+ * message schedule is kept in 4 registers of 4 words, each replaced by the
+ * next 4 words as soon as the rounds are done with it.
+ * @param state the 8 words of the state
+ * @param data the blocks
+ * @param blocks the number of blocks
+ */
+__attribute__((target("sha,sse4.1")))
+static void ipfs_multihash_sha256_ni_blocks(uint32_t* state, const unsigned char* data, size_t blocks) {
+	const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i message[4];
+
+	// the state as the instructions want it, ABEF and CDGH
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	for(; blocks > 0; blocks--, data += 64) {
+		__m128i abef = state0;
+		__m128i cdgh = state1;
+		for(int i = 0; i < 16; i++) {
+			// rounds 4 * i to 4 * i + 3
+			if (i < 4)
+				message[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[16 * i]), byte_swap);
+			__m128i words = _mm_add_epi32(message[i % 4], _mm_loadu_si128((const __m128i*)&ipfs_multihash_sha256_k[4 * i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+			if (i >= 3 && i < 15) {
+				tmp = _mm_alignr_epi8(message[i % 4], message[(i + 3) % 4], 4);
+				message[(i + 1) % 4] = _mm_add_epi32(message[(i + 1) % 4], tmp);
+				message[(i + 1) % 4] = _mm_sha256msg2_epu32(message[(i + 1) % 4], message[i % 4]);
+			}
+			words = _mm_shuffle_epi32(words, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+			if (i >= 1 && i < 13)
+				message[(i + 3) % 4] = _mm_sha256msg1_epu32(message[(i + 3) % 4], message[i % 4]);
+		}
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	// back to ABCD and EFGH
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i*)&state[0], state0);
+	_mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+/***
+ * sha2-256 with the SHA instructions
+ */
+static int ipfs_multihash_sha256_ni(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	uint32_t state[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	unsigned char last[128];
+	size_t whole = data_size / 64;
+	size_t rest = data_size % 64;
+	uint64_t bits = (uint64_t)data_size * 8;
+
+	ipfs_multihash_sha256_ni_blocks(state, data, whole);
+	// the rest, a 1 bit, zeros, and the length in bits, in one block or two
+	size_t last_size = rest < 56 ? 64 : 128;
+	memset(last, 0, last_size);
+	if (rest > 0)
+		memcpy(last, &data[whole * 64], rest);
+	last[rest] = 0x80;
+	for(int i = 0; i < 8; i++)
+		last[last_size - 1 - i] = bits >> (8 * i);
+	ipfs_multihash_sha256_ni_blocks(state, last, last_size / 64);
+	for(int i = 0; i < 8; i++) {
+		digest[4 * i] = state[i] >> 24;
+		digest[4 * i + 1] = state[i] >> 16;
+		digest[4 * i + 2] = state[i] >> 8;
+		digest[4 * i + 3] = state[i];
+	}
+	return 1;
+}
+
+/***
+ * Whether the CPU has the SHA extensions, and the SSSE3 and SSE4.1 they are used with
+ */
+static int ipfs_multihash_cpu_has_sha() {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 29)) != 0;
+}
+
+#endif
+
+typedef int (*ipfs_multihash_digest_func)(const unsigned char* data, size_t data_size, unsigned char* digest);
+
+/***
+ * sha2-256 without the SHA instructions
+ */
+static int ipfs_multihash_sha256_generic(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	return libp2p_crypto_hashing_sha256((unsigned char*)data, data_size, digest);
+}
+
+// chosen for the CPU by the first call
+static ipfs_multihash_digest_func ipfs_multihash_sha256_func = NULL;
+
+static ipfs_multihash_digest_func ipfs_multihash_sha256_choose() {
+	ipfs_multihash_digest_func func = __atomic_load_n(&ipfs_multihash_sha256_func, __ATOMIC_ACQUIRE);
+	if (func == NULL) {
+		func = ipfs_multihash_sha256_generic;
+#ifdef IPFS_MULTIHASH_SHA_NI
+		if (ipfs_multihash_cpu_has_sha())
+			func = ipfs_multihash_sha256_ni;
+#endif
+		__atomic_store_n(&ipfs_multihash_sha256_func, func, __ATOMIC_RELEASE);
+	}
+	return func;
+}
+
+/***
+ * The sha2-256 of some data, with the SHA extensions of the CPU if it has them
+ * @param data the data
+ * @param data_size the number of bytes
+ * @param digest where to put the 32 bytes of the digest
+ * @returns true(1) on success
+ */
+int ipfs_multihash_sha256(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	return ipfs_multihash_sha256_choose()(data, data_size, digest) != 0;
+}
+
+/***
+ * What ipfs_multihash_sha256 computes with on this CPU
+ * @returns "sha-ni" or "generic"
+ */
+const char* ipfs_multihash_sha256_implementation() {
+#ifdef IPFS_MULTIHASH_SHA_NI
+	if (ipfs_multihash_sha256_choose() == ipfs_multihash_sha256_ni)
+		return "sha-ni";
+#endif
+	return "generic";
+}
@@ -2,10 +2,12 @@
 #include <string.h>
 #include <pthread.h>
 #include "libp2p/routing/dht_protocol.h"
+#include "libp2p/utils/logger.h"
 #include "ipfs/util/errs.h"
 #include "ipfs/util/time.h"
 #include "ipfs/namesys/pb.h"
 #include "ipfs/namesys/publisher.h"
+#include "ipfs/namesys/routing.h"
 
 /**
  * Convert an ipns_entry into a char array
@@ -170,6 +172,29 @@ int ipfs_namesys_copy_bytes(uint8_t* from, size_t from_size, uint8_t** to, size_
 	return 1;
 }
 
+/***
+ * Replace what the resolver has cached for our own name
+ * @param local_node the context
+ * @param path what the name now resolves to
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_namesys_publisher_cache(struct IpfsNode* local_node, const char* path) {
+	if (local_node->ipns_cache == NULL || local_node->ipns_cache->cachesize == 0)
+		return 1;
+	size_t id_size = local_node->identity->peer->id_size;
+	char* name = (char*) malloc(id_size + 7);
+	if (name == NULL)
+		return 0;
+	strcpy(name, "/ipns/");
+	memcpy(&name[6], local_node->identity->peer->id, id_size);
+	name[id_size + 6] = '\0';
+	struct timespec eol;
+	ipfs_routing_cache_eol(NULL, &eol);
+	int retVal = ipfs_routing_cache_insert(local_node->ipns_cache, name, path, &eol);
+	free(name);
+	return retVal;
+}
+
 /**
  * Store the hash locally, and notify the network
  *
@@ -213,6 +238,10 @@ int ipfs_namesys_publisher_publish(struct IpfsNode* local_node, char* path) {
 	}
 	libp2p_datastore_record_free(record);
 
+	// what we resolve our own name to has changed
+	if (!ipfs_namesys_publisher_cache(local_node, path))
+		libp2p_logger_error("publisher", "Unable to replace the cached value of our own name.\n");
+
 	// for now, even if what is below fails because of not being connected, return TRUE
 	retVal = 1;
 
@@ -3,6 +3,7 @@
 
 #include "libp2p/utils/logger.h"
 #include "ipfs/namesys/resolver.h"
+#include "ipfs/namesys/routing.h"
 
 /**
  * The opposite of publisher.c
@@ -31,6 +32,11 @@ int is_ipns_string(char* path) {
  * @returns true(1) on success, false(0) otherwise
  */
 int ipfs_namesys_resolver_resolve_once(struct IpfsNode* local_node, const char* path, char** results) {
+	// have we seen it recently?
+	*results = ipfs_routing_cache_lookup(local_node->ipns_cache, path);
+	if (*results != NULL)
+		return 1;
+
 	struct Cid* cid = NULL;
 	if (!ipfs_cid_decode_hash_from_ipfs_ipns_string(path, &cid)) {
 		return 0;
@@ -47,7 +53,12 @@ int ipfs_namesys_resolver_resolve_once(struct IpfsNode* local_node, const char*
 		}
 		memset(*results, 0, record->value_size + 1);
 		memcpy(*results, record->value, record->value_size);
+		libp2p_datastore_record_free(record);
 		ipfs_cid_free(cid);
+		// local records are not IPNS entries, so they get the default TTL
+		struct timespec eol;
+		ipfs_routing_cache_eol(NULL, &eol);
+		ipfs_routing_cache_insert(local_node->ipns_cache, path, *results, &eol);
 		return 1;
 	}
 
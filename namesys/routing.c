@@ -12,75 +12,18 @@
 #include "ipfs/path/path.h"
 #include "libp2p/crypto/encoding/base58.h"
 
-char* ipfs_routing_cache_get (char *key, struct ipns_entry *ientry)
-{
-    int i;
-    struct routingResolver *cache;
-    struct timespec now;
-
-    if (key && ientry) {
-        cache = ientry->cache;
-        if (cache) {
-            timespec_get (&now, TIME_UTC);
-            for (i = 0 ; i < cache->next ; i++) {
-                if (((now.tv_sec < cache->data[i]->eol.tv_sec ||
-                     (now.tv_sec == cache->data[i]->eol.tv_sec && now.tv_nsec < cache->data[i]->eol.tv_nsec))) &&
-                    strcmp(cache->data[i]->key, key) == 0) {
-                    return cache->data[i]->value;
-                }
-            }
-        }
-    }
-    return NULL;
-}
-
-void ipfs_routing_cache_set (char *key, char *value, struct ipns_entry *ientry)
-{
-    struct cacheEntry *n;
-    struct routingResolver *cache;
-
-    if (key && value && ientry) {
-        cache = ientry->cache;
-        if (cache && cache->next < cache->cachesize) {
-            n = malloc(sizeof (struct cacheEntry));
-            if (n) {
-                n->key = key;
-                n->value = value;
-                timespec_get (&n->eol, TIME_UTC); // now
-                n->eol.tv_sec += DefaultResolverCacheTTL; // sum TTL seconds to time seconds.
-                cache->data[cache->next++] = n;
-            }
-        }
-    }
-}
-
 // NewRoutingResolver constructs a name resolver using the IPFS Routing system
 // to implement SFS-like naming on top.
 // cachesize is the limit of the number of entries in the lru cache. Setting it
 // to '0' will disable caching.
 struct routingResolver* ipfs_namesys_new_routing_resolver (struct libp2p_routing_value_store *route, int cachesize)
 {
-    struct routingResolver *ret;
-
     if (!route) {
         fprintf(stderr, "attempt to create resolver with NULL routing system\n");
         exit (1);
     }
 
-    ret = calloc (1, sizeof (struct routingResolver));
-
-    if (!ret) {
-        return NULL;
-    }
-
-    ret->data = calloc(cachesize, sizeof(void*));
-    if (!ret) {
-        free (ret);
-        return NULL;
-    }
-
-    ret->cachesize = cachesize;
-    return ret;
+    return ipfs_routing_cache_new (cachesize);
 }
 
 // ipfs_namesys_routing_resolve implements Resolver.
@@ -158,15 +101,16 @@ int ipfs_namesys_routing_resolve_once (char **path, char *name, int depth, char
     int err, l, s, ok;
     unsigned char* multihash = NULL;
     size_t multihash_size = 0;
-    char *h, *string, val[8];
+    char *h, *string, *cached, val[8];
     char pubkey[60];
 
     if (!path || !name || !prefix) {
         return ErrInvalidParam;
     }
     // log.Debugf("RoutingResolve: '%s'", name)
-    *path = ipfs_routing_cache_get (name, pb->IpnsEntry);
-    if (*path) {
+    cached = ipfs_routing_cache_get (name, pb->IpnsEntry);
+    if (cached) {
+        *path = cached; // the caller frees it
         return 0; // cached
     }
 
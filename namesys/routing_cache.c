@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ipfs/namesys/routing.h"
+#include "ipfs/namesys/pb.h"
+#include "ipfs/util/time.h"
+
+/**
+ * The resolver cache. Entries are found by a hash of the key, and kept in
+ * a list ordered by use. When the cache is full, the least recently used
+ * entry is evicted. Expired entries are removed when they are found.
+ */
+
+static uint32_t ipfs_routing_cache_hash (const char *key)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int ipfs_routing_cache_expired (const struct cacheEntry *n, const struct timespec *now)
+{
+    return now->tv_sec > n->eol.tv_sec || (now->tv_sec == n->eol.tv_sec && now->tv_nsec >= n->eol.tv_nsec);
+}
+
+// remove an entry from the use list
+static void ipfs_routing_cache_unlink (struct routingResolver *cache, struct cacheEntry *n)
+{
+    if (n->prev) {
+        n->prev->next = n->next;
+    } else {
+        cache->head = n->next;
+    }
+    if (n->next) {
+        n->next->prev = n->prev;
+    } else {
+        cache->tail = n->prev;
+    }
+    n->prev = NULL;
+    n->next = NULL;
+}
+
+// place an entry at the front of the use list
+static void ipfs_routing_cache_push_front (struct routingResolver *cache, struct cacheEntry *n)
+{
+    n->prev = NULL;
+    n->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = n;
+    }
+    cache->head = n;
+    if (!cache->tail) {
+        cache->tail = n;
+    }
+}
+
+// find an entry, returning the link that points to it so it can be removed
+static struct cacheEntry** ipfs_routing_cache_find (struct routingResolver *cache, const char *key, uint32_t hash)
+{
+    struct cacheEntry **link = &cache->buckets[hash & (cache->num_buckets - 1)];
+    while (*link) {
+        if ((*link)->hash == hash && strcmp((*link)->key, key) == 0) {
+            return link;
+        }
+        link = &(*link)->bucket_next;
+    }
+    return NULL;
+}
+
+static void ipfs_routing_cache_entry_free (struct cacheEntry *n)
+{
+    free(n->key);
+    free(n->value);
+    free(n);
+}
+
+// remove an entry completely. link is where it is in its bucket.
+static void ipfs_routing_cache_remove (struct routingResolver *cache, struct cacheEntry **link)
+{
+    struct cacheEntry *n = *link;
+    *link = n->bucket_next;
+    ipfs_routing_cache_unlink(cache, n);
+    ipfs_routing_cache_entry_free(n);
+    cache->count--;
+}
+
+struct routingResolver* ipfs_routing_cache_new (int cachesize)
+{
+    struct routingResolver *cache;
+
+    cache = calloc (1, sizeof (struct routingResolver));
+    if (!cache) {
+        return NULL;
+    }
+    cache->cachesize = cachesize > 0 ? cachesize : 0;
+    // a power of 2, at least as many buckets as entries
+    cache->num_buckets = 1;
+    while (cache->num_buckets < cache->cachesize) {
+        cache->num_buckets <<= 1;
+    }
+    cache->buckets = calloc(cache->num_buckets, sizeof(struct cacheEntry*));
+    if (!cache->buckets) {
+        free (cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+int ipfs_routing_cache_free (struct routingResolver *cache)
+{
+    struct cacheEntry *n, *next;
+
+    if (cache) {
+        for (n = cache->head ; n ; n = next) {
+            next = n->next;
+            ipfs_routing_cache_entry_free(n);
+        }
+        free(cache->buckets);
+        pthread_mutex_destroy(&cache->lock);
+        free(cache);
+    }
+    return 1;
+}
+
+char* ipfs_routing_cache_lookup (struct routingResolver *cache, const char *key)
+{
+    struct cacheEntry **link;
+    struct timespec now;
+    char *value = NULL;
+    uint32_t hash;
+
+    if (!cache || !key || cache->cachesize == 0) {
+        return NULL;
+    }
+    hash = ipfs_routing_cache_hash(key);
+    clock_gettime (CLOCK_REALTIME, &now);
+    pthread_mutex_lock(&cache->lock);
+    link = ipfs_routing_cache_find(cache, key, hash);
+    if (link) {
+        if (ipfs_routing_cache_expired(*link, &now)) {
+            ipfs_routing_cache_remove(cache, link);
+        } else {
+            // most recently used
+            ipfs_routing_cache_unlink(cache, *link);
+            ipfs_routing_cache_push_front(cache, *link);
+            value = strdup((*link)->value);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return value;
+}
+
+int ipfs_routing_cache_insert (struct routingResolver *cache, const char *key, const char *value, const struct timespec *eol)
+{
+    struct cacheEntry **link, *n;
+    char *new_value;
+    uint32_t hash;
+
+    if (!cache || !key || !value || !eol || cache->cachesize == 0) {
+        return 0;
+    }
+    hash = ipfs_routing_cache_hash(key);
+    new_value = strdup(value);
+    if (!new_value) {
+        return 0;
+    }
+    pthread_mutex_lock(&cache->lock);
+    link = ipfs_routing_cache_find(cache, key, hash);
+    if (link) {
+        // replace the value
+        n = *link;
+        free(n->value);
+        n->value = new_value;
+        n->eol = *eol;
+        ipfs_routing_cache_unlink(cache, n);
+        ipfs_routing_cache_push_front(cache, n);
+        pthread_mutex_unlock(&cache->lock);
+        return 1;
+    }
+    n = malloc(sizeof (struct cacheEntry));
+    if (n) {
+        n->key = strdup(key);
+    }
+    if (!n || !n->key) {
+        pthread_mutex_unlock(&cache->lock);
+        free(n);
+        free(new_value);
+        return 0;
+    }
+    if (cache->count >= cache->cachesize) {
+        // evict the least recently used
+        link = ipfs_routing_cache_find(cache, cache->tail->key, cache->tail->hash);
+        ipfs_routing_cache_remove(cache, link);
+    }
+    n->value = new_value;
+    n->eol = *eol;
+    n->hash = hash;
+    n->bucket_next = cache->buckets[hash & (cache->num_buckets - 1)];
+    cache->buckets[hash & (cache->num_buckets - 1)] = n;
+    ipfs_routing_cache_push_front(cache, n);
+    cache->count++;
+    pthread_mutex_unlock(&cache->lock);
+    return 1;
+}
+
+int ipfs_routing_cache_eol (struct ipns_entry *ientry, struct timespec *eol)
+{
+    struct timespec validity;
+    uint64_t ttl = DefaultResolverCacheTTL;
+
+    clock_gettime (CLOCK_REALTIME, eol); // now
+    if (ientry && ientry->ttl && *ientry->ttl > 0) {
+        ttl = *ientry->ttl / 1000000000; // the record has it in nanoseconds
+    }
+    eol->tv_sec += ttl;
+    // never past the validity of the record
+    if (ientry && ientry->validityType && *ientry->validityType == IpnsEntry_EOL && ientry->validity) {
+        if (ipfs_util_time_parse_RFC3339 (&validity, ientry->validity) == 0) {
+            if (validity.tv_sec < eol->tv_sec || (validity.tv_sec == eol->tv_sec && validity.tv_nsec < eol->tv_nsec)) {
+                *eol = validity;
+            }
+        }
+    }
+    return 1;
+}
+
+char* ipfs_routing_cache_get (char *key, struct ipns_entry *ientry)
+{
+    if (key && ientry) {
+        return ipfs_routing_cache_lookup(ientry->cache, key);
+    }
+    return NULL;
+}
+
+void ipfs_routing_cache_set (char *key, char *value, struct ipns_entry *ientry)
+{
+    struct timespec eol;
+
+    if (key && value && ientry) {
+        ipfs_routing_cache_eol(ientry, &eol);
+        ipfs_routing_cache_insert(ientry->cache, key, value, &eol);
+    }
+}
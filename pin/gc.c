@@ -0,0 +1,442 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libp2p/os/utils.h"
+#include "libp2p/utils/logger.h"
+#include "ipfs/blocks/blockstore.h"
+#include "ipfs/cid/cid.h"
+#include "ipfs/core/http_request.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/merkledag/walker.h"
+#include "ipfs/pin/gc.h"
+#include "ipfs/pin/pin.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
+#include "ipfs/util/metrics.h"
+
+struct GcDaemon {
+	struct FSRepo* fs_repo;
+	unsigned long period;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+};
+
+/***
+ * Fill in a Cid that points at a hash, to look it up in a CidSet
+ */
+static struct Cid* ipfs_gc_cid(struct Cid* cid, const unsigned char* hash, size_t hash_size) {
+	cid->version = 0;
+	cid->codec = CID_DAG_PROTOBUF;
+	cid->hash = (unsigned char*)hash;
+	cid->hash_length = hash_size;
+	return cid;
+}
+
+static int ipfs_gc_stopped(const struct GcOptions* options) {
+	return options->stop != NULL && __atomic_load_n(options->stop, __ATOMIC_RELAXED);
+}
+
+struct GcRoots {
+	struct CidSet* marked;
+	struct MerkledagWalker* walker;
+	int failed;
+};
+
+/***
+ * Walk from a recursive pin
+ */
+static int ipfs_gc_add_recursive(const unsigned char* hash, size_t hash_size, PinMode mode, void* arg) {
+	struct GcRoots* roots = (struct GcRoots*)arg;
+	if (mode == Recursive && !ipfs_merkledag_walker_push(roots->walker, hash, hash_size)) {
+		roots->failed = 1;
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Mark a pin that is not walked from
+ */
+static int ipfs_gc_add_direct(const unsigned char* hash, size_t hash_size, PinMode mode, void* arg) {
+	struct GcRoots* roots = (struct GcRoots*)arg;
+	struct Cid cid;
+	if (mode == Recursive || ipfs_cid_set_has(roots->marked, ipfs_gc_cid(&cid, hash, hash_size)))
+		return 1;
+	if (ipfs_cid_set_add(roots->marked, &cid, 1) != 0) {
+		roots->failed = 1;
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Mark everything reachable from the pins. Each block is read once, as the
+ * set of marked blocks is also the set of blocks the walk has seen. The
+ * other pins are marked after the walk, as a block the walk has seen is not
+ * followed, and one of them can be inside a recursive pin.
+ * @param fs_repo the repo
+ * @param marked where to put the multihashes of the blocks
+ * @param options for when to stop
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_gc_mark(struct FSRepo* fs_repo, struct CidSet* marked, const struct GcOptions* options) {
+	// a block that is not here, or is not a node, has nothing to follow
+	struct MerkledagWalkOptions walk_options = { MERKLEDAG_WALK_DEPTH_FIRST, 1, 1, 0, marked };
+	struct GcRoots roots = { marked, NULL, 0 };
+	int retVal = 0;
+
+	roots.walker = ipfs_merkledag_walker_new(ipfs_merkledag_walk_fetch_repo, fs_repo, &walk_options);
+	if (roots.walker == NULL)
+		return 0;
+	if (!ipfs_pin_foreach(fs_repo, ipfs_gc_add_recursive, &roots) || roots.failed) {
+		libp2p_logger_error("gc", "Unable to read the pins.\n");
+		goto exit;
+	}
+	for(;;) {
+		if (ipfs_gc_stopped(options))
+			goto exit;
+		int found = ipfs_merkledag_walker_next(roots.walker, NULL, NULL, NULL, NULL);
+		if (found < 0) {
+			libp2p_logger_error("gc", "Out of memory while marking.\n");
+			goto exit;
+		}
+		if (found == 0)
+			break;
+	}
+	if (!ipfs_pin_foreach(fs_repo, ipfs_gc_add_direct, &roots) || roots.failed) {
+		libp2p_logger_error("gc", "Unable to read the pins.\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	ipfs_merkledag_walker_free(roots.walker);
+	return retVal;
+}
+
+/***
+ * Delete the file of a block
+ * @param fs_repo the repo
+ * @param record the datastore record of the block, whose value is the name of the file
+ * @returns the size of the file deleted, 0 if there was none
+ */
+static size_t ipfs_gc_remove_file(struct FSRepo* fs_repo, const struct DatastoreRecord* record) {
+	char name[record->value_size + 1];
+	memcpy(name, record->value, record->value_size);
+	name[record->value_size] = 0;
+	char* filename = ipfs_blockstore_path_get(fs_repo, name);
+	if (filename == NULL)
+		return 0;
+	size_t size = os_utils_file_size(filename);
+	if (unlink(filename) != 0) {
+		if (errno != ENOENT)
+			libp2p_logger_error("gc", "Unable to delete %s.\n", filename);
+		size = 0;
+	}
+	free(filename);
+	return size;
+}
+
+/***
+ * Sleep long enough to delete no more than rate blocks a second
+ */
+static void ipfs_gc_throttle(const struct GcOptions* options, size_t removed) {
+	if (options->rate <= 0 || removed == 0)
+		return;
+	unsigned long long nanos = (unsigned long long)removed * 1000000000ULL / options->rate;
+	struct timespec wait = { nanos / 1000000000ULL, nanos % 1000000000ULL };
+	nanosleep(&wait, NULL);
+}
+
+/***
+ * Delete the blocks that were not marked, a batch at a time
+ * @param fs_repo the repo
+ * @param marked the blocks to keep
+ * @param options the batch size, rate, and when to stop
+ * @param result where to count what was done
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int ipfs_gc_sweep(struct FSRepo* fs_repo, struct CidSet* marked, const struct GcOptions* options, struct GcResult* result) {
+	struct Datastore* datastore = fs_repo->config->datastore;
+	int batch_size = options->batch_size > 0 ? options->batch_size : GC_BATCH_SIZE;
+	struct DatastoreRecord* records[batch_size];
+	struct DatastoreRecord* garbage[batch_size];
+	unsigned char* after = NULL;
+	size_t after_size = 0;
+	struct Cid cid;
+	int retVal = 0;
+
+	for(;;) {
+		if (ipfs_gc_stopped(options))
+			goto exit;
+		int found = repo_fsrepo_lmdb_get_after(after, after_size, records, batch_size, datastore);
+		if (found < 0)
+			goto exit;
+		int num_garbage = 0;
+		for(int i = 0; i < found; i++)
+			if (!ipfs_cid_set_has(marked, ipfs_gc_cid(&cid, records[i]->key, records[i]->key_size)))
+				garbage[num_garbage++] = records[i];
+
+		size_t removed = 0;
+		if (num_garbage > 0) {
+			// writes of these blocks wait for the batch to be deleted, or are seen here
+			pthread_mutex_lock(&fs_repo->gc->lock);
+			int j = 0;
+			for(int i = 0; i < num_garbage; i++) {
+				if (ipfs_cid_set_has(fs_repo->gc->written, ipfs_gc_cid(&cid, garbage[i]->key, garbage[i]->key_size)))
+					result->kept++;
+				else
+					garbage[j++] = garbage[i];
+			}
+			num_garbage = j;
+			int deleted = num_garbage > 0 ? repo_fsrepo_lmdb_delete_many(garbage, num_garbage, datastore) : 0;
+			if (deleted > 0) {
+				for(int i = 0; i < num_garbage; i++)
+					result->bytes_freed += ipfs_gc_remove_file(fs_repo, garbage[i]);
+				removed = deleted;
+			}
+			pthread_mutex_unlock(&fs_repo->gc->lock);
+			if (deleted < 0) {
+				libp2p_logger_error("gc", "Unable to delete a batch of blocks.\n");
+				for(int i = 0; i < found; i++)
+					libp2p_datastore_record_free(records[i]);
+				goto exit;
+			}
+			result->removed += removed;
+			ipfs_util_metrics_add(METRICS_GC_BLOCKS_REMOVED, removed);
+		}
+
+		// the next batch begins after the last key of this one
+		if (found > 0) {
+			free(after);
+			after_size = records[found - 1]->key_size;
+			after = (unsigned char*) malloc(after_size);
+			if (after != NULL)
+				memcpy(after, records[found - 1]->key, after_size);
+		}
+		for(int i = 0; i < found; i++)
+			libp2p_datastore_record_free(records[i]);
+		if (found < batch_size)
+			break;
+		if (after == NULL)
+			goto exit;
+		ipfs_gc_throttle(options, removed);
+	}
+	retVal = 1;
+	exit:
+	free(after);
+	return retVal;
+}
+
+/***
+ * Delete the blocks that are not reachable from a pin
+ * @param fs_repo the repo
+ * @param options how to go about it, NULL for batches of GC_BATCH_SIZE and no rate limit
+ * @param result what was done, can be NULL
+ * @returns true(1) on success, false(0) on error, if stopped, or if another collection is running
+ */
+int ipfs_gc_collect(struct FSRepo* fs_repo, const struct GcOptions* options, struct GcResult* result) {
+	struct GcOptions default_options = { GC_BATCH_SIZE, 0, NULL };
+	struct GcResult local_result;
+	struct CidSet* marked = NULL;
+	int retVal = 0;
+
+	if (fs_repo == NULL || fs_repo->gc == NULL)
+		return 0;
+	if (options == NULL)
+		options = &default_options;
+	if (result == NULL)
+		result = &local_result;
+	memset(result, 0, sizeof(struct GcResult));
+
+	// the blocks of a repo from before pins are all garbage until their roots are pinned
+	if (!ipfs_pin_upgrade(fs_repo)) {
+		libp2p_logger_error("gc", "The blocks from before pins are not pinned, so nothing is collected.\n");
+		return 0;
+	}
+
+	struct CidSet* written = ipfs_cid_set_new();
+	marked = ipfs_cid_set_new();
+	if (written == NULL || marked == NULL) {
+		ipfs_cid_set_destroy(&written);
+		ipfs_cid_set_destroy(&marked);
+		return 0;
+	}
+
+	// from here on, what is written is kept. What adds that began before
+	// wrote is only safe once they have pinned it.
+	pthread_mutex_lock(&fs_repo->gc->lock);
+	if (fs_repo->gc->written != NULL) {
+		pthread_mutex_unlock(&fs_repo->gc->lock);
+		libp2p_logger_error("gc", "A garbage collection is already running.\n");
+		ipfs_cid_set_destroy(&written);
+		ipfs_cid_set_destroy(&marked);
+		return 0;
+	}
+	fs_repo->gc->written = written;
+	while (fs_repo->gc->adds > 0)
+		pthread_cond_wait(&fs_repo->gc->adds_done, &fs_repo->gc->lock);
+	pthread_mutex_unlock(&fs_repo->gc->lock);
+
+	if (!ipfs_gc_mark(fs_repo, marked, options))
+		goto exit;
+	result->marked = ipfs_cid_set_len(marked);
+	libp2p_logger_debug("gc", "Marked %lu blocks.\n", (unsigned long)result->marked);
+
+	if (!ipfs_gc_sweep(fs_repo, marked, options, result))
+		goto exit;
+
+	retVal = 1;
+	exit:
+	ipfs_util_metrics_add(METRICS_GC_BYTES_FREED, result->bytes_freed);
+	libp2p_logger_debug("gc", "Removed %lu blocks, %llu bytes. Kept %lu written during the collection.\n",
+			(unsigned long)result->removed, result->bytes_freed, (unsigned long)result->kept);
+	pthread_mutex_lock(&fs_repo->gc->lock);
+	ipfs_cid_set_destroy(&fs_repo->gc->written);
+	pthread_mutex_unlock(&fs_repo->gc->lock);
+	ipfs_cid_set_destroy(&marked);
+	return retVal;
+}
+
+/***
+ * Parse a period such as "1h", "30m" or "1h30m"
+ * @param in the period. Units are h, m and s.
+ * @param seconds the period in seconds
+ * @returns true(1) on success, false(0) if it is not a period
+ */
+int ipfs_gc_parse_period(const char* in, unsigned long* seconds) {
+	if (in == NULL || *in == 0)
+		return 0;
+	unsigned long total = 0;
+	while (*in != 0) {
+		char* end = NULL;
+		unsigned long value = strtoul(in, &end, 10);
+		if (end == in)
+			return 0;
+		switch (*end) {
+			case 'h': value *= 60 * 60; break;
+			case 'm': value *= 60; break;
+			case 's': break;
+			default: return 0;
+		}
+		total += value;
+		in = end + 1;
+	}
+	*seconds = total;
+	return 1;
+}
+
+/***
+ * Collect every period, until stopped
+ */
+static void* ipfs_gc_daemon_thread(void* arg) {
+	struct GcDaemon* daemon = (struct GcDaemon*)arg;
+	struct GcOptions options = { GC_BATCH_SIZE, GC_RATE, &daemon->stop };
+	struct GcResult result;
+
+	pthread_mutex_lock(&daemon->lock);
+	while (!daemon->stop) {
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += daemon->period;
+		while (!daemon->stop && pthread_cond_timedwait(&daemon->cond, &daemon->lock, &until) != ETIMEDOUT)
+			;
+		if (daemon->stop)
+			break;
+		pthread_mutex_unlock(&daemon->lock);
+		if (ipfs_gc_collect(daemon->fs_repo, &options, &result))
+			libp2p_logger_info("gc", "Removed %lu blocks, %llu bytes.\n", (unsigned long)result.removed, result.bytes_freed);
+		pthread_mutex_lock(&daemon->lock);
+	}
+	pthread_mutex_unlock(&daemon->lock);
+	return NULL;
+}
+
+/***
+ * Start collecting garbage in the background, every period, at GC_RATE
+ * @param fs_repo the repo
+ * @param period the seconds between collections
+ * @returns the background collector, or NULL on error
+ */
+struct GcDaemon* ipfs_gc_daemon_start(struct FSRepo* fs_repo, unsigned long period) {
+	struct GcDaemon* daemon = (struct GcDaemon*) malloc(sizeof(struct GcDaemon));
+	if (daemon == NULL)
+		return NULL;
+	daemon->fs_repo = fs_repo;
+	daemon->period = period > 0 ? period : GC_PERIOD_DEFAULT;
+	daemon->stop = 0;
+	pthread_mutex_init(&daemon->lock, NULL);
+	pthread_cond_init(&daemon->cond, NULL);
+	if (pthread_create(&daemon->thread, NULL, ipfs_gc_daemon_thread, daemon) != 0) {
+		libp2p_logger_error("gc", "Unable to start the garbage collector.\n");
+		pthread_mutex_destroy(&daemon->lock);
+		pthread_cond_destroy(&daemon->cond);
+		free(daemon);
+		return NULL;
+	}
+	return daemon;
+}
+
+/***
+ * Stop the background collector, stopping a collection that is running, and free it
+ * @param daemon the background collector, can be NULL
+ */
+void ipfs_gc_daemon_stop(struct GcDaemon* daemon) {
+	if (daemon == NULL)
+		return;
+	pthread_mutex_lock(&daemon->lock);
+	__atomic_store_n(&daemon->stop, 1, __ATOMIC_RELAXED);
+	pthread_cond_signal(&daemon->cond);
+	pthread_mutex_unlock(&daemon->lock);
+	pthread_join(daemon->thread, NULL);
+	pthread_mutex_destroy(&daemon->lock);
+	pthread_cond_destroy(&daemon->cond);
+	free(daemon);
+}
+
+/***
+ * Handle "ipfs repo gc" from the command line. If the daemon is running, it collects.
+ * @param args the command line arguments
+ * @returns true(1) on success, false(0) otherwise
+ */
+int ipfs_repo_gc(struct CliArguments* args) {
+	struct IpfsNode* local_node = NULL;
+	struct GcResult result;
+	int retVal = 0;
+
+	if (args->argc < args->verb_index + 2 || strcmp(args->argv[args->verb_index + 1], "gc") != 0) {
+		libp2p_logger_error("gc", "Should be \"repo gc\".\n");
+		return 0;
+	}
+	if (!ipfs_node_offline_new(args->config_dir, &local_node)) {
+		libp2p_logger_error("gc", "Unable to open the repo.\n");
+		return 0;
+	}
+	if (local_node->mode == MODE_API_AVAILABLE) {
+		// the daemon knows what it is adding, so it has to be the one to collect
+		struct HttpRequest* request = ipfs_core_http_request_new();
+		char* response = NULL;
+		size_t response_size = 0;
+		if (request != NULL) {
+			request->command = "repo";
+			request->sub_command = "gc";
+			retVal = ipfs_core_http_request_get(local_node, request, &response, &response_size);
+			if (response != NULL && response_size > 0) {
+				fwrite(response, 1, response_size, stdout);
+				fprintf(stdout, "\n");
+			}
+			free(response);
+			ipfs_core_http_request_free(request);
+		}
+	} else if (ipfs_gc_collect(local_node->repo, NULL, &result)) {
+		fprintf(stdout, "removed %lu blocks, %llu bytes\n", (unsigned long)result.removed, result.bytes_freed);
+		retVal = 1;
+	}
+	ipfs_node_free(local_node);
+	return retVal;
+}
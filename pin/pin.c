@@ -1,20 +1,33 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "libp2p/utils/logger.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 
 #define IPFS_PIN_C
 #include "ipfs/pin/pin.h"
 
 #include "ipfs/cid/cid.h"
+#include "ipfs/cmd/cli.h"
+#include "ipfs/core/ipfs_node.h"
 #include "ipfs/datastore/key.h"
 #include "ipfs/merkledag/merkledag.h"
+#include "ipfs/merkledag/walker.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
+#include "ipfs/repo/fsrepo/pinstore.h"
 #include "ipfs/util/errs.h"
 
 // package pin implements structures and methods to keep track of
 // which objects a user wants to keep stored locally.
 
 #define PIN_DATASTOREKEY_SIZE 100
+// blocks added to, or removed from, the index in each transaction
+#define PIN_REFS_BATCH 1024
+// room for the multihash of a pin
+#define PIN_HASH_MAX 128
+// blocks read from the datastore at a time, while pinning the roots of a repo from before pins
+#define PIN_UPGRADE_BATCH 256
 char *pinDatastoreKey = NULL;
 size_t pinDatastoreKeySize = 0;
 
@@ -87,16 +100,16 @@ char *ipfs_pin_pinned_msg (struct Pinned *p)
             break;
         case Indirect:
             msg = "pinned via ";
-            ret = malloc(strlen (msg) + p->Via->hash_length + 1);
+            ret = malloc(strlen (msg) + PIN_HASH_MAX + 1);
             if (!ret) {
                 return NULL;
             }
-            ptr = ret;
-            memcpy(ptr, msg, strlen(msg));
-            ptr += strlen(msg);
-            memcpy(ptr, p->Via->hash, p->Via->hash_length);
-            ptr += p->Via->hash_length;
-            *ptr = '\0';
+            strcpy(ret, msg);
+            if (!p->Via || !ipfs_cid_hash_to_base58(p->Via->hash, p->Via->hash_length,
+                                                    (unsigned char*)ret + strlen(msg), PIN_HASH_MAX + 1)) {
+                free(ret);
+                return NULL;
+            }
             break;
         default:
             ptr = ipfs_pin_mode_to_string (p->Mode);
@@ -114,34 +127,646 @@ char *ipfs_pin_pinned_msg (struct Pinned *p)
     return ret;
 }
 
+struct PinWalk {
+    struct FSRepo *repo;
+    int keep;
+    int (*func)(const unsigned char *hash, size_t hash_size, void *arg);
+    void *arg;
+};
+
+static int ipfs_pin_walk_visit (const unsigned char *hash, size_t hash_size, struct HashtableNode *node, int depth, void *arg)
+{
+    struct PinWalk *walk = arg;
+    struct NodeLink *link;
+
+    if (depth == 0 && !node) {
+        libp2p_logger_error("pin", "Unable to read the root of the pin.\n");
+        return 0;
+    }
+    // the links are kept before they are read, so a collection can't take them in between
+    if (walk->keep && node) {
+        for (link = node->head_link ; link ; link = link->next) {
+            ipfs_repo_fsrepo_gc_keep(walk->repo, link->hash, link->hash_size);
+        }
+    }
+    return depth == 0 || walk->func(hash, hash_size, walk->arg);
+}
+
+/**
+ * Go through the blocks below a root, each one once, however many blocks
+ * link to it. A block that is not here is gone through, but has nothing to follow.
+ * @param repo the repo
+ * @param root the multihash of the root, which must be here
+ * @param keep true to have a garbage collection that is running keep the blocks
+ * @param func called with each block below the root. Returns false to stop.
+ * @returns true if all blocks were seen, false if func stopped, on error, or if the root isn't here
+ */
+static int ipfs_pin_walk (struct FSRepo *repo, const unsigned char *root, size_t root_size, int keep,
+                          int (*func)(const unsigned char *hash, size_t hash_size, void *arg), void *arg)
+{
+    struct MerkledagWalkOptions options = { MERKLEDAG_WALK_DEPTH_FIRST, 1, 1, 0, NULL };
+    struct PinWalk walk = { repo, keep, func, arg };
+
+    if (keep) {
+        ipfs_repo_fsrepo_gc_keep(repo, root, root_size);
+    }
+    return ipfs_merkledag_walk(ipfs_merkledag_walk_fetch_repo, repo, root, root_size, &options,
+                               ipfs_pin_walk_visit, &walk);
+}
+
+/**
+ * Blocks below a recursive pin, on their way to the index
+ */
+struct PinBatch {
+    void *handle;
+    const unsigned char *root;
+    size_t root_size;
+    int remove;
+    unsigned char *hashes[PIN_REFS_BATCH];
+    size_t hash_sizes[PIN_REFS_BATCH];
+    int count;
+};
+
+// Write the blocks to the index in one transaction. Returns false on error.
+static int ipfs_pin_batch_flush (struct PinBatch *batch)
+{
+    int i, ret;
+
+    if (batch->remove) {
+        ret = lmdb_pinstore_refs_delete(batch->handle, batch->root, batch->root_size,
+                                        batch->hashes, batch->hash_sizes, batch->count);
+    } else {
+        ret = lmdb_pinstore_refs_put(batch->handle, batch->root, batch->root_size,
+                                     batch->hashes, batch->hash_sizes, batch->count);
+    }
+    for (i = 0 ; i < batch->count ; i++) {
+        free(batch->hashes[i]);
+    }
+    batch->count = 0;
+    return ret;
+}
+
+static int ipfs_pin_batch_add (const unsigned char *hash, size_t hash_size, void *arg)
+{
+    struct PinBatch *batch = arg;
+    unsigned char *copy = malloc(hash_size);
+
+    if (!copy) {
+        return 0;
+    }
+    memcpy(copy, hash, hash_size);
+    batch->hashes[batch->count] = copy;
+    batch->hash_sizes[batch->count] = hash_size;
+    batch->count++;
+    return batch->count < PIN_REFS_BATCH || ipfs_pin_batch_flush(batch);
+}
+
+/**
+ * Add the blocks below a recursive pin to the index, or remove them
+ * @returns true on success, false otherwise
+ */
+static int ipfs_pin_index (struct FSRepo *repo, const unsigned char *root, size_t root_size, int remove)
+{
+    struct PinBatch *batch = calloc(1, sizeof (struct PinBatch));
+    int ret;
+
+    if (!batch) {
+        return 0;
+    }
+    batch->handle = repo->config->datastore->datastore_context;
+    batch->root = root;
+    batch->root_size = root_size;
+    batch->remove = remove;
+    ret = ipfs_pin_walk(repo, root, root_size, !remove, ipfs_pin_batch_add, batch);
+    if (batch->count > 0 && !ipfs_pin_batch_flush(batch)) {
+        ret = 0;
+    }
+    free(batch);
+    return ret;
+}
+
+struct PinSearch {
+    const unsigned char *child;
+    size_t child_size;
+    int found;
+};
+
+static int ipfs_pin_search (const unsigned char *hash, size_t hash_size, void *arg)
+{
+    struct PinSearch *search = arg;
+
+    if (hash_size == search->child_size && memcmp(hash, search->child, hash_size) == 0) {
+        search->found = 1;
+        return 0; // stop here
+    }
+    return 1;
+}
+
 // Find out if the child is in the hash.
 int ipfs_pin_has_child (struct FSRepo *ds,
                         unsigned char *hash,  size_t hash_size,
                         unsigned char *child, size_t child_size)
 {
-    struct HashtableNode *node;
-    struct NodeLink *node_link;
+    struct PinSearch search = { child, child_size, 0 };
+
+    if (!ds || !hash || !child) {
+        return 0;
+    }
+    if ((hash_size == child_size) && (memcmp (hash, child, child_size) == 0)) {
+        return 1;
+    }
+    // the index has what is below a recursive pin
+    if (ipfs_pin_get_mode (ds, hash, hash_size) == Recursive) {
+        return lmdb_pinstore_refs_has (ds->config->datastore->datastore_context,
+                                       hash, hash_size, child, child_size);
+    }
+    ipfs_pin_walk (ds, hash, hash_size, 0, ipfs_pin_search, &search);
+    return search.found;
+}
+
+/**
+ * Pin a block. Recursive keeps everything it links to as well.
+ * @returns true on success, false otherwise
+ */
+static int ipfs_pin_put (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, PinMode mode)
+{
+    void *handle;
+    int started, ret;
 
-    if (ipfs_merkledag_get (hash, hash_size, &node, ds)) {
-        if (node) {
-            if ((node->hash_size == child_size) &&
-                (memcmp (node->hash, child, child_size) == 0)) {
+    if (!repo || !hash || (mode != Recursive && mode != Direct)) {
+        return 0;
+    }
+    handle = repo->config->datastore->datastore_context;
+    switch (ipfs_pin_get_mode (repo, hash, hash_size)) {
+        case Recursive:
+            if (mode == Direct) {
+                libp2p_logger_error("pin", "The block is already pinned recursively.\n");
+                return 0;
+            }
+            return 1; // nothing to do
+        case Direct:
+            if (mode == Direct) {
                 return 1;
             }
-            // browse the node links.
-            for (node_link = node->head_link ; node_link ; node_link = node_link->next) {
-                if ((node_link->hash_size == child_size) &&
-                    (memcmp (node_link->hash, child, child_size) != 0) &&
-                     ipfs_pin_has_child (ds, node_link->hash, node_link->hash_size,
-                                             child, child_size)) {
-                    return 1;
-                }
-                if ((node_link->hash_size == child_size) &&
-                    (memcmp (node_link->hash, child, child_size) == 0)) {
-                    return 1; // child is a child of the hash node.
-                }
+            break;
+    }
+    if (mode == Direct) {
+        return lmdb_pinstore_put (handle, hash, hash_size, mode);
+    }
+    // the blocks are indexed before the pin is stored, so a pin that is
+    // there is complete. A collection that starts meanwhile waits.
+    started = ipfs_repo_fsrepo_add_begin (repo);
+    ret = ipfs_pin_index (repo, hash, hash_size, 0) &&
+          lmdb_pinstore_put (handle, hash, hash_size, mode);
+    if (!ret) {
+        ipfs_pin_index (repo, hash, hash_size, 1);
+    }
+    ipfs_repo_fsrepo_add_end (repo, started);
+    return ret;
+}
+
+// Pin a block. Recursive keeps everything it links to as well.
+int ipfs_pin_add (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, PinMode mode)
+{
+    if (!ipfs_pin_put (repo, hash, hash_size, mode)) {
+        return 0;
+    }
+    // asked for, so it is no longer only there for replication
+    if (mode == Recursive) {
+        lmdb_pinstore_replicated_delete (repo->config->datastore->datastore_context, hash, hash_size);
+    }
+    return 1;
+}
+
+/**
+ * The pins made for replicated blocks, copied out of the pinstore
+ */
+struct PinList {
+    unsigned char **hashes;
+    size_t *hash_sizes;
+    int count;
+    int capacity;
+};
+
+static int ipfs_pin_list_add (const unsigned char *hash, size_t hash_size, void *arg)
+{
+    struct PinList *list = arg;
+    unsigned char **hashes;
+    size_t *hash_sizes;
+    int capacity;
+
+    if (list->count == list->capacity) {
+        capacity = list->capacity ? list->capacity * 2 : 16;
+        hashes = realloc(list->hashes, capacity * sizeof (unsigned char*));
+        if (!hashes) {
+            return 0;
+        }
+        list->hashes = hashes;
+        hash_sizes = realloc(list->hash_sizes, capacity * sizeof (size_t));
+        if (!hash_sizes) {
+            return 0;
+        }
+        list->hash_sizes = hash_sizes;
+        list->capacity = capacity;
+    }
+    list->hashes[list->count] = malloc(hash_size);
+    if (!list->hashes[list->count]) {
+        return 0;
+    }
+    memcpy(list->hashes[list->count], hash, hash_size);
+    list->hash_sizes[list->count] = hash_size;
+    list->count++;
+    return 1;
+}
+
+// Pin a block from the journal of another node recursively, unless something keeps it already.
+int ipfs_pin_add_replicated (struct FSRepo *repo, const unsigned char *hash, size_t hash_size)
+{
+    struct PinList list = { NULL, NULL, 0, 0 };
+    void *handle;
+    int mode, i, ret;
+
+    if (!repo || !hash) {
+        return 0;
+    }
+    handle = repo->config->datastore->datastore_context;
+    if (!lmdb_pinstore_find (handle, hash, hash_size, &mode, NULL, 0, NULL)) {
+        mode = NotPinned;
+    }
+    if (mode == Recursive || mode == Indirect) {
+        return 1; // kept already
+    }
+    if (!ipfs_pin_put (repo, hash, hash_size, Recursive)) {
+        return 0;
+    }
+    // a direct pin was asked for, so the recursive one is not dropped later
+    if (mode == NotPinned && !lmdb_pinstore_replicated_put (handle, hash, hash_size)) {
+        return 0;
+    }
+    // the pins of replicated blocks below it keep nothing more
+    ret = lmdb_pinstore_replicated_foreach (handle, ipfs_pin_list_add, &list);
+    for (i = 0 ; i < list.count ; i++) {
+        if (ret && lmdb_pinstore_refs_has (handle, hash, hash_size, list.hashes[i], list.hash_sizes[i])) {
+            ipfs_pin_remove (repo, list.hashes[i], list.hash_sizes[i]);
+        }
+        free(list.hashes[i]);
+    }
+    free(list.hashes);
+    free(list.hash_sizes);
+    if (!ret) {
+        libp2p_logger_error("pin", "Unable to drop the replicated pins below a new one.\n");
+    }
+    return 1;
+}
+
+// Unpin a block. Returns true if it was pinned.
+int ipfs_pin_remove (struct FSRepo *repo, const unsigned char *hash, size_t hash_size)
+{
+    PinMode mode;
+
+    if (!repo || !hash) {
+        return 0;
+    }
+    mode = ipfs_pin_get_mode (repo, hash, hash_size);
+    if (!lmdb_pinstore_delete (repo->config->datastore->datastore_context, hash, hash_size)) {
+        return 0;
+    }
+    lmdb_pinstore_replicated_delete (repo->config->datastore->datastore_context, hash, hash_size);
+    // what is left of the index if this fails is ignored, as the pin is gone
+    if (mode == Recursive && !ipfs_pin_index (repo, hash, hash_size, 1)) {
+        libp2p_logger_error("pin", "Unable to remove all of the pin from the index.\n");
+    }
+    return 1;
+}
+
+// Find how a block itself is pinned. Returns NotPinned if it isn't.
+PinMode ipfs_pin_get_mode (struct FSRepo *repo, const unsigned char *hash, size_t hash_size)
+{
+    int mode;
+
+    if (!repo || !hash ||
+        !lmdb_pinstore_get (repo->config->datastore->datastore_context, hash, hash_size, &mode)) {
+        return NotPinned;
+    }
+    return mode;
+}
+
+// Find how a block is pinned, itself or below a recursive pin.
+int ipfs_pin_find (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, struct Pinned *p)
+{
+    unsigned char via[PIN_HASH_MAX];
+    size_t via_size = 0;
+    int mode;
+
+    if (!repo || !hash || !p) {
+        return 0;
+    }
+    p->Key = ipfs_cid_new(0, hash, hash_size, CID_DAG_PROTOBUF);
+    p->Mode = NotPinned;
+    p->Via = NULL;
+    if (!p->Key) {
+        return 0;
+    }
+    if (lmdb_pinstore_find (repo->config->datastore->datastore_context, hash, hash_size,
+                            &mode, via, sizeof via, &via_size)) {
+        p->Mode = mode;
+        if (mode == Indirect && via_size > 0) {
+            p->Via = ipfs_cid_new(0, via, via_size, CID_DAG_PROTOBUF);
+        }
+    }
+    return 1;
+}
+// Call func with each pin, until it returns false.
+int ipfs_pin_foreach (struct FSRepo *repo,
+                      int (*func)(const unsigned char *hash, size_t hash_size, PinMode mode, void *arg),
+                      void *arg)
+{
+    if (!repo) {
+        return 0;
+    }
+    return lmdb_pinstore_foreach (repo->config->datastore->datastore_context, func, arg);
+}
+
+/**
+ * Go through the blocks of the datastore, a batch at a time
+ * @param repo the repo
+ * @param func called with each block. The hash is only good during the call. Returns false to stop.
+ * @returns true if all blocks were seen, false if func stopped, or on error
+ */
+static int ipfs_pin_upgrade_foreach (struct FSRepo *repo,
+                                     int (*func)(struct FSRepo *repo, const unsigned char *hash, size_t hash_size, void *arg),
+                                     void *arg)
+{
+    struct DatastoreRecord *records[PIN_UPGRADE_BATCH];
+    unsigned char *after = NULL;
+    size_t after_size = 0;
+    int found, i, ret = 1;
+
+    do {
+        found = repo_fsrepo_lmdb_get_after(after, after_size, records, PIN_UPGRADE_BATCH, repo->config->datastore);
+        if (found < 0) {
+            ret = 0;
+            break;
+        }
+        for (i = 0 ; i < found && ret ; i++) {
+            ret = func(repo, records[i]->key, records[i]->key_size, arg);
+        }
+        // the next batch begins after the last key of this one
+        if (found > 0) {
+            free(after);
+            after_size = records[found - 1]->key_size;
+            after = malloc(after_size);
+            if (after) {
+                memcpy(after, records[found - 1]->key, after_size);
+            } else {
+                ret = 0;
+            }
+        }
+        for (i = 0 ; i < found ; i++) {
+            libp2p_datastore_record_free(records[i]);
+        }
+    } while (ret && found == PIN_UPGRADE_BATCH);
+    free(after);
+    return ret;
+}
+
+// Remember the blocks that a block links to
+static int ipfs_pin_upgrade_links (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, void *arg)
+{
+    struct CidSet *linked = arg;
+    struct HashtableNode *node = NULL;
+    struct NodeLink *link;
+    struct Cid cid;
+    int ret = 1;
+
+    // raw blocks are not nodes, and link to nothing
+    if (!ipfs_merkledag_get(hash, hash_size, &node, repo)) {
+        return 1;
+    }
+    for (link = node->head_link ; link && ret ; link = link->next) {
+        cid.version = 0;
+        cid.codec = CID_DAG_PROTOBUF;
+        cid.hash = link->hash;
+        cid.hash_length = link->hash_size;
+        ret = ipfs_cid_set_add(linked, &cid, 1) == 0;
+    }
+    ipfs_hashtable_node_free(node);
+    return ret;
+}
+
+// Pin a block that no block links to
+static int ipfs_pin_upgrade_root (struct FSRepo *repo, const unsigned char *hash, size_t hash_size, void *arg)
+{
+    struct CidSet *linked = arg;
+    struct Cid cid;
+
+    cid.version = 0;
+    cid.codec = CID_DAG_PROTOBUF;
+    cid.hash = (unsigned char*)hash;
+    cid.hash_length = hash_size;
+    if (ipfs_cid_set_has(linked, &cid) || ipfs_pin_get_mode(repo, hash, hash_size) != NotPinned) {
+        return 1;
+    }
+    return ipfs_pin_add(repo, hash, hash_size, Recursive);
+}
+
+// Pin the roots of the blocks of a repo from before there were pins.
+int ipfs_pin_upgrade (struct FSRepo *repo)
+{
+    struct CidSet *linked;
+    int ret;
+
+    if (!repo) {
+        return 0;
+    }
+    if (!lmdb_pinstore_upgrade_pending(repo->config->datastore->datastore_context)) {
+        return 1;
+    }
+    linked = ipfs_cid_set_new();
+    if (!linked) {
+        return 0;
+    }
+    // a root is a block that no other block links to
+    ret = ipfs_pin_upgrade_foreach(repo, ipfs_pin_upgrade_links, linked) &&
+          ipfs_pin_upgrade_foreach(repo, ipfs_pin_upgrade_root, linked) &&
+          lmdb_pinstore_upgrade_done(repo->config->datastore->datastore_context);
+    ipfs_cid_set_destroy(&linked);
+    if (!ret) {
+        libp2p_logger_error("pin", "Unable to pin the roots of the blocks from before pins.\n");
+    } else {
+        libp2p_logger_info("pin", "Pinned the roots of the blocks from before pins.\n");
+    }
+    return ret;
+}
+
+/**
+ * Print a block and how it is pinned, as "pin ls" does
+ */
+static int ipfs_pin_print (const unsigned char *hash, size_t hash_size, PinMode mode, const unsigned char *via, size_t via_size)
+{
+    unsigned char buffer[PIN_HASH_MAX + 1];
+    unsigned char via_buffer[PIN_HASH_MAX + 1];
+
+    if (!ipfs_cid_hash_to_base58(hash, hash_size, buffer, sizeof buffer)) {
+        return 0;
+    }
+    if (via && ipfs_cid_hash_to_base58(via, via_size, via_buffer, sizeof via_buffer)) {
+        fprintf(stdout, "%s indirect through %s\n", buffer, via_buffer);
+    } else {
+        fprintf(stdout, "%s %s\n", buffer, ipfs_pin_mode_to_string(mode));
+    }
+    return 1;
+}
+
+static int ipfs_pin_ls_pin (const unsigned char *hash, size_t hash_size, PinMode mode, void *arg)
+{
+    PinMode type = *(PinMode*)arg;
+
+    if (type == All || type == mode) {
+        return ipfs_pin_print(hash, hash_size, mode, NULL, 0);
+    }
+    return 1;
+}
+
+static int ipfs_pin_ls_indirect (const unsigned char *hash, size_t hash_size, void *arg)
+{
+    return ipfs_pin_print(hash, hash_size, Indirect, NULL, 0);
+}
+
+/**
+ * Decode a hash from the command line
+ * @returns the cid, to be freed with ipfs_cid_free, or NULL
+ */
+static struct Cid *ipfs_pin_arg_cid (const char *arg)
+{
+    struct Cid *cid = NULL;
+    const char prefix[] = "/ipfs/";
+
+    if (strncmp(arg, prefix, sizeof (prefix) - 1) == 0) {
+        arg += sizeof (prefix) - 1;
+    }
+    if (!ipfs_cid_decode_hash_from_base58((unsigned char*)arg, strlen(arg), &cid)) {
+        ipfs_cid_free(cid);
+        fprintf(stderr, "Invalid hash: %s\n", arg);
+        return NULL;
+    }
+    return cid;
+}
+
+/**
+ * "ipfs pin ls [--type=direct|recursive|indirect|all] [hash...]"
+ */
+static int ipfs_pin_ls (struct FSRepo *repo, struct CliArguments *args)
+{
+    PinMode type = All;
+    int i, hashes = 0, ret = 1;
+
+    for (i = args->verb_index + 2 ; i < args->argc ; i++) {
+        if (strncmp(args->argv[i], "--type=", 7) == 0 || strncmp(args->argv[i], "-t=", 3) == 0) {
+            type = ipfs_string_to_pin_mode(strchr(args->argv[i], '=') + 1);
+            if (type != Recursive && type != Direct && type != Indirect && type != All) {
+                fprintf(stderr, "Invalid type: %s\n", strchr(args->argv[i], '=') + 1);
+                return 0;
             }
         }
     }
-    return 0;
+    // the hashes given, one lookup each
+    for (i = args->verb_index + 2 ; i < args->argc ; i++) {
+        struct Pinned p;
+        struct Cid *cid;
+
+        if (args->argv[i][0] == '-') {
+            continue;
+        }
+        hashes++;
+        cid = ipfs_pin_arg_cid(args->argv[i]);
+        if (!cid || !ipfs_pin_find(repo, cid->hash, cid->hash_length, &p)) {
+            ipfs_cid_free(cid);
+            ret = 0;
+            continue;
+        }
+        if (p.Mode == NotPinned || (type != All && type != p.Mode)) {
+            fprintf(stderr, "%s is not pinned\n", args->argv[i]);
+            ret = 0;
+        } else {
+            ipfs_pin_print(cid->hash, cid->hash_length, p.Mode,
+                           p.Via ? p.Via->hash : NULL, p.Via ? p.Via->hash_length : 0);
+        }
+        ipfs_cid_free(p.Key);
+        ipfs_cid_free(p.Via);
+        ipfs_cid_free(cid);
+    }
+    if (hashes > 0) {
+        return ret;
+    }
+    // all of them
+    if (type != Indirect && !ipfs_pin_foreach(repo, ipfs_pin_ls_pin, &type)) {
+        return 0;
+    }
+    if ((type == Indirect || type == All) &&
+        !lmdb_pinstore_refs_foreach(repo->config->datastore->datastore_context, ipfs_pin_ls_indirect, NULL)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Handle "ipfs pin add|rm|ls" from the command line.
+int ipfs_pin (struct CliArguments *args)
+{
+    struct IpfsNode *local_node = NULL;
+    PinMode mode = Recursive;
+    const char *sub;
+    int i, ret = 0;
+
+    if (args->argc < args->verb_index + 2) {
+        libp2p_logger_error("pin", "Should be \"pin add|rm|ls\".\n");
+        return 0;
+    }
+    sub = args->argv[args->verb_index + 1];
+    if (strcmp(sub, "add") != 0 && strcmp(sub, "rm") != 0 && strcmp(sub, "ls") != 0) {
+        libp2p_logger_error("pin", "Should be \"pin add|rm|ls\".\n");
+        return 0;
+    }
+    if (!ipfs_node_offline_new(args->config_dir, &local_node)) {
+        libp2p_logger_error("pin", "Unable to open the repo.\n");
+        return 0;
+    }
+    if (strcmp(sub, "ls") == 0) {
+        ret = ipfs_pin_ls(local_node->repo, args);
+        ipfs_node_free(local_node);
+        return ret;
+    }
+    for (i = args->verb_index + 2 ; i < args->argc ; i++) {
+        if (strcmp(args->argv[i], "-r=false") == 0 || strcmp(args->argv[i], "--recursive=false") == 0) {
+            mode = Direct;
+        }
+    }
+    ret = 1;
+    for (i = args->verb_index + 2 ; i < args->argc ; i++) {
+        struct Cid *cid;
+        int done;
+
+        if (args->argv[i][0] == '-') {
+            continue;
+        }
+        cid = ipfs_pin_arg_cid(args->argv[i]);
+        if (!cid) {
+            ret = 0;
+            continue;
+        }
+        if (strcmp(sub, "add") == 0) {
+            done = ipfs_pin_add(local_node->repo, cid->hash, cid->hash_length, mode);
+        } else {
+            done = ipfs_pin_remove(local_node->repo, cid->hash, cid->hash_length);
+        }
+        if (done) {
+            fprintf(stdout, "%s %s\n", strcmp(sub, "add") == 0 ? "pinned" : "unpinned", args->argv[i]);
+        } else {
+            fprintf(stderr, "Unable to %s %s\n", strcmp(sub, "add") == 0 ? "pin" : "unpin", args->argv[i]);
+            ret = 0;
+        }
+        ipfs_cid_free(cid);
+    }
+    ipfs_node_free(local_node);
+    return ret;
 }
@@ -215,6 +215,11 @@ int ipfs_repo_config_new(struct RepoConfig** config) {
 	if (retVal == 0)
 		return 0;
 
+	(*config)->lmdb.map_size = strdup("64MB");
+	(*config)->lmdb.sync_mode = strdup("full");
+	(*config)->lmdb.sync_interval = 30;
+	(*config)->lmdb.no_readahead = 0;
+
 	(*config)->filestore = libp2p_filestore_new();
 
 	retVal = repo_config_addresses_new(&((*config)->addresses));
@@ -244,6 +249,8 @@ int ipfs_repo_config_free(struct RepoConfig* config) {
 			repo_config_bootstrap_peers_free(config->bootstrap_peers);
 		if (config->datastore != NULL)
 			libp2p_datastore_free(config->datastore);
+		free(config->lmdb.map_size);
+		free(config->lmdb.sync_mode);
 		if (config->filestore != NULL)
 			libp2p_filestore_free(config->filestore);
 		if (config->addresses != NULL)
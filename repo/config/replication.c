@@ -14,6 +14,9 @@ struct ReplicationPeer* repo_config_replication_peer_new() {
 	if (rp != NULL) {
 		rp->lastConnect = 0;
 		rp->lastJournalTime = 0;
+		rp->lastJournalHash = NULL;
+		rp->lastJournalHashSize = 0;
+		rp->progressLoaded = 0;
 		rp->peer = NULL;
 	}
 	return rp;
@@ -28,6 +31,8 @@ int repo_config_replication_peer_free(struct ReplicationPeer* rp) {
 	if (rp != NULL) {
 		// we allocated the peer structure, so we must remove it
 		libp2p_peer_free(rp->peer);
+		if (rp->lastJournalHash != NULL)
+			free(rp->lastJournalHash);
 		free(rp);
 	}
 	return 1;
@@ -44,6 +49,7 @@ int repo_config_replication_new(struct Replication** replication) {
 		return 0;
 	struct Replication* out = *replication;
 	out->announce_minutes = 0;
+	out->reconcile = 0;
 	out->replication_peers = NULL;
 	return 1;
 }
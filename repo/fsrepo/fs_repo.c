@@ -7,6 +7,7 @@
 #include "libp2p/peer/peer.h"
 #include "libp2p/utils/vector.h"
 #include "ipfs/blocks/blockstore.h"
+#include "ipfs/cid/cid.h"
 #include "ipfs/datastore/ds_helper.h"
 #include "libp2p/db/datastore.h"
 #include "libp2p/db/filestore.h"
@@ -69,7 +70,11 @@ int repo_config_write_config_file(char* full_filename, struct RepoConfig* config
 	fprintf(out_file, "  \"Params\": null,\n");
 	fprintf(out_file, "  \"NoSync\": %s,\n", config->datastore->no_sync ? "true" : "false");
 	fprintf(out_file, "  \"HashOnRead\": %s,\n", config->datastore->hash_on_read ? "true" : "false");
-	fprintf(out_file, "  \"BloomFilterSize\": %d\n", config->datastore->bloom_filter_size);
+	fprintf(out_file, "  \"BloomFilterSize\": %d,\n", config->datastore->bloom_filter_size);
+	fprintf(out_file, "  \"MapSize\": \"%s\",\n", config->lmdb.map_size);
+	fprintf(out_file, "  \"SyncMode\": \"%s\",\n", config->lmdb.sync_mode);
+	fprintf(out_file, "  \"SyncInterval\": %d,\n", config->lmdb.sync_interval);
+	fprintf(out_file, "  \"NoReadahead\": %s\n", config->lmdb.no_readahead ? "true" : "false");
 	fprintf(out_file, " },\n \"Addresses\": {\n");
 	fprintf(out_file, "  \"Swarm\": [\n");
 	struct Libp2pLinkedList* current = config->addresses->swarm_head;
@@ -154,6 +159,16 @@ int ipfs_repo_fsrepo_new(const char* repo_path, struct RepoConfig* config, struc
 			strncpy((*repo)->path, repo_path, len);
 	}
 	// allocate other structures
+	(*repo)->gc = (struct FSRepoGc*)malloc(sizeof(struct FSRepoGc));
+	if ((*repo)->gc == NULL) {
+		free((*repo)->path);
+		free(*repo);
+		return 0;
+	}
+	pthread_mutex_init(&(*repo)->gc->lock, NULL);
+	pthread_cond_init(&(*repo)->gc->adds_done, NULL);
+	(*repo)->gc->adds = 0;
+	(*repo)->gc->written = NULL;
 	if (config != NULL)
 		(*repo)->config = config;
 	else {
@@ -176,6 +191,12 @@ int ipfs_repo_fsrepo_free(struct FSRepo* repo) {
 			free(repo->path);
 		if (repo->config != NULL)
 			ipfs_repo_config_free(repo->config);
+		if (repo->gc != NULL) {
+			pthread_mutex_destroy(&repo->gc->lock);
+			pthread_cond_destroy(&repo->gc->adds_done);
+			ipfs_cid_set_destroy(&repo->gc->written);
+			free(repo->gc);
+		}
 		free(repo);
 	}
 	return 1;
@@ -415,6 +436,19 @@ int fs_repo_open_config(struct FSRepo* repo) {
 	_get_json_int_value(data, tokens, num_tokens, curr_pos, "NoSync", &repo->config->datastore->no_sync);
 	_get_json_int_value(data, tokens, num_tokens, curr_pos, "HashOnRead", &repo->config->datastore->hash_on_read);
 	_get_json_int_value(data, tokens, num_tokens, curr_pos, "BloomFilterSize", &repo->config->datastore->bloom_filter_size);
+	// how LMDB is opened. Older config files don't have these, and keep the defaults.
+	char* lmdb_value = NULL;
+	if (_get_json_string_value(data, tokens, num_tokens, curr_pos, "MapSize", &lmdb_value)) {
+		free(repo->config->lmdb.map_size);
+		repo->config->lmdb.map_size = lmdb_value;
+	}
+	lmdb_value = NULL;
+	if (_get_json_string_value(data, tokens, num_tokens, curr_pos, "SyncMode", &lmdb_value)) {
+		free(repo->config->lmdb.sync_mode);
+		repo->config->lmdb.sync_mode = lmdb_value;
+	}
+	_get_json_int_value(data, tokens, num_tokens, curr_pos, "SyncInterval", &repo->config->lmdb.sync_interval);
+	_get_json_int_value(data, tokens, num_tokens, curr_pos, "NoReadahead", &repo->config->lmdb.no_readahead);
 
 	// get addresses. First is Swarm array, then Api, then Gateway
 	curr_pos = _find_token(data, tokens, num_tokens, curr_pos, "Addresses");
@@ -488,6 +522,7 @@ int fs_repo_open_config(struct FSRepo* repo) {
 		curr_pos++;
 		_get_json_int_value(data, tokens, num_tokens, curr_pos, "AnnounceMinutes", &repo->config->replication->announce_minutes);
 		_get_json_int_value(data, tokens, num_tokens, curr_pos, "Announce", &repo->config->replication->announce);
+		_get_json_int_value(data, tokens, num_tokens, curr_pos, "Reconcile", &repo->config->replication->reconcile);
 		// nodes list
 		int nodes_pos = _find_token(data, tokens, num_tokens, curr_pos, "Peers");
 		if (nodes_pos >= 0) {
@@ -541,13 +576,29 @@ int fs_repo_setup_lmdb_datastore(struct FSRepo* repo) {
  */
 int fs_repo_open_datastore(struct FSRepo* repo) {
 	int argc = 0;
-	char** argv = NULL;
+	char* argv[4];
+	char map_size[64];
+	char sync_mode[64];
+	char sync_interval[32];
+	char no_readahead[32];
 
 	if (strncmp(repo->config->datastore->type, "lmdb", 4) == 0) {
 		// this is a LightningDB. Open it.
 		int retVal = fs_repo_setup_lmdb_datastore(repo);
 		if (retVal == 0)
 			return 0;
+		if (repo->config->lmdb.map_size != NULL) {
+			snprintf(map_size, sizeof(map_size), "MapSize=%s", repo->config->lmdb.map_size);
+			argv[argc++] = map_size;
+		}
+		if (repo->config->lmdb.sync_mode != NULL) {
+			snprintf(sync_mode, sizeof(sync_mode), "SyncMode=%s", repo->config->lmdb.sync_mode);
+			argv[argc++] = sync_mode;
+		}
+		snprintf(sync_interval, sizeof(sync_interval), "SyncInterval=%d", repo->config->lmdb.sync_interval);
+		argv[argc++] = sync_interval;
+		snprintf(no_readahead, sizeof(no_readahead), "NoReadahead=%s", repo->config->lmdb.no_readahead ? "true" : "false");
+		argv[argc++] = no_readahead;
 	} else {
 		// add new datastore types here
 		return 0;
@@ -707,6 +758,63 @@ int fs_repo_write_config_file(char* path, struct RepoConfig* config) {
 	return retVal;
 }
 
+/***
+ * Begin adding content, which will be pinned once it is all written.
+ * A collection that begins after this waits for the add to end, because
+ * what was written before it began is not kept by it.
+ * @param fs_repo the repo
+ * @returns what to give to ipfs_repo_fsrepo_add_end
+ */
+int ipfs_repo_fsrepo_add_begin(const struct FSRepo* fs_repo) {
+	int started = 0;
+	if (fs_repo == NULL || fs_repo->gc == NULL)
+		return 0;
+	pthread_mutex_lock(&fs_repo->gc->lock);
+	// while a collection runs, everything written is kept anyway
+	if (fs_repo->gc->written == NULL) {
+		fs_repo->gc->adds++;
+		started = 1;
+	}
+	pthread_mutex_unlock(&fs_repo->gc->lock);
+	return started;
+}
+
+/***
+ * The content is pinned, or the add failed
+ * @param fs_repo the repo
+ * @param started what ipfs_repo_fsrepo_add_begin returned
+ */
+void ipfs_repo_fsrepo_add_end(const struct FSRepo* fs_repo, int started) {
+	if (!started || fs_repo == NULL || fs_repo->gc == NULL)
+		return;
+	pthread_mutex_lock(&fs_repo->gc->lock);
+	if (--fs_repo->gc->adds == 0)
+		pthread_cond_broadcast(&fs_repo->gc->adds_done);
+	pthread_mutex_unlock(&fs_repo->gc->lock);
+}
+
+/***
+ * Tell a running garbage collector that a block is being written, so it is kept.
+ * The collector holds the lock while it deletes a batch, so a block is either
+ * deleted before it is written again, or kept.
+ * @param fs_repo the repo
+ * @param hash the multihash of the block
+ * @param hash_length the length of hash
+ */
+void ipfs_repo_fsrepo_gc_keep(const struct FSRepo* fs_repo, const unsigned char* hash, size_t hash_length) {
+	if (fs_repo == NULL || fs_repo->gc == NULL)
+		return;
+	struct Cid cid;
+	cid.version = 0;
+	cid.codec = CID_DAG_PROTOBUF;
+	cid.hash = (unsigned char*)hash;
+	cid.hash_length = hash_length;
+	pthread_mutex_lock(&fs_repo->gc->lock);
+	if (fs_repo->gc->written != NULL && ipfs_cid_set_add(fs_repo->gc->written, &cid, 1) != 0)
+		libp2p_logger_error("fs_repo", "gc_keep: Unable to remember a block written during garbage collection.\n");
+	pthread_mutex_unlock(&fs_repo->gc->lock);
+}
+
 /***
  * Write a block to the datastore and blockstore
  * @param block the block to write
@@ -1,13 +1,14 @@
 #include <stdlib.h>
 
 #include "ipfs/repo/fsrepo/lmdb_cursor.h"
+#include "ipfs/util/memory.h"
 
 /**
  * Create a new lmdb_trans_cursor struct
  * @returns a newly allocated trans_cursor struct
  */
 struct lmdb_trans_cursor* lmdb_trans_cursor_new() {
-	struct lmdb_trans_cursor* out = (struct lmdb_trans_cursor*) malloc(sizeof(struct lmdb_trans_cursor));
+	struct lmdb_trans_cursor* out = (struct lmdb_trans_cursor*) ipfs_util_memory_alloc(MEMORY_TAG_REPO, sizeof(struct lmdb_trans_cursor));
 	if (out != NULL) {
 		out->environment = NULL;
 		out->cursor = NULL;
@@ -25,7 +26,7 @@ struct lmdb_trans_cursor* lmdb_trans_cursor_new() {
  */
 int lmdb_trans_cursor_free(struct lmdb_trans_cursor* in) {
 	if (in != NULL) {
-		free(in);
+		ipfs_util_memory_free(MEMORY_TAG_REPO, in);
 	}
 	return 1;
 }
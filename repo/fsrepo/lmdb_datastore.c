@@ -4,6 +4,8 @@
  * of the multihash key if the file exists on disk.
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -17,13 +19,208 @@
 #include "libp2p/db/datastore.h"
 #include "ipfs/repo/fsrepo/lmdb_datastore.h"
 #include "ipfs/repo/fsrepo/journalstore.h"
+#include "ipfs/repo/fsrepo/pinstore.h"
+#include "ipfs/util/memory.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
 #include "libp2p/db/datastore.h"
 #include "varint.h"
 
+// the transactions this thread has open. The outermost holds the resize lock.
+static __thread int lmdb_txn_depth = 0;
+static __thread int lmdb_txn_writes = 0;
+
+/***
+ * Check if the map is close to full, while a transaction is still open, so it can't be resized
+ * @param db_context the context
+ * @returns true(1) if more than 3/4 of the map is used
+ */
+static int repo_fsrepo_lmdb_map_nearly_full(struct lmdb_context* db_context) {
+	MDB_envinfo info;
+	MDB_stat stat;
+	if (mdb_env_info(db_context->db_environment, &info) != 0 || mdb_env_stat(db_context->db_environment, &stat) != 0)
+		return 0;
+	size_t used = (info.me_last_pgno + 1) * (size_t)stat.ms_psize;
+	return used > db_context->map_size / 4 * 3;
+}
+
+/***
+ * Double the size of the map, up to map_size_max. Waits for the transactions
+ * of the other threads to finish, but not forever. If they don't, the next
+ * transaction tries again.
+ * @param db_context the context
+ */
+static void repo_fsrepo_lmdb_grow(struct lmdb_context* db_context) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += 1;
+	if (pthread_rwlock_timedwrlock(&db_context->resize_lock, &deadline) != 0) {
+		libp2p_logger_debug("lmdb_datastore", "Transactions still open, the map will grow later.\n");
+		return;
+	}
+	// another thread may have grown it while this one waited
+	if (__atomic_load_n(&db_context->map_full, __ATOMIC_RELAXED) || repo_fsrepo_lmdb_map_nearly_full(db_context)) {
+		size_t new_size = db_context->map_size * 2;
+		if (new_size > db_context->map_size_max)
+			new_size = db_context->map_size_max;
+		if (new_size <= db_context->map_size) {
+			if (__atomic_load_n(&db_context->map_full, __ATOMIC_RELAXED))
+				libp2p_logger_error("lmdb_datastore", "The datastore is full at %lu bytes. Raise StorageMax to let it grow.\n", (unsigned long)db_context->map_size);
+		} else if (mdb_env_set_mapsize(db_context->db_environment, new_size) != 0) {
+			libp2p_logger_error("lmdb_datastore", "Unable to grow the map to %lu bytes.\n", (unsigned long)new_size);
+		} else {
+			libp2p_logger_debug("lmdb_datastore", "Map grew from %lu to %lu bytes.\n", (unsigned long)db_context->map_size, (unsigned long)new_size);
+			db_context->map_size = new_size;
+			__atomic_add_fetch(&db_context->map_resizes, 1, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&db_context->map_full, 0, __ATOMIC_RELAXED);
+	}
+	pthread_rwlock_unlock(&db_context->resize_lock);
+}
+
+/***
+ * A transaction ended. When it is this thread's last, let go of the resize
+ * lock, and grow the map if the transactions have written it close to full.
+ * @param env the database environment
+ */
+static void repo_fsrepo_lmdb_txn_done(MDB_env* env) {
+	if (--lmdb_txn_depth > 0)
+		return;
+	struct lmdb_context* db_context = (struct lmdb_context*) mdb_env_get_userctx(env);
+	if (db_context == NULL)
+		return;
+	int grow = __atomic_load_n(&db_context->map_full, __ATOMIC_RELAXED)
+			|| (lmdb_txn_writes && repo_fsrepo_lmdb_map_nearly_full(db_context));
+	pthread_rwlock_unlock(&db_context->resize_lock);
+	if (grow)
+		repo_fsrepo_lmdb_grow(db_context);
+}
+
+/***
+ * Start a transaction, counting it for the metrics
+ * @param env the database environment
+ * @param parent the parent transaction, can be NULL
+ * @param flags flags for mdb_txn_begin
+ * @param txn the new transaction
+ * @returns what mdb_txn_begin returned, 0 on success
+ */
+int repo_fsrepo_lmdb_txn_begin(MDB_env* env, MDB_txn* parent, unsigned int flags, MDB_txn** txn) {
+	if (lmdb_txn_depth++ == 0) {
+		struct lmdb_context* db_context = (struct lmdb_context*) mdb_env_get_userctx(env);
+		if (db_context != NULL)
+			pthread_rwlock_rdlock(&db_context->resize_lock);
+		lmdb_txn_writes = 0;
+	}
+	if (!(flags & MDB_RDONLY))
+		lmdb_txn_writes = 1;
+	int retVal = mdb_txn_begin(env, parent, flags, txn);
+	ipfs_util_metrics_add(retVal == 0 ? METRICS_LMDB_TXN_BEGIN : METRICS_LMDB_TXN_FAILED, 1);
+	if (retVal != 0)
+		repo_fsrepo_lmdb_txn_done(env);
+	return retVal;
+}
+
+/***
+ * Commit a transaction, timing it for the metrics
+ * @param txn the transaction
+ * @returns what mdb_txn_commit returned, 0 on success
+ */
+int repo_fsrepo_lmdb_txn_commit(MDB_txn* txn) {
+	IPFS_TRACE_SPAN("mdb_txn_commit");
+	MDB_env* env = mdb_txn_env(txn);
+	uint64_t start = ipfs_util_metrics_now();
+	int retVal = mdb_txn_commit(txn);
+	ipfs_util_metrics_observe(METRICS_LMDB_COMMIT_SECONDS, start);
+	ipfs_util_metrics_add(retVal == 0 ? METRICS_LMDB_TXN_COMMIT : METRICS_LMDB_TXN_FAILED, 1);
+	if (retVal == MDB_MAP_FULL) {
+		struct lmdb_context* db_context = (struct lmdb_context*) mdb_env_get_userctx(env);
+		if (db_context != NULL)
+			__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
+	}
+	repo_fsrepo_lmdb_txn_done(env);
+	return retVal;
+}
+
+/***
+ * Abort a transaction
+ * @param txn the transaction
+ */
+void repo_fsrepo_lmdb_txn_abort(MDB_txn* txn) {
+	MDB_env* env = mdb_txn_env(txn);
+	mdb_txn_abort(txn);
+	repo_fsrepo_lmdb_txn_done(env);
+}
+
+/***
+ * Parse a size such as "64MB", "10GB" or "512KiB". The units are powers of 1024.
+ * @param in the size
+ * @param result the size in bytes
+ * @returns true(1) on success, false(0) if it is not a size
+ */
+int repo_fsrepo_lmdb_parse_size(const char* in, size_t* result) {
+	if (in == NULL)
+		return 0;
+	char* end = NULL;
+	errno = 0;
+	unsigned long long value = strtoull(in, &end, 10);
+	if (end == in || errno != 0)
+		return 0;
+	int shift = 0;
+	switch (*end) {
+		case 'K': case 'k': shift = 10; end++; break;
+		case 'M': case 'm': shift = 20; end++; break;
+		case 'G': case 'g': shift = 30; end++; break;
+		case 'T': case 't': shift = 40; end++; break;
+	}
+	if (shift > 0 && *end == 'i')
+		end++;
+	if (*end == 'B' || *end == 'b')
+		end++;
+	if (*end != 0 || value > (SIZE_MAX >> shift))
+		return 0;
+	*result = (size_t)(value << shift);
+	return 1;
+}
+
+/***
+ * Flush what was committed to disk. Needed when the commits don't.
+ * @param db_context the context
+ */
+static void repo_fsrepo_lmdb_sync(struct lmdb_context* db_context) {
+	pthread_rwlock_rdlock(&db_context->resize_lock);
+	int retVal = mdb_env_sync(db_context->db_environment, 1);
+	pthread_rwlock_unlock(&db_context->resize_lock);
+	if (retVal != 0)
+		libp2p_logger_error("lmdb_datastore", "Unable to sync the datastore. Error code %d.\n", retVal);
+}
+
+/***
+ * Sync every sync_interval seconds until told to stop
+ * @param ctx the lmdb_context
+ * @returns NULL
+ */
+static void* repo_fsrepo_lmdb_sync_thread(void* ctx) {
+	struct lmdb_context* db_context = (struct lmdb_context*) ctx;
+	pthread_mutex_lock(&db_context->sync_lock);
+	while (db_context->sync_running) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += db_context->sync_interval;
+		pthread_cond_timedwait(&db_context->sync_cond, &db_context->sync_lock, &deadline);
+		if (!db_context->sync_running)
+			break;
+		pthread_mutex_unlock(&db_context->sync_lock);
+		repo_fsrepo_lmdb_sync(db_context);
+		pthread_mutex_lock(&db_context->sync_lock);
+	}
+	pthread_mutex_unlock(&db_context->sync_lock);
+	return NULL;
+}
+
 /**
  * Build a "value" section for a datastore record
  * @param record the data
- * @param result the data (usually a base32 of the cid hash) + the timestamp as varint
+ * @param result the data (usually a base32 of the cid hash) + the timestamp as varint, freed with ipfs_util_memory_free and MEMORY_TAG_REPO
  * @param result_size the size of the result
  * @returns true(1) on success, otherwise 0
  */
@@ -35,7 +232,7 @@ int repo_fsrepo_lmdb_encode_record(struct DatastoreRecord* record, uint8_t **res
 		return 0;
 	}
 	// make new structure
-	*result = (uint8_t *) malloc(num_bytes + record->value_size);
+	*result = (uint8_t *) ipfs_util_memory_alloc(MEMORY_TAG_REPO, num_bytes + record->value_size);
 	if (*result == NULL) {
 		return 0;
 	}
@@ -140,17 +337,189 @@ int repo_fsrepo_lmdb_get(const unsigned char* key, size_t key_size, struct Datas
 		return 0;
 	}
 
-	// open transaction
-	if (mdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &mdb_txn) != 0)
+	// open transaction (nested transactions cannot be read-only)
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &mdb_txn) != 0)
 		return 0;
 
 	int retVal = repo_fsrepo_lmdb_get_with_transaction(key, key_size, record, mdb_txn, db_context->datastore_db);
 
-	mdb_txn_commit(mdb_txn);
+	repo_fsrepo_lmdb_txn_commit(mdb_txn);
 
 	return retVal;
 }
 
+/***
+ * Retrieve many records from the database using one read transaction
+ * @param keys the keys to look for
+ * @param key_sizes the length of each key
+ * @param num_keys the number of keys (and key sizes)
+ * @param records an array of num_keys pointers. Each will be the record, or NULL if the key was not found
+ * @param datastore where to look for the data
+ * @returns the number of keys found, or -1 on error
+ */
+int repo_fsrepo_lmdb_get_many(const unsigned char** keys, const size_t* key_sizes, int num_keys, struct DatastoreRecord** records, const struct Datastore* datastore) {
+	MDB_txn* mdb_txn;
+
+	for(int i = 0; i < num_keys; i++)
+		records[i] = NULL;
+
+	if (datastore == NULL || datastore->datastore_context == NULL) {
+		libp2p_logger_error("lmdb_datastore", "get_many: datastore not initialized.\n");
+		return -1;
+	}
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+	if (db_context->db_environment == NULL) {
+		libp2p_logger_error("lmdb_datastore", "get_many: datastore environment not initialized.\n");
+		return -1;
+	}
+
+	// open transaction (nested transactions cannot be read-only)
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &mdb_txn) != 0)
+		return -1;
+
+	int found = 0;
+	for(int i = 0; i < num_keys; i++) {
+		if (repo_fsrepo_lmdb_get_with_transaction(keys[i], key_sizes[i], &records[i], mdb_txn, db_context->datastore_db))
+			found++;
+		else
+			records[i] = NULL;
+	}
+
+	repo_fsrepo_lmdb_txn_abort(mdb_txn);
+
+	return found;
+}
+
+/***
+ * Retrieve the records that follow a key, in key order, using one read transaction.
+ * Meant for going through the whole datastore a batch at a time.
+ * @param after the key to start after, or NULL to start at the beginning
+ * @param after_size the length of after
+ * @param records an array of max pointers, filled with the records found
+ * @param max the most records to retrieve
+ * @param datastore where to look for the data
+ * @returns the number of records found, which is less than max at the end, or -1 on error
+ */
+int repo_fsrepo_lmdb_get_after(const unsigned char* after, size_t after_size, struct DatastoreRecord** records, int max, const struct Datastore* datastore) {
+	MDB_txn* mdb_txn;
+	MDB_cursor* cursor;
+	MDB_val db_key;
+	MDB_val db_value;
+
+	if (datastore == NULL || datastore->datastore_context == NULL) {
+		libp2p_logger_error("lmdb_datastore", "get_after: datastore not initialized.\n");
+		return -1;
+	}
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &mdb_txn) != 0)
+		return -1;
+	if (mdb_cursor_open(mdb_txn, *db_context->datastore_db, &cursor) != 0) {
+		repo_fsrepo_lmdb_txn_abort(mdb_txn);
+		return -1;
+	}
+
+	int rc;
+	if (after == NULL) {
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_FIRST);
+	} else {
+		db_key.mv_size = after_size;
+		db_key.mv_data = (void*)after;
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_SET_RANGE);
+		// it may have been deleted since, so it is only skipped if it is still there
+		if (rc == 0 && db_key.mv_size == after_size && memcmp(db_key.mv_data, after, after_size) == 0)
+			rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT_NODUP);
+	}
+	int found = 0;
+	while (rc == 0 && found < max) {
+		if (!repo_fsrepo_lmdb_build_record(&db_key, &db_value, &records[found]) || records[found] == NULL) {
+			rc = -1;
+			break;
+		}
+		found++;
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT_NODUP);
+	}
+	mdb_cursor_close(cursor);
+	repo_fsrepo_lmdb_txn_abort(mdb_txn);
+
+	if (rc != 0 && rc != MDB_NOTFOUND && found < max) {
+		libp2p_logger_error("lmdb_datastore", "get_after: Unable to read the datastore. Error code %d.\n", rc);
+		for(int i = 0; i < found; i++) {
+			libp2p_datastore_record_free(records[i]);
+			records[i] = NULL;
+		}
+		return -1;
+	}
+	return found;
+}
+
+/***
+ * Delete many records, and their journal entries, in one write transaction
+ * @param records the records to delete. The key and timestamp are used.
+ * @param num_records the number of records
+ * @param datastore the datastore
+ * @returns the number of records deleted, or -1 on error, when nothing is deleted
+ */
+int repo_fsrepo_lmdb_delete_many(struct DatastoreRecord** records, int num_records, const struct Datastore* datastore) {
+	MDB_txn* mdb_txn;
+	MDB_val db_key;
+	struct lmdb_trans_cursor *journalstore_cursor = NULL;
+	struct JournalRecord journal_record;
+
+	if (datastore == NULL || datastore->datastore_context == NULL) {
+		libp2p_logger_error("lmdb_datastore", "delete_many: datastore not initialized.\n");
+		return -1;
+	}
+	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_datastore", "delete_many: Unable to create transaction.\n");
+		return -1;
+	}
+	lmdb_journalstore_cursor_open(db_context, &journalstore_cursor, mdb_txn);
+	if (journalstore_cursor == NULL) {
+		repo_fsrepo_lmdb_txn_abort(mdb_txn);
+		return -1;
+	}
+
+	int deleted = 0;
+	for(int i = 0; i < num_records; i++) {
+		db_key.mv_size = records[i]->key_size;
+		db_key.mv_data = records[i]->key;
+		int rc = mdb_del(mdb_txn, *db_context->datastore_db, &db_key, NULL);
+		if (rc == MDB_NOTFOUND)
+			continue;
+		if (rc != 0) {
+			libp2p_logger_error("lmdb_datastore", "delete_many: Unable to delete record. Error code %d.\n", rc);
+			deleted = -1;
+			break;
+		}
+		// the journal is keyed by the timestamp and the hash
+		journal_record.timestamp = records[i]->timestamp;
+		journal_record.hash = records[i]->key;
+		journal_record.hash_size = records[i]->key_size;
+		if (!lmdb_journalstore_journal_delete(journalstore_cursor, &journal_record)) {
+			deleted = -1;
+			break;
+		}
+		deleted++;
+	}
+	lmdb_journalstore_cursor_close(journalstore_cursor, 0);
+
+	if (deleted < 0) {
+		repo_fsrepo_lmdb_txn_abort(mdb_txn);
+		return -1;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(mdb_txn) != 0) {
+		libp2p_logger_error("lmdb_datastore", "delete_many: transaction commit failed.\n");
+		return -1;
+	}
+	return deleted;
+}
+
 /**
  * Open the database and create a new transaction
  * @param mdb_env the database handle
@@ -160,7 +529,7 @@ int repo_fsrepo_lmdb_get(const unsigned char* key, size_t key_size, struct Datas
  */
 int lmdb_datastore_create_transaction(struct lmdb_context *db_context, MDB_txn **mdb_txn) {
 	// open transaction
-	int retVal = mdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, mdb_txn);
+	int retVal = repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, mdb_txn);
 	if (retVal != 0) {
 		libp2p_logger_error("lmdb_datastore", "Unable to create transaction. Error code %d.\n", retVal);
 		return 0;
@@ -169,15 +538,13 @@ int lmdb_datastore_create_transaction(struct lmdb_context *db_context, MDB_txn *
 }
 
 /**
- * Write (or update) data in the datastore with the specified key
- * @param key the key
- * @param key_size the length of the key
- * @param data the data to be written
- * @param data_size the length of the data to be written
+ * Write (or update) data in the datastore with the specified key, in one transaction
+ * @param datastore_record the record to write
  * @param datastore the datastore to write to
+ * @param db_context the datastore's context
  * @returns true(1) on success
  */
-int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct Datastore* datastore) {
+static int repo_fsrepo_lmdb_put_once(struct DatastoreRecord* datastore_record, const struct Datastore* datastore, struct lmdb_context* db_context) {
 	int retVal;
 	struct MDB_txn *child_transaction;
 	struct MDB_val datastore_key;
@@ -186,16 +553,6 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 	struct JournalRecord *journalstore_record = NULL;
 	struct lmdb_trans_cursor *journalstore_cursor = NULL;
 
-	if (datastore == NULL || datastore->datastore_context == NULL)
-		return 0;
-
-	struct lmdb_context *db_context = (struct lmdb_context*)datastore->datastore_context;
-
-	if (db_context->db_environment == NULL) {
-		libp2p_logger_error("lmdb_datastore", "put: invalid datastore handle.\n");
-		return 0;
-	}
-
 	// open a transaction to the databases
 	if (!lmdb_datastore_create_transaction(db_context, &child_transaction)) {
 		libp2p_logger_error("lmdb_datastore", "put: Unable to create db transaction.\n");
@@ -206,6 +563,7 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 	lmdb_journalstore_cursor_open(datastore->datastore_context, &journalstore_cursor, child_transaction);
 	if (journalstore_cursor == NULL) {
 		libp2p_logger_error("lmdb_datastore", "put: Unable to allocate memory for journalstore cursor.\n");
+		repo_fsrepo_lmdb_txn_abort(child_transaction);
 		return 0;
 	}
 
@@ -218,16 +576,27 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 		}
 		// build the journalstore_record with the search criteria
 		journalstore_record = lmdb_journal_record_new();
-		journalstore_record->hash_size = datastore_record->key_size;
-		journalstore_record->hash = malloc(datastore_record->key_size);
-		if (journalstore_record->hash == NULL) {
+		if (journalstore_record != NULL) {
+			journalstore_record->hash_size = datastore_record->key_size;
+			journalstore_record->hash = malloc(datastore_record->key_size);
+		}
+		if (journalstore_record == NULL || journalstore_record->hash == NULL) {
 			libp2p_logger_error("lmdb_datastore", "put: Unable to allocate memory for key.\n");
+			lmdb_journal_record_free(journalstore_record);
+			lmdb_journalstore_cursor_close(journalstore_cursor, 0);
+			repo_fsrepo_lmdb_txn_abort(child_transaction);
+			libp2p_datastore_record_free(existingRecord);
 			return 0;
 		}
 		memcpy(journalstore_record->hash, datastore_record->key, datastore_record->key_size);
-		journalstore_record->timestamp = datastore_record->timestamp;
+		// the journal is keyed by what is currently stored
+		journalstore_record->timestamp = existingRecord->timestamp;
 		// look up the corresponding journalstore record for possible updating
-		lmdb_journalstore_get_record(db_context, journalstore_cursor, &journalstore_record);
+		if (!lmdb_journalstore_get_record(db_context, journalstore_cursor, &journalstore_record)) {
+			// not in the journal, it will be added below
+			lmdb_journal_record_free(journalstore_record);
+			journalstore_record = NULL;
+		}
 	}
 
 	// Put in the timestamp if it isn't there already (or is newer)
@@ -258,17 +627,21 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 		// Successfully added the datastore record. Now work with the journalstore.
 		if (journalstore_record != NULL) {
 			if (journalstore_record->timestamp != datastore_record->timestamp) {
-				// we need to update
+				// the timestamp is part of the key, so move the record
+				lmdb_journalstore_journal_delete(journalstore_cursor, journalstore_record);
 				journalstore_record->timestamp = datastore_record->timestamp;
-				retVal = lmdb_journalstore_cursor_put(journalstore_cursor, journalstore_record);
-				lmdb_journalstore_cursor_close(journalstore_cursor, 0);
-				lmdb_journal_record_free(journalstore_record);
+				retVal = lmdb_journalstore_journal_add(journalstore_cursor, journalstore_record);
+			} else {
+				retVal = 1;
 			}
+			lmdb_journalstore_cursor_close(journalstore_cursor, 0);
+			lmdb_journal_record_free(journalstore_record);
 		} else {
 			// add it to the journalstore
 			journalstore_record = lmdb_journal_record_new();
-			journalstore_record->hash = (uint8_t*) malloc(datastore_record->key_size);
-			if (journalstore_record->hash == NULL) {
+			if (journalstore_record != NULL)
+				journalstore_record->hash = (uint8_t*) malloc(datastore_record->key_size);
+			if (journalstore_record == NULL || journalstore_record->hash == NULL) {
 				libp2p_logger_error("lmdb_datastore", "Unable to allocate memory to add record to journalstore.\n");
 				lmdb_journalstore_cursor_close(journalstore_cursor, 0);
 				lmdb_journal_record_free(journalstore_record);
@@ -291,90 +664,244 @@ int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct
 		if (retVal == MDB_KEYEXIST) {
 			// duplicate key.. Is this an error?
 		} else {
+			if (retVal == MDB_MAP_FULL)
+				__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
 			libp2p_logger_error("lmdb_datastore", "mdb_put returned %d.\n", retVal);
 			retVal = 0;
 		}
 	}
 
 	// cleanup
-	if (mdb_txn_commit(child_transaction) != 0) {
+	if (repo_fsrepo_lmdb_txn_commit(child_transaction) != 0) {
 		libp2p_logger_error("lmdb_datastore", "lmdb_put: transaction commit failed.\n");
+		retVal = 0;
 	}
-	free(record);
+	ipfs_util_memory_free(MEMORY_TAG_REPO, record);
 	libp2p_datastore_record_free(existingRecord);
 	return retVal;
 }
 
+/**
+ * Write (or update) data in the datastore with the specified key. If the map
+ * was full, it grows when the transaction ends, and the write is tried again.
+ * @param datastore_record the record to write
+ * @param datastore the datastore to write to
+ * @returns true(1) on success
+ */
+int repo_fsrepo_lmdb_put(struct DatastoreRecord* datastore_record, const struct Datastore* datastore) {
+	if (datastore == NULL || datastore->datastore_context == NULL)
+		return 0;
+
+	struct lmdb_context *db_context = (struct lmdb_context*)datastore->datastore_context;
+
+	if (db_context->db_environment == NULL) {
+		libp2p_logger_error("lmdb_datastore", "put: invalid datastore handle.\n");
+		return 0;
+	}
+
+	int resizes = __atomic_load_n(&db_context->map_resizes, __ATOMIC_RELAXED);
+	int retVal = repo_fsrepo_lmdb_put_once(datastore_record, datastore, db_context);
+	if (retVal == 0 && __atomic_load_n(&db_context->map_resizes, __ATOMIC_RELAXED) != resizes)
+		retVal = repo_fsrepo_lmdb_put_once(datastore_record, datastore, db_context);
+	return retVal;
+}
+
+// the flags for each SyncMode. Past "full", a crash can lose the commits since the last sync.
+static const struct {
+	const char* name;
+	unsigned int flags;
+} lmdb_sync_modes[] = {
+	{ "full", 0 }, // both the data and the meta page are synced on every commit
+	{ "nometasync", MDB_NOMETASYNC }, // the meta page is synced with the next commit
+	{ "nosync", MDB_NOSYNC }, // nothing is synced on commit
+	{ "writemap", MDB_WRITEMAP | MDB_MAPASYNC }, // writes go straight to the map, flushed by the OS
+};
+
+/***
+ * Free the context of a datastore that failed to open, or was closed
+ * @param db_context the context
+ */
+static void repo_fsrepo_lmdb_context_free(struct lmdb_context* db_context) {
+	if (db_context->db_environment != NULL)
+		mdb_env_close(db_context->db_environment);
+	free(db_context->datastore_db);
+	free(db_context->journal_db);
+	free(db_context->journal_peers_db);
+	free(db_context->pins_db);
+	free(db_context->pin_refs_db);
+	free(db_context->pins_replicated_db);
+	pthread_rwlock_destroy(&db_context->resize_lock);
+	pthread_mutex_destroy(&db_context->sync_lock);
+	pthread_cond_destroy(&db_context->sync_cond);
+	free(db_context);
+}
+
+/***
+ * Read the parameters given to repo_fsrepro_lmdb_open
+ * @param argc the number of parameters
+ * @param argv the parameters, each "Name=value"
+ * @param db_context where to put the map size and sync interval
+ * @param flags where to add the flags for mdb_env_open
+ * @returns true(1) on success, false(0) if a value could not be understood
+ */
+static int repo_fsrepo_lmdb_parse_params(int argc, char** argv, struct lmdb_context* db_context, unsigned int* flags) {
+	for(int i = 0; i < argc; i++) {
+		char* value = strchr(argv[i], '=');
+		if (value == NULL) {
+			libp2p_logger_error("lmdb_datastore", "open: parameter %s has no value.\n", argv[i]);
+			return 0;
+		}
+		size_t name_length = value - argv[i];
+		value++;
+		if (name_length == 7 && strncmp(argv[i], "MapSize", 7) == 0) {
+			if (!repo_fsrepo_lmdb_parse_size(value, &db_context->map_size) || db_context->map_size == 0) {
+				libp2p_logger_error("lmdb_datastore", "open: MapSize %s is not a size.\n", value);
+				return 0;
+			}
+		} else if (name_length == 8 && strncmp(argv[i], "SyncMode", 8) == 0) {
+			size_t mode = 0;
+			size_t num_modes = sizeof(lmdb_sync_modes) / sizeof(lmdb_sync_modes[0]);
+			while (mode < num_modes && strcmp(value, lmdb_sync_modes[mode].name) != 0)
+				mode++;
+			if (mode == num_modes) {
+				libp2p_logger_error("lmdb_datastore", "open: SyncMode %s is not one of full, nometasync, nosync or writemap.\n", value);
+				return 0;
+			}
+			*flags |= lmdb_sync_modes[mode].flags;
+		} else if (name_length == 12 && strncmp(argv[i], "SyncInterval", 12) == 0) {
+			db_context->sync_interval = atoi(value);
+		} else if (name_length == 11 && strncmp(argv[i], "NoReadahead", 11) == 0) {
+			if (strcmp(value, "true") == 0 || strcmp(value, "1") == 0)
+				*flags |= MDB_NORDAHEAD;
+		} else {
+			libp2p_logger_debug("lmdb_datastore", "open: ignoring unknown parameter %s.\n", argv[i]);
+		}
+	}
+	return 1;
+}
+
 /**
  * Open an lmdb database with the given parameters.
- * Note: for now, the parameters are not used
+ * The parameters are "Name=value" strings:
+ *   MapSize: the size the map starts at, i.e. "64MB". It doubles when nearly full, up to the datastore's StorageMax
+ *   SyncMode: full, nometasync, nosync or writemap (see lmdb_sync_modes). The datastore's NoSync is the same as nosync
+ *   SyncInterval: with a SyncMode other than full, seconds between syncs to disk. 0 for none
+ *   NoReadahead: true to turn off the OS readahead, which only helps sequential reads
  * @param argc number of parameters in the following array
  * @param argv an array of parameters
  * @param datastore the datastore struct
  * @returns true(1) on success, false(0) otherwise
  */
 int repo_fsrepro_lmdb_open(int argc, char** argv, struct Datastore* datastore) {
-	// create environment
-	struct MDB_env* mdb_env;
-	if (mdb_env_create(&mdb_env) < 0) {
-		mdb_env_close(mdb_env);
+	struct lmdb_context *db_context = (struct lmdb_context *) malloc(sizeof(struct lmdb_context));
+	if (db_context == NULL)
+		return 0;
+	memset(db_context, 0, sizeof(struct lmdb_context));
+	pthread_rwlockattr_t resize_attr;
+	pthread_rwlockattr_init(&resize_attr);
+#ifdef __GLIBC__
+	// a steady stream of transactions would otherwise keep the map from ever growing
+	pthread_rwlockattr_setkind_np(&resize_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&db_context->resize_lock, &resize_attr);
+	pthread_rwlockattr_destroy(&resize_attr);
+	pthread_mutex_init(&db_context->sync_lock, NULL);
+	pthread_cond_init(&db_context->sync_cond, NULL);
+	db_context->map_size = REPO_FSREPO_LMDB_MAP_SIZE;
+	db_context->sync_interval = REPO_FSREPO_LMDB_SYNC_INTERVAL;
+
+	unsigned int flags = 0;
+	if (!repo_fsrepo_lmdb_parse_params(argc, argv, db_context, &flags)) {
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
+	if (datastore->no_sync && !(flags & (MDB_NOMETASYNC | MDB_WRITEMAP)))
+		flags |= MDB_NOSYNC;
+	if (!repo_fsrepo_lmdb_parse_size(datastore->storage_max, &db_context->map_size_max)
+			|| db_context->map_size_max < db_context->map_size)
+		db_context->map_size_max = db_context->map_size;
+	db_context->env_flags = flags;
 
-	// at most, 2 databases will be opened. The datastore and the journal.
-	MDB_dbi dbs = 2;
-	if (mdb_env_set_maxdbs(mdb_env, dbs) != 0) {
-		mdb_env_close(mdb_env);
+	// create environment
+	if (mdb_env_create(&db_context->db_environment) != 0) {
+		db_context->db_environment = NULL;
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
-
-	// open the environment
-	if (mdb_env_open(mdb_env, datastore->path, 0, S_IRWXU) < 0) {
-		mdb_env_close(mdb_env);
+	MDB_env* mdb_env = db_context->db_environment;
+	mdb_env_set_userctx(mdb_env, db_context);
+
+	// at most, 8 databases will be opened. The datastore, the journal, the
+	// replication progress of the journal, the pins, the index of the recursive
+	// pins, the pins made for replicated blocks, and the original journal and
+	// the mark of a repo from before pins (only while upgrading)
+	MDB_dbi dbs = 8;
+	if (mdb_env_set_maxdbs(mdb_env, dbs) != 0 || mdb_env_set_mapsize(mdb_env, db_context->map_size) != 0) {
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
 
-	struct lmdb_context *db_context = (struct lmdb_context *) malloc(sizeof(struct lmdb_context));
-	if (db_context == NULL) {
-		mdb_env_close(mdb_env);
+	// open the environment
+	if (mdb_env_open(mdb_env, datastore->path, flags, S_IRWXU) != 0) {
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
-	datastore->datastore_context = (void*) db_context;
-	db_context->db_environment = (void*)mdb_env;
-	db_context->datastore_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
-	if (db_context->datastore_db == NULL) {
-		mdb_env_close(mdb_env);
-		free(db_context);
-		return 0;
+	// a map that grew before is bigger than what was asked for
+	MDB_envinfo info;
+	if (mdb_env_info(mdb_env, &info) == 0 && info.me_mapsize > db_context->map_size) {
+		db_context->map_size = info.me_mapsize;
+		if (db_context->map_size_max < db_context->map_size)
+			db_context->map_size_max = db_context->map_size;
 	}
+
+	db_context->datastore_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
 	db_context->journal_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
-	if (db_context->journal_db == NULL) {
-		free(db_context->datastore_db);
-		free(db_context);
-		mdb_env_close(mdb_env);
+	db_context->journal_peers_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
+	db_context->pins_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
+	db_context->pin_refs_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
+	db_context->pins_replicated_db = (MDB_dbi*) malloc(sizeof(MDB_dbi));
+	if (db_context->datastore_db == NULL || db_context->journal_db == NULL || db_context->journal_peers_db == NULL
+			|| db_context->pins_db == NULL || db_context->pin_refs_db == NULL || db_context->pins_replicated_db == NULL) {
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
 
-	// open the 2 databases
-	if (mdb_txn_begin(mdb_env, NULL, 0, &db_context->current_transaction) != 0) {
-		mdb_env_close(mdb_env);
-		db_context->db_environment = NULL;
-		return 0;
-	}
-	if (mdb_dbi_open(db_context->current_transaction, "DATASTORE", MDB_DUPSORT | MDB_CREATE, db_context->datastore_db ) != 0) {
-		mdb_txn_abort(db_context->current_transaction);
-		mdb_env_close(mdb_env);
-		db_context->db_environment = NULL;
+	// open the databases
+	if (repo_fsrepo_lmdb_txn_begin(mdb_env, NULL, 0, &db_context->current_transaction) != 0) {
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
-	if (mdb_dbi_open(db_context->current_transaction, "JOURNALSTORE", MDB_DUPSORT | MDB_CREATE, db_context->journal_db) != 0) {
-		mdb_txn_abort(db_context->current_transaction);
-		mdb_env_close(mdb_env);
-		db_context->db_environment = NULL;
+	// a repo from before pins has blocks, but nothing to keep them
+	MDB_dbi existing_pins;
+	int pins_created = mdb_dbi_open(db_context->current_transaction, PINSTORE_TABLE, 0, &existing_pins) == MDB_NOTFOUND;
+	if (mdb_dbi_open(db_context->current_transaction, "DATASTORE", MDB_DUPSORT | MDB_CREATE, db_context->datastore_db ) != 0
+			// journalstore keys are (timestamp, hash), so they are unique and no DUPSORT is needed
+			|| mdb_dbi_open(db_context->current_transaction, JOURNALSTORE_TABLE, MDB_CREATE, db_context->journal_db) != 0
+			|| mdb_dbi_open(db_context->current_transaction, JOURNALSTORE_PEERS_TABLE, MDB_CREATE, db_context->journal_peers_db) != 0
+			|| mdb_dbi_open(db_context->current_transaction, PINSTORE_TABLE, MDB_CREATE, db_context->pins_db) != 0
+			|| mdb_dbi_open(db_context->current_transaction, PINSTORE_REFS_TABLE, MDB_DUPSORT | MDB_CREATE, db_context->pin_refs_db) != 0
+			|| mdb_dbi_open(db_context->current_transaction, PINSTORE_REPLICATED_TABLE, MDB_CREATE, db_context->pins_replicated_db) != 0
+			// move records from an older repo's journalstore if necessary
+			|| !lmdb_journalstore_upgrade(db_context->current_transaction, *db_context->journal_db)
+			// and remember to pin the roots of the blocks of a repo from before pins
+			|| !lmdb_pinstore_upgrade(db_context, pins_created)) {
+		repo_fsrepo_lmdb_txn_abort(db_context->current_transaction);
+		repo_fsrepo_lmdb_context_free(db_context);
 		return 0;
 	}
-	mdb_txn_commit(db_context->current_transaction);
+	repo_fsrepo_lmdb_txn_commit(db_context->current_transaction);
 	db_context->current_transaction = NULL;
+
+	// commits that don't sync need something else to
+	if (flags & (MDB_NOSYNC | MDB_NOMETASYNC | MDB_MAPASYNC) && db_context->sync_interval > 0) {
+		db_context->sync_running = 1;
+		if (pthread_create(&db_context->sync_thread, NULL, repo_fsrepo_lmdb_sync_thread, db_context) != 0) {
+			libp2p_logger_error("lmdb_datastore", "open: Unable to start the sync thread.\n");
+			db_context->sync_running = 0;
+		}
+	}
+
+	datastore->datastore_context = (void*) db_context;
 	return 1;
 }
 
@@ -391,14 +918,20 @@ int repo_fsrepo_lmdb_close(struct Datastore* datastore) {
 	// close the db environment
 	struct lmdb_context *db_context = (struct lmdb_context*) datastore->datastore_context;
 	if (db_context->current_transaction != NULL) {
-		mdb_txn_commit(db_context->current_transaction);
+		repo_fsrepo_lmdb_txn_commit(db_context->current_transaction);
 	}
-	mdb_env_close(db_context->db_environment);
-
-	free(db_context->datastore_db);
-	free(db_context->journal_db);
+	if (db_context->sync_running) {
+		pthread_mutex_lock(&db_context->sync_lock);
+		db_context->sync_running = 0;
+		pthread_cond_signal(&db_context->sync_cond);
+		pthread_mutex_unlock(&db_context->sync_lock);
+		pthread_join(db_context->sync_thread, NULL);
+	}
+	if (db_context->env_flags & (MDB_NOSYNC | MDB_NOMETASYNC | MDB_MAPASYNC))
+		repo_fsrepo_lmdb_sync(db_context);
 
-	free(db_context);
+	repo_fsrepo_lmdb_context_free(db_context);
+	datastore->datastore_context = NULL;
 
 	return 1;
 }
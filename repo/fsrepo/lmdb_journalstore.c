@@ -7,9 +7,10 @@
 #include "libp2p/crypto/encoding/base58.h"
 #include "ipfs/repo/fsrepo/journalstore.h"
 #include "ipfs/repo/fsrepo/lmdb_datastore.h"
+#include "ipfs/util/memory.h"
 
 struct JournalRecord* lmdb_journal_record_new() {
-	struct JournalRecord* rec = (struct JournalRecord*) malloc(sizeof(struct JournalRecord));
+	struct JournalRecord* rec = (struct JournalRecord*) ipfs_util_memory_alloc(MEMORY_TAG_REPO, sizeof(struct JournalRecord));
 	if (rec != NULL) {
 		rec->hash = NULL;
 		rec->hash_size = 0;
@@ -25,46 +26,82 @@ int lmdb_journal_record_free(struct JournalRecord* rec) {
 		if (rec->hash != NULL)
 			free(rec->hash);
 		rec->hash = NULL;
-		free(rec);
+		ipfs_util_memory_free(MEMORY_TAG_REPO, rec);
 	}
 	return 1;
 }
 
-int lmdb_journalstore_generate_key(const struct JournalRecord* journal_record, struct MDB_val *db_key) {
-	// build the key
-	uint8_t time_varint[8];
-	size_t time_varint_size = 0;
-	varint_encode(journal_record->timestamp, &time_varint[0], 8, &time_varint_size);
+/***
+ * Write a number into a buffer in big-endian order, so that a memcmp of
+ * two keys sorts them the same way as the numbers themselves
+ * @param value the number
+ * @param buffer where to put it (must be at least JOURNALSTORE_TIMESTAMP_SIZE bytes)
+ */
+static void lmdb_journalstore_encode_timestamp(unsigned long long value, uint8_t* buffer) {
+	for(int i = JOURNALSTORE_TIMESTAMP_SIZE - 1; i >= 0; i--) {
+		buffer[i] = value & 0xff;
+		value >>= 8;
+	}
+}
 
-	db_key->mv_size = time_varint_size;
-	db_key->mv_data = time_varint;
+/***
+ * Read a big-endian number from a buffer
+ * @param buffer the bytes (must be at least JOURNALSTORE_TIMESTAMP_SIZE bytes)
+ * @returns the number
+ */
+static unsigned long long lmdb_journalstore_decode_timestamp(const uint8_t* buffer) {
+	unsigned long long value = 0;
+	for(int i = 0; i < JOURNALSTORE_TIMESTAMP_SIZE; i++) {
+		value = (value << 8) | buffer[i];
+	}
+	return value;
+}
+
+/***
+ * Build the composite key for a journal record. The key is the timestamp
+ * as 8 big-endian bytes, followed by the hash. This keeps records sorted by time,
+ * and multiple records within the same second no longer collide.
+ * @param journal_record the record
+ * @param buffer where the key bytes will be written (JOURNALSTORE_MAX_KEY_SIZE bytes)
+ * @param db_key the resultant key, which points into buffer
+ * @returns true(1) on success, false(0) if the hash is too large
+ */
+int lmdb_journalstore_generate_key(const struct JournalRecord* journal_record, uint8_t* buffer, struct MDB_val *db_key) {
+	if (journal_record->hash_size > JOURNALSTORE_MAX_HASH_SIZE) {
+		libp2p_logger_error("lmdb_journalstore", "generate_key: Hash of %lu bytes is too large.\n", journal_record->hash_size);
+		return 0;
+	}
+	lmdb_journalstore_encode_timestamp(journal_record->timestamp, buffer);
+	if (journal_record->hash_size > 0)
+		memcpy(&buffer[JOURNALSTORE_TIMESTAMP_SIZE], journal_record->hash, journal_record->hash_size);
+	db_key->mv_size = JOURNALSTORE_TIMESTAMP_SIZE + journal_record->hash_size;
+	db_key->mv_data = buffer;
 	return 1;
 }
 
 /***
  * Convert the JournalRec struct into a lmdb key and lmdb value
  * @param journal_record the record to convert
+ * @param key_buffer memory for the key (JOURNALSTORE_MAX_KEY_SIZE bytes)
+ * @param value_buffer memory for the value (JOURNALSTORE_VALUE_SIZE bytes)
  * @param db_key where to store the key information
  * @param db_value where to store the value information
+ * @returns true(1) on success, false(0) otherwise
  */
-int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, struct MDB_val* db_key, struct MDB_val *db_value) {
-	// build the record, which is a timestamp as a key
-
+int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_record, uint8_t* key_buffer, uint8_t* value_buffer,
+		struct MDB_val* db_key, struct MDB_val *db_value) {
 	// build the key
-	lmdb_journalstore_generate_key(journal_record, db_key);
+	if (!lmdb_journalstore_generate_key(journal_record, key_buffer, db_key))
+		return 0;
 
 	// build the value
-	size_t record_size = journal_record->hash_size + 2;
-	uint8_t record[record_size];
 	// Field 1: pin flag
-	record[0] = journal_record->pin;
+	value_buffer[0] = journal_record->pin;
 	// Field 2: pending flag
-	record[1] = journal_record->pending;
-	// field 3: hash
-	memcpy(&record[2], journal_record->hash, journal_record->hash_size);
+	value_buffer[1] = journal_record->pending;
 
-	db_value->mv_size = record_size;
-	db_value->mv_data = record;
+	db_value->mv_size = JOURNALSTORE_VALUE_SIZE;
+	db_value->mv_data = value_buffer;
 
 	return 1;
 }
@@ -77,6 +114,10 @@ int lmdb_journalstore_build_key_value_pair(const struct JournalRecord* journal_r
  * @reutrns true(1) on success, false(0) on error
  */
 int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MDB_val *db_value, struct JournalRecord **journal_record) {
+	if (db_key->mv_size < JOURNALSTORE_TIMESTAMP_SIZE || db_value->mv_size < JOURNALSTORE_VALUE_SIZE) {
+		libp2p_logger_error("lmdb_journalstore", "build_record: Record is not in the expected format.\n");
+		return 0;
+	}
 	if (*journal_record == NULL) {
 		*journal_record = lmdb_journal_record_new();
 		if (*journal_record == NULL) {
@@ -86,9 +127,9 @@ int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MD
 	}
 
 	struct JournalRecord *rec = *journal_record;
+	uint8_t *key = (uint8_t*)db_key->mv_data;
 	// timestamp
-	size_t varint_size = 0;
-	rec->timestamp = varint_decode(db_key->mv_data, db_key->mv_size, &varint_size);
+	rec->timestamp = lmdb_journalstore_decode_timestamp(key);
 	// pin flag
 	rec->pin = ((uint8_t*)db_value->mv_data)[0];
 	// pending flag
@@ -99,11 +140,10 @@ int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MD
 		rec->hash = NULL;
 		rec->hash_size = 0;
 	}
-	rec->hash_size = db_value->mv_size - 2;
+	rec->hash_size = db_key->mv_size - JOURNALSTORE_TIMESTAMP_SIZE;
 	rec->hash = malloc(rec->hash_size);
 	if (rec->hash != NULL) {
-		uint8_t *val = (uint8_t*)db_value->mv_data;
-		memcpy(rec->hash, &val[2], rec->hash_size);
+		memcpy(rec->hash, &key[JOURNALSTORE_TIMESTAMP_SIZE], rec->hash_size);
 	} else {
 		return 0;
 	}
@@ -111,52 +151,154 @@ int lmdb_journalstore_build_record(const struct MDB_val* db_key, const struct MD
 	return 1;
 }
 
+/***
+ * Move records from the original JOURNALSTORE table (keyed by a varint timestamp,
+ * with the hash in the value) into the composite keyed table, then drop the old table.
+ * @param txn the (write) transaction to do the work in
+ * @param journal_db the already opened composite keyed table
+ * @returns true(1) on success or if there is nothing to upgrade, false(0) otherwise
+ */
+int lmdb_journalstore_upgrade(MDB_txn *txn, MDB_dbi journal_db) {
+	MDB_dbi old_db;
+	MDB_cursor *old_cursor = NULL;
+	MDB_val old_key;
+	MDB_val old_value;
+	size_t records_moved = 0;
+
+	int retVal = mdb_dbi_open(txn, JOURNALSTORE_V1_TABLE, MDB_DUPSORT, &old_db);
+	if (retVal == MDB_NOTFOUND) {
+		// nothing to upgrade
+		return 1;
+	}
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_journalstore", "upgrade: Unable to open old journalstore. Error code %d.\n", retVal);
+		return 0;
+	}
+
+	if (mdb_cursor_open(txn, old_db, &old_cursor) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "upgrade: Unable to open cursor on old journalstore.\n");
+		return 0;
+	}
+
+	retVal = mdb_cursor_get(old_cursor, &old_key, &old_value, MDB_FIRST);
+	while (retVal == 0) {
+		if (old_value.mv_size > 2) {
+			struct JournalRecord rec;
+			uint8_t *val = (uint8_t*)old_value.mv_data;
+			size_t varint_size = 0;
+			rec.timestamp = varint_decode(old_key.mv_data, old_key.mv_size, &varint_size);
+			rec.pin = val[0];
+			rec.pending = val[1];
+			rec.hash = &val[2];
+			rec.hash_size = old_value.mv_size - 2;
+			uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+			uint8_t value_buffer[JOURNALSTORE_VALUE_SIZE];
+			MDB_val new_key;
+			MDB_val new_value;
+			if (lmdb_journalstore_build_key_value_pair(&rec, key_buffer, value_buffer, &new_key, &new_value)) {
+				if (mdb_put(txn, journal_db, &new_key, &new_value, 0) != 0) {
+					libp2p_logger_error("lmdb_journalstore", "upgrade: Unable to write upgraded record.\n");
+					mdb_cursor_close(old_cursor);
+					return 0;
+				}
+				records_moved++;
+			}
+		}
+		retVal = mdb_cursor_get(old_cursor, &old_key, &old_value, MDB_NEXT);
+	}
+	mdb_cursor_close(old_cursor);
+
+	// remove the old table
+	if (mdb_drop(txn, old_db, 1) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "upgrade: Unable to drop old journalstore.\n");
+		return 0;
+	}
+	libp2p_logger_debug("lmdb_journalstore", "upgrade: Moved %lu records to the new journalstore.\n", records_moved);
+	return 1;
+}
+
 /***
  * Write a journal record
- * @param mbd_txn the transaction
- * @param timestamp the timestamp
- * @param hash the hash
- * @param hash_size the size of the hash
+ * @param journalstore_cursor the cursor (a transaction will be created if necessary)
+ * @param journalstore_record the record to write
  * @returns true(1) on success, false(0) otherwise
  */
 int lmdb_journalstore_journal_add(struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord *journalstore_record) {
 
 	MDB_val journalstore_key;
 	MDB_val journalstore_value;
+	uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+	uint8_t value_buffer[JOURNALSTORE_VALUE_SIZE];
 	int createdTransaction = 0;
 
-	if (!lmdb_journalstore_build_key_value_pair(journalstore_record, &journalstore_key, &journalstore_value)) {
+	if (!lmdb_journalstore_build_key_value_pair(journalstore_record, key_buffer, value_buffer, &journalstore_key, &journalstore_value)) {
 		libp2p_logger_error("lmdbd_journalstore", "add: Unable to convert journalstore record to key/value.\n");
 		return 0;
 	}
 
 	// create transaction if necessary
 	if (journalstore_cursor->transaction == NULL) {
-		mdb_txn_begin(journalstore_cursor->environment, journalstore_cursor->parent_transaction, 0, &journalstore_cursor->transaction);
+		repo_fsrepo_lmdb_txn_begin(journalstore_cursor->environment, journalstore_cursor->parent_transaction, 0, &journalstore_cursor->transaction);
 		createdTransaction = 1;
 	}
 
-	if (mdb_put(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, &journalstore_value, 0) != 0) {
-		libp2p_logger_error("lmdb_journalstore", "Unable to add to JOURNALSTORE database.\n");
+	// new records are almost always the newest, so try to append to the end of the table first.
+	// MDB_APPEND returns MDB_KEYEXIST if the key does not sort last, so fall back to a normal put.
+	int retVal = mdb_put(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, &journalstore_value, MDB_APPEND);
+	if (retVal == MDB_KEYEXIST)
+		retVal = mdb_put(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, &journalstore_value, 0);
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_journalstore", "Unable to add to JOURNALSTORE database. Error code %d.\n", retVal);
+		if (retVal == MDB_MAP_FULL) {
+			// grow the map once the transaction is done
+			struct lmdb_context* db_context = (struct lmdb_context*) mdb_env_get_userctx(journalstore_cursor->environment);
+			if (db_context != NULL)
+				__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
+		}
 		return 0;
 	}
 
 	if (createdTransaction) {
-		if (mdb_txn_commit(journalstore_cursor->transaction) != 0) {
+		if (repo_fsrepo_lmdb_txn_commit(journalstore_cursor->transaction) != 0) {
 			libp2p_logger_error("lmdb_journalstore", "Unable to commit JOURNALSTORE transaction.\n");
 			return 0;
 		}
+		journalstore_cursor->transaction = NULL;
 	}
 
 	return 1;
 }
 
+/***
+ * Remove a journal record
+ * @param journalstore_cursor the cursor (must have an open transaction)
+ * @param journalstore_record the record to remove (timestamp and hash are used)
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_journal_delete(struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord *journalstore_record) {
+	MDB_val journalstore_key;
+	uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+
+	if (journalstore_cursor->transaction == NULL) {
+		libp2p_logger_error("lmdb_journalstore", "delete: No transaction available.\n");
+		return 0;
+	}
+	if (!lmdb_journalstore_generate_key(journalstore_record, key_buffer, &journalstore_key))
+		return 0;
+	int retVal = mdb_del(journalstore_cursor->transaction, *journalstore_cursor->database, &journalstore_key, NULL);
+	if (retVal != 0 && retVal != MDB_NOTFOUND) {
+		libp2p_logger_error("lmdb_journalstore", "delete: Unable to delete record. Error code %d.\n", retVal);
+		return 0;
+	}
+	return 1;
+}
+
 /***
  * Attempt to get a specific record identified by its timestamp and bytes
  * @param handle a handle to the database engine
  * @param journalstore_cursor the cursor (will be returned as a cursor that points to the record found)
  * @param journalstore_record where to put the results (can pass null). If data is within the struct, will use it as search criteria
- * @returns true(1) on success, false(0) otherwise
+ * @returns true(1) on success, false(0) otherwise (including if the exact record was not found)
  */
 int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journalstore_cursor, struct JournalRecord **journalstore_record)
 {
@@ -169,7 +311,7 @@ int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journal
 
 	// create a new transaction if necessary
 	if (journalstore_cursor->transaction == NULL) {
-		if (mdb_txn_begin(db_context->db_environment, journalstore_cursor->parent_transaction, 0, &journalstore_cursor->transaction) != 0) {
+		if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, journalstore_cursor->parent_transaction, 0, &journalstore_cursor->transaction) != 0) {
 			libp2p_logger_error("lmdb_journanstore", "get_record: Attempt to begin transaction failed.\n");
 			return 0;
 		}
@@ -181,9 +323,9 @@ int lmdb_journalstore_get_record(void* handle, struct lmdb_trans_cursor *journal
 			return 0;
 		}
 	}
-	// search for the timestamp
+	// search for the timestamp and hash
 	if (!lmdb_journalstore_cursor_get(journalstore_cursor, CURSOR_FIRST, journalstore_record)) {
-		libp2p_logger_debug("lmdb_journalstore", "Unable to find any records in table.\n");
+		libp2p_logger_debug("lmdb_journalstore", "get_record: Unable to find the record in table.\n");
 		return 0;
 	}
 
@@ -215,7 +357,7 @@ int lmdb_journalstore_cursor_open(void *handle, struct lmdb_trans_cursor **crsr,
 				cursor->transaction = trans_to_use;
 			else {
 				// open transaction
-				if (mdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &cursor->transaction) != 0) {
+				if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &cursor->transaction) != 0) {
 					libp2p_logger_error("lmdb_journalstore", "cursor_open: Unable to begin a transaction.\n");
 					return 0;
 				}
@@ -225,7 +367,7 @@ int lmdb_journalstore_cursor_open(void *handle, struct lmdb_trans_cursor **crsr,
 			// open cursor
 			if (mdb_cursor_open(cursor->transaction, *cursor->database, &cursor->cursor) != 0) {
 				libp2p_logger_error("lmdb_journalstore", "cursor_open: Unable to open cursor.\n");
-				mdb_txn_commit(cursor->transaction);
+				repo_fsrepo_lmdb_txn_commit(cursor->transaction);
 				return 0;
 			}
 			return 1;
@@ -237,36 +379,128 @@ int lmdb_journalstore_cursor_open(void *handle, struct lmdb_trans_cursor **crsr,
 
 }
 
-int lmdb_journalstore_composite_key_compare(struct JournalRecord *a, struct JournalRecord *b) {
+/***
+ * Compare two records in the order their keys are stored in the journalstore
+ * (by timestamp, then by hash)
+ * @param a the first record
+ * @param b the second record
+ * @returns <0 if a comes before b, 0 if they are the same, >0 if a comes after b
+ */
+int lmdb_journalstore_composite_key_compare(const struct JournalRecord *a, const struct JournalRecord *b) {
 	if (a == NULL && b == NULL)
 		return 0;
 	if (a == NULL && b != NULL)
-		return 1;
-	if (a != NULL && b == NULL)
 		return -1;
-	if (a->timestamp != b->timestamp) {
-		if (a->timestamp > b->timestamp)
-			return -1;
-		else
-			return 1;
+	if (a != NULL && b == NULL)
+		return 1;
+	if (a->timestamp != b->timestamp)
+		return a->timestamp < b->timestamp ? -1 : 1;
+	// same as LMDB's default: compare the common bytes, then the shorter sorts first
+	size_t len = a->hash_size < b->hash_size ? a->hash_size : b->hash_size;
+	if (len > 0) {
+		int retVal = memcmp(a->hash, b->hash, len);
+		if (retVal != 0)
+			return retVal;
 	}
-	if (a->hash_size != b->hash_size) {
-		if (a->hash_size > b->hash_size)
-			return -1;
-		else
-			return 1;
+	if (a->hash_size != b->hash_size)
+		return a->hash_size < b->hash_size ? -1 : 1;
+	return 0;
+}
+
+/***
+ * Retrieve how far through our journal a replication peer has been sent
+ * @param handle the database context
+ * @param peer_id the id of the peer
+ * @param peer_id_size the length of peer_id
+ * @param position where to put the timestamp and hash of the last record sent (allocated if *position is NULL)
+ * @returns true(1) if the peer was found, false(0) otherwise
+ */
+int lmdb_journalstore_get_peer_progress(void* handle, const uint8_t* peer_id, size_t peer_id_size, struct JournalRecord** position) {
+	if (handle == NULL || peer_id == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	MDB_val progress_value;
+	uint8_t flags[JOURNALSTORE_VALUE_SIZE] = { 0, 0 };
+	int retVal = 0;
+
+	// a read only transaction can't be nested in a write transaction
+	unsigned int txn_flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, txn_flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "get_peer_progress: Unable to begin transaction.\n");
+		return 0;
 	}
-	for(int i = 0; i < a->hash_size; i++) {
-		if (a->hash[i] != b->hash[i]) {
-			return b->hash[i] - a->hash[i];
-		}
+	db_key.mv_size = peer_id_size;
+	db_key.mv_data = (void*)peer_id;
+	if (mdb_get(txn, *db_context->journal_peers_db, &db_key, &db_value) == 0) {
+		// the value is a journalstore key
+		progress_value.mv_size = JOURNALSTORE_VALUE_SIZE;
+		progress_value.mv_data = flags;
+		retVal = lmdb_journalstore_build_record(&db_value, &progress_value, position);
 	}
-	return 0;
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Remember how far through our journal a replication peer has been sent
+ * @param handle the database context
+ * @param peer_id the id of the peer
+ * @param peer_id_size the length of peer_id
+ * @param position the timestamp and hash of the last record sent
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_journalstore_set_peer_progress(void* handle, const uint8_t* peer_id, size_t peer_id_size, const struct JournalRecord* position) {
+	if (handle == NULL || peer_id == NULL || position == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+
+	if (!lmdb_journalstore_generate_key(position, key_buffer, &db_value))
+		return 0;
+	db_key.mv_size = peer_id_size;
+	db_key.mv_data = (void*)peer_id;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "set_peer_progress: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_put(txn, *db_context->journal_peers_db, &db_key, &db_value, 0) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "set_peer_progress: Unable to write progress.\n");
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_journalstore", "set_peer_progress: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Translate a DatastoreCursorOp into its LMDB equivalent
+ * @param op the datastore operation
+ * @returns the lmdb operation
+ */
+static MDB_cursor_op lmdb_journalstore_cursor_op(enum DatastoreCursorOp op) {
+	if (op == CURSOR_NEXT)
+		return MDB_NEXT;
+	else if (op == CURSOR_LAST)
+		return MDB_LAST;
+	else if (op == CURSOR_PREVIOUS)
+		return MDB_PREV;
+	return MDB_FIRST;
 }
 
 /**
- * Read a record from the cursor. If (record) contains a key, it will look for the exact record.
- * If not, it will return the first matching record.
+ * Read a record from the cursor. If (record) contains a hash and op is CURSOR_FIRST,
+ * it will look for the exact record. Otherwise the cursor is moved and the record
+ * found is placed in (record), reusing the struct if it was already allocated.
  * @param crsr the lmdb_trans_cursor
  * @param op the cursor operation (i.e. CURSOR_FIRST, CURSOR_NEXT, CURSOR_LAST, CURSOR_PREVIOUS)
  * @param record the record (will allocate a new one if *record is NULL)
@@ -276,19 +510,16 @@ int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *tc, enum DatastoreCur
 	if (tc != NULL) {
 		MDB_val mdb_key;
 		MDB_val mdb_value;
-		MDB_cursor_op co = MDB_FIRST;
-
-		if (op == CURSOR_FIRST)
-			co = MDB_FIRST;
-		else if (op == CURSOR_NEXT)
-			co = MDB_NEXT;
-		else if (op == CURSOR_LAST)
-			co = MDB_LAST;
-		else if (op == CURSOR_PREVIOUS)
-			co = MDB_PREV;
-
-		if (*record != NULL) {
-			lmdb_journalstore_generate_key(*record, &mdb_key);
+		uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+		MDB_cursor_op co = lmdb_journalstore_cursor_op(op);
+		int exact_match = 0;
+
+		if (op == CURSOR_FIRST && *record != NULL && (*record)->hash_size > 0) {
+			// we are looking for a specific record. The key is unique, so go straight to it.
+			if (!lmdb_journalstore_generate_key(*record, key_buffer, &mdb_key))
+				return 0;
+			co = MDB_SET_KEY;
+			exact_match = 1;
 		}
 
 		int retVal = mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, co);
@@ -301,52 +532,48 @@ int lmdb_journalstore_cursor_get(struct lmdb_trans_cursor *tc, enum DatastoreCur
 			return 0;
 		}
 
-		if (*record == NULL) {
-			// make a new record and pass it back
-			if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, record))
+		if (exact_match) {
+			// we found the exact record. merge it into the *record
+			if (mdb_value.mv_size < JOURNALSTORE_VALUE_SIZE)
 				return 0;
+			(*record)->pin = ((uint8_t*)mdb_value.mv_data)[0];
+			(*record)->pending = ((uint8_t*)mdb_value.mv_data)[1];
 			return 1;
 		}
 
-		// see if the passed in record has a specific record in mind (take care of duplicate keys)
-		if ( (*record)->hash_size > 0) {
-			struct JournalRecord* curr_record = NULL;
-			if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, &curr_record)) {
-				libp2p_logger_error("lmdb_journalstore", "Unable to convert journalstore record into a JournalRecord struct.\n");
-				return 0;
-			}
-			// we are looking for a specific record. Flip through the records looking for the exact record
-			while (lmdb_journalstore_composite_key_compare(*record, curr_record) != 0) {
-				if ( (*record)->timestamp != curr_record->timestamp) {
-					//we've exhausted all records for this timestamp. Exit.
-					lmdb_journal_record_free(curr_record);
-					curr_record = NULL;
-					break;
-				}
-				// we did not find the exact record. Skip to the next one
-				lmdb_journal_record_free(curr_record);
-				curr_record = NULL;
-				mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, MDB_NEXT);
-				if (!lmdb_journalstore_build_record(&mdb_key, &mdb_value, &curr_record)) {
-					libp2p_logger_error("lmdb_journalstore", "Unable to convert journalstore record into a JournalRecord struct.\n");
-					return 0;
-				}
-			}
-			if (curr_record != NULL) {
-				// we found the exact record. merge it into the *record
-				(*record)->pending = curr_record->pending;
-				(*record)->pin = curr_record->pin;
-				lmdb_journal_record_free(curr_record);
-				return 1;
-			}
-		} else {
-			// we're not looking for any particular record. Return the first one found.
-			return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
-		}
+		return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
 	}
 	return 0;
 }
 
+/***
+ * Position the cursor at the first record with a timestamp equal to or after the one requested.
+ * As the keys are sorted by time, this is the starting point for a range scan.
+ * @param tc the cursor
+ * @param timestamp the earliest timestamp wanted
+ * @param record where to put the record found (will allocate a new one if *record is NULL)
+ * @returns true(1) if a record was found, false(0) otherwise
+ */
+int lmdb_journalstore_cursor_seek(struct lmdb_trans_cursor *tc, unsigned long long timestamp, struct JournalRecord** record) {
+	if (tc == NULL || tc->cursor == NULL)
+		return 0;
+	MDB_val mdb_key;
+	MDB_val mdb_value;
+	uint8_t key_buffer[JOURNALSTORE_TIMESTAMP_SIZE];
+
+	lmdb_journalstore_encode_timestamp(timestamp, key_buffer);
+	mdb_key.mv_size = JOURNALSTORE_TIMESTAMP_SIZE;
+	mdb_key.mv_data = key_buffer;
+
+	int retVal = mdb_cursor_get(tc->cursor, &mdb_key, &mdb_value, MDB_SET_RANGE);
+	if (retVal != 0) {
+		if (retVal != MDB_NOTFOUND)
+			libp2p_logger_error("lmdb_journalstore", "cursor_seek: Error %d.\n", retVal);
+		return 0;
+	}
+	return lmdb_journalstore_build_record(&mdb_key, &mdb_value, record);
+}
+
 /***
  * Write the record at the cursor
  * @param crsr the cursor
@@ -357,8 +584,10 @@ int lmdb_journalstore_cursor_put(struct lmdb_trans_cursor *crsr, struct JournalR
 	struct MDB_cursor* cursor = crsr->cursor;
 	struct MDB_val db_key;
 	struct MDB_val db_value;
+	uint8_t key_buffer[JOURNALSTORE_MAX_KEY_SIZE];
+	uint8_t value_buffer[JOURNALSTORE_VALUE_SIZE];
 
-	if (!lmdb_journalstore_build_key_value_pair(journal_record, &db_key, &db_value)) {
+	if (!lmdb_journalstore_build_key_value_pair(journal_record, key_buffer, value_buffer, &db_key, &db_value)) {
 		libp2p_logger_error("lmdb_journalstore", "Unable to create journalstore record.\n");
 		return 0;
 	}
@@ -397,7 +626,7 @@ int lmdb_journalstore_cursor_close(struct lmdb_trans_cursor *cursor, int commitT
 			//mdb_cursor_close(cursor->cursor);
 		}
 		if (cursor->transaction != NULL && commitTransaction) {
-			mdb_txn_commit(cursor->transaction);
+			repo_fsrepo_lmdb_txn_commit(cursor->transaction);
 		}
 		cursor->cursor = NULL;
 		cursor->transaction = NULL;
@@ -0,0 +1,594 @@
+#include <string.h>
+
+#include "lmdb.h"
+#include "libp2p/utils/logger.h"
+#include "ipfs/pin/pin.h"
+#include "ipfs/repo/fsrepo/pinstore.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
+
+/***
+ * Pin a block, or change how it is pinned
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode the PinMode
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_put(void* handle, const uint8_t* hash, size_t hash_size, int mode) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	uint8_t value = (uint8_t)mode;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	db_value.mv_size = 1;
+	db_value.mv_data = &value;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "put: Unable to begin transaction.\n");
+		return 0;
+	}
+	int retVal = mdb_put(txn, *db_context->pins_db, &db_key, &db_value, 0);
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_pinstore", "put: Unable to write pin. Error code %d.\n", retVal);
+		if (retVal == MDB_MAP_FULL)
+			__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "put: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Look up a pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode where to put the PinMode
+ * @returns true(1) if the block is pinned, false(0) otherwise
+ */
+int lmdb_pinstore_get(void* handle, const uint8_t* hash, size_t hash_size, int* mode) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "get: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_get(txn, *db_context->pins_db, &db_key, &db_value) == 0 && db_value.mv_size == 1) {
+		if (mode != NULL)
+			*mode = ((uint8_t*)db_value.mv_data)[0];
+		retVal = 1;
+	}
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Remove a pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) if it was pinned, false(0) otherwise
+ */
+int lmdb_pinstore_delete(void* handle, const uint8_t* hash, size_t hash_size) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "delete: Unable to begin transaction.\n");
+		return 0;
+	}
+	int retVal = mdb_del(txn, *db_context->pins_db, &db_key, NULL);
+	if (retVal != 0) {
+		if (retVal != MDB_NOTFOUND)
+			libp2p_logger_error("lmdb_pinstore", "delete: Unable to delete pin. Error code %d.\n", retVal);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "delete: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Go through the pins, in one read transaction
+ * @param handle the database context
+ * @param func called with each pin. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all pins were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, int mode, void* arg), void* arg) {
+	if (handle == NULL || func == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 1;
+
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "foreach: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(txn, *db_context->pins_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "foreach: Unable to open cursor.\n");
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	int rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_FIRST);
+	while (rc == 0) {
+		int mode = db_value.mv_size == 1 ? ((uint8_t*)db_value.mv_data)[0] : 0;
+		if (!func((uint8_t*)db_key.mv_data, db_key.mv_size, mode, arg)) {
+			retVal = 0;
+			break;
+		}
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT);
+	}
+	if (rc != 0 && rc != MDB_NOTFOUND) {
+		libp2p_logger_error("lmdb_pinstore", "foreach: Unable to read pins. Error code %d.\n", rc);
+		retVal = 0;
+	}
+	mdb_cursor_close(cursor);
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Remember that a recursive pin was made for a block from the journal of another node
+ * @param handle the database context
+ * @param hash the multihash of the pin
+ * @param hash_size the length of hash
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_replicated_put(void* handle, const uint8_t* hash, size_t hash_size) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	db_value.mv_size = 0;
+	db_value.mv_data = NULL;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_put: Unable to begin transaction.\n");
+		return 0;
+	}
+	int retVal = mdb_put(txn, *db_context->pins_replicated_db, &db_key, &db_value, 0);
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_put: Unable to write pin. Error code %d.\n", retVal);
+		if (retVal == MDB_MAP_FULL)
+			__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_put: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Forget that a pin was made for a block from the journal of another node
+ * @param handle the database context
+ * @param hash the multihash of the pin
+ * @param hash_size the length of hash
+ * @returns true(1) if it was, false(0) otherwise
+ */
+int lmdb_pinstore_replicated_delete(void* handle, const uint8_t* hash, size_t hash_size) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_delete: Unable to begin transaction.\n");
+		return 0;
+	}
+	int retVal = mdb_del(txn, *db_context->pins_replicated_db, &db_key, NULL);
+	if (retVal != 0) {
+		if (retVal != MDB_NOTFOUND)
+			libp2p_logger_error("lmdb_pinstore", "replicated_delete: Unable to delete pin. Error code %d.\n", retVal);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_delete: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Go through the pins made for blocks from the journal of another node, in one read transaction
+ * @param handle the database context
+ * @param func called with each pin. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all pins were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_replicated_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, void* arg), void* arg) {
+	if (handle == NULL || func == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 1;
+
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_foreach: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(txn, *db_context->pins_replicated_db, &cursor) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_foreach: Unable to open cursor.\n");
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	int rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_FIRST);
+	while (rc == 0) {
+		if (!func((uint8_t*)db_key.mv_data, db_key.mv_size, arg)) {
+			retVal = 0;
+			break;
+		}
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT);
+	}
+	if (rc != 0 && rc != MDB_NOTFOUND) {
+		libp2p_logger_error("lmdb_pinstore", "replicated_foreach: Unable to read pins. Error code %d.\n", rc);
+		retVal = 0;
+	}
+	mdb_cursor_close(cursor);
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Put or delete pairs of the index in one write transaction
+ * @param remove true(1) to delete the pairs, false(0) to put them
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int lmdb_pinstore_refs_write(void* handle, const uint8_t* root, size_t root_size, uint8_t** hashes, size_t* hash_sizes, int count, int remove) {
+	if (handle == NULL || root == NULL || root_size == 0 || (count > 0 && (hashes == NULL || hash_sizes == NULL)))
+		return 0;
+	if (count <= 0)
+		return 1;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "refs: Unable to begin transaction.\n");
+		return 0;
+	}
+	for(int i = 0; i < count; i++) {
+		db_key.mv_size = hash_sizes[i];
+		db_key.mv_data = hashes[i];
+		db_value.mv_size = root_size;
+		db_value.mv_data = (void*)root;
+		int retVal = remove ? mdb_del(txn, *db_context->pin_refs_db, &db_key, &db_value)
+				: mdb_put(txn, *db_context->pin_refs_db, &db_key, &db_value, MDB_NODUPDATA);
+		// the pair is already there, or already gone
+		if (retVal == MDB_KEYEXIST || retVal == MDB_NOTFOUND)
+			continue;
+		if (retVal != 0) {
+			libp2p_logger_error("lmdb_pinstore", "refs: Unable to write the index. Error code %d.\n", retVal);
+			if (retVal == MDB_MAP_FULL)
+				__atomic_store_n(&db_context->map_full, 1, __ATOMIC_RELAXED);
+			repo_fsrepo_lmdb_txn_abort(txn);
+			return 0;
+		}
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "refs: Unable to commit transaction.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Add to the index the blocks below a recursive pin, in one transaction
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hashes the multihashes of the blocks below it
+ * @param hash_sizes the lengths of hashes
+ * @param count the number of hashes
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_refs_put(void* handle, const uint8_t* root, size_t root_size, uint8_t** hashes, size_t* hash_sizes, int count) {
+	return lmdb_pinstore_refs_write(handle, root, root_size, hashes, hash_sizes, count, 0);
+}
+
+/***
+ * Remove from the index the blocks below a recursive pin, in one transaction
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hashes the multihashes of the blocks below it
+ * @param hash_sizes the lengths of hashes
+ * @param count the number of hashes
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_refs_delete(void* handle, const uint8_t* root, size_t root_size, uint8_t** hashes, size_t* hash_sizes, int count) {
+	return lmdb_pinstore_refs_write(handle, root, root_size, hashes, hash_sizes, count, 1);
+}
+
+/***
+ * Determine if a block is below a recursive pin, from the index
+ * @param handle the database context
+ * @param root the multihash of the recursive pin
+ * @param root_size the length of root
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @returns true(1) if it is, false(0) otherwise
+ */
+int lmdb_pinstore_refs_has(void* handle, const uint8_t* root, size_t root_size, const uint8_t* hash, size_t hash_size) {
+	if (handle == NULL || root == NULL || root_size == 0 || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	db_value.mv_size = root_size;
+	db_value.mv_data = (void*)root;
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "refs_has: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(txn, *db_context->pin_refs_db, &cursor) == 0) {
+		retVal = mdb_cursor_get(cursor, &db_key, &db_value, MDB_GET_BOTH) == 0;
+		mdb_cursor_close(cursor);
+	}
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Find a recursive pin a block is below, skipping pairs of the index left
+ * by a pin that was stopped half way, or not removed all the way
+ * @param db_context the database context
+ * @param txn the transaction
+ * @param cursor a cursor of the index
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param root where to put the multihash of the recursive pin, which is only good during the transaction
+ * @returns true(1) if there is one, false(0) otherwise
+ */
+static int lmdb_pinstore_refs_root(struct lmdb_context* db_context, MDB_txn* txn, MDB_cursor* cursor, const uint8_t* hash, size_t hash_size, MDB_val* root) {
+	MDB_val db_key;
+	MDB_val db_value;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	int rc = mdb_cursor_get(cursor, &db_key, root, MDB_SET_KEY);
+	while (rc == 0) {
+		if (mdb_get(txn, *db_context->pins_db, root, &db_value) == 0
+				&& db_value.mv_size == 1 && ((uint8_t*)db_value.mv_data)[0] == Recursive)
+			return 1;
+		rc = mdb_cursor_get(cursor, &db_key, root, MDB_NEXT_DUP);
+	}
+	return 0;
+}
+
+/***
+ * Find how a block is pinned: itself, or because it is below a recursive pin
+ * @param handle the database context
+ * @param hash the multihash of the block
+ * @param hash_size the length of hash
+ * @param mode where to put the PinMode, Indirect if it is below a recursive pin
+ * @param via where to put the multihash of the recursive pin it is below, can be NULL
+ * @param via_max the room in via
+ * @param via_size where to put the length of via
+ * @returns true(1) if the block is pinned, false(0) otherwise
+ */
+int lmdb_pinstore_find(void* handle, const uint8_t* hash, size_t hash_size, int* mode, uint8_t* via, size_t via_max, size_t* via_size) {
+	if (handle == NULL || hash == NULL || hash_size == 0)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 0;
+
+	db_key.mv_size = hash_size;
+	db_key.mv_data = (void*)hash;
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "find: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_get(txn, *db_context->pins_db, &db_key, &db_value) == 0 && db_value.mv_size == 1) {
+		if (mode != NULL)
+			*mode = ((uint8_t*)db_value.mv_data)[0];
+		retVal = 1;
+	} else if (mdb_cursor_open(txn, *db_context->pin_refs_db, &cursor) == 0) {
+		if (lmdb_pinstore_refs_root(db_context, txn, cursor, hash, hash_size, &db_value)) {
+			if (mode != NULL)
+				*mode = Indirect;
+			if (via != NULL && via_size != NULL && db_value.mv_size <= via_max) {
+				memcpy(via, db_value.mv_data, db_value.mv_size);
+				*via_size = db_value.mv_size;
+			}
+			retVal = 1;
+		}
+		mdb_cursor_close(cursor);
+	}
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Go through the blocks that are only pinned because they are below a
+ * recursive pin, in one read transaction
+ * @param handle the database context
+ * @param func called with each block. The hash is only good during the call. Returns false(0) to stop.
+ * @param arg passed to func
+ * @returns true(1) if all blocks were seen, false(0) if func stopped, or on error
+ */
+int lmdb_pinstore_refs_foreach(void* handle, int (*func)(const uint8_t* hash, size_t hash_size, void* arg), void* arg) {
+	if (handle == NULL || func == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_cursor *roots = NULL;
+	MDB_val db_key;
+	MDB_val db_value;
+	int retVal = 1;
+
+	unsigned int flags = db_context->current_transaction == NULL ? MDB_RDONLY : 0;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, flags, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "refs_foreach: Unable to begin transaction.\n");
+		return 0;
+	}
+	if (mdb_cursor_open(txn, *db_context->pin_refs_db, &cursor) != 0
+			|| mdb_cursor_open(txn, *db_context->pin_refs_db, &roots) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "refs_foreach: Unable to open cursor.\n");
+		if (cursor != NULL)
+			mdb_cursor_close(cursor);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	int rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_FIRST);
+	while (rc == 0) {
+		MDB_val root;
+		// blocks that are pinned themselves are listed with the pins
+		if (mdb_get(txn, *db_context->pins_db, &db_key, &db_value) != 0
+				&& lmdb_pinstore_refs_root(db_context, txn, roots, db_key.mv_data, db_key.mv_size, &root)
+				&& !func((uint8_t*)db_key.mv_data, db_key.mv_size, arg)) {
+			retVal = 0;
+			break;
+		}
+		rc = mdb_cursor_get(cursor, &db_key, &db_value, MDB_NEXT_NODUP);
+	}
+	if (rc != 0 && rc != MDB_NOTFOUND) {
+		libp2p_logger_error("lmdb_pinstore", "refs_foreach: Unable to read the index. Error code %d.\n", rc);
+		retVal = 0;
+	}
+	mdb_cursor_close(roots);
+	mdb_cursor_close(cursor);
+	repo_fsrepo_lmdb_txn_abort(txn);
+	return retVal;
+}
+
+/***
+ * Called as the databases are opened. If the PINS table is new, but the
+ * datastore has blocks, the repo is from before pins, and the roots of its
+ * blocks need to be pinned before anything is collected.
+ * @param db_context the database context, with the datastore opened in its current transaction
+ * @param pins_created true(1) if the PINS table did not exist before
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade(struct lmdb_context* db_context, int pins_created) {
+	MDB_txn* txn = db_context->current_transaction;
+	MDB_stat stat;
+	int retVal = 0;
+
+	if (pins_created) {
+		if (mdb_stat(txn, *db_context->datastore_db, &stat) != 0) {
+			libp2p_logger_error("lmdb_pinstore", "upgrade: Unable to count the blocks.\n");
+			return 0;
+		}
+		if (stat.ms_entries == 0)
+			return 1;
+		libp2p_logger_info("lmdb_pinstore", "upgrade: The repo is from before pins. The roots of its %lu blocks will be pinned.\n", (unsigned long)stat.ms_entries);
+		retVal = mdb_dbi_open(txn, PINSTORE_UPGRADE_TABLE, MDB_CREATE, &db_context->pins_upgrade_db);
+	} else {
+		retVal = mdb_dbi_open(txn, PINSTORE_UPGRADE_TABLE, 0, &db_context->pins_upgrade_db);
+		if (retVal == MDB_NOTFOUND)
+			return 1;
+	}
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_pinstore", "upgrade: Unable to open %s. Error code %d.\n", PINSTORE_UPGRADE_TABLE, retVal);
+		return 0;
+	}
+	db_context->pins_upgrade = 1;
+	return 1;
+}
+
+/***
+ * Determine if the roots of the blocks of a repo from before pins still need to be pinned
+ * @param handle the database context
+ * @returns true(1) if they do, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade_pending(void* handle) {
+	if (handle == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	return __atomic_load_n(&db_context->pins_upgrade, __ATOMIC_ACQUIRE);
+}
+
+/***
+ * The roots of the blocks of a repo from before pins are pinned
+ * @param handle the database context
+ * @returns true(1) on success, false(0) otherwise
+ */
+int lmdb_pinstore_upgrade_done(void* handle) {
+	if (handle == NULL)
+		return 0;
+	struct lmdb_context *db_context = (struct lmdb_context*)handle;
+	MDB_txn *txn = NULL;
+
+	if (!lmdb_pinstore_upgrade_pending(handle))
+		return 1;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, db_context->current_transaction, 0, &txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "upgrade_done: Unable to begin transaction.\n");
+		return 0;
+	}
+	int retVal = mdb_drop(txn, db_context->pins_upgrade_db, 1);
+	if (retVal != 0) {
+		libp2p_logger_error("lmdb_pinstore", "upgrade_done: Unable to drop %s. Error code %d.\n", PINSTORE_UPGRADE_TABLE, retVal);
+		repo_fsrepo_lmdb_txn_abort(txn);
+		return 0;
+	}
+	if (repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		libp2p_logger_error("lmdb_pinstore", "upgrade_done: Unable to commit transaction.\n");
+		return 0;
+	}
+	__atomic_store_n(&db_context->pins_upgrade, 0, __ATOMIC_RELEASE);
+	return 1;
+}
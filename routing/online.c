@@ -12,6 +12,8 @@
 #include "libp2p/utils/logger.h"
 #include "libp2p/conn/dialer.h"
 #include "ipfs/core/null.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
 
 /**
  * Implements the routing interface for communicating with network clients
@@ -24,8 +26,10 @@
  * @returns what was received
  */
 struct KademliaMessage* ipfs_routing_online_send_receive_message(struct SessionContext* sessionContext, struct KademliaMessage* message) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_send_receive_message");
 	struct KademliaMessage* return_message = NULL;
 	//unsigned char* protocol = (unsigned char*)"/ipfs/kad/1.0.0\n";
+	uint64_t start = ipfs_util_metrics_now();
 
 	// send the message, and expect the same back
 	if (!libp2p_routing_dht_send_message(sessionContext, message)) {
@@ -33,6 +37,8 @@ struct KademliaMessage* ipfs_routing_online_send_receive_message(struct SessionC
 	} else {
 		if (!libp2p_routing_dht_receive_message(sessionContext, &return_message)) {
 			libp2p_logger_error("online", "Unable to receive kademlia message.\n");
+		} else {
+			ipfs_util_metrics_observe(METRICS_ROUTING_QUERY_SECONDS, start);
 		}
 	}
 	return return_message;
@@ -47,6 +53,7 @@ struct KademliaMessage* ipfs_routing_online_send_receive_message(struct SessionC
  * @returns true(1) on success, otherwise false(0)
  */
 int ipfs_routing_online_find_remote_providers(struct IpfsRouting* routing, const unsigned char* key, size_t key_size, struct Libp2pVector** peers) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_find_remote_providers");
 	int found = 0;
 	// build the message to be transmitted
 	struct KademliaMessage* message = libp2p_message_new();
@@ -120,6 +127,7 @@ int ipfs_routing_online_find_remote_providers(struct IpfsRouting* routing, const
  * @returns true(1) on success, otherwise false(0)
  */
 int ipfs_routing_online_find_providers(struct IpfsRouting* routing, const unsigned char* key, size_t key_size, struct Libp2pVector** peers) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_find_providers");
 	unsigned char* peer_id;
 	int peer_id_size;
 	struct Libp2pPeer *peer;
@@ -204,6 +212,7 @@ int ipfs_routing_online_ask_peer_for_peer(struct Libp2pPeer* whoToAsk, const uns
  * @returns true(1) on success, otherwise false(0)
  */
 int ipfs_routing_online_find_peer(struct IpfsRouting* routing, const unsigned char* peer_id, size_t peer_id_size, struct Libp2pPeer **result) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_find_peer");
 	// first look to see if we have it in the local peerstore
 	struct Peerstore* peerstore = routing->local_node->peerstore;
 	*result = libp2p_peerstore_get_peer(peerstore, (unsigned char*)peer_id, peer_id_size);
@@ -247,6 +256,7 @@ struct Libp2pPeer* ipfs_routing_online_build_local_peer(struct IpfsRouting* rout
  * @returns true(1) on success, otherwise false
  */
 int ipfs_routing_online_provide(struct IpfsRouting* routing, const unsigned char* key, size_t key_size) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_provide");
 	// build a Libp2pPeer that represents this peer
 	struct Libp2pPeer* local_peer = ipfs_routing_online_build_local_peer(routing);
 
@@ -295,6 +305,7 @@ int ipfs_routing_online_provide(struct IpfsRouting* routing, const unsigned char
  * @returns true(1) on success, otherwise false(0)
  */
 int ipfs_routing_online_ping(struct IpfsRouting* routing, struct Libp2pPeer* peer) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_ping");
 	struct KademliaMessage *outMsg = NULL, *inMsg = NULL;
 	int retVal = 0;
 
@@ -341,6 +352,7 @@ int ipfs_routing_online_ping(struct IpfsRouting* routing, struct Libp2pPeer* pee
  * @returns true(1) on success
  */
 int ipfs_routing_online_get_peer_value(ipfs_routing* routing, const struct Libp2pPeer* peer, const unsigned char* key, size_t key_size, void** buffer, size_t *buffer_size) {
+	IPFS_TRACE_SPAN("ipfs_routing_online_get_peer_value");
 	// build message
 	struct KademliaMessage* msg = libp2p_message_new();
 	msg->key_size = key_size;
@@ -386,6 +398,7 @@ int ipfs_routing_online_get_peer_value(ipfs_routing* routing, const struct Libp2
  */
 int ipfs_routing_online_get_value (ipfs_routing* routing, const unsigned char *key, size_t key_size, void **buffer, size_t *buffer_size)
 {
+	IPFS_TRACE_SPAN("ipfs_routing_online_get_value");
 	struct Libp2pVector *peers = NULL;
 	int retVal = 0;
 
@@ -430,7 +443,11 @@ int ipfs_routing_online_get_value (ipfs_routing* routing, const unsigned char *k
 			if (!libp2p_peer_is_connected(current_peer)) {
 				// attempt to connect. If unsuccessful, continue in the loop.
 				libp2p_logger_debug("online", "Attempting to connect to peer to retrieve file\n");
-				if (libp2p_peer_connect(routing->local_node->dialer, current_peer, routing->local_node->peerstore, routing->local_node->repo->config->datastore, 5)) {
+				struct TraceSpan dial;
+				ipfs_util_trace_begin(&dial, "libp2p_peer_connect");
+				int connected = libp2p_peer_connect(routing->local_node->dialer, current_peer, routing->local_node->peerstore, routing->local_node->repo->config->datastore, 5);
+				ipfs_util_trace_end(&dial);
+				if (connected) {
 					libp2p_logger_debug("online", "Peer connected\n");
 					if (ipfs_routing_online_get_peer_value(routing, current_peer, key, key_size, buffer, buffer_size)) {
 						libp2p_logger_debug("online", "Retrieved a value\n");
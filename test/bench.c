@@ -0,0 +1,732 @@
+/***
+ * Micro-benchmarks of the storage and encoding hot paths.
+ *
+ * Each benchmark runs a fixed number of operations on data built from a
+ * fixed seed, several times, and the fastest run is reported. One line of
+ * JSON is written per benchmark, so runs can be compared by a script.
+ *
+ * Usage: bench_ipfs [-r repeats] [-s scale] [name ...]
+ * where a name runs the benchmarks whose names start with it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libp2p/crypto/encoding/base32.h"
+#include "libp2p/crypto/encoding/base58.h"
+#include "libp2p/crypto/sha256.h"
+#include "libp2p/db/datastore.h"
+#include "ipfs/blocks/block.h"
+#include "ipfs/blocks/blockstore.h"
+#include "ipfs/cid/cid.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/datastore/ds_helper.h"
+#include "ipfs/importer/importer.h"
+#include "ipfs/merkledag/node.h"
+#include "ipfs/multibase/multibase.h"
+#include "ipfs/multihash/multihash.h"
+#include "ipfs/repo/fsrepo/fs_repo.h"
+#include "ipfs/unixfs/unixfs.h"
+#include "test_helper.h"
+
+#define BENCH_REPO "/tmp/ipfs_bench"
+#define BENCH_FILE "/tmp/ipfs_bench_file"
+#define BENCH_CHUNK_SIZE 262144 // what the importer puts in a block
+#define BENCH_LINKS 174 // the links of a node that has a full block of links
+#define BENCH_FILE_SIZE (4 * 1024 * 1024)
+
+/***
+ * Allocations are counted by wrapping malloc, calloc and realloc at link
+ * time (-Wl,--wrap). Only allocations of code linked into the binary are
+ * counted, not those made inside the C library itself.
+ */
+static unsigned long long bench_allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	__atomic_fetch_add(&bench_allocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	__atomic_fetch_add(&bench_allocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+	__atomic_fetch_add(&bench_allocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+/***
+ * What the benchmarks work on. Built once, before any are run.
+ */
+struct BenchFixture {
+	struct IpfsNode* local_node;
+	struct HashtableNode* node;
+	unsigned char* node_protobuf;
+	size_t node_protobuf_size;
+	struct Block* block;
+	unsigned char* block_protobuf;
+	size_t block_protobuf_size;
+	struct UnixFS* unix_fs;
+	unsigned char* chunk; // BENCH_CHUNK_SIZE bytes
+	struct Cid** cids; // of the blocks put in the blockstore
+	int cids_count;
+	struct DatastoreRecord** records; // for the datastore
+	int records_count;
+	int records_put; // the first records_put records are in the datastore
+};
+
+/***
+ * One run of a benchmark
+ */
+struct BenchRun {
+	struct BenchFixture* fixture;
+	int ops;
+	int first; // each repeat of a put uses new items, starting here
+	size_t bytes; // bytes handled by all the ops
+	uint64_t nanoseconds;
+	unsigned long long allocs;
+};
+
+struct Bench {
+	const char* name;
+	int ops; // at scale 1
+	int (*run)(struct BenchRun* run);
+};
+
+static uint64_t bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_start(struct BenchRun* run) {
+	run->allocs = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED);
+	run->nanoseconds = bench_now();
+}
+
+static void bench_stop(struct BenchRun* run) {
+	run->nanoseconds = bench_now() - run->nanoseconds;
+	run->allocs = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED) - run->allocs;
+}
+
+/***
+ * Fill a buffer with bytes that are the same on every run
+ * @param buffer the buffer
+ * @param size its size
+ * @param seed where the sequence starts
+ */
+static void bench_fill(unsigned char* buffer, size_t size, uint64_t seed) {
+	uint64_t x = seed * 0x9E3779B97F4A7C15ULL + 1;
+	for(size_t i = 0; i < size; i++) {
+		// xorshift64
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buffer[i] = (unsigned char)x;
+	}
+}
+
+/***
+ * A multihash (sha2-256) made from the seed
+ */
+static void bench_hash(unsigned char hash[34], uint64_t seed) {
+	hash[0] = 0x12;
+	hash[1] = 0x20;
+	bench_fill(&hash[2], 32, seed);
+}
+
+int bench_node_encode(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	size_t size = ipfs_hashtable_node_protobuf_encode_size(fixture->node);
+	unsigned char* buffer = malloc(size);
+	size_t written = 0;
+	if (buffer == NULL)
+		return 0;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!ipfs_hashtable_node_protobuf_encode(fixture->node, buffer, size, &written)) {
+			free(buffer);
+			return 0;
+		}
+		run->bytes += written;
+	}
+	bench_stop(run);
+	free(buffer);
+	return 1;
+}
+
+int bench_node_decode(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct HashtableNode* node = NULL;
+		if (!ipfs_hashtable_node_protobuf_decode(fixture->node_protobuf, fixture->node_protobuf_size, &node))
+			return 0;
+		ipfs_hashtable_node_free(node);
+		run->bytes += fixture->node_protobuf_size;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_block_encode(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	size_t size = ipfs_blocks_block_protobuf_encode_size(fixture->block);
+	unsigned char* buffer = malloc(size);
+	size_t written = 0;
+	if (buffer == NULL)
+		return 0;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!ipfs_blocks_block_protobuf_encode(fixture->block, buffer, size, &written)) {
+			free(buffer);
+			return 0;
+		}
+		run->bytes += written;
+	}
+	bench_stop(run);
+	free(buffer);
+	return 1;
+}
+
+int bench_block_decode(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct Block* block = NULL;
+		if (!ipfs_blocks_block_protobuf_decode(fixture->block_protobuf, fixture->block_protobuf_size, &block))
+			return 0;
+		ipfs_block_free(block);
+		run->bytes += fixture->block_protobuf_size;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_unixfs_encode(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	size_t size = ipfs_unixfs_protobuf_encode_size(fixture->unix_fs);
+	unsigned char* buffer = malloc(size);
+	size_t written = 0;
+	if (buffer == NULL)
+		return 0;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!ipfs_unixfs_protobuf_encode(fixture->unix_fs, buffer, size, &written)) {
+			free(buffer);
+			return 0;
+		}
+		run->bytes += written;
+	}
+	bench_stop(run);
+	free(buffer);
+	return 1;
+}
+
+int bench_cid_decode_base58(struct BenchRun* run) {
+	const char* hash = "QmPZ9gcCEpqKTo6aq61g2nXGUhM4iCL3ewB6LDXZCtioEB";
+	size_t hash_length = strlen(hash);
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct Cid* cid = NULL;
+		if (!ipfs_cid_decode_hash_from_base58((const unsigned char*)hash, hash_length, &cid))
+			return 0;
+		ipfs_cid_free(cid);
+		run->bytes += hash_length;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+/***
+ * Fill a set the way a DAG walk does with the nodes it visited, checking
+ * each cid before adding it, then look them all up again
+ */
+int bench_cid_set(struct BenchRun* run) {
+	unsigned char* hashes = malloc((size_t)run->ops * 34);
+	struct CidSet* set = ipfs_cid_set_new();
+	struct Cid cid;
+	int retVal = 0;
+	if (hashes == NULL || set == NULL)
+		goto exit;
+	for(int i = 0; i < run->ops; i++)
+		bench_hash(&hashes[(size_t)i * 34], i);
+	cid.version = 0;
+	cid.codec = CID_DAG_PROTOBUF;
+	cid.hash_length = 34;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		cid.hash = &hashes[(size_t)i * 34];
+		if (ipfs_cid_set_has(set, &cid) || ipfs_cid_set_add(set, &cid, 1) != 0)
+			goto exit;
+	}
+	for(int i = 0; i < run->ops; i++) {
+		cid.hash = &hashes[(size_t)i * 34];
+		if (!ipfs_cid_set_has(set, &cid))
+			goto exit;
+		run->bytes += 34;
+	}
+	bench_stop(run);
+	retVal = 1;
+	exit:
+	ipfs_cid_set_destroy(&set);
+	free(hashes);
+	return retVal;
+}
+
+int bench_base32_key(struct BenchRun* run) {
+	unsigned char hash[34];
+	unsigned char key[100];
+	size_t key_length;
+	bench_hash(hash, 1);
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		key_length = sizeof(key);
+		if (!ipfs_datastore_helper_ds_key_from_binary(hash, sizeof(hash), key, key_length, &key_length))
+			return 0;
+		run->bytes += sizeof(hash);
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_base32_multihash(struct BenchRun* run) {
+	unsigned char hash[MULTIBASE_MULTIHASH_SIZE];
+	unsigned char key[MULTIBASE_BASE32_MULTIHASH_LENGTH + 1];
+	size_t key_length;
+	bench_hash(hash, 1);
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		hash[2] = i;
+		if (!multibase_base32_encode_upper(hash, sizeof(hash), key, sizeof(key), &key_length))
+			return 0;
+		run->bytes += sizeof(hash);
+	}
+	bench_stop(run);
+	return 1;
+}
+
+/***
+ * What base32_multihash replaces, to compare with
+ */
+int bench_base32_libp2p(struct BenchRun* run) {
+	unsigned char hash[MULTIBASE_MULTIHASH_SIZE];
+	unsigned char key[MULTIBASE_BASE32_MULTIHASH_LENGTH + 1];
+	size_t key_length;
+	bench_hash(hash, 1);
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		hash[2] = i;
+		key_length = sizeof(key);
+		if (!libp2p_crypto_encoding_base32_encode(hash, sizeof(hash), key, &key_length))
+			return 0;
+		run->bytes += sizeof(hash);
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_base58_cidv0(struct BenchRun* run) {
+	const char* hash = "QmPZ9gcCEpqKTo6aq61g2nXGUhM4iCL3ewB6LDXZCtioEB";
+	unsigned char multihash[MULTIBASE_MULTIHASH_SIZE];
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!multibase_base58_decode_cidv0((const unsigned char*)hash, MULTIBASE_BASE58_CIDV0_LENGTH, multihash))
+			return 0;
+		run->bytes += MULTIBASE_BASE58_CIDV0_LENGTH;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+/***
+ * What base58_cidv0 replaces, to compare with
+ */
+int bench_base58_libp2p(struct BenchRun* run) {
+	const char* hash = "QmPZ9gcCEpqKTo6aq61g2nXGUhM4iCL3ewB6LDXZCtioEB";
+	unsigned char multihash[MULTIBASE_MULTIHASH_SIZE + 16];
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		unsigned char* ptr = multihash;
+		size_t multihash_length = sizeof(multihash);
+		if (!libp2p_crypto_encoding_base58_decode((const unsigned char*)hash, MULTIBASE_BASE58_CIDV0_LENGTH, &ptr, &multihash_length))
+			return 0;
+		run->bytes += MULTIBASE_BASE58_CIDV0_LENGTH;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+/***
+ * Hash a chunk with a hash function of the multihash module
+ */
+static int bench_hash_chunk(struct BenchRun* run, int (*digest)(const unsigned char* data, size_t data_size, unsigned char* digest)) {
+	unsigned char hash[IPFS_MULTIHASH_DIGEST_SIZE];
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!digest(run->fixture->chunk, BENCH_CHUNK_SIZE, hash))
+			return 0;
+		run->bytes += BENCH_CHUNK_SIZE;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_sha256(struct BenchRun* run) {
+	return bench_hash_chunk(run, ipfs_multihash_sha256);
+}
+
+/***
+ * What sha256 replaces, to compare with
+ */
+static int bench_libp2p_sha256(const unsigned char* data, size_t data_size, unsigned char* digest) {
+	return libp2p_crypto_hashing_sha256((unsigned char*)data, data_size, digest);
+}
+
+int bench_sha256_libp2p(struct BenchRun* run) {
+	return bench_hash_chunk(run, bench_libp2p_sha256);
+}
+
+int bench_blake2b_256(struct BenchRun* run) {
+	return bench_hash_chunk(run, ipfs_multihash_blake2b_256);
+}
+
+int bench_blake3(struct BenchRun* run) {
+	return bench_hash_chunk(run, ipfs_multihash_blake3);
+}
+
+/***
+ * Build the records for the datastore, the first time they are needed
+ */
+static int bench_build_records(struct BenchFixture* fixture, int count) {
+	if (fixture->records_count >= count)
+		return 1;
+	struct DatastoreRecord** records = realloc(fixture->records, count * sizeof(struct DatastoreRecord*));
+	if (records == NULL)
+		return 0;
+	fixture->records = records;
+	for(int i = fixture->records_count; i < count; i++) {
+		struct DatastoreRecord* rec = libp2p_datastore_record_new();
+		if (rec == NULL)
+			return 0;
+		fixture->records[i] = rec;
+		fixture->records_count = i + 1;
+		rec->key_size = 34;
+		rec->key = malloc(rec->key_size);
+		rec->value = malloc(100);
+		if (rec->key == NULL || rec->value == NULL)
+			return 0;
+		bench_hash(rec->key, i + 1000);
+		if (!ipfs_datastore_helper_ds_key_from_binary(rec->key, rec->key_size, rec->value, 100, &rec->value_size))
+			return 0;
+		rec->timestamp = 0;
+	}
+	return 1;
+}
+
+int bench_blockstore_put(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	struct Blockstore* blockstore = fixture->local_node->blockstore;
+	struct Block* blocks[run->ops];
+	struct Cid** cids = realloc(fixture->cids, (fixture->cids_count + run->ops) * sizeof(struct Cid*));
+	size_t written = 0;
+	int retVal = 0;
+
+	if (cids == NULL)
+		return 0;
+	fixture->cids = cids;
+	memset(blocks, 0, sizeof(blocks));
+	// each block is new to the blockstore
+	for(int i = 0; i < run->ops; i++) {
+		int seed = run->first + i;
+		memcpy(fixture->chunk, &seed, sizeof(seed));
+		blocks[i] = ipfs_block_new();
+		if (blocks[i] == NULL || !ipfs_blocks_block_add_data(fixture->chunk, BENCH_CHUNK_SIZE, blocks[i]))
+			goto exit;
+	}
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		if (!blockstore->Put(blockstore->blockstoreContext, blocks[i], &written))
+			goto exit;
+		run->bytes += written;
+	}
+	bench_stop(run);
+	// keep what is needed to get them back
+	for(int i = 0; i < run->ops; i++)
+		fixture->cids[fixture->cids_count++] = ipfs_cid_copy(blocks[i]->cid);
+	retVal = 1;
+	exit:
+	for(int i = 0; i < run->ops; i++)
+		if (blocks[i] != NULL)
+			ipfs_block_free(blocks[i]);
+	return retVal;
+}
+
+int bench_blockstore_get(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	struct Blockstore* blockstore = fixture->local_node->blockstore;
+	// the blocks were put by blockstore_put, or are put now
+	if (fixture->cids_count < run->ops) {
+		struct BenchRun put = { fixture, run->ops - fixture->cids_count, fixture->cids_count, 0, 0, 0 };
+		if (!bench_blockstore_put(&put))
+			return 0;
+	}
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct Block* block = NULL;
+		if (!blockstore->Get(blockstore->blockstoreContext, fixture->cids[i], &block))
+			return 0;
+		run->bytes += block->data_length;
+		ipfs_block_free(block);
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_lmdb_put(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	struct Datastore* datastore = fixture->local_node->repo->config->datastore;
+	// each record is new to the datastore
+	if (!bench_build_records(fixture, run->first + run->ops))
+		return 0;
+	bench_start(run);
+	for(int i = run->first; i < run->first + run->ops; i++) {
+		if (!datastore->datastore_put(fixture->records[i], datastore))
+			return 0;
+		run->bytes += fixture->records[i]->key_size + fixture->records[i]->value_size;
+	}
+	bench_stop(run);
+	if (fixture->records_put < run->first + run->ops)
+		fixture->records_put = run->first + run->ops;
+	return 1;
+}
+
+int bench_lmdb_get(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	struct Datastore* datastore = fixture->local_node->repo->config->datastore;
+	// the records were put by lmdb_put, or are put now
+	if (fixture->records_put < run->ops) {
+		struct BenchRun put = { fixture, run->ops - fixture->records_put, fixture->records_put, 0, 0, 0 };
+		if (!bench_lmdb_put(&put))
+			return 0;
+	}
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct DatastoreRecord* rec = NULL;
+		if (!datastore->datastore_get(fixture->records[i]->key, fixture->records[i]->key_size, &rec, datastore))
+			return 0;
+		run->bytes += rec->key_size + rec->value_size;
+		libp2p_datastore_record_free(rec);
+	}
+	bench_stop(run);
+	return 1;
+}
+
+int bench_import_file(struct BenchRun* run) {
+	struct BenchFixture* fixture = run->fixture;
+	size_t written = 0;
+	bench_start(run);
+	for(int i = 0; i < run->ops; i++) {
+		struct HashtableNode* node = NULL;
+		if (!ipfs_import_file(NULL, BENCH_FILE, &node, fixture->local_node, &written, 0))
+			return 0;
+		ipfs_hashtable_node_free(node);
+		run->bytes += BENCH_FILE_SIZE;
+	}
+	bench_stop(run);
+	return 1;
+}
+
+static struct Bench benches[] = {
+	{ "hashtable_node_protobuf_encode", 20000, bench_node_encode },
+	{ "hashtable_node_protobuf_decode", 20000, bench_node_decode },
+	{ "block_protobuf_encode", 2000, bench_block_encode },
+	{ "block_protobuf_decode", 2000, bench_block_decode },
+	{ "unixfs_protobuf_encode", 2000, bench_unixfs_encode },
+	{ "cid_decode_hash_from_base58", 200000, bench_cid_decode_base58 },
+	{ "base32_key", 1000000, bench_base32_key },
+	{ "base32_multihash", 1000000, bench_base32_multihash },
+	{ "base32_libp2p", 1000000, bench_base32_libp2p },
+	{ "base58_cidv0", 1000000, bench_base58_cidv0 },
+	{ "base58_libp2p", 200000, bench_base58_libp2p },
+	{ "sha256", 200, bench_sha256 },
+	{ "sha256_libp2p", 200, bench_sha256_libp2p },
+	{ "blake2b_256", 200, bench_blake2b_256 },
+	{ "blake3", 200, bench_blake3 },
+	{ "cid_set", 1000000, bench_cid_set },
+	{ "blockstore_put", 200, bench_blockstore_put },
+	{ "blockstore_get", 200, bench_blockstore_get },
+	{ "lmdb_put", 2000, bench_lmdb_put },
+	{ "lmdb_get", 2000, bench_lmdb_get },
+	{ "import_file", 5, bench_import_file },
+};
+
+/***
+ * Build what the benchmarks work on
+ * @param fixture the struct to fill
+ * @returns true(1) on success, false(0) otherwise
+ */
+static int bench_fixture_new(struct BenchFixture* fixture) {
+	unsigned char hash[34];
+	char name[20];
+
+	memset(fixture, 0, sizeof(struct BenchFixture));
+	if (!drop_and_build_repository(BENCH_REPO, 4001, NULL, NULL))
+		return 0;
+	if (!ipfs_node_offline_new(BENCH_REPO, &fixture->local_node))
+		return 0;
+
+	fixture->chunk = malloc(BENCH_CHUNK_SIZE);
+	if (fixture->chunk == NULL)
+		return 0;
+	bench_fill(fixture->chunk, BENCH_CHUNK_SIZE, 0);
+
+	// a node with a block worth of links, like the root of a large file
+	if (!ipfs_hashtable_node_new(&fixture->node))
+		return 0;
+	for(int i = 0; i < BENCH_LINKS; i++) {
+		struct NodeLink* link = NULL;
+		bench_hash(hash, i);
+		sprintf(name, "%d", i);
+		if (!ipfs_node_link_create(name, hash, sizeof(hash), &link) || !ipfs_hashtable_node_add_link(fixture->node, link))
+			return 0;
+	}
+	if (!ipfs_hashtable_node_set_data(fixture->node, fixture->chunk, 1024))
+		return 0;
+	fixture->node_protobuf_size = ipfs_hashtable_node_protobuf_encode_size(fixture->node);
+	fixture->node_protobuf = malloc(fixture->node_protobuf_size);
+	if (fixture->node_protobuf == NULL
+			|| !ipfs_hashtable_node_protobuf_encode(fixture->node, fixture->node_protobuf, fixture->node_protobuf_size, &fixture->node_protobuf_size))
+		return 0;
+
+	// a block with a full chunk
+	fixture->block = ipfs_block_new();
+	if (fixture->block == NULL || !ipfs_blocks_block_add_data(fixture->chunk, BENCH_CHUNK_SIZE, fixture->block))
+		return 0;
+	fixture->block_protobuf_size = ipfs_blocks_block_protobuf_encode_size(fixture->block);
+	fixture->block_protobuf = malloc(fixture->block_protobuf_size);
+	if (fixture->block_protobuf == NULL
+			|| !ipfs_blocks_block_protobuf_encode(fixture->block, fixture->block_protobuf, fixture->block_protobuf_size, &fixture->block_protobuf_size))
+		return 0;
+
+	// the data of a leaf of a file
+	if (!ipfs_unixfs_new(&fixture->unix_fs))
+		return 0;
+	fixture->unix_fs->data_type = UNIXFS_FILE;
+	fixture->unix_fs->file_size = BENCH_CHUNK_SIZE;
+	if (!ipfs_unixfs_add_data(fixture->chunk, BENCH_CHUNK_SIZE, fixture->unix_fs))
+		return 0;
+
+	// the file to import
+	unsigned char* file_bytes = malloc(BENCH_FILE_SIZE);
+	if (file_bytes == NULL)
+		return 0;
+	bench_fill(file_bytes, BENCH_FILE_SIZE, 2);
+	int retVal = create_file(BENCH_FILE, file_bytes, BENCH_FILE_SIZE);
+	free(file_bytes);
+	return retVal;
+}
+
+static void bench_fixture_free(struct BenchFixture* fixture) {
+	for(int i = 0; i < fixture->cids_count; i++)
+		ipfs_cid_free(fixture->cids[i]);
+	free(fixture->cids);
+	for(int i = 0; i < fixture->records_count; i++)
+		libp2p_datastore_record_free(fixture->records[i]);
+	free(fixture->records);
+	if (fixture->unix_fs != NULL)
+		ipfs_unixfs_free(fixture->unix_fs);
+	if (fixture->block != NULL)
+		ipfs_block_free(fixture->block);
+	free(fixture->block_protobuf);
+	if (fixture->node != NULL)
+		ipfs_hashtable_node_free(fixture->node);
+	free(fixture->node_protobuf);
+	free(fixture->chunk);
+	if (fixture->local_node != NULL)
+		ipfs_node_free(fixture->local_node);
+	unlink(BENCH_FILE);
+}
+
+/***
+ * See if a benchmark was asked for
+ */
+static int bench_selected(const char* name, int argc, char** argv, int first) {
+	if (first == argc)
+		return 1;
+	for(int i = first; i < argc; i++)
+		if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+			return 1;
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	struct BenchFixture fixture;
+	int repeats = 5;
+	double scale = 1;
+	int first = 1;
+	int retVal = 0;
+
+	while (first + 1 < argc && argv[first][0] == '-') {
+		if (strcmp(argv[first], "-r") == 0)
+			repeats = atoi(argv[first + 1]);
+		else if (strcmp(argv[first], "-s") == 0)
+			scale = atof(argv[first + 1]);
+		else
+			break;
+		first += 2;
+	}
+	if (first < argc && argv[first][0] == '-') {
+		fprintf(stderr, "Usage: %s [-r repeats] [-s scale] [name ...]\n", argv[0]);
+		return 1;
+	}
+	if (repeats < 1)
+		repeats = 1;
+
+	if (!bench_fixture_new(&fixture)) {
+		fprintf(stderr, "Unable to build what the benchmarks need.\n");
+		bench_fixture_free(&fixture);
+		return 1;
+	}
+
+	for(int i = 0; i < sizeof(benches) / sizeof(struct Bench); i++) {
+		if (!bench_selected(benches[i].name, argc, argv, first))
+			continue;
+		int ops = benches[i].ops * scale;
+		if (ops < 1)
+			ops = 1;
+		struct BenchRun best = { &fixture, ops, 0, 0, UINT64_MAX, 0 };
+		for(int j = 0; j < repeats; j++) {
+			struct BenchRun run = { &fixture, ops, j * ops, 0, 0, 0 };
+			if (!benches[i].run(&run)) {
+				fprintf(stderr, "Benchmark %s failed.\n", benches[i].name);
+				retVal = 1;
+				break;
+			}
+			if (run.nanoseconds < best.nanoseconds)
+				best = run;
+		}
+		if (best.nanoseconds == UINT64_MAX)
+			continue;
+		double seconds = best.nanoseconds / 1e9;
+		printf("{\"benchmark\":\"%s\",\"ops\":%d,\"repeats\":%d,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f,\"bytes_per_sec\":%.1f,\"allocs_per_op\":%.2f}\n",
+				benches[i].name, best.ops, repeats,
+				(double)best.nanoseconds / best.ops,
+				seconds > 0 ? best.ops / seconds : 0,
+				seconds > 0 ? best.bytes / seconds : 0,
+				(double)best.allocs / best.ops);
+		fflush(stdout);
+	}
+
+	bench_fixture_free(&fixture);
+	return retVal;
+}
@@ -6,6 +6,8 @@
 #include "ipfs/cid/cid.h"
 #include "ipfs/multibase/multibase.h"
 
+#include "libp2p/crypto/encoding/base32.h"
+#include "libp2p/crypto/encoding/base58.h"
 #include "libp2p/crypto/sha256.h"
 
 int test_cid_new_free() {
@@ -154,3 +156,156 @@ int test_cid_protobuf_encode_decode() {
 	ipfs_cid_free(results);
 	return 1;
 }
+
+static int test_cid_set_count = 0;
+
+static int test_cid_set_counter(struct Cid* cid) {
+	test_cid_set_count++;
+	return 0;
+}
+
+/***
+ * Add, find and remove enough cids that the set has to grow and rebuild
+ */
+int test_cid_set() {
+	int retVal = 0;
+	unsigned char hash[34];
+	struct Cid cid;
+	unsigned char** keys = NULL;
+	struct CidSet* set = ipfs_cid_set_new();
+	if (set == NULL)
+		return 0;
+
+	cid.version = 0;
+	cid.codec = CID_DAG_PROTOBUF;
+	cid.hash = hash;
+	cid.hash_length = sizeof(hash);
+	hash[0] = 0x12;
+	hash[1] = 0x20;
+	memset(&hash[2], 0, 32);
+
+	for(int i = 0; i < 10000; i++) {
+		memcpy(&hash[2], &i, sizeof(int));
+		if (ipfs_cid_set_add(set, &cid, 1) != 0)
+			goto exit;
+	}
+	// again, which changes nothing
+	for(int i = 0; i < 10000; i++) {
+		memcpy(&hash[2], &i, sizeof(int));
+		if (ipfs_cid_set_add(set, &cid, 1) != 0)
+			goto exit;
+	}
+	if (ipfs_cid_set_len(set) != 10000)
+		goto exit;
+	// remove the odd ones
+	for(int i = 1; i < 10000; i += 2) {
+		memcpy(&hash[2], &i, sizeof(int));
+		if (!ipfs_cid_set_remove(set, &cid))
+			goto exit;
+	}
+	for(int i = 0; i < 10000; i++) {
+		memcpy(&hash[2], &i, sizeof(int));
+		if (ipfs_cid_set_has(set, &cid) != (i % 2 == 0)) {
+			fprintf(stderr, "Cid %d should%s be in the set.\n", i, i % 2 == 0 ? "" : " not");
+			goto exit;
+		}
+	}
+	if (ipfs_cid_set_len(set) != 5000)
+		goto exit;
+
+	// a shorter multihash, with a new codec
+	cid.hash_length = 4;
+	cid.codec = CID_RAW;
+	if (ipfs_cid_set_add(set, &cid, 1) != 0 || !ipfs_cid_set_has(set, &cid) || ipfs_cid_set_len(set) != 5001)
+		goto exit;
+
+	keys = ipfs_cid_set_keys(set);
+	if (keys == NULL)
+		goto exit;
+	int num_keys = 0;
+	while (keys[num_keys] != NULL)
+		num_keys++;
+	if (num_keys != 5001)
+		goto exit;
+
+	test_cid_set_count = 0;
+	ipfs_cid_set_foreach(set, test_cid_set_counter);
+	if (test_cid_set_count != 5001)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	if (keys != NULL) {
+		for(int i = 0; keys[i] != NULL; i++)
+			free(keys[i]);
+		free(keys);
+	}
+	ipfs_cid_set_destroy(&set);
+	return retVal;
+}
+
+/***
+ * The allocation free codecs of multibase should give what the libp2p ones do
+ */
+int test_cid_multibase_fast_codecs() {
+	const char* cidv0 = "QmPZ9gcCEpqKTo6aq61g2nXGUhM4iCL3ewB6LDXZCtioEB";
+	unsigned char multihash[MULTIBASE_MULTIHASH_SIZE];
+	unsigned char expected[100];
+	unsigned char* ptr = expected;
+	size_t expected_length = sizeof(expected);
+	unsigned char key[100];
+	size_t key_length = 0;
+	unsigned int seed = 1;
+
+	// a known CIDv0
+	if (!multibase_base58_decode_cidv0((unsigned char*)cidv0, strlen(cidv0), multihash)
+			|| !libp2p_crypto_encoding_base58_decode((unsigned char*)cidv0, strlen(cidv0), &ptr, &expected_length)
+			|| expected_length != sizeof(multihash) || memcmp(multihash, expected, sizeof(multihash)) != 0) {
+		fprintf(stderr, "The base58 of %s was not decoded as libp2p does\n", cidv0);
+		return 0;
+	}
+	for(int i = 0; i < 1000; i++) {
+		multihash[0] = 0x12;
+		multihash[1] = 0x20;
+		for(size_t j = 2; j < sizeof(multihash); j++) {
+			seed = seed * 1103515245 + 12345;
+			multihash[j] = seed >> 16;
+		}
+		// base32, as the datastore keys
+		expected_length = sizeof(expected);
+		if (!multibase_base32_encode_upper(multihash, sizeof(multihash), key, sizeof(key), &key_length)
+				|| key_length != MULTIBASE_BASE32_MULTIHASH_LENGTH
+				|| !libp2p_crypto_encoding_base32_encode(multihash, sizeof(multihash), expected, &expected_length)
+				|| expected_length != key_length || memcmp(key, expected, key_length) != 0) {
+			fprintf(stderr, "The base32 of multihash %d is not what libp2p makes\n", i);
+			return 0;
+		}
+		// base58 and back
+		unsigned char decoded[MULTIBASE_MULTIHASH_SIZE];
+		ptr = key;
+		key_length = sizeof(key);
+		if (!libp2p_crypto_encoding_base58_encode(multihash, sizeof(multihash), &ptr, &key_length)
+				|| key_length != MULTIBASE_BASE58_CIDV0_LENGTH
+				|| !multibase_base58_decode_cidv0(key, key_length, decoded)
+				|| memcmp(decoded, multihash, sizeof(multihash)) != 0) {
+			fprintf(stderr, "The base58 of multihash %d was not decoded\n", i);
+			return 0;
+		}
+	}
+	// what is not the base58 of a sha2-256 multihash
+	if (multibase_base58_decode_cidv0((unsigned char*)cidv0, strlen(cidv0) - 1, multihash)
+			|| multibase_base58_decode_cidv0((unsigned char*)"QmPZ9gcCEpqKTo6aq61g2nXGUhM4iCL3ewB6LDXZCtio0B", 46, multihash)
+			|| multibase_base58_decode_cidv0((unsigned char*)"zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz", 46, multihash)) {
+		fprintf(stderr, "What is not a CIDv0 should not be decoded\n");
+		return 0;
+	}
+	// what is longer than any multihash
+	struct Cid* cid = NULL;
+	memset(key, 'z', sizeof(key));
+	if (ipfs_cid_decode_hash_from_base58(key, sizeof(key), &cid) || cid != NULL) {
+		fprintf(stderr, "What is longer than a multihash should not be decoded\n");
+		ipfs_cid_free(cid);
+		return 0;
+	}
+	return 1;
+}
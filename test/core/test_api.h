@@ -1,13 +1,25 @@
 #include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <curl/curl.h>
 
 #include "../test_helper.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/cmd/cli.h"
+#include "ipfs/core/api.h"
 #include "ipfs/core/client_api.h"
+#include "ipfs/core/multipart.h"
 #include "ipfs/core/daemon.h"
+#include "ipfs/core/gateway.h"
+#include "ipfs/core/http_request.h"
 #include "ipfs/importer/exporter.h"
 #include "ipfs/importer/importer.h"
 #include "ipfs/namesys/name.h"
+#include "ipfs/util/memory.h"
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
+#include "multiaddr/multiaddr.h"
 
 int test_core_api_startup_shutdown() {
 	char* repo_path = "/tmp/ipfs_1";
@@ -530,3 +542,697 @@ int test_core_api_name_resolve_3()
 	return retVal;
 
 }
+
+/***
+ * Split pipelined requests, including partial and chunked ones
+ */
+int test_core_api_request_parse() {
+	int retVal = 0;
+	struct s_request req;
+	size_t used = 0, pos = 0;
+	char data[] = "GET /api/v0/version HTTP/1.1\r\nHost: localhost\r\n\r\n"
+			"POST /api/v0/add HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+			"POST /api/v0/add HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n";
+	size_t len = strlen(data);
+
+	req.buf = NULL;
+
+	// not all of the header has arrived
+	if (api_request_parse(data, 20, &req, &used) != 0) {
+		libp2p_logger_error("test_api", "Partial header was accepted.\n");
+		goto exit;
+	}
+	if (api_request_parse(data, len, &req, &used) != 1
+			|| strcmp(req.buf + req.method, "GET") != 0
+			|| strcmp(req.buf + req.path, "/api/v0/version") != 0
+			|| strcmp(req.buf + req.http_ver, "HTTP/1.1") != 0
+			|| req.body_size != 0) {
+		libp2p_logger_error("test_api", "First request was not parsed.\n");
+		goto exit;
+	}
+	free(req.buf);
+	req.buf = NULL;
+	pos += used;
+
+	// the body is not complete
+	if (api_request_parse(data + pos, 50, &req, &used) != 0) {
+		libp2p_logger_error("test_api", "Partial body was accepted.\n");
+		goto exit;
+	}
+	if (api_request_parse(data + pos, len - pos, &req, &used) != 1
+			|| req.body_size != 5
+			|| memcmp(req.buf + req.body, "hello", 5) != 0) {
+		libp2p_logger_error("test_api", "Second request was not parsed.\n");
+		goto exit;
+	}
+	free(req.buf);
+	req.buf = NULL;
+	pos += used;
+
+	if (api_request_parse(data + pos, len - pos - 2, &req, &used) != 0) {
+		libp2p_logger_error("test_api", "Partial chunked body was accepted.\n");
+		goto exit;
+	}
+	if (api_request_parse(data + pos, len - pos, &req, &used) != 1
+			|| req.body_size != 5
+			|| memcmp(req.buf + req.body, "abcde", 5) != 0
+			|| pos + used != len) {
+		libp2p_logger_error("test_api", "Chunked request was not parsed.\n");
+		goto exit;
+	}
+	free(req.buf);
+	req.buf = NULL;
+
+	if (api_request_parse("GARBAGE\r\n\r\n", 11, &req, &used) != -1) {
+		libp2p_logger_error("test_api", "Malformed request was accepted.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (req.buf != NULL)
+		free(req.buf);
+	return retVal;
+}
+
+struct test_multipart_result {
+	int parts;
+	char filename[20];
+	char data[100];
+	size_t data_size;
+};
+
+int test_multipart_on_part(void* ctx, const char* filename) {
+	struct test_multipart_result* result = (struct test_multipart_result*)ctx;
+	result->parts++;
+	strncpy(result->filename, filename ? filename : "", sizeof(result->filename) - 1);
+	return 1;
+}
+
+int test_multipart_on_data(void* ctx, const uint8_t* data, size_t data_size) {
+	struct test_multipart_result* result = (struct test_multipart_result*)ctx;
+	if (result->data_size + data_size > sizeof(result->data))
+		return 0;
+	memcpy(&result->data[result->data_size], data, data_size);
+	result->data_size += data_size;
+	return 1;
+}
+
+/***
+ * Feed a multipart body a byte at a time, so that the boundary is split.
+ * The first boundary line is padded with whitespace.
+ */
+int test_core_api_multipart() {
+	int retVal = 0;
+	const char* body = "--XyZ \t\r\n"
+			"Content-Disposition: form-data; name=\"file\"; filename=\"a.txt\"\r\n"
+			"Content-Type: application/octet-stream\r\n\r\n"
+			"line\r\n--Xy not the end\r\n-"
+			"\r\n--XyZ--\r\n";
+	const char* expected = "line\r\n--Xy not the end\r\n-";
+	struct test_multipart_result result;
+	struct MultipartParser* parser = NULL;
+
+	memset(&result, 0, sizeof(result));
+	parser = ipfs_core_multipart_new("XyZ", test_multipart_on_part, test_multipart_on_data, NULL, &result);
+	if (parser == NULL)
+		goto exit;
+	for(size_t i = 0; i < strlen(body); i++) {
+		if (!ipfs_core_multipart_feed(parser, (uint8_t*)&body[i], 1)) {
+			libp2p_logger_error("test_api", "Feed failed at %lu.\n", i);
+			goto exit;
+		}
+	}
+	if (!ipfs_core_multipart_done(parser)) {
+		libp2p_logger_error("test_api", "Last boundary not found.\n");
+		goto exit;
+	}
+	if (result.parts != 1 || strcmp(result.filename, "a.txt") != 0) {
+		libp2p_logger_error("test_api", "Part was not found.\n");
+		goto exit;
+	}
+	if (result.data_size != strlen(expected) || memcmp(result.data, expected, result.data_size) != 0) {
+		libp2p_logger_error("test_api", "Data of part is wrong.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	ipfs_core_multipart_free(parser);
+	return retVal;
+}
+
+/***
+ * A file name written into json can't end its string or hold control characters
+ */
+int test_core_api_json_escape() {
+	int retVal = 0;
+	char* text = NULL;
+	size_t text_size = 0;
+	const char* expected = "a \\\"b\\\\c\\n\\u0001.txt";
+
+	FILE* out = open_memstream(&text, &text_size);
+	if (out == NULL)
+		goto exit;
+	api_json_escape(out, "a \"b\\c\n\001.txt");
+	fclose(out);
+	if (strcmp(text, expected) != 0) {
+		libp2p_logger_error("test_api", "Expected %s, not %s.\n", expected, text);
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	free(text);
+	return retVal;
+}
+
+/***
+ * What is written to a chunk stream should arrive as chunks of MAX_CHUNK
+ */
+int test_core_api_chunk_stream() {
+	int retVal = 0;
+	int fds[2] = { -1, -1 };
+	size_t data_size = MAX_CHUNK + 100;
+	char* data = NULL;
+	char expected[40];
+	char received[40];
+	FILE* out = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		goto exit;
+	data = malloc(data_size);
+	if (data == NULL)
+		goto exit;
+	memset(data, 'x', data_size);
+
+	out = api_chunk_stream_open(fds[0]);
+	if (out == NULL)
+		goto exit;
+	// several writes should still be one chunk, until the buffer is full
+	fwrite(data, 1, 100, out);
+	fwrite(&data[100], 1, data_size - 100, out);
+	if (fclose(out) != 0) {
+		out = NULL;
+		goto exit;
+	}
+	out = NULL;
+
+	sprintf(expected, "%x\r\n", MAX_CHUNK);
+	if (read(fds[1], received, strlen(expected)) != strlen(expected) || memcmp(received, expected, strlen(expected)) != 0) {
+		libp2p_logger_error("test_api", "First chunk has the wrong size.\n");
+		goto exit;
+	}
+	for(size_t pos = 0; pos < MAX_CHUNK; ) {
+		ssize_t r = read(fds[1], data, MAX_CHUNK - pos);
+		if (r <= 0)
+			goto exit;
+		pos += r;
+	}
+	if (read(fds[1], received, 6) != 6 || memcmp(received, "\r\n64\r\n", 6) != 0) {
+		libp2p_logger_error("test_api", "Second chunk has the wrong size.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (out != NULL)
+		fclose(out);
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	free(data);
+	return retVal;
+}
+
+/***
+ * Parse the Range header of gateway requests
+ */
+int test_core_gateway_range() {
+	size_t first = 0;
+	size_t last = 0;
+
+	if (ipfs_core_gateway_range_parse("bytes=0-499", 1000, &first, &last) != 1 || first != 0 || last != 499)
+		return 0;
+	if (ipfs_core_gateway_range_parse("bytes=500-", 1000, &first, &last) != 1 || first != 500 || last != 999)
+		return 0;
+	if (ipfs_core_gateway_range_parse("bytes=-100", 1000, &first, &last) != 1 || first != 900 || last != 999)
+		return 0;
+	// ranges past the end are cut to the end
+	if (ipfs_core_gateway_range_parse("bytes=900-5000", 1000, &first, &last) != 1 || first != 900 || last != 999)
+		return 0;
+	if (ipfs_core_gateway_range_parse("bytes=1000-", 1000, &first, &last) != -1)
+		return 0;
+	// these are ignored, and the whole file is sent
+	if (ipfs_core_gateway_range_parse("bytes=5-3", 1000, &first, &last) != 0)
+		return 0;
+	if (ipfs_core_gateway_range_parse("bytes=1-2,4-5", 1000, &first, &last) != 0)
+		return 0;
+	if (ipfs_core_gateway_range_parse(NULL, 1000, &first, &last) != 0)
+		return 0;
+	return 1;
+}
+
+/***
+ * Send ranges of a file that spans several blocks, as the gateway does
+ */
+int test_core_gateway_send_range() {
+	int retVal = 0;
+	size_t bytes_size = 1000000; //1mb
+	unsigned char file_bytes[bytes_size];
+	const char* fileName = "/tmp/test_gateway.tmp";
+	const char* repo_dir = "/tmp/ipfs_1";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* file_node = NULL;
+	size_t bytes_written = 0;
+	// within a block, across blocks, the last byte, and the whole file
+	size_t ranges[][2] = { { 10, 100 }, { 262000, 300000 }, { 999999, 1 }, { 0, 1000000 } };
+	unsigned char* received = NULL;
+	FILE* out = NULL;
+
+	create_bytes(file_bytes, bytes_size);
+	create_file(fileName, file_bytes, bytes_size);
+
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+	if (ipfs_import_file(NULL, fileName, &file_node, local_node, &bytes_written, 0) == 0)
+		goto exit;
+	received = malloc(bytes_size);
+	if (received == NULL)
+		goto exit;
+
+	for(int i = 0; i < 4; i++) {
+		out = tmpfile();
+		if (out == NULL)
+			goto exit;
+		if (!ipfs_core_gateway_send_range(local_node, fileno(out), file_node, ranges[i][0], ranges[i][1])) {
+			fprintf(stderr, "Unable to send %lu bytes from %lu\n", ranges[i][1], ranges[i][0]);
+			goto exit;
+		}
+		if (pread(fileno(out), received, ranges[i][1], 0) != ranges[i][1] || memcmp(received, &file_bytes[ranges[i][0]], ranges[i][1]) != 0) {
+			fprintf(stderr, "Wrong bytes sent from %lu\n", ranges[i][0]);
+			goto exit;
+		}
+		fclose(out);
+		out = NULL;
+	}
+
+	retVal = 1;
+	exit:
+	if (out != NULL)
+		fclose(out);
+	free(received);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	if (file_node != NULL)
+		ipfs_hashtable_node_free(file_node);
+	return retVal;
+}
+
+void* test_core_api_metrics_thread(void* arg) {
+	for(int i = 0; i < 1000; i++) {
+		uint64_t start = ipfs_util_metrics_now();
+		ipfs_util_metrics_add(METRICS_BLOCKSTORE_PUT_BYTES, 10);
+		ipfs_util_metrics_observe(METRICS_API_NAME_SECONDS, start);
+	}
+	return NULL;
+}
+
+/***
+ * Counts made by several threads are all in what is written
+ */
+int test_core_api_metrics() {
+	int retVal = 0;
+	pthread_t threads[4];
+	char* text = NULL;
+	size_t text_size = 0;
+	char line[100];
+
+	// the counts are never reset, so only look at what is added here
+	FILE* out = open_memstream(&text, &text_size);
+	if (out == NULL || !ipfs_util_metrics_write(out))
+		goto exit;
+	fclose(out);
+	out = NULL;
+	char* pos = strstr(text, "\nipfs_blockstore_put_bytes_total ");
+	if (pos == NULL)
+		goto exit;
+	unsigned long long bytes = strtoull(strchr(pos + 1, ' ') + 1, NULL, 10);
+	pos = strstr(text, "ipfs_api_request_duration_seconds_count{command=\"name\"} ");
+	if (pos == NULL)
+		goto exit;
+	unsigned long long count = strtoull(strchr(pos, ' ') + 1, NULL, 10);
+	free(text);
+	text = NULL;
+
+	for(int i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, test_core_api_metrics_thread, NULL);
+	for(int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+
+	out = open_memstream(&text, &text_size);
+	if (out == NULL || !ipfs_util_metrics_write(out))
+		goto exit;
+	fclose(out);
+	out = NULL;
+	sprintf(line, "\nipfs_blockstore_put_bytes_total %llu\n", bytes + 40000);
+	if (strstr(text, line) == NULL) {
+		fprintf(stderr, "Expected %s", &line[1]);
+		goto exit;
+	}
+	sprintf(line, "ipfs_api_request_duration_seconds_bucket{command=\"name\",le=\"+Inf\"} %llu\n", count + 4000);
+	if (strstr(text, line) == NULL) {
+		fprintf(stderr, "Expected %s", line);
+		goto exit;
+	}
+	if (strstr(text, "# TYPE ipfs_api_request_duration_seconds histogram\n") == NULL)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	if (out != NULL)
+		fclose(out);
+	free(text);
+	return retVal;
+}
+
+/***
+ * Spans started within a span belong to its trace, and the trace can be
+ * written on its own
+ */
+int test_core_api_trace() {
+	int retVal = 0;
+	char* text = NULL;
+	size_t text_size = 0;
+	char line[100];
+	struct TraceSpan outer, inner, other;
+
+	ipfs_util_trace_begin(&outer, "test_outer");
+	ipfs_util_trace_begin(&inner, "test_inner");
+	uint64_t trace_id = ipfs_util_trace_id();
+	ipfs_util_trace_end(&inner);
+	ipfs_util_trace_end(&outer);
+	if (inner.trace_id != outer.span_id || inner.parent_id != outer.span_id || trace_id != outer.span_id || ipfs_util_trace_id() != 0)
+		goto exit;
+	ipfs_util_trace_begin(&other, "test_other");
+	ipfs_util_trace_end(&other);
+	if (other.trace_id == outer.trace_id)
+		goto exit;
+
+	FILE* out = open_memstream(&text, &text_size);
+	if (out == NULL)
+		goto exit;
+	if (!ipfs_util_trace_write(out, outer.trace_id)) {
+		fclose(out);
+		goto exit;
+	}
+	fclose(out);
+	if (strncmp(text, "{\"traceEvents\":[", 15) != 0 || strstr(text, "\"test_other\"") != NULL)
+		goto exit;
+	// the inner span ended first
+	char* pos = strstr(text, "\"name\":\"test_inner\"");
+	if (pos == NULL || strstr(text, "\"name\":\"test_outer\"") < pos)
+		goto exit;
+	sprintf(line, "\"span\":\"%016llx\",\"parent\":\"%016llx\"", (unsigned long long)inner.span_id, (unsigned long long)outer.span_id);
+	if (strstr(text, line) == NULL) {
+		fprintf(stderr, "Expected %s\n", line);
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	free(text);
+	return retVal;
+}
+
+/***
+ * Tagged allocations are counted against their tag until they are freed
+ */
+int test_core_api_memory() {
+	int retVal = 0;
+	char* text = NULL;
+	size_t text_size = 0;
+	void* ptrs[10];
+
+	uint64_t allocations = ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + MEMORY_TAG_REPO);
+	uint64_t frees = ipfs_util_metrics_counter(METRICS_MEMORY_FREES + MEMORY_TAG_REPO);
+	for(int i = 0; i < 10; i++)
+		ptrs[i] = ipfs_util_memory_alloc(MEMORY_TAG_REPO, 100);
+	if (ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + MEMORY_TAG_REPO) != allocations + 10)
+		goto exit;
+	if (ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATED_BYTES + MEMORY_TAG_REPO)
+			- ipfs_util_metrics_counter(METRICS_MEMORY_FREED_BYTES + MEMORY_TAG_REPO) < 1000)
+		goto exit;
+	FILE* out = open_memstream(&text, &text_size);
+	if (out == NULL)
+		goto exit;
+	int written = ipfs_util_memory_write(out);
+	fclose(out);
+	if (!written || strstr(text, "# TYPE ipfs_memory_live_bytes gauge\n") == NULL
+			|| strstr(text, "ipfs_memory_live_objects{tag=\"repo\"} ") == NULL)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	for(int i = 0; i < 10; i++)
+		ipfs_util_memory_free(MEMORY_TAG_REPO, ptrs[i]);
+	if (ipfs_util_metrics_counter(METRICS_MEMORY_FREES + MEMORY_TAG_REPO) != frees + 10)
+		retVal = 0;
+	free(text);
+	return retVal;
+}
+
+/***
+ * Connect to the api of a repo
+ * @param local_node the node of the repo
+ * @returns the socket, or -1
+ */
+int test_core_api_connect(struct IpfsNode* local_node) {
+	struct MultiAddress* address = multiaddress_new_from_string(local_node->repo->config->addresses->api);
+	struct sockaddr_in server;
+	char* ip = NULL;
+	int s = -1;
+
+	if (address == NULL)
+		return -1;
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(multiaddress_get_ip_port(address));
+	multiaddress_get_ip_address(address, &ip);
+	multiaddress_free(address);
+	if (ip == NULL || inet_pton(AF_INET, ip, &server.sin_addr) != 1) {
+		free(ip);
+		return -1;
+	}
+	free(ip);
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s >= 0 && connect(s, (struct sockaddr*)&server, sizeof(server)) != 0) {
+		close(s);
+		s = -1;
+	}
+	return s;
+}
+
+/***
+ * Two requests sent on one connection before either is answered are both
+ * answered, in order. The body of the first arrives in two pieces, so the
+ * connection waits in the event loop in between.
+ */
+int test_core_api_keep_alive_pipelined() {
+	char* repo_path = "/tmp/ipfs_1";
+	int retVal = 0;
+	pthread_t daemon_thread;
+	int thread_started = 0;
+	struct IpfsNode* client_node = NULL;
+	int s = -1;
+	const char* body = "--XyZ\r\n"
+			"Content-Disposition: form-data; name=\"file\"; filename=\"pipelined.txt\"\r\n"
+			"Content-Type: application/octet-stream\r\n\r\n"
+			"hello, world\r\n--XyZ--\r\n";
+	const char* second = "GET " API_METRICS_PATH " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	char first[200];
+	char response[100000];
+	size_t response_size = 0;
+	size_t half = strlen(body) / 2;
+	struct timeval tv;
+
+	if (!drop_and_build_repository(repo_path, 4001, NULL, NULL))
+		goto exit;
+	pthread_create(&daemon_thread, NULL, test_daemon_start, repo_path);
+	thread_started = 1;
+	sleep(3);
+	if (!ipfs_node_offline_new(repo_path, &client_node) || client_node->mode != MODE_API_AVAILABLE) {
+		libp2p_logger_error("test_api", "API Not available.\n");
+		goto exit;
+	}
+	s = test_core_api_connect(client_node);
+	if (s < 0) {
+		libp2p_logger_error("test_api", "Unable to connect to the API.\n");
+		goto exit;
+	}
+	tv.tv_sec = 10;
+	tv.tv_usec = 0;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	// the header and half of the body, then the rest with the second request
+	sprintf(first, "POST " API_V0_START "add HTTP/1.1\r\nHost: localhost\r\n"
+			"Content-Type: multipart/form-data; boundary=XyZ\r\nContent-Length: %lu\r\n\r\n", (unsigned long)strlen(body));
+	if (write(s, first, strlen(first)) != strlen(first) || write(s, body, half) != half)
+		goto exit;
+	sleep(1);
+	if (write(s, body + half, strlen(body) - half) != strlen(body) - half || write(s, second, strlen(second)) != strlen(second))
+		goto exit;
+
+	// both responses are chunked, and end with the last chunk
+	for (;;) {
+		response[response_size] = 0;
+		char* end = strstr(response, "\r\n0\r\n\r\n");
+		if (end != NULL && strstr(end + 7, "\r\n0\r\n\r\n") != NULL)
+			break;
+		ssize_t r = read(s, response + response_size, sizeof(response) - 1 - response_size);
+		if (r <= 0) {
+			libp2p_logger_error("test_api", "Both responses did not arrive.\n");
+			goto exit;
+		}
+		response_size += r;
+	}
+	char* added = strstr(response, "\"Name\":\"pipelined.txt\"");
+	char* metrics = strstr(response, "# TYPE ");
+	if (strncmp(response, "HTTP/1.1 200", 12) != 0 || added == NULL || metrics == NULL || metrics < added
+			|| strstr(added, "HTTP/1.1 200") == NULL) {
+		libp2p_logger_error("test_api", "The responses are not the ones asked for.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (s >= 0)
+		close(s);
+	if (client_node != NULL)
+		ipfs_node_free(client_node);
+	ipfs_daemon_stop();
+	if (thread_started)
+		pthread_join(daemon_thread, NULL);
+	return retVal;
+}
+
+/***
+ * Count the bytes of a response
+ */
+size_t test_core_http_client_count(void* ptr, size_t size, size_t nmemb, void* data) {
+	*(size_t*)data += size * nmemb;
+	return nmemb;
+}
+
+/***
+ * Requests of the client of a node go to the API on one connection, with
+ * their arguments, and fail on an error status
+ */
+int test_core_http_client() {
+	char* repo_path = "/tmp/ipfs_1";
+	int retVal = 0;
+	pthread_t daemon_thread;
+	int thread_started = 0;
+	struct IpfsNode* client_node = NULL;
+	struct HttpRequest* request = NULL;
+	char* result = NULL;
+	size_t result_size = 0;
+	char* streamed = NULL;
+	size_t streamed_size = 0;
+	FILE* out = NULL;
+	size_t counted = 0;
+	long first_port = 0, second_port = 0;
+	char expected[200];
+
+	if (!drop_and_build_repository(repo_path, 4001, NULL, NULL))
+		goto exit;
+	pthread_create(&daemon_thread, NULL, test_daemon_start, repo_path);
+	thread_started = 1;
+	sleep(3);
+	if (!ipfs_node_offline_new(repo_path, &client_node) || client_node->mode != MODE_API_AVAILABLE) {
+		libp2p_logger_error("test_api", "API Not available.\n");
+		goto exit;
+	}
+	request = ipfs_core_http_request_new();
+	if (request == NULL)
+		goto exit;
+
+	// a GET, counted as it arrives, then kept in memory, on the same connection
+	request->command = "metrics";
+	if (!ipfs_core_http_request_perform(client_node, request, NULL, 0, test_core_http_client_count, &counted) || counted == 0) {
+		libp2p_logger_error("test_api", "The metrics did not arrive.\n");
+		goto exit;
+	}
+	curl_easy_getinfo(client_node->http_client->curl, CURLINFO_LOCAL_PORT, &first_port);
+	if (!ipfs_core_http_request_buffered(client_node, request, &result, &result_size, NULL, 0)
+			|| strstr(result, "# TYPE ") == NULL) {
+		libp2p_logger_error("test_api", "The metrics were not kept.\n");
+		goto exit;
+	}
+	curl_easy_getinfo(client_node->http_client->curl, CURLINFO_LOCAL_PORT, &second_port);
+	if (first_port == 0 || first_port != second_port) {
+		libp2p_logger_error("test_api", "The connection was not used again.\n");
+		goto exit;
+	}
+	free(result);
+	result = NULL;
+
+	// a POST, written to a stream as it arrives
+	out = open_memstream(&streamed, &streamed_size);
+	request->command = "add";
+	if (out == NULL || !ipfs_core_http_request_post_stream(client_node, request, "hello, world", 12, out))
+		goto exit;
+	fclose(out);
+	out = NULL;
+	if (strstr(streamed, "\"Hash\":\"") == NULL) {
+		libp2p_logger_error("test_api", "The add did not answer with a hash.\n");
+		goto exit;
+	}
+
+	// every argument after the first is joined with '&', or the first would not be a trace id
+	request->command = "trace";
+	libp2p_utils_vector_add(request->arguments, "0");
+	libp2p_utils_vector_add(request->arguments, "1");
+	if (!ipfs_core_http_request_build_url(client_node->http_client, request))
+		goto exit;
+	sprintf(expected, "%s/trace?arg=0&arg=1", client_node->http_client->base_url);
+	if (strcmp(client_node->http_client->url, expected) != 0) {
+		libp2p_logger_error("test_api", "Expected %s, not %s.\n", expected, client_node->http_client->url);
+		goto exit;
+	}
+	if (!ipfs_core_http_request_get(client_node, request, &result, &result_size)) {
+		libp2p_logger_error("test_api", "The trace was not found.\n");
+		goto exit;
+	}
+	free(result);
+	result = NULL;
+
+	// a 404 is a failure
+	request->command = "nothing";
+	if (ipfs_core_http_request_get(client_node, request, &result, &result_size)) {
+		libp2p_logger_error("test_api", "An unknown command did not fail.\n");
+		goto exit;
+	}
+	result = NULL;
+
+	retVal = 1;
+	exit:
+	if (out != NULL)
+		fclose(out);
+	free(streamed);
+	free(result);
+	ipfs_core_http_request_free(request);
+	if (client_node != NULL)
+		ipfs_node_free(client_node);
+	ipfs_daemon_stop();
+	if (thread_started)
+		pthread_join(daemon_thread, NULL);
+	return retVal;
+}
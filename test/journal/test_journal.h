@@ -1,7 +1,9 @@
 #include <stdlib.h>
 #include <pthread.h>
 
+#include "ipfs/journal/journal.h"
 #include "ipfs/journal/journal_entry.h"
+#include "ipfs/journal/journal_fetch.h"
 #include "ipfs/journal/journal_message.h"
 #include "ipfs/repo/fsrepo/journalstore.h"
 
@@ -70,6 +72,549 @@ int test_journal_encode_decode() {
 	return retVal;
 }
 
+/***
+ * Build a fake multihash for the summary test
+ */
+void test_journal_fake_hash(int i, uint8_t* hash) {
+	hash[0] = 0x12;
+	hash[1] = 0x20;
+	unsigned int val = i * 2654435761u;
+	for(int j = 2; j < 34; j++) {
+		val = val * 1103515245u + 12345u;
+		hash[j] = val >> 16;
+	}
+}
+
+/***
+ * Summaries of a journal should find every entry, have few false
+ * positives, and be much smaller on the wire than the entries themselves
+ */
+int test_journal_summary() {
+	int retVal = 0;
+	int num_entries = 10000;
+	struct JournalMessage* full = ipfs_journal_message_new();
+	struct JournalMessage* summarized = ipfs_journal_message_new();
+	struct JournalMessage* result_message = NULL;
+	uint8_t* buffer = NULL;
+	size_t full_size = 0, summary_size = 0;
+	uint8_t hash[34];
+
+	// 10 windows of entries
+	int per_window = num_entries / 10;
+	for(int w = 0; w < 10; w++) {
+		unsigned long long start = 1500000000 + w * JOURNAL_SUMMARY_WINDOW;
+		struct JournalSummary* summary = ipfs_journal_summary_new(start, start + JOURNAL_SUMMARY_WINDOW - 1, per_window, 42);
+		for(int i = w * per_window; i < (w + 1) * per_window; i++) {
+			test_journal_fake_hash(i, hash);
+			ipfs_journal_summary_add(summary, hash, 34);
+			struct JournalEntry* entry = ipfs_journal_entry_new();
+			entry->timestamp = start + (i % JOURNAL_SUMMARY_WINDOW);
+			entry->pin = 1;
+			entry->hash_size = 34;
+			entry->hash = malloc(34);
+			memcpy(entry->hash, hash, 34);
+			libp2p_utils_vector_add(full->journal_entries, entry);
+		}
+		libp2p_utils_vector_add(summarized->summaries, summary);
+	}
+
+	// bytes on the wire
+	full_size = ipfs_journal_message_encode_size(full);
+	buffer = malloc(full_size);
+	if (!ipfs_journal_message_encode(full, buffer, full_size, &full_size))
+		goto exit;
+	free(buffer);
+	summary_size = ipfs_journal_message_encode_size(summarized);
+	buffer = malloc(summary_size);
+	if (!ipfs_journal_message_encode(summarized, buffer, summary_size, &summary_size))
+		goto exit;
+	fprintf(stderr, "%d journal entries: %lu bytes as entries, %lu bytes as summaries.\n", num_entries, full_size, summary_size);
+	if (summary_size * 10 > full_size)
+		goto exit;
+
+	// unprotobuf the summaries
+	if (!ipfs_journal_message_decode(buffer, summary_size, &result_message))
+		goto exit;
+	if (result_message->summaries->total != 10)
+		goto exit;
+
+	// every entry should be found
+	for(int i = 0; i < num_entries; i++) {
+		struct JournalSummary* summary = (struct JournalSummary*) libp2p_utils_vector_get(result_message->summaries, i / per_window);
+		test_journal_fake_hash(i, hash);
+		if (!ipfs_journal_summary_contains(summary, hash, 34))
+			goto exit;
+	}
+	// and few that are not there
+	int false_positives = 0;
+	struct JournalSummary* summary = (struct JournalSummary*) libp2p_utils_vector_get(result_message->summaries, 0);
+	for(int i = num_entries; i < num_entries * 2; i++) {
+		test_journal_fake_hash(i, hash);
+		if (ipfs_journal_summary_contains(summary, hash, 34))
+			false_positives++;
+	}
+	fprintf(stderr, "False positives: %d of %d.\n", false_positives, num_entries);
+	if (false_positives > num_entries / 50)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	if (buffer != NULL)
+		free(buffer);
+	ipfs_journal_message_free(full);
+	ipfs_journal_message_free(summarized);
+	ipfs_journal_message_free(result_message);
+	return retVal;
+}
+
+/***
+ * Summaries of a long journal are split into messages of bounded size that
+ * cover the journal without gaps, the last one flagged, and the flags and
+ * position survive the wire
+ */
+int test_journal_summary_batches() {
+	int retVal = 0;
+	int num_windows = 200;
+	struct JournalMessage* message = ipfs_journal_message_new();
+	struct JournalMessage* result_message = NULL;
+	struct Libp2pVector* batches = NULL;
+	uint8_t* buffer = NULL;
+	size_t buffer_size = 0;
+	uint8_t hash[34];
+	unsigned long long first = 1500000000 - (1500000000 % JOURNAL_SUMMARY_WINDOW);
+
+	message->current_epoch = 1600000000;
+	message->start_epoch = 0;
+	message->end_epoch = first + num_windows * JOURNAL_SUMMARY_WINDOW - 10;
+	for(int w = 0; w < num_windows; w++) {
+		unsigned long long start = first + w * JOURNAL_SUMMARY_WINDOW;
+		struct JournalSummary* summary = ipfs_journal_summary_new(start, start + JOURNAL_SUMMARY_WINDOW - 1, 1, 42);
+		test_journal_fake_hash(w, hash);
+		ipfs_journal_summary_add(summary, hash, 34);
+		libp2p_utils_vector_add(message->summaries, summary);
+	}
+	batches = ipfs_journal_message_split_summaries(message, JOURNAL_MESSAGE_REPLY);
+	if (batches == NULL || message->summaries->total != 0) {
+		fprintf(stderr, "Unable to split the summaries.\n");
+		goto exit;
+	}
+	if (batches->total != (num_windows + JOURNAL_SUMMARY_BATCH_SIZE - 1) / JOURNAL_SUMMARY_BATCH_SIZE) {
+		fprintf(stderr, "%d summaries were split into %d messages.\n", num_windows, batches->total);
+		goto exit;
+	}
+	int summaries = 0;
+	unsigned long long next_start = message->start_epoch;
+	for(int i = 0; i < batches->total; i++) {
+		struct JournalMessage* batch = (struct JournalMessage*) libp2p_utils_vector_get(batches, i);
+		int last = (i == batches->total - 1);
+		if (batch->summaries->total > JOURNAL_SUMMARY_BATCH_SIZE
+				|| ipfs_journal_message_encode_size(batch) > JOURNAL_MESSAGE_MAX_SIZE) {
+			fprintf(stderr, "Message %d is too big.\n", i);
+			goto exit;
+		}
+		if (batch->start_epoch != next_start || batch->end_epoch < batch->start_epoch) {
+			fprintf(stderr, "Message %d does not start where message %d ends.\n", i, i - 1);
+			goto exit;
+		}
+		if (!(batch->flags & JOURNAL_MESSAGE_REPLY) || last != ((batch->flags & JOURNAL_MESSAGE_LAST_SUMMARY) != 0)) {
+			fprintf(stderr, "Message %d has the wrong flags.\n", i);
+			goto exit;
+		}
+		summaries += batch->summaries->total;
+		next_start = batch->end_epoch + 1;
+		if (last && batch->end_epoch != message->end_epoch)
+			goto exit;
+	}
+	if (summaries != num_windows)
+		goto exit;
+
+	// the flags and the position on the wire
+	struct JournalMessage* batch = (struct JournalMessage*) libp2p_utils_vector_get(batches, batches->total - 1);
+	test_journal_fake_hash(1, hash);
+	if (!ipfs_journal_message_set_position(batch, 1500000123, hash, 34))
+		goto exit;
+	buffer_size = ipfs_journal_message_encode_size(batch);
+	buffer = malloc(buffer_size);
+	if (!ipfs_journal_message_encode(batch, buffer, buffer_size, &buffer_size)
+			|| !ipfs_journal_message_decode(buffer, buffer_size, &result_message))
+		goto exit;
+	if (result_message->flags != (JOURNAL_MESSAGE_REPLY | JOURNAL_MESSAGE_LAST_SUMMARY)
+			|| result_message->position_epoch != 1500000123 || result_message->position_hash_size != 34
+			|| memcmp(result_message->position_hash, hash, 34) != 0
+			|| result_message->summaries->total != batch->summaries->total) {
+		fprintf(stderr, "The flags and position did not come back from the wire.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (buffer != NULL)
+		free(buffer);
+	if (batches != NULL) {
+		for(int i = 0; i < batches->total; i++)
+			ipfs_journal_message_free((struct JournalMessage*) libp2p_utils_vector_get(batches, i));
+		libp2p_utils_vector_free(batches);
+	}
+	ipfs_journal_message_free(message);
+	ipfs_journal_message_free(result_message);
+	return retVal;
+}
+
+/***
+ * Many records within the same second should all be kept, and
+ * a range scan by time should find them in order
+ */
+int test_journal_composite_key() {
+	int retVal = 0;
+	struct FSRepo* fs_repo = NULL;
+	struct lmdb_trans_cursor *cursor = NULL;
+	struct JournalRecord* rec = NULL;
+	int num_records = 100;
+	int found = 0;
+
+	if (!drop_build_and_open_repo("/tmp/.ipfs", &fs_repo))
+		goto exit;
+
+	if (!lmdb_journalstore_cursor_open(fs_repo->config->datastore->datastore_context, &cursor, NULL))
+		goto exit;
+
+	// a record in an earlier second, then many records in the same second
+	uint8_t hash[2];
+	struct JournalRecord in;
+	in.hash = hash;
+	in.hash_size = 2;
+	in.pin = 1;
+	in.pending = 0;
+	in.timestamp = 999;
+	hash[0] = 0xff;
+	hash[1] = 0xff;
+	if (!lmdb_journalstore_journal_add(cursor, &in))
+		goto exit;
+	in.timestamp = 1000;
+	for(int i = num_records - 1; i >= 0; i--) {
+		hash[0] = i >> 8;
+		hash[1] = i & 0xff;
+		if (!lmdb_journalstore_journal_add(cursor, &in))
+			goto exit;
+	}
+
+	// range scan from 1000
+	if (!lmdb_journalstore_cursor_seek(cursor, 1000, &rec))
+		goto exit;
+	do {
+		if (rec->timestamp != 1000 || rec->hash_size != 2)
+			goto exit;
+		if (((rec->hash[0] << 8) | rec->hash[1]) != found)
+			goto exit;
+		found++;
+	} while (lmdb_journalstore_cursor_get(cursor, CURSOR_NEXT, &rec));
+	if (found != num_records)
+		goto exit;
+
+	// exact lookup
+	lmdb_journal_record_free(rec);
+	rec = lmdb_journal_record_new();
+	rec->timestamp = 1000;
+	rec->hash_size = 2;
+	rec->hash = malloc(2);
+	rec->hash[0] = 0;
+	rec->hash[1] = 42;
+	if (!lmdb_journalstore_cursor_get(cursor, CURSOR_FIRST, &rec) || rec->pin != 1)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	lmdb_journal_record_free(rec);
+	if (cursor != NULL)
+		lmdb_journalstore_cursor_close(cursor, 1);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
+
+/***
+ * Walk the journal in batches, as replication does, and make sure
+ * every record is seen exactly once. Also store and retrieve a peer's progress.
+ */
+int test_journal_get_after() {
+	int retVal = 0;
+	struct FSRepo* fs_repo = NULL;
+	struct lmdb_trans_cursor *cursor = NULL;
+	struct JournalRecord* progress = NULL;
+	int num_records = JOURNAL_SYNC_BATCH_SIZE * 2 + 10;
+	int found = 0;
+
+	if (!drop_build_and_open_repo("/tmp/.ipfs", &fs_repo))
+		goto exit;
+
+	// many records, a few per second
+	if (!lmdb_journalstore_cursor_open(fs_repo->config->datastore->datastore_context, &cursor, NULL))
+		goto exit;
+	uint8_t hash[2];
+	struct JournalRecord in;
+	in.hash = hash;
+	in.hash_size = 2;
+	in.pin = 1;
+	in.pending = 0;
+	for(int i = 0; i < num_records; i++) {
+		in.timestamp = 1000 + (i / 3);
+		hash[0] = i >> 8;
+		hash[1] = i & 0xff;
+		if (!lmdb_journalstore_journal_add(cursor, &in))
+			goto exit;
+	}
+	lmdb_journalstore_cursor_close(cursor, 1);
+	cursor = NULL;
+
+	// read them back in batches
+	struct JournalRecord position;
+	position.timestamp = 0;
+	position.hash = NULL;
+	position.hash_size = 0;
+	uint8_t last_hash[2];
+	for(;;) {
+		struct Libp2pVector* batch = ipfs_journal_get_after(fs_repo->config->datastore, &position, JOURNAL_SYNC_BATCH_SIZE);
+		if (batch == NULL)
+			goto exit;
+		if (batch->total == 0) {
+			ipfs_journal_free_records(batch);
+			break;
+		}
+		for(int i = 0; i < batch->total; i++) {
+			struct JournalRecord* rec = (struct JournalRecord*) libp2p_utils_vector_get(batch, i);
+			if (((rec->hash[0] << 8) | rec->hash[1]) != found) {
+				ipfs_journal_free_records(batch);
+				goto exit;
+			}
+			found++;
+		}
+		struct JournalRecord* last = (struct JournalRecord*) libp2p_utils_vector_get(batch, batch->total - 1);
+		position.timestamp = last->timestamp;
+		memcpy(last_hash, last->hash, 2);
+		position.hash = last_hash;
+		position.hash_size = 2;
+		ipfs_journal_free_records(batch);
+	}
+	if (found != num_records)
+		goto exit;
+
+	// peer progress
+	void* context = fs_repo->config->datastore->datastore_context;
+	if (lmdb_journalstore_get_peer_progress(context, (uint8_t*)"ABC", 3, &progress))
+		goto exit;
+	if (!lmdb_journalstore_set_peer_progress(context, (uint8_t*)"ABC", 3, &position))
+		goto exit;
+	if (!lmdb_journalstore_get_peer_progress(context, (uint8_t*)"ABC", 3, &progress))
+		goto exit;
+	if (lmdb_journalstore_composite_key_compare(progress, &position) != 0)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	lmdb_journal_record_free(progress);
+	if (cursor != NULL)
+		lmdb_journalstore_cursor_close(cursor, 1);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
+
+/***
+ * Collects what reconciling sends
+ */
+static int test_journal_collect_message(struct JournalMessage* message, void* arg) {
+	struct Libp2pVector* messages = (struct Libp2pVector*) arg;
+	struct JournalMessage* copy = ipfs_journal_message_new();
+	if (copy == NULL || !ipfs_journal_message_set_position(copy, message->position_epoch, message->position_hash, message->position_hash_size)) {
+		ipfs_journal_message_free(copy);
+		return 0;
+	}
+	// take the entries
+	struct Libp2pVector* entries = copy->journal_entries;
+	copy->journal_entries = message->journal_entries;
+	message->journal_entries = entries;
+	libp2p_utils_vector_add(messages, copy);
+	return 1;
+}
+
+/***
+ * Reconcile a journal of 10 records against a summary of the peer, and see
+ * if the one with hash missing_index is sent, and where the last message says
+ * the journal was sent up to
+ * @param fs_repo the repo with the journal
+ * @param missing_index the record the peer does not have (-1 for none)
+ * @param all_bits to set every bit in the filter, so it holds what the peer does not have
+ * @param num_sent the number of entries sent
+ * @param missing_sent true if the entry the peer does not have was sent
+ * @returns true(1) if the last message is positioned at the last record
+ */
+static int test_journal_reconcile_with(struct FSRepo* fs_repo, int missing_index, int all_bits, int* num_sent, int* missing_sent) {
+	int retVal = 0;
+	struct JournalMessage* incoming = ipfs_journal_message_new();
+	struct Libp2pVector* messages = libp2p_utils_vector_new(1);
+	*num_sent = 0;
+	*missing_sent = 0;
+	if (incoming == NULL || messages == NULL)
+		goto exit;
+	struct JournalSummary* summary = ipfs_journal_summary_new(0, JOURNAL_SUMMARY_WINDOW - 1, 10, 42);
+	if (summary == NULL)
+		goto exit;
+	libp2p_utils_vector_add(incoming->summaries, summary);
+	uint8_t hash[2];
+	for(int i = 0; i < 10; i++) {
+		if (i == missing_index)
+			continue;
+		hash[0] = 0;
+		hash[1] = i;
+		ipfs_journal_summary_add(summary, hash, 2);
+	}
+	summary->num_entries = missing_index < 0 ? 10 : 9;
+	if (all_bits)
+		memset(summary->filter, 0xff, summary->filter_size);
+	incoming->start_epoch = 0;
+	incoming->end_epoch = JOURNAL_SUMMARY_WINDOW - 1;
+	incoming->flags = JOURNAL_MESSAGE_LAST_SUMMARY;
+
+	if (!ipfs_journal_reconcile_records(fs_repo->config->datastore, incoming, test_journal_collect_message, messages))
+		goto exit;
+	struct JournalMessage* last = NULL;
+	for(int i = 0; i < messages->total; i++) {
+		last = (struct JournalMessage*) libp2p_utils_vector_get(messages, i);
+		for(int j = 0; j < last->journal_entries->total; j++) {
+			struct JournalEntry* entry = (struct JournalEntry*) libp2p_utils_vector_get(last->journal_entries, j);
+			if (entry->hash_size == 2 && entry->hash[1] == missing_index)
+				*missing_sent = 1;
+			(*num_sent)++;
+		}
+	}
+	retVal = last != NULL && last->position_epoch == 1009 && last->position_hash_size == 2 && last->position_hash[1] == 9;
+	exit:
+	ipfs_journal_message_free(incoming);
+	if (messages != NULL) {
+		for(int i = 0; i < messages->total; i++)
+			ipfs_journal_message_free((struct JournalMessage*) libp2p_utils_vector_get(messages, i));
+		libp2p_utils_vector_free(messages);
+	}
+	return retVal;
+}
+
+/***
+ * An entry the summary of a peer wrongly holds is still sent
+ */
+int test_journal_reconcile_false_positive() {
+	int retVal = 0;
+	struct FSRepo* fs_repo = NULL;
+	struct lmdb_trans_cursor *cursor = NULL;
+	int num_sent = 0;
+	int missing_sent = 0;
+
+	if (!drop_build_and_open_repo("/tmp/.ipfs", &fs_repo))
+		goto exit;
+	if (!lmdb_journalstore_cursor_open(fs_repo->config->datastore->datastore_context, &cursor, NULL))
+		goto exit;
+	uint8_t hash[2];
+	struct JournalRecord in;
+	in.hash = hash;
+	in.hash_size = 2;
+	in.pin = 1;
+	in.pending = 0;
+	for(int i = 0; i < 10; i++) {
+		in.timestamp = 1000 + i;
+		hash[0] = 0;
+		hash[1] = i;
+		if (!lmdb_journalstore_journal_add(cursor, &in))
+			goto exit;
+	}
+	lmdb_journalstore_cursor_close(cursor, 1);
+	cursor = NULL;
+
+	// the peer has them all
+	if (!test_journal_reconcile_with(fs_repo, -1, 0, &num_sent, &missing_sent) || num_sent != 0) {
+		fprintf(stderr, "Sent %d entries to a peer that has them all.\n", num_sent);
+		goto exit;
+	}
+	// the filter says the peer does not have one
+	if (!test_journal_reconcile_with(fs_repo, 5, 0, &num_sent, &missing_sent) || !missing_sent || num_sent != 1) {
+		fprintf(stderr, "Sent %d entries for one missing entry.\n", num_sent);
+		goto exit;
+	}
+	// the filter wrongly says the peer has it
+	if (!test_journal_reconcile_with(fs_repo, 5, 1, &num_sent, &missing_sent) || !missing_sent) {
+		fprintf(stderr, "An entry in the filter by mistake was not sent.\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (cursor != NULL)
+		lmdb_journalstore_cursor_close(cursor, 1);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
+
+/***
+ * Find which of a group of hashes are missing from the datastore
+ */
+int test_journal_fetch_find_missing() {
+	int retVal = 0;
+	struct FSRepo* fs_repo = NULL;
+	struct Libp2pVector* items = NULL;
+	struct Libp2pVector* missing = NULL;
+	struct IpfsNode local_node;
+	uint8_t hash[2];
+
+	if (!drop_build_and_open_repo("/tmp/.ipfs", &fs_repo))
+		goto exit;
+	local_node.repo = fs_repo;
+
+	// put the even ones in the datastore
+	for(int i = 0; i < 10; i += 2) {
+		struct DatastoreRecord* rec = libp2p_datastore_record_new();
+		rec->key_size = 2;
+		rec->key = (uint8_t*) malloc(2);
+		rec->key[0] = 'A';
+		rec->key[1] = i;
+		rec->value_size = 1;
+		rec->value = (uint8_t*) malloc(1);
+		rec->value[0] = 0;
+		rec->timestamp = 1000;
+		int success = fs_repo->config->datastore->datastore_put(rec, fs_repo->config->datastore);
+		libp2p_datastore_record_free(rec);
+		if (!success)
+			goto exit;
+	}
+
+	// look for all of them
+	items = libp2p_utils_vector_new(10);
+	missing = libp2p_utils_vector_new(10);
+	hash[0] = 'A';
+	for(int i = 0; i < 10; i++) {
+		hash[1] = i;
+		libp2p_utils_vector_add(items, ipfs_journal_fetch_item_new(hash, 2, 0));
+	}
+	if (ipfs_journal_fetch_find_missing(&local_node, items, missing) != 5)
+		goto exit;
+	for(int i = 0; i < missing->total; i++) {
+		struct JournalFetchItem* item = (struct JournalFetchItem*) libp2p_utils_vector_get(missing, i);
+		if (item->hash[1] != i * 2 + 1)
+			goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (items != NULL) {
+		for(int i = 0; i < items->total; i++)
+			ipfs_journal_fetch_item_free((struct JournalFetchItem*) libp2p_utils_vector_get(items, i));
+		libp2p_utils_vector_free(items);
+	}
+	// the items in missing were also in items
+	libp2p_utils_vector_free(missing);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
+
 /***
  * Starts a server with a file in it with a specific set of files.
  * It also has a specific address, with a config file of another
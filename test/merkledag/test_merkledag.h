@@ -1,5 +1,6 @@
 #include "ipfs/merkledag/merkledag.h"
 #include "ipfs/merkledag/node.h"
+#include "ipfs/merkledag/walker.h"
 #include "../test_helper.h"
 
 struct FSRepo* createAndOpenRepo(const char* dir) {
@@ -299,3 +300,113 @@ int test_merkledag_add_node_with_links() {
 
 	return 1;
 }
+
+/***
+ * Store a node of one letter of data, that links to other nodes
+ */
+static struct HashtableNode* test_merkledag_walk_node(struct FSRepo* fs_repo, char letter, struct HashtableNode** children, int count) {
+	struct HashtableNode* node = NULL;
+	size_t bytes_written = 0;
+	if (!ipfs_hashtable_node_new_from_data((unsigned char*)&letter, 1, &node))
+		return NULL;
+	for(int i = 0; i < count; i++) {
+		struct NodeLink* link = NULL;
+		if (!ipfs_node_link_create("", children[i]->hash, children[i]->hash_size, &link)
+				|| !ipfs_hashtable_node_add_link(node, link)) {
+			ipfs_hashtable_node_free(node);
+			return NULL;
+		}
+	}
+	if (!ipfs_merkledag_add(node, fs_repo, &bytes_written)) {
+		ipfs_hashtable_node_free(node);
+		return NULL;
+	}
+	return node;
+}
+
+/***
+ * Walk a DAG into a string of the letters of the nodes
+ */
+static int test_merkledag_walk_letters(struct FSRepo* fs_repo, struct HashtableNode* root, int order, int unique, int prefetch, char* letters) {
+	struct MerkledagWalkOptions options = { order, unique, 0, prefetch, NULL };
+	struct MerkledagWalker* walker = ipfs_merkledag_walker_new(ipfs_merkledag_walk_fetch_repo, fs_repo, &options);
+	struct HashtableNode* node = NULL;
+	int found = 0;
+	letters[0] = 0;
+	if (walker == NULL || !ipfs_merkledag_walker_push(walker, root->hash, root->hash_size)) {
+		ipfs_merkledag_walker_free(walker);
+		return 0;
+	}
+	while ((found = ipfs_merkledag_walker_next(walker, NULL, NULL, &node, NULL)) > 0) {
+		size_t len = strlen(letters);
+		letters[len] = node->data[0];
+		letters[len + 1] = 0;
+	}
+	ipfs_merkledag_walker_free(walker);
+	return found == 0;
+}
+
+/***
+ * Walk R -> (M, L, M), M -> (L, N) in the ways a walk can go
+ */
+int test_merkledag_walk() {
+	int retVal = 0;
+	char letters[20];
+	struct HashtableNode* l = NULL;
+	struct HashtableNode* n = NULL;
+	struct HashtableNode* m = NULL;
+	struct HashtableNode* r = NULL;
+
+	struct FSRepo* fs_repo = createAndOpenRepo("/tmp/.ipfs");
+	if (fs_repo == NULL) {
+		printf("Unable to create repo\n");
+		return 0;
+	}
+	l = test_merkledag_walk_node(fs_repo, 'L', NULL, 0);
+	n = test_merkledag_walk_node(fs_repo, 'N', NULL, 0);
+	if (l == NULL || n == NULL)
+		goto exit;
+	struct HashtableNode* m_links[] = { l, n };
+	m = test_merkledag_walk_node(fs_repo, 'M', m_links, 2);
+	if (m == NULL)
+		goto exit;
+	struct HashtableNode* r_links[] = { m, l, m };
+	r = test_merkledag_walk_node(fs_repo, 'R', r_links, 3);
+	if (r == NULL)
+		goto exit;
+
+	// every path, in the order of the links, fetched when visited or ahead
+	if (!test_merkledag_walk_letters(fs_repo, r, MERKLEDAG_WALK_DEPTH_FIRST, 0, 0, letters) || strcmp(letters, "RMLNLMLN") != 0) {
+		printf("Depth first walk was %s\n", letters);
+		goto exit;
+	}
+	if (!test_merkledag_walk_letters(fs_repo, r, MERKLEDAG_WALK_DEPTH_FIRST, 0, 3, letters) || strcmp(letters, "RMLNLMLN") != 0) {
+		printf("Depth first walk with prefetch was %s\n", letters);
+		goto exit;
+	}
+	// each block once. L is seen from R before M is read.
+	if (!test_merkledag_walk_letters(fs_repo, r, MERKLEDAG_WALK_DEPTH_FIRST, 1, 0, letters) || strcmp(letters, "RMNL") != 0) {
+		printf("Unique depth first walk was %s\n", letters);
+		goto exit;
+	}
+	if (!test_merkledag_walk_letters(fs_repo, r, MERKLEDAG_WALK_BREADTH_FIRST, 0, 0, letters) || strcmp(letters, "RMLMLNLN") != 0) {
+		printf("Breadth first walk was %s\n", letters);
+		goto exit;
+	}
+	if (!test_merkledag_walk_letters(fs_repo, r, MERKLEDAG_WALK_BREADTH_FIRST, 1, 2, letters) || strcmp(letters, "RMLN") != 0) {
+		printf("Unique breadth first walk with prefetch was %s\n", letters);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (l != NULL)
+		ipfs_hashtable_node_free(l);
+	if (n != NULL)
+		ipfs_hashtable_node_free(n);
+	if (m != NULL)
+		ipfs_hashtable_node_free(m);
+	if (r != NULL)
+		ipfs_hashtable_node_free(r);
+	ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
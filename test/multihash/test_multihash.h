@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test_helper.h"
+#include "ipfs/cid/cid.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/importer/importer.h"
+#include "ipfs/merkledag/merkledag.h"
+#include "ipfs/multihash/multihash.h"
+#include "libp2p/crypto/sha256.h"
+
+/***
+ * Whether a digest is the one written in hex
+ */
+static int test_multihash_is(const unsigned char* digest, const char* hex) {
+	char buffer[2 * IPFS_MULTIHASH_DIGEST_SIZE + 1];
+	for(int i = 0; i < IPFS_MULTIHASH_DIGEST_SIZE; i++)
+		sprintf(&buffer[2 * i], "%02x", digest[i]);
+	return strcmp(buffer, hex) == 0;
+}
+
+/***
+ * The official test vectors of BLAKE3, whose input is the bytes 0 to 250
+ * repeated, at the lengths where the tree of chunks changes shape
+ */
+static const struct {
+	size_t size;
+	const char* digest;
+} test_multihash_blake3_vectors[] = {
+	{ 1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11" },
+	{ 1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7" },
+	{ 1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444" },
+	{ 2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a" },
+	{ 2049, "5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030" },
+	{ 3072, "b98cb0ff3623be03326b373de6b9095218513e64f1ee2edd2525c7ad1e5cffd2" },
+	{ 3073, "7124b49501012f81cc7f11ca069ec9226cecb8a2c850cfe644e327d22d3e1cd3" },
+	{ 8193, "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b" },
+	{ 102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085" },
+};
+
+/***
+ * blake2b-256 of the same input, around its block size of 128 bytes
+ */
+static const struct {
+	size_t size;
+	const char* digest;
+} test_multihash_blake2b_vectors[] = {
+	{ 127, "f2fe67ff342e21b8f45e8f2e0bcd1d9243245d50ee6c78042e9c491388791c72" },
+	{ 128, "c3582f71ebb2be66fa5dd750f80baae97554f3b015663c8be377cfcb2488c1d1" },
+	{ 129, "f7f3c46ba2564ff4c4c162da1f5b605f9f1c4aa6a20652a9f9a337c1a2f5b9c9" },
+	{ 256, "582f782226018ec33076bd8d1c42413530ac7e1126260ffc0f306ba3befc3f24" },
+};
+
+/***
+ * The functions give the known digests, and sha2-256 gives what libp2p gives
+ * whatever it runs on
+ */
+int test_multihash_functions() {
+	const unsigned char* abc = (const unsigned char*)"abc";
+	unsigned char digest[IPFS_MULTIHASH_DIGEST_SIZE];
+	unsigned char expected[IPFS_MULTIHASH_DIGEST_SIZE];
+	size_t max_size = 102400;
+	unsigned char* data = NULL;
+	unsigned int seed = 1;
+	int retVal = 0;
+
+	if (!ipfs_multihash_sha256(abc, 3, digest)
+			|| !test_multihash_is(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")) {
+		fprintf(stderr, "The sha2-256 of abc is wrong (%s)\n", ipfs_multihash_sha256_implementation());
+		goto exit;
+	}
+	if (!ipfs_multihash_blake2b_256(abc, 3, digest)
+			|| !test_multihash_is(digest, "bddd813c634239723171ef3fee98579b94964e3bb1cb3e427262c8c068d52319")) {
+		fprintf(stderr, "The blake2b-256 of abc is wrong\n");
+		goto exit;
+	}
+	if (!ipfs_multihash_blake3(abc, 3, digest)
+			|| !test_multihash_is(digest, "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85")) {
+		fprintf(stderr, "The blake3 of abc is wrong\n");
+		goto exit;
+	}
+
+	data = (unsigned char*)malloc(max_size);
+	if (data == NULL)
+		goto exit;
+	for(size_t i = 0; i < max_size; i++)
+		data[i] = i % 251;
+	for(size_t i = 0; i < sizeof(test_multihash_blake3_vectors) / sizeof(test_multihash_blake3_vectors[0]); i++) {
+		if (!ipfs_multihash_blake3(data, test_multihash_blake3_vectors[i].size, digest)
+				|| !test_multihash_is(digest, test_multihash_blake3_vectors[i].digest)) {
+			fprintf(stderr, "The blake3 of %lu bytes is wrong\n", (unsigned long)test_multihash_blake3_vectors[i].size);
+			goto exit;
+		}
+	}
+	for(size_t i = 0; i < sizeof(test_multihash_blake2b_vectors) / sizeof(test_multihash_blake2b_vectors[0]); i++) {
+		if (!ipfs_multihash_blake2b_256(data, test_multihash_blake2b_vectors[i].size, digest)
+				|| !test_multihash_is(digest, test_multihash_blake2b_vectors[i].digest)) {
+			fprintf(stderr, "The blake2b-256 of %lu bytes is wrong\n", (unsigned long)test_multihash_blake2b_vectors[i].size);
+			goto exit;
+		}
+	}
+
+	// every way the end of the data can fall in a block, and data of many blocks
+	for(size_t i = 0; i < max_size; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+	for(size_t size = 0; size <= max_size; size = (size < 200 ? size + 1 : size * 3 + 7)) {
+		if (!ipfs_multihash_sha256(data, size, digest)
+				|| !libp2p_crypto_hashing_sha256(data, size, expected)
+				|| memcmp(digest, expected, sizeof(digest)) != 0) {
+			fprintf(stderr, "The sha2-256 of %lu bytes is not what libp2p makes (%s)\n", (unsigned long)size, ipfs_multihash_sha256_implementation());
+			goto exit;
+		}
+	}
+	retVal = 1;
+	exit:
+	if (data != NULL)
+		free(data);
+	return retVal;
+}
+
+/***
+ * A hash is a sha2-256 digest, or the whole multihash of another function,
+ * and is turned into a multihash and back the same
+ */
+int test_multihash_wrap_unwrap() {
+	const unsigned char* data = (const unsigned char*)"hello, world";
+	int codes[] = { IPFS_MULTIHASH_SHA2_256, IPFS_MULTIHASH_BLAKE2B_256, IPFS_MULTIHASH_BLAKE3 };
+	unsigned char hash[IPFS_MULTIHASH_MAX_SIZE];
+	unsigned char multihash[IPFS_MULTIHASH_MAX_SIZE + 2];
+	size_t hash_size = 0;
+	size_t multihash_size = 0;
+	const unsigned char* unwrapped = NULL;
+	size_t unwrapped_size = 0;
+
+	for(int i = 0; i < 3; i++) {
+		if (!ipfs_multihash_hash(codes[i], data, strlen((char*)data), hash, &hash_size)
+				|| ipfs_multihash_hash_code(hash, hash_size) != codes[i]) {
+			fprintf(stderr, "Unable to hash with function %x\n", codes[i]);
+			return 0;
+		}
+		if ((codes[i] == IPFS_MULTIHASH_SHA2_256) != (hash_size == IPFS_MULTIHASH_DIGEST_SIZE)) {
+			fprintf(stderr, "Only a sha2-256 hash should be the digest alone\n");
+			return 0;
+		}
+		if (!ipfs_multihash_wrap(hash, hash_size, multihash, sizeof(multihash), &multihash_size)
+				|| multihash_size != (codes[i] == IPFS_MULTIHASH_SHA2_256 ? hash_size + 2 : hash_size)
+				|| !ipfs_multihash_unwrap(multihash, multihash_size, &unwrapped, &unwrapped_size)
+				|| unwrapped_size != hash_size || memcmp(unwrapped, hash, hash_size) != 0) {
+			fprintf(stderr, "The hash of function %x did not come back from its multihash\n", codes[i]);
+			return 0;
+		}
+	}
+	if (ipfs_multihash_hash(0x1b, data, strlen((char*)data), hash, &hash_size)
+			|| ipfs_multihash_function_by_name("md5") != NULL
+			|| ipfs_multihash_function_by_name("blake3")->code != IPFS_MULTIHASH_BLAKE3) {
+		fprintf(stderr, "Only the functions here should be found\n");
+		return 0;
+	}
+	return 1;
+}
+
+/***
+ * Import a file of several chunks with blake3, and find it again by the
+ * base58 of its hash
+ */
+int test_multihash_import() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* file_name = "/tmp/test_multihash_import.tmp";
+	size_t file_size = 600000;
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* node = NULL;
+	struct HashtableNode* read_node = NULL;
+	struct Cid* cid = NULL;
+	unsigned char* bytes = NULL;
+	unsigned char base58[100];
+	size_t bytes_written = 0;
+	int retVal = 0;
+
+	bytes = (unsigned char*)malloc(file_size);
+	if (bytes == NULL || !create_bytes(bytes, file_size) || !create_file(file_name, bytes, file_size))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+	if (!ipfs_import_file_with_hash(NULL, file_name, &node, local_node, &bytes_written, 0, IPFS_MULTIHASH_BLAKE3)) {
+		fprintf(stderr, "Unable to import the file\n");
+		goto exit;
+	}
+	// the file and its chunks are named by blake3 multihashes
+	if (node->hash_size != 34 || node->hash[0] != IPFS_MULTIHASH_BLAKE3 || node->hash[1] != IPFS_MULTIHASH_DIGEST_SIZE
+			|| node->link_count != 3) {
+		fprintf(stderr, "The file should be hashed with blake3\n");
+		goto exit;
+	}
+	for(struct NodeLink* link = node->head_link; link != NULL; link = link->next) {
+		if (ipfs_multihash_hash_code(link->hash, link->hash_size) != IPFS_MULTIHASH_BLAKE3) {
+			fprintf(stderr, "The chunks should be hashed with blake3\n");
+			goto exit;
+		}
+	}
+	// found again by its name
+	if (!ipfs_cid_hash_to_base58(node->hash, node->hash_size, base58, sizeof(base58))
+			|| !ipfs_cid_decode_hash_from_base58(base58, strlen((char*)base58), &cid)
+			|| cid->hash_length != node->hash_size || memcmp(cid->hash, node->hash, node->hash_size) != 0) {
+		fprintf(stderr, "The name of the file did not give its hash\n");
+		goto exit;
+	}
+	if (!ipfs_merkledag_get(cid->hash, cid->hash_length, &read_node, local_node->repo)
+			|| read_node->link_count != node->link_count
+			|| read_node->head_link->hash_size != node->head_link->hash_size
+			|| memcmp(read_node->head_link->hash, node->head_link->hash, node->head_link->hash_size) != 0) {
+		fprintf(stderr, "The file was not read back with its links\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (bytes != NULL)
+		free(bytes);
+	if (cid != NULL)
+		ipfs_cid_free(cid);
+	if (node != NULL)
+		ipfs_hashtable_node_free(node);
+	if (read_node != NULL)
+		ipfs_hashtable_node_free(read_node);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
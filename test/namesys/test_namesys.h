@@ -6,6 +6,7 @@
 #include "ipfs/core/ipfs_node.h"
 #include "ipfs/namesys/publisher.h"
 #include "ipfs/namesys/resolver.h"
+#include "ipfs/namesys/routing.h"
 
 int test_namesys_publisher_publish() {
 	int retVal = 0;
@@ -83,3 +84,94 @@ int test_namesys_resolver_resolve() {
 		free(result);
 	return retVal;
 }
+
+/***
+ * After a name is published again, resolving it gives the new value, not
+ * the one the resolver cached
+ */
+int test_namesys_resolver_republish() {
+	int retVal = 0;
+	struct IpfsNode* local_node = NULL;
+	char* first = "/ipfs/QmZtAEqmnXMZkwVPKdyMGxUoo35cQMzNhmq6CN3DvgRwAD";
+	char* second = "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG";
+	char ipns_path[512] = "";
+	char* repo_path = "/tmp/ipfs_1";
+	char* peer_id = NULL;
+	char* result = NULL;
+
+	if (!drop_and_build_repository(repo_path, 4001, NULL, &peer_id))
+		goto exit;
+	if (!ipfs_node_offline_new(repo_path, &local_node))
+		goto exit;
+	sprintf(ipns_path, "/ipns/%s", peer_id);
+
+	if (!ipfs_namesys_publisher_publish(local_node, first)
+			|| !ipfs_namesys_resolver_resolve(local_node, ipns_path, 0, &result)
+			|| strcmp(result, first) != 0) {
+		libp2p_logger_error("test_namesys", "Could not resolve %s to %s.\n", ipns_path, first);
+		goto exit;
+	}
+	free(result);
+	result = NULL;
+	if (!ipfs_namesys_publisher_publish(local_node, second)
+			|| !ipfs_namesys_resolver_resolve(local_node, ipns_path, 0, &result)
+			|| strcmp(result, second) != 0) {
+		libp2p_logger_error("test_namesys", "After publishing again, %s resolved to %s.\n", ipns_path, result == NULL ? "nothing" : result);
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	ipfs_node_free(local_node);
+	if (result != NULL)
+		free(result);
+	return retVal;
+}
+
+/***
+ * The resolver cache should evict the least recently used entry when
+ * full, and not return expired entries
+ */
+int test_namesys_routing_cache() {
+	int retVal = 0;
+	char* value = NULL;
+	struct timespec eol;
+	struct routingResolver* cache = ipfs_routing_cache_new(2);
+	if (cache == NULL)
+		goto exit;
+
+	ipfs_routing_cache_eol(NULL, &eol);
+	ipfs_routing_cache_insert(cache, "/ipns/A", "/ipfs/1", &eol);
+	ipfs_routing_cache_insert(cache, "/ipns/B", "/ipfs/2", &eol);
+	// use A, so B is the least recently used
+	value = ipfs_routing_cache_lookup(cache, "/ipns/A");
+	if (value == NULL || strcmp(value, "/ipfs/1") != 0)
+		goto exit;
+	free(value);
+	value = NULL;
+	ipfs_routing_cache_insert(cache, "/ipns/C", "/ipfs/3", &eol);
+	if (cache->count != 2)
+		goto exit;
+	value = ipfs_routing_cache_lookup(cache, "/ipns/B");
+	if (value != NULL)
+		goto exit;
+	value = ipfs_routing_cache_lookup(cache, "/ipns/C");
+	if (value == NULL || strcmp(value, "/ipfs/3") != 0)
+		goto exit;
+	free(value);
+	value = NULL;
+
+	// an expired entry is removed
+	eol.tv_sec -= DefaultResolverCacheTTL * 2;
+	ipfs_routing_cache_insert(cache, "/ipns/A", "/ipfs/4", &eol);
+	value = ipfs_routing_cache_lookup(cache, "/ipns/A");
+	if (value != NULL || cache->count != 1)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	if (value != NULL)
+		free(value);
+	ipfs_routing_cache_free(cache);
+	return retVal;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+
+#include "../test_helper.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/importer/hamt.h"
+#include "ipfs/merkledag/merkledag.h"
+
+/***
+ * Count the entries of a sharded directory, and check they are named as expected
+ */
+static int test_hamt_count(struct NodeLink* link, void* arg) {
+	int* count = (int*)arg;
+	if (strncmp(link->name, "file_", 5) != 0 || link->hash_size != 32)
+		return 0;
+	(*count)++;
+	return 1;
+}
+
+/***
+ * Shard a directory with enough entries that some slots need a shard below
+ * them, and find the entries again by name, and by walking the shards
+ */
+int test_hamt_directory() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* directory = NULL;
+	struct NodeLink* link = NULL;
+	unsigned char hash[32];
+	char name[20];
+	size_t bytes_written = 0;
+	int retVal = 0;
+	int count = 0;
+
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+
+	if (!ipfs_hashtable_node_create_directory(&directory))
+		goto exit;
+	memset(hash, 0, sizeof(hash));
+	for(int i = 0; i < 2000; i++) {
+		sprintf(name, "file_%d", i);
+		memcpy(hash, &i, sizeof(int));
+		if (!ipfs_node_link_create(name, hash, sizeof(hash), &link))
+			goto exit;
+		link->t_size = i;
+		ipfs_hashtable_node_add_link(directory, link);
+	}
+	if (ipfs_hamt_is_shard(directory))
+		goto exit;
+	if (!ipfs_hamt_shard_directory(&directory, local_node->repo, &bytes_written) || bytes_written == 0)
+		goto exit;
+	if (!ipfs_hamt_is_shard(directory) || directory->link_count > HAMT_FANOUT)
+		goto exit;
+	if (!ipfs_merkledag_add(directory, local_node->repo, &bytes_written))
+		goto exit;
+
+	for(int i = 0; i < 2000; i += 13) {
+		sprintf(name, "file_%d", i);
+		if (!ipfs_hamt_find(directory, name, local_node, &link)) {
+			fprintf(stderr, "%s not found in the shards.\n", name);
+			goto exit;
+		}
+		int found = strcmp(link->name, name) == 0 && memcmp(link->hash, &i, sizeof(int)) == 0 && link->t_size == i;
+		ipfs_node_link_free(link);
+		if (!found)
+			goto exit;
+	}
+	if (ipfs_hamt_find(directory, "file_2000", local_node, &link) || link != NULL)
+		goto exit;
+
+	if (!ipfs_hamt_foreach(directory, local_node, test_hamt_count, &count) || count != 2000) {
+		fprintf(stderr, "Found %d of 2000 entries in the shards.\n", count);
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	ipfs_hashtable_node_free(directory);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
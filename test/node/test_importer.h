@@ -240,3 +240,70 @@ int test_import_small_file() {
 
 	return retVal;
 }
+
+/***
+ * A file imported in pieces should get the same hash as one read from disk
+ */
+int test_import_stream() {
+	size_t bytes_size = 1000000; //1mb
+	unsigned char file_bytes[bytes_size];
+	const char* fileName = "/tmp/test_import_stream.tmp";
+	const char* repo_dir = "/tmp/ipfs_1";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* file_node = NULL;
+	struct HashtableNode* stream_node = NULL;
+	struct ImportStream* stream = NULL;
+	size_t bytes_written = 0;
+	size_t pos = 0;
+	int retVal = 0;
+
+	create_bytes(file_bytes, bytes_size);
+	create_file(fileName, file_bytes, bytes_size);
+
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+
+	if (ipfs_import_file(NULL, fileName, &file_node, local_node, &bytes_written, 0) == 0) {
+		goto exit;
+	}
+
+	stream = ipfs_import_stream_new(local_node);
+	if (stream == NULL)
+		goto exit;
+	// pieces that do not line up with the chunks
+	while (pos < bytes_size) {
+		size_t len = bytes_size - pos > 7919 ? 7919 : bytes_size - pos;
+		if (!ipfs_import_stream_write(stream, &file_bytes[pos], len))
+			goto exit;
+		pos += len;
+	}
+	if (!ipfs_import_stream_finish(stream, &stream_node))
+		goto exit;
+
+	if (file_node->hash_size != stream_node->hash_size || memcmp(file_node->hash, stream_node->hash, file_node->hash_size) != 0) {
+		printf("Hash of streamed file is different from the imported file.\n");
+		goto exit;
+	}
+	if (stream->bytes_written != bytes_written) {
+		printf("Bytes written should be %lu but are %lu\n", bytes_written, stream->bytes_written);
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	ipfs_import_stream_free(stream);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	if (file_node != NULL)
+		ipfs_hashtable_node_free(file_node);
+	if (stream_node != NULL)
+		ipfs_hashtable_node_free(stream_node);
+	return retVal;
+}
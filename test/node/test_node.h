@@ -1,4 +1,6 @@
+#include "ipfs/blocks/block.h"
 #include "ipfs/merkledag/node.h"
+#include "ipfs/util/metrics.h"
 
 /***
  * Testing of storage nodes. Nodes can be directories, files, or sections of a file.
@@ -156,3 +158,156 @@ ed_exit:
 
 	return retVal;
 }
+
+/***
+ * Build a node with enough links that lookups use the index, and make sure
+ * adding and removing links keeps the list, the tail and the index right
+ */
+int test_node_link_index() {
+	struct HashtableNode* node = NULL;
+	struct NodeLink* link = NULL;
+	char name[20];
+	unsigned char hash[34];
+	int retVal = 0;
+
+	memset(hash, 0, sizeof(hash));
+	if (!ipfs_hashtable_node_new(&node))
+		return 0;
+	for(int i = 0; i < 1000; i++) {
+		sprintf(name, "file_%d", i);
+		memcpy(hash, &i, sizeof(int));
+		if (!ipfs_node_link_create(name, hash, sizeof(hash), &link) || !ipfs_hashtable_node_add_link(node, link))
+			goto exit;
+	}
+	// a second link named file_10, which should not be the one found
+	if (!ipfs_node_link_create("file_10", hash, sizeof(hash), &link) || !ipfs_hashtable_node_add_link(node, link))
+		goto exit;
+	if (node->link_count != 1001 || node->tail_link != link)
+		goto exit;
+
+	for(int i = 0; i < 1000; i += 7) {
+		sprintf(name, "file_%d", i);
+		link = ipfs_hashtable_node_get_link_by_name(node, name);
+		if (link == NULL || strcmp(link->name, name) != 0 || memcmp(link->hash, &i, sizeof(int)) != 0) {
+			fprintf(stderr, "Link %s not found.\n", name);
+			goto exit;
+		}
+	}
+	if (ipfs_hashtable_node_get_link_by_name(node, "file_1000") != NULL)
+		goto exit;
+
+	// remove the first, and the first file_10, and the lookups still work
+	if (!ipfs_hashtable_node_remove_link_by_name("file_0", node) || !ipfs_hashtable_node_remove_link_by_name("file_10", node))
+		goto exit;
+	if (ipfs_hashtable_node_get_link_by_name(node, "file_0") != NULL || ipfs_hashtable_node_get_link_by_name(node, "file_500") == NULL)
+		goto exit;
+	link = ipfs_hashtable_node_get_link_by_name(node, "file_10");
+	if (link == NULL || link != node->tail_link)
+		goto exit;
+	int count = 0;
+	for(link = node->head_link; link != NULL; link = link->next) {
+		count++;
+		if (link->next == NULL && link != node->tail_link)
+			goto exit;
+	}
+	if (count != 999 || node->link_count != 999)
+		goto exit;
+
+	retVal = 1;
+	exit:
+	ipfs_hashtable_node_free(node);
+	return retVal;
+}
+
+/***
+ * Decode a node with many links into an arena, and as a view of a block, and
+ * make sure each takes a fixed number of allocations, and that the links can
+ * still be changed and freed
+ */
+int test_node_decode_view() {
+	struct HashtableNode* control = NULL;
+	struct HashtableNode* results = NULL;
+	struct HashtableNode* view = NULL;
+	struct NodeLink* link = NULL;
+	struct Block* block = NULL;
+	unsigned char* buffer = NULL;
+	size_t buffer_length = 0;
+	unsigned char hash[32];
+	char name[20];
+	int retVal = 0;
+
+	memset(hash, 0, sizeof(hash));
+	if (!ipfs_hashtable_node_new(&control) || !ipfs_hashtable_node_set_data(control, (unsigned char*)"Hello, World!", 13))
+		goto exit;
+	for(int i = 0; i < 500; i++) {
+		sprintf(name, "file_%d", i);
+		memcpy(hash, &i, sizeof(int));
+		if (!ipfs_node_link_create(name, hash, sizeof(hash), &link))
+			goto exit;
+		link->t_size = i;
+		ipfs_hashtable_node_add_link(control, link);
+	}
+	buffer_length = ipfs_hashtable_node_protobuf_encode_size(control);
+	buffer = (unsigned char*)malloc(buffer_length);
+	if (buffer == NULL || !ipfs_hashtable_node_protobuf_encode(control, buffer, buffer_length, &buffer_length))
+		goto exit;
+
+	// the node and its arena
+	uint64_t allocations = ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + MEMORY_TAG_MERKLEDAG);
+	if (!ipfs_hashtable_node_protobuf_decode(buffer, buffer_length, &results))
+		goto exit;
+	if (ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + MEMORY_TAG_MERKLEDAG) != allocations + 2) {
+		fprintf(stderr, "Decode took more than 2 allocations.\n");
+		goto exit;
+	}
+
+	block = ipfs_block_new();
+	if (block == NULL || !ipfs_blocks_block_add_data(buffer, buffer_length, block))
+		goto exit;
+	if (!ipfs_hashtable_node_protobuf_decode_view(block, &view))
+		goto exit;
+	block = NULL; // the node has it now
+	if (view->data < view->block->data || view->data >= view->block->data + view->block->data_length)
+		goto exit;
+
+	struct NodeLink* control_link = control->head_link;
+	struct NodeLink* results_link = results->head_link;
+	struct NodeLink* view_link = view->head_link;
+	while(control_link != NULL) {
+		if (results_link == NULL || view_link == NULL)
+			goto exit;
+		if (!compare_link(control_link, results_link) || !compare_link(control_link, view_link)
+				|| results_link->t_size != control_link->t_size || view_link->t_size != control_link->t_size) {
+			fprintf(stderr, "Error was on link %s\n", control_link->name);
+			goto exit;
+		}
+		control_link = control_link->next;
+		results_link = results_link->next;
+		view_link = view_link->next;
+	}
+	if (results_link != NULL || view_link != NULL || results->link_count != 500 || view->link_count != 500)
+		goto exit;
+	if (results->data_size != 13 || memcmp(results->data, "Hello, World!", 13) != 0
+			|| view->data_size != 13 || memcmp(view->data, "Hello, World!", 13) != 0)
+		goto exit;
+
+	// links in the arena can be removed, and ones allocated on their own added
+	if (!ipfs_hashtable_node_remove_link_by_name("file_0", view) || !ipfs_hashtable_node_remove_link_by_name("file_499", results))
+		goto exit;
+	if (!ipfs_node_link_create("file_500", hash, sizeof(hash), &link) || !ipfs_hashtable_node_add_link(view, link))
+		goto exit;
+	if (ipfs_hashtable_node_get_link_by_name(view, "file_500") != view->tail_link || view->link_count != 500)
+		goto exit;
+	if (!ipfs_hashtable_node_set_data(results, (unsigned char*)"Bye", 3))
+		goto exit;
+
+	retVal = 1;
+	exit:
+	ipfs_hashtable_node_free(control);
+	ipfs_hashtable_node_free(results);
+	ipfs_hashtable_node_free(view);
+	if (block != NULL)
+		ipfs_block_free(block);
+	free(buffer);
+	return retVal;
+}
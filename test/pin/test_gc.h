@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../test_helper.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/importer/importer.h"
+#include "ipfs/merkledag/merkledag.h"
+#include "ipfs/pin/gc.h"
+#include "ipfs/pin/pin.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
+#include "ipfs/repo/fsrepo/pinstore.h"
+
+/***
+ * Write a file of bytes that don't repeat, so each chunk is a different block
+ */
+static int test_gc_create_file(const char* file_name, size_t num_bytes, unsigned int seed) {
+	unsigned char* bytes = (unsigned char*) malloc(num_bytes);
+	if (bytes == NULL)
+		return 0;
+	for(size_t i = 0; i < num_bytes; i++) {
+		seed = seed * 1103515245 + 12345;
+		bytes[i] = seed >> 16;
+	}
+	int retVal = create_file(file_name, bytes, num_bytes);
+	free(bytes);
+	return retVal;
+}
+
+/***
+ * Count the blocks in the datastore, a few at a time
+ */
+static int test_gc_count_blocks(struct FSRepo* fs_repo) {
+	struct DatastoreRecord* records[3];
+	unsigned char after[200];
+	size_t after_size = 0;
+	int total = 0;
+	for(;;) {
+		int found = repo_fsrepo_lmdb_get_after(total == 0 ? NULL : after, after_size, records, 3, fs_repo->config->datastore);
+		if (found < 0)
+			return -1;
+		total += found;
+		if (found > 0) {
+			after_size = records[found - 1]->key_size;
+			memcpy(after, records[found - 1]->key, after_size);
+		}
+		for(int i = 0; i < found; i++)
+			libp2p_datastore_record_free(records[i]);
+		if (found < 3)
+			return total;
+	}
+}
+
+/***
+ * Check that a file and all of its chunks are there
+ */
+static int test_gc_file_complete(struct HashtableNode* file, struct FSRepo* fs_repo) {
+	struct HashtableNode* node = NULL;
+	if (!ipfs_merkledag_get(file->hash, file->hash_size, &node, fs_repo))
+		return 0;
+	ipfs_hashtable_node_free(node);
+	for(struct NodeLink* link = file->head_link; link != NULL; link = link->next) {
+		node = NULL;
+		if (!ipfs_merkledag_get(link->hash, link->hash_size, &node, fs_repo))
+			return 0;
+		ipfs_hashtable_node_free(node);
+	}
+	return 1;
+}
+
+/***
+ * Add a pinned and an unpinned file, collect, and only the pinned one should be left.
+ * Then unpin it, and collect everything.
+ */
+int test_gc_collect() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* keep_file = "/tmp/test_gc_keep.tmp";
+	const char* drop_file = "/tmp/test_gc_drop.tmp";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* keep = NULL;
+	struct HashtableNode* drop = NULL;
+	struct HashtableNode* node = NULL;
+	struct GcOptions options = { 2, 0, NULL };
+	struct GcResult result;
+	size_t bytes_written = 0;
+	int retVal = 0;
+
+	if (!test_gc_create_file(keep_file, 700000, 1) || !test_gc_create_file(drop_file, 600000, 2))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+	// the importer itself doesn't pin, the add command does
+	if (!ipfs_import_file(NULL, keep_file, &keep, local_node, &bytes_written, 0)
+			|| !ipfs_import_file(NULL, drop_file, &drop, local_node, &bytes_written, 0)) {
+		fprintf(stderr, "Unable to import the files\n");
+		goto exit;
+	}
+	if (!ipfs_pin_add(local_node->repo, keep->hash, keep->hash_size, Recursive)
+			|| ipfs_pin_get_mode(local_node->repo, keep->hash, keep->hash_size) != Recursive
+			|| ipfs_pin_get_mode(local_node->repo, drop->hash, drop->hash_size) != NotPinned) {
+		fprintf(stderr, "Unable to pin\n");
+		goto exit;
+	}
+	int blocks = test_gc_count_blocks(local_node->repo);
+	// 3 chunks and the root, and 3 chunks and the root
+	if (blocks != 8) {
+		fprintf(stderr, "There should be 8 blocks, but there are %d\n", blocks);
+		goto exit;
+	}
+
+	if (!ipfs_gc_collect(local_node->repo, &options, &result)) {
+		fprintf(stderr, "The collection failed\n");
+		goto exit;
+	}
+	if (result.marked != 4 || result.removed != 4 || result.kept != 0 || result.bytes_freed < 600000) {
+		fprintf(stderr, "Marked %lu and removed %lu blocks, %llu bytes. Should be 4 and 4.\n",
+				(unsigned long)result.marked, (unsigned long)result.removed, result.bytes_freed);
+		goto exit;
+	}
+	if (!test_gc_file_complete(keep, local_node->repo)) {
+		fprintf(stderr, "The pinned file was collected\n");
+		goto exit;
+	}
+	if (ipfs_merkledag_get(drop->hash, drop->hash_size, &node, local_node->repo)
+			|| ipfs_merkledag_get(drop->head_link->hash, drop->head_link->hash_size, &node, local_node->repo)) {
+		fprintf(stderr, "The file that was not pinned is still there\n");
+		goto exit;
+	}
+	if (test_gc_count_blocks(local_node->repo) != 4) {
+		fprintf(stderr, "There should be 4 blocks left\n");
+		goto exit;
+	}
+
+	// without the pin, nothing is left
+	if (!ipfs_pin_remove(local_node->repo, keep->hash, keep->hash_size)
+			|| !ipfs_gc_collect(local_node->repo, NULL, &result)
+			|| result.removed != 4
+			|| test_gc_count_blocks(local_node->repo) != 0) {
+		fprintf(stderr, "Unpinned blocks were not collected\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (node != NULL)
+		ipfs_hashtable_node_free(node);
+	if (keep != NULL)
+		ipfs_hashtable_node_free(keep);
+	if (drop != NULL)
+		ipfs_hashtable_node_free(drop);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
+
+/***
+ * A directory pinned directly inside a recursively pinned one is still
+ * walked through, so what is below it is kept
+ */
+int test_gc_direct_in_recursive() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* dir_name = "/tmp/test_gc_dir";
+	const char* file_name = "/tmp/test_gc_dir/sub/file.tmp";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* top = NULL;
+	struct HashtableNode* sub = NULL;
+	struct HashtableNode* file = NULL;
+	struct GcResult result;
+	size_t bytes_written = 0;
+	int retVal = 0;
+
+	unlink(file_name);
+	rmdir("/tmp/test_gc_dir/sub");
+	rmdir(dir_name);
+	if (mkdir(dir_name, S_IRWXU) != 0 || mkdir("/tmp/test_gc_dir/sub", S_IRWXU) != 0
+			|| !test_gc_create_file(file_name, 700000, 4))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)
+			|| !ipfs_node_offline_new(repo_dir, &local_node)
+			|| !ipfs_import_file(NULL, dir_name, &top, local_node, &bytes_written, 1)) {
+		fprintf(stderr, "Unable to import the directory\n");
+		goto exit;
+	}
+	struct NodeLink* link = ipfs_hashtable_node_get_link_by_name(top, "sub");
+	if (link == NULL || !ipfs_merkledag_get(link->hash, link->hash_size, &sub, local_node->repo)) {
+		fprintf(stderr, "The directory has no sub directory\n");
+		goto exit;
+	}
+	link = ipfs_hashtable_node_get_link_by_name(sub, "file.tmp");
+	if (link == NULL || !ipfs_merkledag_get(link->hash, link->hash_size, &file, local_node->repo)) {
+		fprintf(stderr, "The sub directory has no file\n");
+		goto exit;
+	}
+	if (!ipfs_pin_add(local_node->repo, sub->hash, sub->hash_size, Direct)
+			|| !ipfs_pin_add(local_node->repo, top->hash, top->hash_size, Recursive)) {
+		fprintf(stderr, "Unable to pin\n");
+		goto exit;
+	}
+
+	// the directory, the sub directory, the file and its 3 chunks
+	if (!ipfs_gc_collect(local_node->repo, NULL, &result) || result.removed != 0 || result.marked != 6) {
+		fprintf(stderr, "Marked %lu and removed %lu blocks. Should be 6 and 0.\n",
+				(unsigned long)result.marked, (unsigned long)result.removed);
+		goto exit;
+	}
+	if (!test_gc_file_complete(file, local_node->repo)) {
+		fprintf(stderr, "What is below the directly pinned directory was collected\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (top != NULL)
+		ipfs_hashtable_node_free(top);
+	if (sub != NULL)
+		ipfs_hashtable_node_free(sub);
+	if (file != NULL)
+		ipfs_hashtable_node_free(file);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
+
+/***
+ * A repo from before pins has blocks, but no pins. Its first collection
+ * pins the roots of the blocks, and deletes nothing.
+ */
+int test_gc_upgrade() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* file_name = "/tmp/test_gc_upgrade.tmp";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* file = NULL;
+	struct GcResult result;
+	MDB_txn* txn = NULL;
+	size_t bytes_written = 0;
+	int retVal = 0;
+
+	if (!test_gc_create_file(file_name, 700000, 3))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)
+			|| !ipfs_node_offline_new(repo_dir, &local_node)
+			|| !ipfs_import_file(NULL, file_name, &file, local_node, &bytes_written, 0)) {
+		fprintf(stderr, "Unable to import the file\n");
+		goto exit;
+	}
+	// take the pins away, as if the repo was from before them
+	struct lmdb_context* db_context = (struct lmdb_context*) local_node->repo->config->datastore->datastore_context;
+	if (repo_fsrepo_lmdb_txn_begin(db_context->db_environment, NULL, 0, &txn) != 0
+			|| mdb_drop(txn, *db_context->pins_db, 1) != 0
+			|| repo_fsrepo_lmdb_txn_commit(txn) != 0) {
+		fprintf(stderr, "Unable to drop the pins\n");
+		goto exit;
+	}
+	ipfs_node_free(local_node);
+	local_node = NULL;
+	if (!ipfs_node_offline_new(repo_dir, &local_node))
+		goto exit;
+	if (!lmdb_pinstore_upgrade_pending(local_node->repo->config->datastore->datastore_context)) {
+		fprintf(stderr, "The repo should be seen as from before pins\n");
+		goto exit;
+	}
+
+	if (!ipfs_gc_collect(local_node->repo, NULL, &result) || result.removed != 0 || result.marked != 4) {
+		fprintf(stderr, "The first collection removed %lu blocks, and marked %lu\n", (unsigned long)result.removed, (unsigned long)result.marked);
+		goto exit;
+	}
+	if (!test_gc_file_complete(file, local_node->repo)
+			|| ipfs_pin_get_mode(local_node->repo, file->hash, file->hash_size) != Recursive
+			|| ipfs_pin_get_mode(local_node->repo, file->head_link->hash, file->head_link->hash_size) != NotPinned) {
+		fprintf(stderr, "The root of the file should be pinned, and the file kept\n");
+		goto exit;
+	}
+	// and it is only done once
+	ipfs_node_free(local_node);
+	local_node = NULL;
+	if (!ipfs_node_offline_new(repo_dir, &local_node)
+			|| lmdb_pinstore_upgrade_pending(local_node->repo->config->datastore->datastore_context)) {
+		fprintf(stderr, "The repo should no longer be seen as from before pins\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (file != NULL)
+		ipfs_hashtable_node_free(file);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+
+#include "../test_helper.h"
+#include "ipfs/core/ipfs_node.h"
+#include "ipfs/importer/importer.h"
+#include "ipfs/pin/pin.h"
+
+/***
+ * Write a file of bytes that don't repeat, so each chunk is a different block.
+ * Files of the same seed start with the same chunks.
+ */
+static int test_pin_create_file(const char* file_name, size_t num_bytes, unsigned int seed) {
+	unsigned char* bytes = (unsigned char*) malloc(num_bytes);
+	if (bytes == NULL)
+		return 0;
+	for(size_t i = 0; i < num_bytes; i++) {
+		seed = seed * 1103515245 + 12345;
+		bytes[i] = seed >> 16;
+	}
+	int retVal = create_file(file_name, bytes, num_bytes);
+	free(bytes);
+	return retVal;
+}
+
+/***
+ * Find how a block is pinned, and what through
+ */
+static PinMode test_pin_mode(struct FSRepo* fs_repo, struct NodeLink* link, struct HashtableNode* via) {
+	struct Pinned p;
+	if (!ipfs_pin_find(fs_repo, link->hash, link->hash_size, &p))
+		return -1;
+	PinMode mode = p.Mode;
+	if (via != NULL && (p.Via == NULL || p.Via->hash_length != via->hash_size
+			|| memcmp(p.Via->hash, via->hash, via->hash_size) != 0))
+		mode = -1;
+	ipfs_cid_free(p.Key);
+	ipfs_cid_free(p.Via);
+	return mode;
+}
+
+/***
+ * Pin two files that share their first chunk, and check what the index says
+ * as they are pinned and unpinned
+ */
+int test_pin_index() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* big_file = "/tmp/test_pin_big.tmp";
+	const char* small_file = "/tmp/test_pin_small.tmp";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* big = NULL;
+	struct HashtableNode* small = NULL;
+	size_t bytes_written = 0;
+	int retVal = 0;
+
+	if (!test_pin_create_file(big_file, 700000, 1) || !test_pin_create_file(small_file, 300000, 1))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)) {
+		fprintf(stderr, "Unable to drop and build test repository at %s\n", repo_dir);
+		goto exit;
+	}
+	if (!ipfs_node_offline_new(repo_dir, &local_node)) {
+		fprintf(stderr, "Unable to create new IpfsNode\n");
+		goto exit;
+	}
+	if (!ipfs_import_file(NULL, big_file, &big, local_node, &bytes_written, 0)
+			|| !ipfs_import_file(NULL, small_file, &small, local_node, &bytes_written, 0)) {
+		fprintf(stderr, "Unable to import the files\n");
+		goto exit;
+	}
+	struct FSRepo* fs_repo = local_node->repo;
+	struct NodeLink* shared = big->head_link;
+	struct NodeLink* big_only = big->head_link->next;
+	struct NodeLink* small_only = small->head_link->next;
+	if (shared == NULL || big_only == NULL || small_only == NULL
+			|| shared->hash_size != small->head_link->hash_size
+			|| memcmp(shared->hash, small->head_link->hash, shared->hash_size) != 0) {
+		fprintf(stderr, "The files should share their first chunk\n");
+		goto exit;
+	}
+
+	// a direct pin keeps only the block itself
+	if (!ipfs_pin_add(fs_repo, small->hash, small->hash_size, Direct)
+			|| test_pin_mode(fs_repo, small_only, NULL) != NotPinned) {
+		fprintf(stderr, "A direct pin should not keep the chunks\n");
+		goto exit;
+	}
+	if (!ipfs_pin_add(fs_repo, big->hash, big->hash_size, Recursive)
+			|| test_pin_mode(fs_repo, shared, big) != Indirect
+			|| test_pin_mode(fs_repo, big_only, big) != Indirect
+			|| !ipfs_pin_has_child(fs_repo, big->hash, big->hash_size, big_only->hash, big_only->hash_size)
+			|| ipfs_pin_has_child(fs_repo, big->hash, big->hash_size, small_only->hash, small_only->hash_size)) {
+		fprintf(stderr, "The chunks of a recursive pin should be indexed\n");
+		goto exit;
+	}
+	// a recursive pin is not made direct
+	if (ipfs_pin_add(fs_repo, big->hash, big->hash_size, Direct)
+			|| ipfs_pin_get_mode(fs_repo, big->hash, big->hash_size) != Recursive) {
+		fprintf(stderr, "A recursive pin should stay recursive\n");
+		goto exit;
+	}
+	// a direct pin made recursive keeps its chunks
+	if (!ipfs_pin_add(fs_repo, small->hash, small->hash_size, Recursive)
+			|| test_pin_mode(fs_repo, small_only, small) != Indirect) {
+		fprintf(stderr, "The chunks of the direct pin made recursive should be indexed\n");
+		goto exit;
+	}
+	// the shared chunk is still kept by the other pin
+	if (!ipfs_pin_remove(fs_repo, big->hash, big->hash_size)
+			|| ipfs_pin_get_mode(fs_repo, big->hash, big->hash_size) != NotPinned
+			|| test_pin_mode(fs_repo, big_only, NULL) != NotPinned
+			|| test_pin_mode(fs_repo, shared, small) != Indirect) {
+		fprintf(stderr, "Unpinning should only drop what no other pin keeps\n");
+		goto exit;
+	}
+	if (!ipfs_pin_remove(fs_repo, small->hash, small->hash_size)
+			|| ipfs_pin_remove(fs_repo, small->hash, small->hash_size)
+			|| test_pin_mode(fs_repo, shared, NULL) != NotPinned) {
+		fprintf(stderr, "Nothing should be pinned\n");
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (big != NULL)
+		ipfs_hashtable_node_free(big);
+	if (small != NULL)
+		ipfs_hashtable_node_free(small);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
+
+static int test_pin_count_recursive(const unsigned char* hash, size_t hash_size, PinMode mode, void* arg) {
+	if (mode == Recursive)
+		(*(int*)arg)++;
+	return 1;
+}
+
+/***
+ * A replicated block that arrives before its parent loses its pin to the
+ * parent's, but a pin that was asked for stays
+ */
+int test_pin_replicated() {
+	const char* repo_dir = "/tmp/ipfs_1";
+	const char* file_name = "/tmp/test_pin_big.tmp";
+	struct IpfsNode* local_node = NULL;
+	struct HashtableNode* file = NULL;
+	size_t bytes_written = 0;
+	int recursive = 0;
+	int retVal = 0;
+
+	if (!test_pin_create_file(file_name, 700000, 2))
+		goto exit;
+	if (!drop_and_build_repository(repo_dir, 4001, NULL, NULL)
+			|| !ipfs_node_offline_new(repo_dir, &local_node)
+			|| !ipfs_import_file(NULL, file_name, &file, local_node, &bytes_written, 0)) {
+		fprintf(stderr, "Unable to import the file\n");
+		goto exit;
+	}
+	struct FSRepo* fs_repo = local_node->repo;
+	struct NodeLink* first = file->head_link;
+	struct NodeLink* second = first == NULL ? NULL : first->next;
+	if (second == NULL)
+		goto exit;
+
+	// the chunks arrive first, one of them is also pinned by the user
+	if (!ipfs_pin_add_replicated(fs_repo, first->hash, first->hash_size)
+			|| !ipfs_pin_add_replicated(fs_repo, second->hash, second->hash_size)
+			|| !ipfs_pin_add(fs_repo, second->hash, second->hash_size, Recursive)
+			|| ipfs_pin_get_mode(fs_repo, first->hash, first->hash_size) != Recursive) {
+		fprintf(stderr, "The replicated chunk should be pinned\n");
+		goto exit;
+	}
+	// then the file
+	if (!ipfs_pin_add_replicated(fs_repo, file->hash, file->hash_size)
+			|| ipfs_pin_get_mode(fs_repo, file->hash, file->hash_size) != Recursive
+			|| ipfs_pin_get_mode(fs_repo, first->hash, first->hash_size) != NotPinned
+			|| test_pin_mode(fs_repo, first, file) != Indirect
+			|| ipfs_pin_get_mode(fs_repo, second->hash, second->hash_size) != Recursive) {
+		fprintf(stderr, "Only the pin of the replicated chunk should be dropped\n");
+		goto exit;
+	}
+	// once more changes nothing
+	if (!ipfs_pin_add_replicated(fs_repo, first->hash, first->hash_size)
+			|| ipfs_pin_get_mode(fs_repo, first->hash, first->hash_size) != NotPinned)
+		goto exit;
+	// the file's, and the one that was asked for
+	if (!ipfs_pin_foreach(fs_repo, test_pin_count_recursive, &recursive) || recursive != 2) {
+		fprintf(stderr, "There are %d recursive pins. Should be 2.\n", recursive);
+		goto exit;
+	}
+	retVal = 1;
+	exit:
+	if (file != NULL)
+		ipfs_hashtable_node_free(file);
+	if (local_node != NULL)
+		ipfs_node_free(local_node);
+	return retVal;
+}
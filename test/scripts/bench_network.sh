@@ -0,0 +1,203 @@
+#!/bin/bash
+
+####
+# Measure how fast files move between daemons over bitswap.
+#
+# Starts a number of daemons on loopback, each with its own repository.
+# Files are added to the first one, and every other one fetches all of
+# them through its API. The result is one line of JSON, with the
+# throughput, the latency of the fetches, and the duplicate blocks the
+# fetching daemons received.
+#
+# Syntax: ./bench_network.sh [nodes] [files] [file size]
+#    nodes: the number of daemons, at least 2 (default 3)
+#    files: the number of files fetched by each daemon (default 5)
+#    file size: the size of each file in bytes (default 1048576)
+####
+
+source ./test_helpers.sh
+
+NODES=${1:-3}
+FILES=${2:-5}
+FILE_SIZE=${3:-1048576}
+IPFS="../../main/ipfs"
+REPO_BASE=/tmp/ipfs_bench_
+SWARM_BASE=4000 # node i listens on SWARM_BASE + i
+API_BASE=5000 # and serves its API on API_BASE + i
+WORK_DIR=/tmp/ipfs_bench_work
+
+daemon_ids=()
+hashes=()
+
+####
+# Build the repository of a node from the config templates. Node 1 uses the
+# first template, the others the second, which uses node 1 to bootstrap.
+# Param $1 the number of the node
+####
+function build_repo {
+	local node=$1
+	local repo=$REPO_BASE$node
+	rm -Rf $repo
+	eval "$IPFS --config $repo init" > /dev/null
+	check_failure_with_exit "init node $node" $?
+	if [ $node -eq 1 ]; then
+		sed -e "s|/tmp/ipfs_1|$repo|g" \
+			-e "s|tcp/4001\"|tcp/$((SWARM_BASE + node))\"|g" \
+			-e "s|tcp/5001\"|tcp/$((API_BASE + node))\"|g" \
+			-e "s|tcp/4002/|tcp/$((SWARM_BASE + 2))/|g" \
+			../config.test1.wo_journal > $repo/config.bench
+	else
+		sed -e "s|/tmp/ipfs_2|$repo|g" \
+			-e "s|tcp/4002\"|tcp/$((SWARM_BASE + node))\"|g" \
+			-e "s|tcp/5002\"|tcp/$((API_BASE + node))\"|g" \
+			-e "s|tcp/4001/|tcp/$((SWARM_BASE + 1))/|g" \
+			../config.test2.wo_journal > $repo/config.bench
+		if [ $node -gt 2 ]; then
+			# the template's identity belongs to node 2, keep the one init made
+			local peer_id=$(grep '"PeerID"' $repo/config)
+			local priv_key=$(grep '"PrivKey"' $repo/config)
+			sed -i -e "s|^.*\"PeerID\".*$|$peer_id|" -e "s|^.*\"PrivKey\".*$|$priv_key|" $repo/config.bench
+		fi
+	fi
+	mv $repo/config.bench $repo/config
+}
+
+function pre {
+	post
+	if [ $NODES -lt 2 ]; then
+		echo "At least 2 nodes are needed."
+		exit 1
+	fi
+	if [ ! -x ./generate_file ]; then
+		make all > /dev/null
+		check_failure_with_exit "make generate_file" $?
+	fi
+	mkdir -p $WORK_DIR
+	local node=1
+	while [ $node -le $NODES ]; do
+		build_repo $node
+		let node++
+	done
+}
+
+function post {
+	for id in ${daemon_ids[@]}; do
+		kill -9 $id 2> /dev/null
+	done
+	local node=1
+	while [ $node -le $NODES ]; do
+		rm -Rf $REPO_BASE$node
+		let node++
+	done
+	rm -Rf $WORK_DIR
+}
+
+####
+# The current time in milliseconds
+####
+function now_ms {
+	echo $(( $(date +%s%N) / 1000000 ))
+}
+
+####
+# Fetch every file from one node, writing the milliseconds each took
+# Param $1 the number of the node
+####
+function fetch_all {
+	local node=$1
+	local out=$WORK_DIR/latency_$node
+	for hash in ${hashes[@]}; do
+		local start=$(now_ms)
+		eval "$IPFS --config $REPO_BASE$node cat $hash" > $WORK_DIR/fetched_$node
+		local retVal=$?
+		local end=$(now_ms)
+		local size=$(wc -c < $WORK_DIR/fetched_$node)
+		if [ $retVal -ne 0 ] || [ $size -eq 0 ]; then
+			echo "***Failure*** node $node could not fetch $hash" >&2
+			echo "failed" >> $out
+		else
+			echo $((end - start)) >> $out
+		fi
+	done
+	rm -f $WORK_DIR/fetched_$node
+}
+
+####
+# The duplicate blocks a node received, from its metrics
+# Param $1 the number of the node
+####
+function duplicates {
+	curl -s http://127.0.0.1:$((API_BASE + $1))/api/v0/metrics \
+		| awk '$1 == "ipfs_bitswap_duplicates_received_total" { print $2 }'
+}
+
+function body {
+	# the files, each a different size so that each has its own hash
+	local i=1
+	while [ $i -le $FILES ]; do
+		./generate_file $WORK_DIR/file_$i $((FILE_SIZE + i)) > /dev/null
+		local hash=$(eval "$IPFS --config ${REPO_BASE}1 add $WORK_DIR/file_$i" | awk '$1 == "added" { print $2 }')
+		if [ -z "$hash" ]; then
+			check_failure_with_exit "add file_$i" 1
+		fi
+		hashes+=($hash)
+		let i++
+	done
+
+	local node=1
+	while [ $node -le $NODES ]; do
+		eval "$IPFS --config $REPO_BASE$node daemon" > $WORK_DIR/daemon_$node.log 2>&1 &
+		daemon_ids+=($!)
+		let node++
+	done
+	sleep 5
+
+	# every node but the first fetches at the same time
+	local fetch_ids=()
+	local start=$(now_ms)
+	node=2
+	while [ $node -le $NODES ]; do
+		fetch_all $node &
+		fetch_ids+=($!)
+		let node++
+	done
+	wait ${fetch_ids[@]}
+	local elapsed=$(( $(now_ms) - start ))
+
+	local failed=$(cat $WORK_DIR/latency_* | grep -c failed)
+	local fetched=$(cat $WORK_DIR/latency_* | grep -c -v failed)
+	local dups=0
+	node=2
+	while [ $node -le $NODES ]; do
+		dups=$((dups + $(duplicates $node || echo 0)))
+		let node++
+	done
+
+	cat $WORK_DIR/latency_* | grep -v failed | sort -n | awk \
+		-v nodes=$NODES -v files=$FILES -v size=$FILE_SIZE -v elapsed=$elapsed \
+		-v fetched=$fetched -v failed=$failed -v dups=$dups '
+		{ latency[NR] = $1 }
+		function percentile(p) {
+			if (NR == 0) return 0
+			i = int(NR * p / 100 + 0.5)
+			if (i < 1) i = 1
+			return latency[i]
+		}
+		END {
+			seconds = elapsed / 1000
+			printf("{\"benchmark\":\"network\",\"nodes\":%d,\"files\":%d,\"file_size\":%d,", nodes, files, size)
+			printf("\"fetched\":%d,\"failed\":%d,\"seconds\":%.3f,", fetched, failed, seconds)
+			printf("\"bytes_per_sec\":%.1f,", seconds > 0 ? fetched * size / seconds : 0)
+			printf("\"latency_ms_p50\":%d,\"latency_ms_p90\":%d,\"latency_ms_p99\":%d,", percentile(50), percentile(90), percentile(99))
+			printf("\"duplicate_blocks\":%d}\n", dups)
+		}'
+
+	if [ $failed -ne 0 ]; then
+		failure_count=$failed
+	fi
+}
+
+pre
+body
+post
+exit $failure_count
@@ -1,4 +1,6 @@
 #include "ipfs/blocks/block.h"
+#include "ipfs/blocks/blockstore.h"
+#include "ipfs/util/metrics.h"
 
 int test_blocks_new() {
 	const unsigned char* input = (const unsigned char*)"Hello, World!";
@@ -51,3 +53,44 @@ int test_blocks_new() {
 
 	return 1;
 }
+
+/***
+ * A block that is not there is counted as a miss, as a block and as a node
+ */
+int test_blockstore_get_miss() {
+	struct FSRepo* fs_repo = NULL;
+	struct Blockstore* blockstore = NULL;
+	struct Block* block = NULL;
+	struct HashtableNode* node = NULL;
+	struct Cid* cid = NULL;
+	unsigned char hash[32];
+	int retVal = 0;
+
+	memset(hash, 7, sizeof(hash));
+	if (!drop_build_open_repo("/tmp/ipfs_1", &fs_repo, NULL))
+		goto exit;
+	blockstore = ipfs_blockstore_new(fs_repo);
+	cid = ipfs_cid_new(0, hash, sizeof(hash), CID_DAG_PROTOBUF);
+	if (blockstore == NULL || cid == NULL)
+		goto exit;
+	uint64_t misses = ipfs_util_metrics_counter(METRICS_BLOCKSTORE_GET_MISSES);
+	if (ipfs_blockstore_get(blockstore->blockstoreContext, cid, &block)
+			|| ipfs_blockstore_get_node(hash, sizeof(hash), &node, fs_repo)) {
+		fprintf(stderr, "A block that was never put was found\n");
+		goto exit;
+	}
+	if (ipfs_util_metrics_counter(METRICS_BLOCKSTORE_GET_MISSES) != misses + 2) {
+		fprintf(stderr, "The misses were not counted\n");
+		goto exit;
+	}
+
+	retVal = 1;
+	exit:
+	if (cid != NULL)
+		ipfs_cid_free(cid);
+	if (blockstore != NULL)
+		ipfs_blockstore_free(blockstore);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
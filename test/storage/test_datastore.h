@@ -4,6 +4,8 @@
 #include "ipfs/repo/config/config.h"
 #include "ipfs/repo/fsrepo/fs_repo.h"
 #include "ipfs/repo/fsrepo/journalstore.h"
+#include "ipfs/repo/fsrepo/lmdb_cursor.h"
+#include "ipfs/repo/fsrepo/lmdb_datastore.h"
 
 #include "../test_helper.h"
 
@@ -112,5 +114,84 @@ int test_datastore_list_journal() {
 		op = CURSOR_NEXT;
 	} while (record != NULL);
 	libp2p_logger_error("test_datastore", "Found %d records.\n", recCount);
+	lmdb_journalstore_cursor_close(crsr, 1);
+	ipfs_repo_fsrepo_free(fs_repo);
 	return 1;
 }
+
+/***
+ * Open the datastore with a map too small for what is written to it, and
+ * make sure the map grows and every record makes it
+ */
+int test_datastore_map_grows() {
+	int retVal = 0;
+	struct FSRepo* fs_repo = NULL;
+	struct DatastoreRecord* rec = NULL;
+	char* argv[] = { "MapSize=64KB", "SyncMode=nosync", "SyncInterval=1", "NoReadahead=true" };
+	size_t size = 0;
+
+	if (!repo_fsrepo_lmdb_parse_size("64MB", &size) || size != 64 * 1024 * 1024)
+		goto exit;
+	if (!repo_fsrepo_lmdb_parse_size("2GiB", &size) || size != 2UL * 1024 * 1024 * 1024)
+		goto exit;
+	if (!repo_fsrepo_lmdb_parse_size("4096", &size) || size != 4096)
+		goto exit;
+	if (repo_fsrepo_lmdb_parse_size("10XB", &size) || repo_fsrepo_lmdb_parse_size("MB", &size))
+		goto exit;
+
+	if (!drop_build_and_open_repo("/tmp/.ipfs", &fs_repo))
+		goto exit;
+	// reopen it small
+	struct Datastore* datastore = fs_repo->config->datastore;
+	datastore->datastore_close(datastore);
+	if (!repo_fsrepro_lmdb_open(4, argv, datastore)) {
+		datastore->datastore_context = NULL;
+		goto exit;
+	}
+	struct lmdb_context* db_context = (struct lmdb_context*) datastore->datastore_context;
+	size_t first_size = db_context->map_size;
+
+	// the datastore table is DUPSORT, which keeps values under 512 bytes
+	for(int i = 0; i < 1000; i++) {
+		rec = libp2p_datastore_record_new();
+		rec->key_size = 3;
+		rec->key = (uint8_t*) malloc(3);
+		rec->key[0] = 'M';
+		rec->key[1] = i / 256;
+		rec->key[2] = i % 256;
+		rec->value_size = 400;
+		rec->value = (uint8_t*) malloc(400);
+		memset(rec->value, i % 256, 400);
+		if (!datastore->datastore_put(rec, datastore)) {
+			fprintf(stderr, "Put of record %d failed with a map of %lu bytes.\n", i, (unsigned long)db_context->map_size);
+			goto exit;
+		}
+		libp2p_datastore_record_free(rec);
+		rec = NULL;
+	}
+	if (db_context->map_resizes == 0 || db_context->map_size <= first_size) {
+		fprintf(stderr, "The map did not grow from %lu bytes.\n", (unsigned long)first_size);
+		goto exit;
+	}
+
+	// they all should be there
+	uint8_t key[3] = { 'M', 0, 0 };
+	for(int i = 0; i < 1000; i++) {
+		key[1] = i / 256;
+		key[2] = i % 256;
+		if (!datastore->datastore_get(key, 3, &rec, datastore) || rec->value_size != 400 || rec->value[399] != i % 256) {
+			fprintf(stderr, "Record %d is not in the datastore.\n", i);
+			goto exit;
+		}
+		libp2p_datastore_record_free(rec);
+		rec = NULL;
+	}
+
+	retVal = 1;
+	exit:
+	if (rec != NULL)
+		libp2p_datastore_record_free(rec);
+	if (fs_repo != NULL)
+		ipfs_repo_fsrepo_free(fs_repo);
+	return retVal;
+}
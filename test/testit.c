@@ -13,9 +13,13 @@
 #include "flatfs/test_flatfs.h"
 #include "journal/test_journal.h"
 #include "merkledag/test_merkledag.h"
+#include "multihash/test_multihash.h"
 #include "node/test_node.h"
+#include "node/test_hamt.h"
 #include "node/test_importer.h"
 #include "node/test_resolver.h"
+#include "pin/test_gc.h"
+#include "pin/test_pin.h"
 #include "repo/test_repo_bootstrap_peers.h"
 #include "repo/test_repo_config.h"
 #include "repo/test_repo_fsrepo.h"
@@ -84,18 +88,38 @@ int build_test_collection() {
 	add_test("test_cid_cast_multihash", test_cid_cast_multihash, 1);
 	add_test("test_cid_cast_non_multihash", test_cid_cast_non_multihash, 1);
 	add_test("test_cid_protobuf_encode_decode", test_cid_protobuf_encode_decode, 1);
+	add_test("test_cid_set", test_cid_set, 1);
+	add_test("test_cid_multibase_fast_codecs", test_cid_multibase_fast_codecs, 1);
 	add_test("test_core_api_startup_shutdown", test_core_api_startup_shutdown, 1);
+	add_test("test_core_api_request_parse", test_core_api_request_parse, 1);
+	add_test("test_core_api_multipart", test_core_api_multipart, 1);
+	add_test("test_core_api_json_escape", test_core_api_json_escape, 1);
+	add_test("test_core_api_chunk_stream", test_core_api_chunk_stream, 1);
+	add_test("test_core_api_keep_alive_pipelined", test_core_api_keep_alive_pipelined, 1);
+	add_test("test_core_http_client", test_core_http_client, 1);
 	add_test("test_core_api_object_cat", test_core_api_object_cat, 1);
 	add_test("test_core_api_object_cat_binary", test_core_api_object_cat_binary, 1);
 	add_test("test_core_api_object_cat_large_binary", test_core_api_object_cat_large_binary, 1);
 	add_test("test_core_api_name_resolve", test_core_api_name_resolve, 1);
+	add_test("test_core_gateway_range", test_core_gateway_range, 1);
+	add_test("test_core_gateway_send_range", test_core_gateway_send_range, 1);
+	add_test("test_core_api_metrics", test_core_api_metrics, 1);
+	add_test("test_core_api_trace", test_core_api_trace, 1);
+	add_test("test_core_api_memory", test_core_api_memory, 1);
 	add_test("test_core_api_name_resolve_1", test_core_api_name_resolve_1, 0);
 	add_test("test_core_api_name_resolve_2", test_core_api_name_resolve_2, 0);
 	add_test("test_core_api_name_resolve_3", test_core_api_name_resolve_3, 0);
 	add_test("test_daemon_startup_shutdown", test_daemon_startup_shutdown, 1);
 	add_test("test_datastore_list_journal", test_datastore_list_journal, 1);
+	add_test("test_datastore_map_grows", test_datastore_map_grows, 1);
 	add_test("test_journal_db", test_journal_db, 1);
 	add_test("test_journal_encode_decode", test_journal_encode_decode, 1);
+	add_test("test_journal_summary", test_journal_summary, 1);
+	add_test("test_journal_summary_batches", test_journal_summary_batches, 1);
+	add_test("test_journal_composite_key", test_journal_composite_key, 1);
+	add_test("test_journal_get_after", test_journal_get_after, 1);
+	add_test("test_journal_reconcile_false_positive", test_journal_reconcile_false_positive, 1);
+	add_test("test_journal_fetch_find_missing", test_journal_fetch_find_missing, 1);
 	add_test("test_journal_server_1", test_journal_server_1, 0);
 	add_test("test_journal_server_2", test_journal_server_2, 0);
 	add_test("test_repo_config_new", test_repo_config_new, 1);
@@ -109,24 +133,40 @@ int build_test_collection() {
 	add_test("test_get_init_command", test_get_init_command, 1);
 	add_test("test_import_small_file", test_import_small_file, 1);
 	add_test("test_import_large_file", test_import_large_file, 1);
+	add_test("test_import_stream", test_import_stream, 1);
+	add_test("test_hamt_directory", test_hamt_directory, 1);
+	add_test("test_gc_collect", test_gc_collect, 1);
+	add_test("test_gc_direct_in_recursive", test_gc_direct_in_recursive, 1);
+	add_test("test_gc_upgrade", test_gc_upgrade, 1);
+	add_test("test_pin_index", test_pin_index, 1);
+	add_test("test_pin_replicated", test_pin_replicated, 1);
+	add_test("test_multihash_functions", test_multihash_functions, 1);
+	add_test("test_multihash_wrap_unwrap", test_multihash_wrap_unwrap, 1);
+	add_test("test_multihash_import", test_multihash_import, 1);
 	add_test("test_repo_fsrepo_open_config", test_repo_fsrepo_open_config, 1);
 	add_test("test_flatfs_get_directory", test_flatfs_get_directory, 1);
 	add_test("test_flatfs_get_filename", test_flatfs_get_filename, 1);
 	add_test("test_flatfs_get_full_filename", test_flatfs_get_full_filename, 1);
 	add_test("test_ds_key_from_binary", test_ds_key_from_binary, 1);
 	add_test("test_blocks_new", test_blocks_new, 1);
+	add_test("test_blockstore_get_miss", test_blockstore_get_miss, 1);
 	add_test("test_repo_bootstrap_peers_init", test_repo_bootstrap_peers_init, 1);
 	add_test("test_ipfs_datastore_put", test_ipfs_datastore_put, 1);
 	add_test("test_node", test_node, 1);
+	add_test("test_node_link_index", test_node_link_index, 1);
 	add_test("test_node_link_encode_decode", test_node_link_encode_decode, 1);
 	add_test("test_node_encode_decode", test_node_encode_decode, 1);
+	add_test("test_node_decode_view", test_node_decode_view, 1);
 	add_test("test_node_peerstore", test_node_peerstore, 1);
 	add_test("test_merkledag_add_data", test_merkledag_add_data, 1);
 	add_test("test_merkledag_get_data", test_merkledag_get_data, 1);
 	add_test("test_merkledag_add_node", test_merkledag_add_node, 1);
 	add_test("test_merkledag_add_node_with_links", test_merkledag_add_node_with_links, 1);
+	add_test("test_merkledag_walk", test_merkledag_walk, 1);
 	add_test("test_namesys_publisher_publish", test_namesys_publisher_publish, 1);
 	add_test("test_namesys_resolver_resolve", test_namesys_resolver_resolve, 1);
+	add_test("test_namesys_resolver_republish", test_namesys_resolver_republish, 1);
+	add_test("test_namesys_routing_cache", test_namesys_routing_cache, 1);
 	add_test("test_resolver_get", test_resolver_get, 0); // not working (test directory does not exist)
 	add_test("test_resolver_remote_get", test_resolver_remote_get, 0); // not working (test directory does not exist)
 	add_test("test_routing_find_peer", test_routing_find_peer, 1);
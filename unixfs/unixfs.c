@@ -7,7 +7,7 @@
 #include <string.h>
 
 #include "libp2p/crypto/encoding/base58.h"
-#include "libp2p/crypto/sha256.h"
+#include "ipfs/multihash/multihash.h"
 #include "libp2p/utils/logger.h"
 #include "ipfs/unixfs/unixfs.h"
 #include "protobuf.h"
@@ -22,12 +22,15 @@
  *		File = 2;
  *		Metadata = 3;
  *		Symlink = 4;
+ *		HAMTShard = 5;
  *	}
  *
  *	required DataType Type = 1;
  *	optional bytes Data = 2;
  *	optional uint64 filesize = 3;
  *	repeated uint64 blocksizes = 4;
+ *	optional uint64 hashType = 5;
+ *	optional uint64 fanout = 6;
  * }
  *
  * message Metadata {
@@ -51,6 +54,8 @@ int ipfs_unixfs_new(struct UnixFS** obj) {
 	(*obj)->hash = NULL;
 	(*obj)->hash_length = 0;
 	(*obj)->file_size = 0;
+	(*obj)->hash_type = 0;
+	(*obj)->fanout = 0;
 	return 1;
 }
 
@@ -132,7 +137,7 @@ int ipfs_unixfs_add_data(unsigned char* data, size_t data_length, struct UnixFS*
 		free(unix_fs->bytes);
 		return 0;
 	}
-	if (libp2p_crypto_hashing_sha256(data, data_length, &unix_fs->hash[0]) == 0) {
+	if (ipfs_multihash_sha256(data, data_length, &unix_fs->hash[0]) == 0) {
 		free(unix_fs->bytes);
 		free(unix_fs->hash);
 		return 0;
@@ -185,8 +190,8 @@ int ipfs_unixfs_add_blocksize(const struct UnixFSBlockSizeNode* blocksize, struc
  * Protobuf functions
  */
 
-//                                            data type         bytes                    file size           block sizes
-enum WireType ipfs_unixfs_message_fields[] = { WIRETYPE_VARINT, WIRETYPE_LENGTH_DELIMITED, WIRETYPE_VARINT, WIRETYPE_VARINT };
+//                                            data type         bytes                    file size           block sizes      hash type        fanout
+enum WireType ipfs_unixfs_message_fields[] = { WIRETYPE_VARINT, WIRETYPE_LENGTH_DELIMITED, WIRETYPE_VARINT, WIRETYPE_VARINT, WIRETYPE_VARINT, WIRETYPE_VARINT };
 
 /**
  * Calculate the max size of the protobuf before encoding
@@ -207,6 +212,8 @@ size_t ipfs_unixfs_protobuf_encode_size(const struct UnixFS* obj) {
 		sz += 11;
 		currNode = currNode->next;
 	}
+	// hash type and fanout
+	sz += 22;
 	return sz;
 }
 
@@ -249,6 +256,20 @@ int ipfs_unixfs_protobuf_encode(const struct UnixFS* incoming, unsigned char* ou
 			*bytes_written += bytes_used;
 			currNode = currNode->next;
 		}
+		// hash type (optional)
+		if (incoming->hash_type > 0) {
+			retVal = protobuf_encode_varint(5, ipfs_unixfs_message_fields[4], incoming->hash_type, &outgoing[*bytes_written], max_buffer_size - (*bytes_written), &bytes_used);
+			if (retVal == 0)
+				return 0;
+			*bytes_written += bytes_used;
+		}
+		// fanout (optional)
+		if (incoming->fanout > 0) {
+			retVal = protobuf_encode_varint(6, ipfs_unixfs_message_fields[5], incoming->fanout, &outgoing[*bytes_written], max_buffer_size - (*bytes_written), &bytes_used);
+			if (retVal == 0)
+				return 0;
+			*bytes_written += bytes_used;
+		}
 	}
 	return 1;
 }
@@ -306,6 +327,14 @@ int ipfs_unixfs_protobuf_decode(unsigned char* incoming, size_t incoming_size, s
 				pos += bytes_read;
 				break;
 			}
+			case (5): // hash type
+				result->hash_type = varint_decode(&incoming[pos], incoming_size - pos, &bytes_read);
+				pos += bytes_read;
+				break;
+			case (6): // fanout
+				result->fanout = varint_decode(&incoming[pos], incoming_size - pos, &bytes_read);
+				pos += bytes_read;
+				break;
 		}
 
 	}
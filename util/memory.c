@@ -0,0 +1,93 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ipfs/util/memory.h"
+#include "ipfs/util/metrics.h"
+
+static const char* memory_tag_names[MEMORY_TAG_MAX] = {
+	"blocks",
+	"cid",
+	"merkledag",
+	"exchange",
+	"repo",
+};
+
+void* ipfs_util_memory_alloc(enum MemoryTag tag, size_t size) {
+	void* ptr = malloc(size);
+	if (ptr != NULL) {
+		ipfs_util_metrics_add(METRICS_MEMORY_ALLOCATIONS + tag, 1);
+		ipfs_util_metrics_add(METRICS_MEMORY_ALLOCATED_BYTES + tag, malloc_usable_size(ptr));
+	}
+	return ptr;
+}
+
+void ipfs_util_memory_free(enum MemoryTag tag, void* ptr) {
+	if (ptr == NULL)
+		return;
+	ipfs_util_metrics_add(METRICS_MEMORY_FREES + tag, 1);
+	ipfs_util_metrics_add(METRICS_MEMORY_FREED_BYTES + tag, malloc_usable_size(ptr));
+	free(ptr);
+}
+
+/***
+ * What a tag has allocated, and not freed
+ * @param tag the tag
+ * @param bytes where to put the bytes
+ * @param objects where to put the number of allocations
+ */
+static void ipfs_util_memory_live(enum MemoryTag tag, uint64_t* bytes, uint64_t* objects) {
+	// frees first, so that an allocation freed in between can't make it negative
+	uint64_t freed_bytes = ipfs_util_metrics_counter(METRICS_MEMORY_FREED_BYTES + tag);
+	uint64_t frees = ipfs_util_metrics_counter(METRICS_MEMORY_FREES + tag);
+	*bytes = ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATED_BYTES + tag) - freed_bytes;
+	*objects = ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + tag) - frees;
+}
+
+int ipfs_util_memory_write(FILE* out) {
+	uint64_t bytes[MEMORY_TAG_MAX], objects[MEMORY_TAG_MAX];
+
+	for (int i = 0; i < MEMORY_TAG_MAX; i++)
+		ipfs_util_memory_live(i, &bytes[i], &objects[i]);
+
+	if (!ipfs_util_metrics_write_header(out, "ipfs_memory_live_bytes", "gauge", "Bytes allocated and not yet freed."))
+		return 0;
+	for (int i = 0; i < MEMORY_TAG_MAX; i++)
+		if (fprintf(out, "ipfs_memory_live_bytes{tag=\"%s\"} %llu\n", memory_tag_names[i], (unsigned long long)bytes[i]) < 0)
+			return 0;
+	if (!ipfs_util_metrics_write_header(out, "ipfs_memory_live_objects", "gauge", "Allocations not yet freed."))
+		return 0;
+	for (int i = 0; i < MEMORY_TAG_MAX; i++)
+		if (fprintf(out, "ipfs_memory_live_objects{tag=\"%s\"} %llu\n", memory_tag_names[i], (unsigned long long)objects[i]) < 0)
+			return 0;
+	if (!ipfs_util_metrics_write_header(out, "ipfs_memory_allocations_total", "counter", "Allocations made."))
+		return 0;
+	for (int i = 0; i < MEMORY_TAG_MAX; i++)
+		if (fprintf(out, "ipfs_memory_allocations_total{tag=\"%s\"} %llu\n", memory_tag_names[i],
+				(unsigned long long)ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATIONS + i)) < 0)
+			return 0;
+	if (!ipfs_util_metrics_write_header(out, "ipfs_memory_allocated_bytes_total", "counter", "Bytes allocated."))
+		return 0;
+	for (int i = 0; i < MEMORY_TAG_MAX; i++)
+		if (fprintf(out, "ipfs_memory_allocated_bytes_total{tag=\"%s\"} %llu\n", memory_tag_names[i],
+				(unsigned long long)ipfs_util_metrics_counter(METRICS_MEMORY_ALLOCATED_BYTES + i)) < 0)
+			return 0;
+	return 1;
+}
+
+size_t ipfs_util_memory_report(FILE* out) {
+	uint64_t bytes, objects;
+	size_t leaked = 0;
+
+	for (int i = 0; i < MEMORY_TAG_MAX; i++) {
+		ipfs_util_memory_live(i, &bytes, &objects);
+		if (objects == 0)
+			continue;
+		fprintf(out, "memory: %s has %llu objects, %llu bytes still allocated\n", memory_tag_names[i],
+				(unsigned long long)objects, (unsigned long long)bytes);
+		leaked += objects;
+	}
+	if (leaked == 0)
+		fprintf(out, "memory: nothing still allocated\n");
+	return leaked;
+}
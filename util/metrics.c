@@ -0,0 +1,221 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipfs/util/metrics.h"
+
+/***
+ * The counts of one thread. Only that thread writes them, so an add is a
+ * relaxed load and store, which a scrape can read at any time without tearing.
+ * When the thread ends its shard is kept with what it counted, and given to
+ * the next new thread, so the sums never go down.
+ */
+struct MetricsShard {
+	uint64_t counters[METRICS_COUNTER_MAX];
+	struct {
+		uint64_t buckets[METRICS_BUCKET_COUNT + 1]; // the last one is +Inf
+		uint64_t sum; // nanoseconds
+		uint64_t count;
+	} histograms[METRICS_HISTOGRAM_MAX];
+	int in_use;
+	struct MetricsShard* next;
+};
+
+struct MetricsCounterInfo {
+	const char* name;
+	const char* help;
+};
+
+struct MetricsHistogramInfo {
+	const char* name;
+	const char* label; // can be NULL
+	const char* help;
+};
+
+// the memory counters are labelled by tag, so are written by ipfs_util_memory_write
+static const struct MetricsCounterInfo metrics_counters[METRICS_MEMORY_ALLOCATIONS] = {
+	{ "ipfs_blockstore_get_bytes_total", "Bytes read from the blockstore." },
+	{ "ipfs_blockstore_put_bytes_total", "Bytes written to the blockstore." },
+	{ "ipfs_blockstore_get_misses_total", "Blocks asked of the blockstore that it did not have." },
+	{ "ipfs_lmdb_txn_begin_total", "LMDB transactions started." },
+	{ "ipfs_lmdb_txn_commit_total", "LMDB transactions committed." },
+	{ "ipfs_lmdb_txn_failed_total", "LMDB transactions that failed to start or commit." },
+	{ "ipfs_bitswap_wants_sent_total", "Wantlist entries sent to peers." },
+	{ "ipfs_bitswap_wants_received_total", "Wantlist entries received from peers." },
+	{ "ipfs_bitswap_blocks_sent_total", "Blocks sent to peers." },
+	{ "ipfs_bitswap_blocks_received_total", "Blocks received from peers." },
+	{ "ipfs_bitswap_duplicates_received_total", "Blocks received from peers that were not wanted, or were already received." },
+	{ "ipfs_gc_blocks_removed_total", "Blocks deleted by the garbage collector." },
+	{ "ipfs_gc_freed_bytes_total", "Bytes of block files deleted by the garbage collector." },
+};
+
+static const struct MetricsHistogramInfo metrics_histograms[METRICS_HISTOGRAM_MAX] = {
+	{ "ipfs_blockstore_get_duration_seconds", NULL, "Time to read a block from the blockstore." },
+	{ "ipfs_blockstore_put_duration_seconds", NULL, "Time to write a block to the blockstore." },
+	{ "ipfs_lmdb_commit_duration_seconds", NULL, "Time to commit an LMDB transaction." },
+	{ "ipfs_routing_query_duration_seconds", NULL, "Time for a peer to answer a routing query." },
+	{ "ipfs_api_request_duration_seconds", "command=\"add\"", "Time to answer an API request." },
+	{ "ipfs_api_request_duration_seconds", "command=\"dht\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"gateway\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"metrics\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"name\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"object\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"swarm\"", NULL },
+	{ "ipfs_api_request_duration_seconds", "command=\"other\"", NULL },
+};
+
+static const double metrics_bucket_seconds[METRICS_BUCKET_COUNT] = METRICS_BUCKETS;
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t metrics_key;
+static struct MetricsShard* metrics_shards = NULL;
+static __thread struct MetricsShard* metrics_shard = NULL;
+
+/***
+ * Give the shard of a thread that ended back, to be used by a new thread
+ */
+static void ipfs_util_metrics_release(void* ptr) {
+	struct MetricsShard* shard = (struct MetricsShard*)ptr;
+	pthread_mutex_lock(&metrics_lock);
+	shard->in_use = 0;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+static void ipfs_util_metrics_init() {
+	pthread_key_create(&metrics_key, ipfs_util_metrics_release);
+}
+
+/***
+ * Find the shard of this thread, giving it one the first time
+ * @returns the shard, or NULL if there is no memory for one
+ */
+static struct MetricsShard* ipfs_util_metrics_shard() {
+	if (metrics_shard != NULL)
+		return metrics_shard;
+	pthread_once(&metrics_once, ipfs_util_metrics_init);
+	pthread_mutex_lock(&metrics_lock);
+	struct MetricsShard* shard = metrics_shards;
+	while (shard != NULL && shard->in_use)
+		shard = shard->next;
+	if (shard == NULL) {
+		shard = (struct MetricsShard*) calloc(1, sizeof(struct MetricsShard));
+		if (shard != NULL) {
+			shard->next = metrics_shards;
+			metrics_shards = shard;
+		}
+	}
+	if (shard != NULL)
+		shard->in_use = 1;
+	pthread_mutex_unlock(&metrics_lock);
+	if (shard != NULL) {
+		pthread_setspecific(metrics_key, shard);
+		metrics_shard = shard;
+	}
+	return shard;
+}
+
+/***
+ * Add to a value of the shard of this thread
+ */
+static inline void ipfs_util_metrics_inc(uint64_t* value, uint64_t amount) {
+	__atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+uint64_t ipfs_util_metrics_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void ipfs_util_metrics_add(enum MetricsCounter counter, uint64_t value) {
+	struct MetricsShard* shard = ipfs_util_metrics_shard();
+	if (shard != NULL && counter < METRICS_COUNTER_MAX)
+		ipfs_util_metrics_inc(&shard->counters[counter], value);
+}
+
+void ipfs_util_metrics_observe(enum MetricsHistogram histogram, uint64_t start) {
+	uint64_t elapsed = ipfs_util_metrics_now() - start;
+	struct MetricsShard* shard = ipfs_util_metrics_shard();
+	if (shard == NULL || histogram >= METRICS_HISTOGRAM_MAX)
+		return;
+	int i = 0;
+	while (i < METRICS_BUCKET_COUNT && elapsed > metrics_bucket_seconds[i] * 1e9)
+		i++;
+	ipfs_util_metrics_inc(&shard->histograms[histogram].buckets[i], 1);
+	ipfs_util_metrics_inc(&shard->histograms[histogram].sum, elapsed);
+	ipfs_util_metrics_inc(&shard->histograms[histogram].count, 1);
+}
+
+int ipfs_util_metrics_write_header(FILE* out, const char* name, const char* type, const char* help) {
+	return fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type) > 0;
+}
+
+/***
+ * Add up a value over all shards. Must be called with metrics_lock held.
+ * @param offset where the value is within a shard
+ * @returns the sum
+ */
+static uint64_t ipfs_util_metrics_sum(size_t offset) {
+	uint64_t sum = 0;
+	for (struct MetricsShard* shard = metrics_shards; shard != NULL; shard = shard->next)
+		sum += __atomic_load_n((uint64_t*)((char*)shard + offset), __ATOMIC_RELAXED);
+	return sum;
+}
+
+uint64_t ipfs_util_metrics_counter(enum MetricsCounter counter) {
+	if (counter >= METRICS_COUNTER_MAX)
+		return 0;
+	pthread_mutex_lock(&metrics_lock);
+	uint64_t sum = ipfs_util_metrics_sum(offsetof(struct MetricsShard, counters[counter]));
+	pthread_mutex_unlock(&metrics_lock);
+	return sum;
+}
+
+int ipfs_util_metrics_write(FILE* out) {
+	int retVal = 1;
+
+	pthread_mutex_lock(&metrics_lock);
+	for (int i = 0; i < METRICS_MEMORY_ALLOCATIONS; i++) {
+		const struct MetricsCounterInfo* info = &metrics_counters[i];
+		if (!ipfs_util_metrics_write_header(out, info->name, "counter", info->help)
+				|| fprintf(out, "%s %llu\n", info->name,
+						(unsigned long long)ipfs_util_metrics_sum(offsetof(struct MetricsShard, counters[i]))) < 0) {
+			retVal = 0;
+			goto exit;
+		}
+	}
+	for (int i = 0; i < METRICS_HISTOGRAM_MAX; i++) {
+		const struct MetricsHistogramInfo* info = &metrics_histograms[i];
+		const char* label = info->label != NULL ? info->label : "";
+		const char* comma = info->label != NULL ? "," : "";
+		// histograms that only differ by label share one header
+		if (info->help != NULL && !ipfs_util_metrics_write_header(out, info->name, "histogram", info->help)) {
+			retVal = 0;
+			goto exit;
+		}
+		uint64_t cumulative = 0;
+		for (int j = 0; j <= METRICS_BUCKET_COUNT; j++) {
+			cumulative += ipfs_util_metrics_sum(offsetof(struct MetricsShard, histograms[i].buckets[j]));
+			if (j < METRICS_BUCKET_COUNT)
+				retVal = fprintf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", info->name, label, comma, metrics_bucket_seconds[j], (unsigned long long)cumulative) > 0;
+			else
+				retVal = fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", info->name, label, comma, (unsigned long long)cumulative) > 0;
+			if (!retVal)
+				goto exit;
+		}
+		uint64_t sum = ipfs_util_metrics_sum(offsetof(struct MetricsShard, histograms[i].sum));
+		uint64_t count = ipfs_util_metrics_sum(offsetof(struct MetricsShard, histograms[i].count));
+		if (info->label != NULL)
+			retVal = fprintf(out, "%s_sum{%s} %.9f\n%s_count{%s} %llu\n", info->name, label, sum / 1e9, info->name, label, (unsigned long long)count) > 0;
+		else
+			retVal = fprintf(out, "%s_sum %.9f\n%s_count %llu\n", info->name, sum / 1e9, info->name, (unsigned long long)count) > 0;
+		if (!retVal)
+			goto exit;
+	}
+	exit:
+	pthread_mutex_unlock(&metrics_lock);
+	return retVal;
+}
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ipfs/util/metrics.h"
+#include "ipfs/util/trace.h"
+
+/***
+ * A span that ended. A writer takes a slot by adding to trace_next, so writers
+ * never wait. The sequence is odd while the slot is written, and a reader
+ * checks it is the same before and after copying the slot, skipping the slot
+ * if a writer came by in between.
+ */
+struct TraceEvent {
+	uint64_t sequence; // 2 * (index + 1) once written
+	const char* name;
+	uint64_t trace_id;
+	uint64_t span_id;
+	uint64_t parent_id;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t thread;
+};
+
+static struct TraceEvent trace_ring[TRACE_RING_SIZE];
+static uint64_t trace_next = 0; // the index of the next span to record
+static uint64_t trace_last_id = 0;
+static uint64_t trace_last_thread = 0;
+static __thread struct TraceSpan* trace_current = NULL;
+static __thread uint64_t trace_thread = 0;
+
+void ipfs_util_trace_begin(struct TraceSpan* span, const char* name) {
+	span->name = name;
+	span->span_id = __atomic_add_fetch(&trace_last_id, 1, __ATOMIC_RELAXED);
+	span->parent = trace_current;
+	if (span->parent != NULL) {
+		span->trace_id = span->parent->trace_id;
+		span->parent_id = span->parent->span_id;
+	} else {
+		span->trace_id = span->span_id;
+		span->parent_id = 0;
+	}
+	trace_current = span;
+	span->start = ipfs_util_metrics_now();
+}
+
+void ipfs_util_trace_end(struct TraceSpan* span) {
+	uint64_t duration = ipfs_util_metrics_now() - span->start;
+	trace_current = span->parent;
+	if (trace_thread == 0)
+		trace_thread = __atomic_add_fetch(&trace_last_thread, 1, __ATOMIC_RELAXED);
+
+	uint64_t index = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+	struct TraceEvent* event = &trace_ring[index & (TRACE_RING_SIZE - 1)];
+	__atomic_store_n(&event->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&event->name, span->name, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->trace_id, span->trace_id, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->span_id, span->span_id, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->parent_id, span->parent_id, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->start, span->start, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->duration, duration, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->thread, trace_thread, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t ipfs_util_trace_id() {
+	return trace_current != NULL ? trace_current->trace_id : 0;
+}
+
+/***
+ * Copy a recorded span out of the ring buffer
+ * @param index the index it was recorded at
+ * @param event where to copy it
+ * @returns true(1) if it was copied, false(0) if it was overwritten or is still being written
+ */
+static int ipfs_util_trace_read(uint64_t index, struct TraceEvent* event) {
+	struct TraceEvent* slot = &trace_ring[index & (TRACE_RING_SIZE - 1)];
+	uint64_t sequence = 2 * index + 2;
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != sequence)
+		return 0;
+	event->name = __atomic_load_n(&slot->name, __ATOMIC_RELAXED);
+	event->trace_id = __atomic_load_n(&slot->trace_id, __ATOMIC_RELAXED);
+	event->span_id = __atomic_load_n(&slot->span_id, __ATOMIC_RELAXED);
+	event->parent_id = __atomic_load_n(&slot->parent_id, __ATOMIC_RELAXED);
+	event->start = __atomic_load_n(&slot->start, __ATOMIC_RELAXED);
+	event->duration = __atomic_load_n(&slot->duration, __ATOMIC_RELAXED);
+	event->thread = __atomic_load_n(&slot->thread, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+int ipfs_util_trace_write(FILE* out, uint64_t trace_id) {
+	uint64_t last = __atomic_load_n(&trace_next, __ATOMIC_ACQUIRE);
+	uint64_t index = last > TRACE_RING_SIZE ? last - TRACE_RING_SIZE : 0;
+	const char* separator = "";
+	struct TraceEvent event;
+
+	if (fprintf(out, "{\"traceEvents\":[") < 0)
+		return 0;
+	for (; index < last; index++) {
+		if (!ipfs_util_trace_read(index, &event))
+			continue;
+		if (trace_id != 0 && event.trace_id != trace_id)
+			continue;
+		// the names are literals, so need no escaping. Times are in microseconds.
+		if (fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"ipfs\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%llu,"
+				"\"args\":{\"trace\":\"%016llx\",\"span\":\"%016llx\",\"parent\":\"%016llx\"}}",
+				separator, event.name, event.start / 1e3, event.duration / 1e3, (int)getpid(), (unsigned long long)event.thread,
+				(unsigned long long)event.trace_id, (unsigned long long)event.span_id, (unsigned long long)event.parent_id) < 0)
+			return 0;
+		separator = ",";
+	}
+	return fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n") > 0;
+}